@@ -1,15 +1,25 @@
 #include "DirectPort.h"
+#include "DirectPortShm.h"
+#include "DirectPortCPU.h"
+#include "DirectPortCache.h"
 #include <vector>
 #include <string>
 #include <stdexcept>
 #include <memory>
 #include <map>
+#include <list>
+#include <deque>
 #include <algorithm>
-#include <d3dcompiler.h>
-#include <sddl.h>
-#include <tlhelp32.h>
+#include <cstring>
 #include <cmath>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <chrono>
 #include <stdexcept>
+#ifdef _WIN32
+#include <d3dcompiler.h>
+#include <sddl.h>
 
 #pragma comment(lib, "d3d11.lib")
 #pragma comment(lib, "d3d12.lib")
@@ -17,12 +27,17 @@
 #pragma comment(lib, "d3dcompiler.lib")
 #pragma comment(lib, "user32.lib")
 #pragma comment(lib, "advapi32.lib")
-#pragma comment(lib, "Synchronization.lib")
+#else
+#include <fstream>
+#endif
 
+#ifdef _WIN32
 using namespace Microsoft::WRL;
+#endif
 using namespace DirectPort;
 
 namespace {
+#ifdef _WIN32
     const char* g_blitShaderHLSL = R"(
         Texture2D    g_texture : register(t0);
         SamplerState g_sampler : register(s0);
@@ -36,7 +51,62 @@ namespace {
         }
         float4 PSMain(PSInput input) : SV_TARGET { return g_texture.Sample(g_sampler, input.uv); }
     )";
+
+    // D3DCompile behind the on-disk blob cache, keyed by source, entry point, target and flags, so a
+    // warm cache skips the compiler entirely. On failure the compiler's messages are left in errors.
+    HRESULT compile_shader_cached(const void* source, size_t size, const char* entry_point, const char* target, UINT flags,
+                                  ComPtr<ID3DBlob>& blob, ComPtr<ID3DBlob>* errors = nullptr, bool* fromDisk = nullptr) {
+        const uint64_t key = Cache::hash_shader(source, size, std::string(entry_point) + ":" + target, flags);
+        std::vector<uint8_t> cached;
+        if (Cache::load_blob(key, cached) && SUCCEEDED(D3DCreateBlob(cached.size(), &blob))) {
+            memcpy(blob->GetBufferPointer(), cached.data(), cached.size());
+            if (fromDisk) *fromDisk = true;
+            return S_OK;
+        }
+        HRESULT hr = D3DCompile(source, size, "hlsl_shader", nullptr, nullptr, entry_point, target, flags, 0, &blob, errors ? errors->ReleaseAndGetAddressOf() : nullptr);
+        if (SUCCEEDED(hr)) {
+            const uint8_t* compiled = static_cast<const uint8_t*>(blob->GetBufferPointer());
+            Cache::store_blob(key, std::vector<uint8_t>(compiled, compiled + blob->GetBufferSize()));
+        }
+        return hr;
+    }
     
+    // Resource states through one recorded D3D12 command list. Textures rest in COMMON between
+    // submissions, so tracking starts there; a transition is only recorded when an operation needs a
+    // different state than the previous one left, and restore() returns everything to COMMON.
+    class ResourceStates {
+    public:
+        explicit ResourceStates(ID3D12GraphicsCommandList* list) : list(list) {}
+
+        // Queued until flush(), so one operation's transitions go out as a single ResourceBarrier.
+        void require(ID3D12Resource* resource, D3D12_RESOURCE_STATES state) {
+            auto it = std::find_if(states.begin(), states.end(), [&](const auto& entry) { return entry.first == resource; });
+            if (it == states.end()) it = states.insert(states.end(), { resource, D3D12_RESOURCE_STATE_COMMON });
+            if (it->second == state) return;
+            D3D12_RESOURCE_BARRIER barrier = {};
+            barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+            barrier.Transition = { resource, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, it->second, state };
+            pending.push_back(barrier);
+            it->second = state;
+        }
+
+        void flush() {
+            if (pending.empty()) return;
+            list->ResourceBarrier((UINT)pending.size(), pending.data());
+            pending.clear();
+        }
+
+        void restore() {
+            for (const auto& entry : states) require(entry.first, D3D12_RESOURCE_STATE_COMMON);
+            flush();
+        }
+
+    private:
+        ID3D12GraphicsCommandList* list;
+        std::vector<std::pair<ID3D12Resource*, D3D12_RESOURCE_STATES>> states;
+        std::vector<D3D12_RESOURCE_BARRIER> pending;
+    };
+
     std::wstring string_to_wstring(const std::string& str) {
         if (str.empty()) return std::wstring();
         int size = MultiByteToWideChar(CP_UTF8, 0, str.c_str(), (int)str.size(), NULL, 0);
@@ -44,6 +114,11 @@ namespace {
         MultiByteToWideChar(CP_UTF8, 0, str.c_str(), (int)str.size(), wstr.data(), size);
         return wstr;
     }
+#else
+    std::wstring string_to_wstring(const std::string& str) {
+        return std::wstring(str.begin(), str.end());
+    }
+#endif
 
     void validate_stream_name(const std::string& name) {
         if (name.empty() || name.length() > 64) {
@@ -56,6 +131,7 @@ namespace {
         }
     }
 
+#ifdef _WIN32
     HANDLE get_handle_from_name(const WCHAR* name) {
         ComPtr<ID3D12Device> d3d12Device;
         if (FAILED(D3D12CreateDevice(nullptr, D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&d3d12Device)))) {
@@ -65,141 +141,1745 @@ namespace {
         d3d12Device->OpenSharedHandleByName(name, GENERIC_ALL, &handle);
         return handle;
     }
-    
-    bool get_manifest_from_pid(DWORD pid, BroadcastManifest& manifest) {
-        const std::vector<std::wstring> prefixes = { L"D3D12_Producer_Manifest_", L"DirectPort_Producer_Manifest_" };
+#endif
+
+    const uint32_t g_livenessPollIntervalMs = 100;
+    const std::string g_hostTexturePrefix = "DirectPort_Host_Texture_";
+    const std::string g_hostManifestPrefix = "DirectPort_Producer_Manifest_";
+    const std::string g_streamTablePrefix = "DirectPort_Stream_Table_";
+    const std::string g_registryName = "DirectPort_Registry";
+    // A stream stamped this recently is known to be live without querying its process.
+    const UINT64 g_heartbeatFreshMs = 2000;
+
+    UINT get_bytes_per_pixel(DXGI_FORMAT format) {
+        switch (format) {
+            case DXGI_FORMAT_B8G8R8A8_UNORM:
+            case DXGI_FORMAT_R8G8B8A8_UNORM:
+            case DXGI_FORMAT_R32_FLOAT:
+            case DXGI_FORMAT_R10G10B10A2_UNORM: return 4;
+            case DXGI_FORMAT_R16_FLOAT:
+            case DXGI_FORMAT_R8G8_UNORM: return 2;
+            case DXGI_FORMAT_R16G16B16A16_FLOAT: return 8;
+            case DXGI_FORMAT_R32G32B32A32_FLOAT: return 16;
+            case DXGI_FORMAT_R8_UNORM: return 1;
+            default: return 0;
+        }
+    }
+
+    // Host rows are padded to a cache line so every row starts on an aligned address.
+    UINT get_host_row_pitch(UINT width, DXGI_FORMAT format) {
+        return (width * get_bytes_per_pixel(format) + 63) & ~63u;
+    }
+
+    std::string get_stream_table_name(unsigned long pid) {
+        return g_streamTablePrefix + std::to_string(pid);
+    }
+
+    template <size_t N>
+    std::wstring read_manifest_name(const WCHAR (&name)[N]) {
+        return std::wstring(name, std::find(name, name + N, L'\0'));
+    }
+
+    template <size_t N, typename String>
+    void write_manifest_name(WCHAR (&dest)[N], const String& name) {
+        size_t length = std::min(name.size(), N - 1);
+        std::copy(name.begin(), name.begin() + length, dest);
+        dest[length] = L'\0';
+    }
+
+    // Shared-memory object names are ASCII by construction, so widening/narrowing is a plain copy.
+    std::string narrow_name(const std::wstring& name) {
+        std::string narrowed(name.size(), '\0');
+        std::transform(name.begin(), name.end(), narrowed.begin(), [](WCHAR c) { return (char)c; });
+        return narrowed;
+    }
+
+#ifdef _WIN32
+    std::wstring get_slot_texture_name(const std::wstring& textureName, UINT32 slot) {
+        return textureName + L"_Slot" + std::to_wstring(slot);
+    }
+#endif
+
+    void init_ring_manifest(RingManifest& ring, UINT32 slotCount) {
+        memset(&ring, 0, sizeof(RingManifest));
+        ring.magic = RING_MANIFEST_MAGIC;
+        ring.version = RING_MANIFEST_VERSION;
+        ring.slotCount = slotCount;
+    }
+
+    // Producer half of the per-slot seqlock. Readers treat an odd sequence as "being written".
+    void begin_slot_write(RingSlot& slot) {
+        Shm::store_release(&slot.sequence, slot.sequence + 1);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void end_slot_write(RingSlot& slot, UINT64 frameValue) {
+        slot.frameValue = frameValue;
+        Shm::store_release(&slot.sequence, slot.sequence + 1);
+    }
+
+    // Copies the latest complete slot into dest. A copy that raced the producer is discarded and retried
+    // against the new latest slot, so the result is never a torn frame.
+    bool read_latest_slot(const RingManifest& ring, const uint8_t* slots, size_t slotSize, uint8_t* dest, UINT64& frameValue) {
+        for (UINT32 attempt = 0; attempt < MAX_RING_SLOTS * 2; ++attempt) {
+            UINT32 latestSlot = Shm::load_acquire(&ring.latestSlot);
+            if (latestSlot >= ring.slotCount) return false;
+            const RingSlot& slot = ring.slots[latestSlot];
+            UINT64 sequence = Shm::load_acquire(&slot.sequence);
+            if (sequence & 1) continue;
+            UINT64 slotFrame = slot.frameValue;
+            memcpy(dest, slots + latestSlot * slotSize, slotSize);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (Shm::load_acquire(&slot.sequence) == sequence) {
+                frameValue = slotFrame;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Picks the slot the producer writes next and marks it owned. Pinned slots and the latest frame are
+    // skipped; if every other slot is pinned by a lease, the preferred slot is taken over regardless.
+    UINT32 claim_write_slot(RingManifest& ring, UINT32 preferred) {
+        for (UINT32 i = 0; i < ring.slotCount; ++i) {
+            UINT32 slot = (preferred + i) % ring.slotCount;
+            if (slot == ring.latestSlot && ring.slotCount > 1) continue;
+            if (Shm::compare_exchange(&ring.slots[slot].pinState, 0, RING_SLOT_WRITER)) return slot;
+        }
+        Shm::fetch_add(&ring.slots[preferred].pinState, RING_SLOT_WRITER);
+        return preferred;
+    }
+
+    void release_write_slot(RingSlot& slot) {
+        Shm::fetch_add(&slot.pinState, 0u - RING_SLOT_WRITER);
+    }
+
+    // Reader half of claim_write_slot: takes a pin on the latest complete slot unless the producer owns it.
+    bool pin_latest_slot(RingManifest& ring, UINT32& slotIndex, UINT64& sequence, UINT64& frameValue) {
+        for (UINT32 attempt = 0; attempt < MAX_RING_SLOTS * 2; ++attempt) {
+            UINT32 latestSlot = Shm::load_acquire(&ring.latestSlot);
+            if (latestSlot >= ring.slotCount) return false;
+            RingSlot& slot = ring.slots[latestSlot];
+            UINT32 pinState = Shm::load_acquire(&slot.pinState);
+            if ((pinState & RING_SLOT_WRITER) || !Shm::compare_exchange(&slot.pinState, pinState, pinState + 1)) continue;
+            UINT64 slotSequence = Shm::load_acquire(&slot.sequence);
+            if (slotSequence == 0 || (slotSequence & 1)) {
+                Shm::fetch_add(&slot.pinState, 0u - 1);
+                if (slotSequence == 0) return false;
+                continue;
+            }
+            slotIndex = latestSlot;
+            sequence = slotSequence;
+            frameValue = slot.frameValue;
+            return true;
+        }
+        return false;
+    }
+
+    void begin_manifest_write(RingManifest& ring) {
+        Shm::store_release(&ring.headerSequence, ring.headerSequence + 1);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void end_manifest_write(RingManifest& ring) {
+        Shm::store_release(&ring.headerSequence, ring.headerSequence + 1);
+    }
+
+    RingManifest* get_ring_manifest(const Shm::Mapping& mapping) {
+        if (mapping.size() < sizeof(ProducerManifest)) return nullptr;
+        RingManifest* ring = &static_cast<ProducerManifest*>(mapping.data())->ring;
+        return Shm::load_acquire(&ring->magic) == RING_MANIFEST_MAGIC ? ring : nullptr;
+    }
+
+    ProducerManifest* get_producer_manifest(const Shm::Mapping& mapping) {
+        return get_ring_manifest(mapping) ? static_cast<ProducerManifest*>(mapping.data()) : nullptr;
+    }
+
+    // Copies the metadata of the latest complete slot, retried like read_latest_slot when the producer
+    // reuses the slot mid-copy. slotIndex receives the slot the metadata belongs to.
+    bool read_latest_metadata(const ProducerManifest& manifest, UINT32& slotIndex, FrameMetadata& metadata) {
+        for (UINT32 attempt = 0; attempt < MAX_RING_SLOTS * 2; ++attempt) {
+            UINT32 latestSlot = Shm::load_acquire(&manifest.ring.latestSlot);
+            if (latestSlot >= manifest.ring.slotCount) return false;
+            UINT64 sequence = Shm::load_acquire(&manifest.ring.slots[latestSlot].sequence);
+            if (sequence & 1) continue;
+            memcpy(&metadata, &manifest.metadata[latestSlot], sizeof(FrameMetadata));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (Shm::load_acquire(&manifest.ring.slots[latestSlot].sequence) == sequence) {
+                slotIndex = latestSlot;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    UINT32 latency_bucket(UINT64 us) {
+        if (us < 16) return (UINT32)us;
+        UINT32 exponent = 4;
+        while ((us >> (exponent + 1)) != 0) ++exponent;
+        UINT32 bucket = 16 + (exponent - 4) * 4 + (UINT32)((us >> (exponent - 2)) & 3);
+        return std::min(bucket, LATENCY_BUCKETS - 1);
+    }
+
+    // Largest latency that still falls into bucket.
+    UINT64 latency_bucket_limit(UINT32 bucket) {
+        if (bucket < 16) return bucket;
+        UINT32 exponent = 4 + (bucket - 16) / 4;
+        return ((UINT64)(5 + (bucket - 16) % 4) << (exponent - 2)) - 1;
+    }
+
+    void record_latency(LatencyHistogram& histogram, UINT64 us) {
+        Shm::fetch_add(&histogram.buckets[latency_bucket(us)], 1);
+        Shm::store_release(&histogram.sumUs, histogram.sumUs + us);
+        if (us > histogram.maxUs) Shm::store_release(&histogram.maxUs, us);
+        Shm::store_release(&histogram.count, histogram.count + 1);
+    }
+
+    LatencyStats summarize_latency(const LatencyHistogram& histogram) {
+        LatencyStats stats = {};
+        UINT32 buckets[LATENCY_BUCKETS];
+        for (UINT32 i = 0; i < LATENCY_BUCKETS; ++i) {
+            buckets[i] = Shm::load_acquire(&histogram.buckets[i]);
+            stats.count += buckets[i];
+        }
+        stats.max_us = Shm::load_acquire(&histogram.maxUs);
+        if (stats.count == 0) return stats;
+        stats.mean_us = (double)Shm::load_acquire(&histogram.sumUs) / (double)std::max<UINT64>(Shm::load_acquire(&histogram.count), 1);
+        auto percentile = [&](UINT64 perMille) {
+            UINT64 rank = (stats.count * perMille + 999) / 1000, seen = 0;
+            for (UINT32 i = 0; i < LATENCY_BUCKETS; ++i) {
+                seen += buckets[i];
+                if (seen >= rank) return std::min(latency_bucket_limit(i), stats.max_us);
+            }
+            return stats.max_us;
+        };
+        stats.p50_us = percentile(500);
+        stats.p99_us = percentile(990);
+        return stats;
+    }
+
+    // Takes a free consumer entry, or one left behind by a process that has exited, and clears it.
+    ConsumerStatsEntry* claim_consumer_stats(StatsManifest& stats) {
+        const UINT32 pid = (UINT32)Shm::current_process_id();
+        for (auto& entry : stats.consumers) {
+            UINT32 owner = Shm::load_acquire(&entry.pid);
+            if (owner != 0 && Shm::is_process_alive(owner)) continue;
+            if (!Shm::compare_exchange(&entry.pid, owner, pid)) continue;
+            memset(&entry.latency, 0, sizeof(entry.latency));
+            Shm::store_release(&entry.lastFrame, 0);
+            return &entry;
+        }
+        return nullptr;
+    }
+
+    // Snapshots the manifest header through its seqlock so a concurrent rewrite is never observed half-done.
+    bool read_manifest(const Shm::Mapping& mapping, BroadcastManifest& manifest, RingManifest* ring = nullptr) {
+        const auto* broadcast = static_cast<const BroadcastManifest*>(mapping.data());
+        const RingManifest* source = get_ring_manifest(mapping);
+        if (ring) ring->magic = 0;
+        if (!source) {
+            memcpy(&manifest, broadcast, sizeof(BroadcastManifest));
+            return true;
+        }
+        for (int attempt = 0; attempt < 64; ++attempt) {
+            UINT64 sequence = Shm::load_acquire(&source->headerSequence);
+            if (sequence & 1) { std::this_thread::yield(); continue; }
+            memcpy(&manifest, broadcast, sizeof(BroadcastManifest));
+            if (ring) memcpy(ring, source, sizeof(RingManifest));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (Shm::load_acquire(&source->headerSequence) == sequence) return true;
+        }
+        return false;
+    }
+
+    std::wstring get_stream_name_from_texture_name(const std::wstring& textureName, unsigned long pid) {
+        std::wstring pid_str = std::to_wstring(pid);
+        size_t pid_pos = textureName.find(pid_str);
+        if (pid_pos == std::wstring::npos) return L"Unknown";
+        size_t first_underscore_after_pid = textureName.find(L"_", pid_pos + pid_str.length());
+        if (first_underscore_after_pid == std::wstring::npos) return L"Unknown";
+        return textureName.substr(first_underscore_after_pid + 1);
+    }
+
+    bool read_stream_table(DWORD pid, StreamTable& table) {
+        Shm::Mapping mapping;
+        if (!mapping.open(get_stream_table_name(pid), sizeof(StreamTable))) return false;
+        const auto* source = static_cast<const StreamTable*>(mapping.data());
+        if (Shm::load_acquire(&source->magic) != STREAM_TABLE_MAGIC) return false;
+        for (int attempt = 0; attempt < 64; ++attempt) {
+            UINT64 sequence = Shm::load_acquire(&source->sequence);
+            if (sequence & 1) { std::this_thread::yield(); continue; }
+            memcpy(&table, source, sizeof(StreamTable));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (Shm::load_acquire(&source->sequence) == sequence) return true;
+        }
+        return false;
+    }
+
+    // Maps the manifest of (pid, streamName), preferring the full ProducerManifest view. An empty stream
+    // name selects the first published stream. Producers that predate the stream table publish a single
+    // manifest under a per-pid name, and may only expose the BroadcastManifest prefix.
+    bool open_manifest(DWORD pid, const std::string& streamName, Shm::Mapping& mapping) {
+        std::wstring w_streamName(streamName.begin(), streamName.end());
+        auto table = std::make_unique<StreamTable>();
+        if (read_stream_table(pid, *table)) {
+            for (const auto& entry : table->entries) {
+                if (!entry.active || (!streamName.empty() && read_manifest_name(entry.streamName) != w_streamName)) continue;
+                // Writable, because consumers pin ring slots in the manifest while they hold a read lease.
+                return mapping.open(narrow_name(read_manifest_name(entry.manifestName)), sizeof(ProducerManifest), true);
+            }
+            return false;
+        }
+#ifdef _WIN32
+        const std::vector<std::string> prefixes = { "D3D12_Producer_Manifest_", "DirectPort_Producer_Manifest_" };
+#else
+        const std::vector<std::string> prefixes = { g_hostManifestPrefix };
+#endif
         for (const auto& prefix : prefixes) {
-            std::wstring manifestName = prefix + std::to_wstring(pid);
-            HANDLE hManifest = OpenFileMappingW(FILE_MAP_READ, FALSE, manifestName.c_str());
-            if (hManifest) {
-                BroadcastManifest* pView = (BroadcastManifest*)MapViewOfFile(hManifest, FILE_MAP_READ, 0, 0, sizeof(BroadcastManifest));
-                if (pView) {
-                    memcpy(&manifest, pView, sizeof(BroadcastManifest));
-                    UnmapViewOfFile(pView);
-                    CloseHandle(hManifest);
-                    return true;
-                }
-                CloseHandle(hManifest);
+            std::string manifestName = prefix + std::to_string(pid);
+            if (!mapping.open(manifestName, sizeof(ProducerManifest), true) && !mapping.open(manifestName, sizeof(BroadcastManifest))) continue;
+            const auto* manifest = static_cast<const BroadcastManifest*>(mapping.data());
+            if (streamName.empty() || get_stream_name_from_texture_name(read_manifest_name(manifest->textureName), pid) == w_streamName) return true;
+            mapping.close();
+        }
+        return false;
+    }
+
+    std::wstring get_current_executable_name() {
+#ifdef _WIN32
+        WCHAR path[MAX_PATH] = {};
+        GetModuleFileNameW(nullptr, path, MAX_PATH);
+        std::wstring fullPath(path);
+        size_t separator = fullPath.find_last_of(L"\\/");
+        return separator == std::wstring::npos ? fullPath : fullPath.substr(separator + 1);
+#else
+        std::string exeFileName;
+        std::ifstream comm("/proc/self/comm");
+        std::getline(comm, exeFileName);
+        return string_to_wstring(exeFileName);
+#endif
+    }
+
+    std::wstring get_producer_type(const std::wstring& textureName, std::wstring exeFileName) {
+        std::transform(exeFileName.begin(), exeFileName.end(), exeFileName.begin(), ::towlower);
+        if (textureName.find(L"DirectPort_Host_Texture_") != std::wstring::npos) return L"Host Producer";
+        const bool is_d3d12 = textureName.find(L"D3D12_Texture_") != std::wstring::npos;
+        std::wstring api = is_d3d12 ? L"D3D12" : L"D3D11";
+        if (exeFileName.find(L"multiplexer") != std::wstring::npos) return api + L" Multiplexer";
+        if (exeFileName.find(L"camera") != std::wstring::npos) return api + L" Camera";
+        if (exeFileName.find(L"shaderfilter") != std::wstring::npos) return api + L" Shader Filter";
+        if (exeFileName.find(L"producer") != std::wstring::npos) return api + L" Producer";
+        return L"Python " + api + L" Producer";
+    }
+
+    // Entries are edited by many processes, so writers serialise on a pid-stamped spin lock in the segment.
+    // A lock left behind by a writer that died is broken by the next one.
+    void lock_registry(Registry& registry) {
+        const UINT32 self = (UINT32)Shm::current_process_id();
+        for (UINT32 spins = 1; !Shm::compare_exchange(&registry.lockOwner, 0, self); ++spins) {
+            if (spins % 1024 == 0) {
+                UINT32 owner = Shm::load_acquire(&registry.lockOwner);
+                if (owner != 0 && !Shm::is_process_alive(owner)) Shm::compare_exchange(&registry.lockOwner, owner, 0);
             }
+            std::this_thread::yield();
+        }
+        if (registry.generation & 1) Shm::store_release(&registry.generation, registry.generation + 1);
+        if (registry.magic != REGISTRY_MAGIC) {
+            memset(registry.entries, 0, sizeof(registry.entries));
+            registry.version = REGISTRY_VERSION;
+            Shm::store_release(&registry.magic, REGISTRY_MAGIC);
+        }
+    }
+
+    void unlock_registry(Registry& registry) {
+        Shm::store_release(&registry.lockOwner, 0);
+    }
+
+    void begin_registry_write(Registry& registry) {
+        Shm::store_release(&registry.generation, registry.generation + 1);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void end_registry_write(Registry& registry) {
+        Shm::store_release(&registry.generation, registry.generation + 1);
+        Shm::wake_all(&registry.generation);
+    }
+
+    bool is_registry_entry_live(const RegistryEntry& entry, UINT64 now) {
+        return entry.active && (entry.heartbeat + g_heartbeatFreshMs >= now || Shm::is_process_alive(entry.pid));
+    }
+
+    // Withdraws entries whose process exited without deregistering. Caller holds the registry lock.
+    void reclaim_dead_registry_entries(Registry& registry) {
+        const UINT64 now = Shm::monotonic_ms();
+        for (auto& entry : registry.entries) {
+            if (!entry.active || is_registry_entry_live(entry, now)) continue;
+            begin_registry_write(registry);
+            memset(&entry, 0, sizeof(RegistryEntry));
+            end_registry_write(registry);
+        }
+    }
+
+    bool read_registry(const Registry& source, Registry& registry) {
+        if (Shm::load_acquire(&source.magic) != REGISTRY_MAGIC) return false;
+        for (int attempt = 0; attempt < 64; ++attempt) {
+            UINT64 generation = Shm::load_acquire(&source.generation);
+            if (generation & 1) { std::this_thread::yield(); continue; }
+            memcpy(&registry, &source, sizeof(Registry));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (Shm::load_acquire(&source.generation) == generation) return true;
         }
         return false;
     }
+
+    // Owns this process's StreamTable and its entries in the machine-wide Registry. Producers claim an entry
+    // when created and release it when destroyed; the table is unlinked once the last producer is gone.
+    class StreamRegistry {
+    public:
+        static std::shared_ptr<StreamRegistry> get() {
+            static std::mutex instanceMutex;
+            static std::weak_ptr<StreamRegistry> instance;
+            std::lock_guard<std::mutex> lock(instanceMutex);
+            auto registry = instance.lock();
+            if (!registry) {
+                registry = std::make_shared<StreamRegistry>();
+                registry->mapping.create(get_stream_table_name(Shm::current_process_id()), sizeof(StreamTable));
+                StreamTable* table = registry->table();
+                memset(table, 0, sizeof(StreamTable));
+                table->magic = STREAM_TABLE_MAGIC;
+                table->version = STREAM_TABLE_VERSION;
+                // The registry is shared by every producer on the machine, so no single process may unlink it.
+                registry->registryMapping.create(g_registryName, sizeof(Registry), false);
+                registry->executableName = get_current_executable_name();
+                instance = registry;
+            }
+            return registry;
+        }
+
+        // Reserves stream_name and returns the manifest name it must be published under.
+        std::string claim(const std::string& manifestPrefix, const std::string& streamName, const std::wstring& textureName, UINT32& index) {
+            std::lock_guard<std::mutex> lock(mutex);
+            StreamTable* t = table();
+            std::wstring w_streamName(streamName.begin(), streamName.end());
+            std::string legacyName = manifestPrefix + std::to_string(Shm::current_process_id());
+            std::wstring w_legacyName(legacyName.begin(), legacyName.end());
+            bool legacyNameTaken = false;
+            UINT32 freeIndex = MAX_STREAMS_PER_PROCESS;
+            for (UINT32 i = 0; i < MAX_STREAMS_PER_PROCESS; ++i) {
+                const StreamTableEntry& entry = t->entries[i];
+                if (!entry.active) {
+                    freeIndex = std::min(freeIndex, i);
+                    continue;
+                }
+                if (read_manifest_name(entry.streamName) == w_streamName) {
+                    throw std::invalid_argument("Stream '" + streamName + "' is already published by this process.");
+                }
+                if (read_manifest_name(entry.manifestName) == w_legacyName) legacyNameTaken = true;
+            }
+            if (freeIndex == MAX_STREAMS_PER_PROCESS) {
+                throw std::runtime_error("A process can publish at most " + std::to_string(MAX_STREAMS_PER_PROCESS) + " streams.");
+            }
+
+            std::string manifestName = legacyNameTaken ? legacyName + "_" + streamName : legacyName;
+            StreamTableEntry& entry = t->entries[freeIndex];
+            begin_table_write(*t);
+            write_manifest_name(entry.streamName, streamName);
+            write_manifest_name(entry.manifestName, manifestName);
+            entry.active = 1;
+            end_table_write(*t);
+            index = freeIndex;
+            registryEntries[freeIndex] = register_stream(streamName, get_producer_type(textureName, executableName));
+            return manifestName;
+        }
+
+        void release(UINT32 index) {
+            std::lock_guard<std::mutex> lock(mutex);
+            StreamTable* t = table();
+            begin_table_write(*t);
+            memset(&t->entries[index], 0, sizeof(StreamTableEntry));
+            end_table_write(*t);
+            if (RegistryEntry* entry = registryEntries[index]) {
+                Registry& r = *registry();
+                lock_registry(r);
+                if (entry->pid == Shm::current_process_id()) {
+                    begin_registry_write(r);
+                    memset(entry, 0, sizeof(RegistryEntry));
+                    end_registry_write(r);
+                }
+                unlock_registry(r);
+                registryEntries[index] = nullptr;
+            }
+        }
+
+        // Stamps the stream as live. Called per frame, so it is a single store with no lock.
+        void heartbeat(UINT32 index) {
+            if (RegistryEntry* entry = registryEntries[index]) Shm::store_release(&entry->heartbeat, Shm::monotonic_ms());
+        }
+
+    private:
+        StreamTable* table() { return static_cast<StreamTable*>(mapping.data()); }
+        Registry* registry() { return static_cast<Registry*>(registryMapping.data()); }
+
+        // A full registry only hides the stream from discover(); it can still be connected to by pid.
+        RegistryEntry* register_stream(const std::string& streamName, const std::wstring& type) {
+            Registry& r = *registry();
+            lock_registry(r);
+            reclaim_dead_registry_entries(r);
+            RegistryEntry* slot = nullptr;
+            for (auto& entry : r.entries) {
+                if (!entry.active) { slot = &entry; break; }
+            }
+            if (slot) {
+                begin_registry_write(r);
+                slot->pid = (UINT32)Shm::current_process_id();
+                slot->heartbeat = Shm::monotonic_ms();
+                write_manifest_name(slot->streamName, streamName);
+                write_manifest_name(slot->executableName, executableName);
+                write_manifest_name(slot->type, type);
+                slot->active = 1;
+                end_registry_write(r);
+            }
+            unlock_registry(r);
+            return slot;
+        }
+
+        static void begin_table_write(StreamTable& t) {
+            Shm::store_release(&t.sequence, t.sequence + 1);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+
+        static void end_table_write(StreamTable& t) {
+            Shm::store_release(&t.sequence, t.sequence + 1);
+        }
+
+        std::mutex mutex;
+        Shm::Mapping mapping;
+        Shm::Mapping registryMapping;
+        RegistryEntry* registryEntries[MAX_STREAMS_PER_PROCESS] = {};
+        std::wstring executableName;
+    };
+
+    enum class PoolResource : uint32_t {
+        Texture,
+        ConstantBuffer,
+        UploadBuffer,
+        SrvHeap,
+        RtvHeap
+    };
+
+    // Describes a pooled resource: textures by (width, height, format), buffers by byte size in width.
+    struct PoolKey {
+        PoolResource kind;
+        uint32_t width;
+        uint32_t height;
+        uint32_t format;
+
+        bool operator<(const PoolKey& other) const {
+            if (kind != other.kind) return kind < other.kind;
+            if (width != other.width) return width < other.width;
+            if (height != other.height) return height < other.height;
+            return format < other.format;
+        }
+    };
+
+    // Idle device resources waiting for reuse, evicted least recently released first once they exceed
+    // the budget. Resources are type-erased so one budget covers textures and scratch alike.
+    class ResourcePool {
+    public:
+        explicit ResourcePool(uint64_t budget) : budgetBytes(budget) {}
+
+        std::shared_ptr<void> take(const PoolKey& key) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = index.find(key);
+            if (it == index.end()) {
+                stats.misses++;
+                return nullptr;
+            }
+            auto entry = it->second;
+            index.erase(it);
+            std::shared_ptr<void> resource = std::move(entry->resource);
+            stats.hits++;
+            stats.bytes_held -= entry->bytes;
+            idle.erase(entry);
+            return resource;
+        }
+
+        void lend(uint64_t bytes) {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.bytes_in_use += bytes;
+        }
+
+        void give_back(const PoolKey& key, std::shared_ptr<void> resource, uint64_t bytes) {
+            std::vector<std::shared_ptr<void>> evicted;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stats.bytes_in_use -= bytes;
+                idle.push_front({ key, std::move(resource), bytes });
+                index.emplace(key, idle.begin());
+                stats.bytes_held += bytes;
+                evict_over_budget(evicted);
+            }
+        }
+
+        void set_budget(uint64_t bytes) {
+            std::vector<std::shared_ptr<void>> evicted;
+            std::lock_guard<std::mutex> lock(mutex);
+            budgetBytes = bytes;
+            evict_over_budget(evicted);
+        }
+
+        PoolStats get_stats() {
+            std::lock_guard<std::mutex> lock(mutex);
+            PoolStats result = stats;
+            result.budget_bytes = budgetBytes;
+            return result;
+        }
+
+    private:
+        struct Entry {
+            PoolKey key;
+            std::shared_ptr<void> resource;
+            uint64_t bytes;
+        };
+
+        // Evicted resources are handed out so they are destroyed after the lock is dropped.
+        void evict_over_budget(std::vector<std::shared_ptr<void>>& evicted) {
+            while (stats.bytes_held > budgetBytes && !idle.empty()) {
+                auto oldest = std::prev(idle.end());
+                auto range = index.equal_range(oldest->key);
+                for (auto it = range.first; it != range.second; ++it) {
+                    if (it->second == oldest) { index.erase(it); break; }
+                }
+                stats.bytes_held -= oldest->bytes;
+                stats.evictions++;
+                evicted.push_back(std::move(oldest->resource));
+                idle.erase(oldest);
+            }
+        }
+
+        std::mutex mutex;
+        std::list<Entry> idle;
+        std::multimap<PoolKey, std::list<Entry>::iterator> index;
+        PoolStats stats = {};
+        uint64_t budgetBytes;
+    };
+
+    // Takes an idle resource for key or creates one, and returns a handle that gives it back to the
+    // pool when released. If the pool is gone by then the resource is simply destroyed.
+    template <typename T, typename Create>
+    std::shared_ptr<T> acquire_pooled(const std::shared_ptr<ResourcePool>& pool, const PoolKey& key, uint64_t bytes, Create create) {
+        std::shared_ptr<T> resource = std::static_pointer_cast<T>(pool->take(key));
+        if (!resource) resource = create();
+        pool->lend(bytes);
+        std::weak_ptr<ResourcePool> weakPool = pool;
+        return std::shared_ptr<T>(resource.get(), [weakPool, resource, key, bytes](T*) {
+            if (auto owner = weakPool.lock()) owner->give_back(key, resource, bytes);
+        });
+    }
+
+    std::shared_ptr<Texture> acquire_pooled_texture(IDirectXDevice& device, const std::shared_ptr<ResourcePool>& pool, uint32_t width, uint32_t height, DXGI_FORMAT format) {
+        const PoolKey key = { PoolResource::Texture, width, height, (uint32_t)format };
+        return acquire_pooled<Texture>(pool, key, (uint64_t)width * height * CPU::bytes_per_pixel(format),
+                                       [&] { return device.create_texture(width, height, format); });
+    }
 }
 
 struct Texture::Impl {
+#ifdef _WIN32
     ComPtr<ID3D11Texture2D> d3d11Texture;
     ComPtr<ID3D11ShaderResourceView> d3d11SRV;
     ComPtr<ID3D11RenderTargetView> d3d11RTV;
     ComPtr<ID3D12Resource> d3d12Resource;
+#endif
+
+    std::shared_ptr<void> hostStorage;
+    uint8_t* hostData = nullptr;
+    UINT32 rowPitch = 0;
     
     UINT32 width = 0;
     UINT32 height = 0;
     DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
     bool is_d3d11 = false;
     bool is_d3d12 = false;
+    bool is_host = false;
 };
 Texture::Texture() : pImpl(std::make_unique<Impl>()) {}
 Texture::~Texture() = default;
+std::shared_ptr<Texture> Texture::create_host(uint32_t width, uint32_t height, DXGI_FORMAT format) {
+    auto tex = std::shared_ptr<Texture>(new Texture());
+    tex->pImpl->is_host = true;
+    tex->pImpl->width = width;
+    tex->pImpl->height = height;
+    tex->pImpl->format = format;
+    tex->pImpl->rowPitch = get_host_row_pitch(width, format);
+    size_t size = (size_t)tex->pImpl->rowPitch * height;
+    uint8_t* data = static_cast<uint8_t*>(::operator new[](size, std::align_val_t(64)));
+    memset(data, 0, size);
+    tex->pImpl->hostStorage = std::shared_ptr<uint8_t>(data, [](uint8_t* p) { ::operator delete[](p, std::align_val_t(64)); });
+    tex->pImpl->hostData = data;
+    return tex;
+}
 uint32_t Texture::get_width() const { return pImpl->width; }
 uint32_t Texture::get_height() const { return pImpl->height; }
 DXGI_FORMAT Texture::get_format() const { return pImpl->format; }
+uintptr_t Texture::get_host_ptr() { return reinterpret_cast<uintptr_t>(pImpl->hostData); }
+uint32_t Texture::get_row_pitch() const { return pImpl->rowPitch; }
+#ifdef _WIN32
 uintptr_t Texture::get_d3d11_texture_ptr() { return reinterpret_cast<uintptr_t>(pImpl->d3d11Texture.Get()); }
 uintptr_t Texture::get_d3d11_srv_ptr() { return reinterpret_cast<uintptr_t>(pImpl->d3d11SRV.Get()); }
 uintptr_t Texture::get_d3d11_rtv_ptr() { return reinterpret_cast<uintptr_t>(pImpl->d3d11RTV.Get()); }
 uintptr_t Texture::get_d3d12_resource_ptr() { return reinterpret_cast<uintptr_t>(pImpl->d3d12Resource.Get()); }
+#endif
 
 struct Consumer::Impl {
     DWORD pid = 0;
+#ifdef _WIN32
     HANDLE hProcess = nullptr;
+    HANDLE hFrameEvent = nullptr;
+#endif
     UINT64 lastSeenFrame = 0;
+    UINT64 lastCopiedFrame = 0;
     std::shared_ptr<Texture> sharedTexture;
     std::shared_ptr<Texture> privateTexture;
+#ifdef _WIN32
     ComPtr<ID3D11Fence> d3d11Fence;
     ComPtr<ID3D12Fence> d3d12Fence;
     void* pDeviceContext = nullptr;
+    std::vector<ComPtr<ID3D11Texture2D>> d3d11SlotTextures;
+    std::vector<ComPtr<ID3D11ShaderResourceView>> d3d11SlotSRVs;
+    std::vector<ComPtr<ID3D12Resource>> d3d12SlotResources;
+#endif
+    std::shared_ptr<Shm::Mapping> manifest = std::make_shared<Shm::Mapping>();
+    std::shared_ptr<Shm::Mapping> hostSlots;
+    size_t slotSize = 0;
+    FrameMetadata frameMetadata = {};
+    ConsumerStatsEntry* stats = nullptr;
+    bool statsClaimed = false;
     bool is_d3d11_producer = false;
+    bool is_host_producer = false;
+
+    const BroadcastManifest* broadcast_manifest() const { return static_cast<const BroadcastManifest*>(manifest->data()); }
+    RingManifest* ring_manifest() const { return get_ring_manifest(*manifest); }
+
+    // The stats entry is claimed on the first frame, so consumers that never read hold no entry.
+    void record_acquisition(const FrameMetadata& metadata) {
+        ProducerManifest* producer = get_producer_manifest(*manifest);
+        if (!producer || metadata.version == 0) return;
+        if (!statsClaimed) {
+            stats = claim_consumer_stats(producer->stats);
+            statsClaimed = true;
+        }
+        if (!stats) return;
+        UINT64 now = Shm::monotonic_us();
+        record_latency(stats->latency, now > metadata.signalTimeUs ? now - metadata.signalTimeUs : 0);
+        Shm::store_release(&stats->lastFrame, metadata.frameSequence);
+    }
 };
 Consumer::Consumer() : pImpl(std::make_unique<Impl>()) {}
 Consumer::~Consumer() {
+    if (pImpl->stats) Shm::store_release(&pImpl->stats->pid, 0);
+#ifdef _WIN32
     if (pImpl->hProcess) CloseHandle(pImpl->hProcess);
+    if (pImpl->hFrameEvent) CloseHandle(pImpl->hFrameEvent);
+#endif
 }
 bool Consumer::is_alive() const {
+#ifdef _WIN32
     if (!pImpl || !pImpl->hProcess) return false;
     return WaitForSingleObject(pImpl->hProcess, 0) == WAIT_TIMEOUT;
+#else
+    return pImpl && Shm::is_process_alive(pImpl->pid);
+#endif
+}
+std::shared_ptr<Texture> Consumer::get_texture() {
+    if (pImpl->is_host_producer && !pImpl->privateTexture) {
+        // Allocated on first use, so consumers that only lease frames never pay for a private copy.
+        auto& shared = *pImpl->sharedTexture->pImpl;
+        pImpl->privateTexture = Texture::create_host(shared.width, shared.height, shared.format);
+    }
+    if (pImpl->is_host_producer && pImpl->lastCopiedFrame != pImpl->lastSeenFrame) {
+        // Host frames have no device queue to schedule the copy on, so the private snapshot is taken on demand.
+        UINT64 copiedFrame = 0;
+        if (read_latest_slot(*pImpl->ring_manifest(), static_cast<const uint8_t*>(pImpl->hostSlots->data()), pImpl->slotSize,
+                             pImpl->privateTexture->pImpl->hostData, copiedFrame)) {
+            pImpl->lastCopiedFrame = copiedFrame;
+            pImpl->lastSeenFrame = std::max(pImpl->lastSeenFrame, copiedFrame);
+        }
+    }
+    return pImpl->privateTexture;
 }
-std::shared_ptr<Texture> Consumer::get_texture() { return pImpl->privateTexture; }
 std::shared_ptr<Texture> Consumer::get_shared_texture() { return pImpl->sharedTexture; }
+const FrameMetadata& Consumer::get_frame_metadata() const { return pImpl->frameMetadata; }
+LatencyStats Consumer::get_latency_stats() const {
+    return pImpl->stats ? summarize_latency(pImpl->stats->latency) : LatencyStats{};
+}
 unsigned long Consumer::get_pid() const { return pImpl->pid; }
 bool Consumer::wait_for_frame() {
-    if (!pImpl || !is_alive()) return false;
-    BroadcastManifest currentManifest;
-    if (!get_manifest_from_pid(pImpl->pid, currentManifest)) return false;
-    UINT64 latestFrame = currentManifest.frameValue;
+    return wait_for_frame(0) == FrameStatus::NewFrame;
+}
+FrameStatus Consumer::wait_for_frame(uint32_t timeout_ms) {
+    if (!pImpl || !*pImpl->manifest || !is_alive()) return FrameStatus::ProducerGone;
+
+    // The manifest stays mapped for the consumer's lifetime, so polling it costs no kernel round-trips.
+    const BroadcastManifest* manifest = pImpl->broadcast_manifest();
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    UINT64 latestFrame = Shm::load_acquire(&manifest->frameValue);
+    while (latestFrame <= pImpl->lastSeenFrame) {
+        auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0) return FrameStatus::Timeout;
+        // Sleep in slices so a producer that dies without signalling is still noticed.
+        uint32_t slice = (uint32_t)std::min<long long>((remaining + 999) / 1000, g_livenessPollIntervalMs);
+#ifdef _WIN32
+        // WaitOnAddress cannot be woken from another process, so D3D consumers sleep on the shared fence instead.
+        HRESULT hr = E_FAIL;
+        if (!pImpl->is_host_producer) {
+            if (!pImpl->hFrameEvent) pImpl->hFrameEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+            if (pImpl->hFrameEvent && pImpl->d3d11Fence) hr = pImpl->d3d11Fence->SetEventOnCompletion(pImpl->lastSeenFrame + 1, pImpl->hFrameEvent);
+            else if (pImpl->hFrameEvent && pImpl->d3d12Fence) hr = pImpl->d3d12Fence->SetEventOnCompletion(pImpl->lastSeenFrame + 1, pImpl->hFrameEvent);
+        }
+        if (SUCCEEDED(hr)) {
+            HANDLE handles[] = { pImpl->hFrameEvent, pImpl->hProcess };
+            WaitForMultipleObjects(2, handles, FALSE, slice);
+        } else {
+            Shm::wait_on_address(&manifest->frameValue, latestFrame, slice);
+        }
+#else
+        Shm::wait_on_address(&manifest->frameValue, latestFrame, slice);
+#endif
+        if (!is_alive()) return FrameStatus::ProducerGone;
+        latestFrame = Shm::load_acquire(&manifest->frameValue);
+    }
 
-    if (latestFrame > pImpl->lastSeenFrame) {
+    const RingManifest* ring = pImpl->ring_manifest();
+    UINT32 latestSlot = ring ? Shm::load_acquire(&ring->latestSlot) : 0;
+    if (ring && !read_latest_metadata(*get_producer_manifest(*pImpl->manifest), latestSlot, pImpl->frameMetadata)) pImpl->frameMetadata = {};
+    pImpl->record_acquisition(pImpl->frameMetadata);
+    auto& shared = *pImpl->sharedTexture->pImpl;
+    if (pImpl->is_host_producer) {
+        shared.hostData = static_cast<uint8_t*>(pImpl->hostSlots->data()) + latestSlot * pImpl->slotSize;
+    }
+#ifdef _WIN32
+    else {
+        if (ring && latestSlot < pImpl->d3d11SlotTextures.size()) {
+            shared.d3d11Texture = pImpl->d3d11SlotTextures[latestSlot];
+            shared.d3d11SRV = pImpl->d3d11SlotSRVs[latestSlot];
+        } else if (ring && latestSlot < pImpl->d3d12SlotResources.size()) {
+            shared.d3d12Resource = pImpl->d3d12SlotResources[latestSlot];
+        }
         if (pImpl->is_d3d11_producer && pImpl->d3d11Fence) {
             auto* ctx = reinterpret_cast<ID3D11DeviceContext4*>(pImpl->pDeviceContext);
             ctx->Wait(pImpl->d3d11Fence.Get(), latestFrame);
-            pImpl->lastSeenFrame = latestFrame;
-            return true;
-        } else if (!pImpl->is_d3d11_producer && pImpl->d3d12Fence) {
-            UINT64 expectedFrame = pImpl->lastSeenFrame;
-            if (WaitOnAddress(&currentManifest.frameValue, &expectedFrame, sizeof(UINT64), 16) == TRUE) {
-                if (!get_manifest_from_pid(pImpl->pid, currentManifest)) return false;
-                latestFrame = currentManifest.frameValue;
-
-                if (latestFrame > pImpl->lastSeenFrame) {
-                    pImpl->lastSeenFrame = latestFrame;
-                    return true;
-                }
-            } else {
-                if (!get_manifest_from_pid(pImpl->pid, currentManifest)) return false;
-                latestFrame = currentManifest.frameValue;
-                if (latestFrame > pImpl->lastSeenFrame) {
-                    pImpl->lastSeenFrame = latestFrame;
-                    return true;
+        }
+    }
+#endif
+    pImpl->lastSeenFrame = latestFrame;
+    return FrameStatus::NewFrame;
+}
+
+struct ReadLease::Impl {
+    std::shared_ptr<Shm::Mapping> manifest;
+    RingManifest* ring = nullptr;
+    UINT32 slot = 0;
+    UINT64 sequence = 0;
+    UINT64 frameValue = 0;
+    FrameMetadata metadata = {};
+    std::shared_ptr<Texture> texture;
+    bool pinned = false;
+};
+ReadLease::ReadLease() : pImpl(std::make_unique<Impl>()) {}
+ReadLease::~ReadLease() { release(); }
+void ReadLease::release() {
+    if (!pImpl->pinned) return;
+    Shm::fetch_add(&pImpl->ring->slots[pImpl->slot].pinState, 0u - 1);
+    pImpl->pinned = false;
+}
+bool ReadLease::is_valid() const {
+    return pImpl->pinned && Shm::load_acquire(&pImpl->ring->slots[pImpl->slot].sequence) == pImpl->sequence;
+}
+uint64_t ReadLease::get_frame() const { return pImpl->frameValue; }
+const FrameMetadata& ReadLease::get_metadata() const { return pImpl->metadata; }
+std::shared_ptr<Texture> ReadLease::get_texture() { return pImpl->texture; }
+
+std::shared_ptr<ReadLease> Consumer::acquire_read() {
+    RingManifest* ring = pImpl->ring_manifest();
+    if (!ring) return nullptr;
+#ifdef _WIN32
+    if (!pImpl->is_host_producer && pImpl->d3d11SlotTextures.empty() && pImpl->d3d12SlotResources.empty()) return nullptr;
+#endif
+
+    auto lease = std::shared_ptr<ReadLease>(new ReadLease());
+    auto& impl = *lease->pImpl;
+    if (!pin_latest_slot(*ring, impl.slot, impl.sequence, impl.frameValue)) return nullptr;
+    impl.manifest = pImpl->manifest;
+    impl.ring = ring;
+    impl.pinned = true;
+    impl.metadata = get_producer_manifest(*pImpl->manifest)->metadata[impl.slot];
+
+    // The lease texture aliases the slot itself, so it stays usable however far the shared texture moves on.
+    auto& shared = *pImpl->sharedTexture->pImpl;
+    impl.texture = std::shared_ptr<Texture>(new Texture());
+    auto& view = *impl.texture->pImpl;
+    view.width = shared.width;
+    view.height = shared.height;
+    view.format = shared.format;
+    view.rowPitch = shared.rowPitch;
+    view.is_host = shared.is_host;
+    view.is_d3d11 = shared.is_d3d11;
+    view.is_d3d12 = shared.is_d3d12;
+    if (pImpl->is_host_producer) {
+        view.hostData = static_cast<uint8_t*>(pImpl->hostSlots->data()) + impl.slot * pImpl->slotSize;
+        view.hostStorage = pImpl->hostSlots;
+    }
+#ifdef _WIN32
+    else {
+        if (impl.slot < pImpl->d3d11SlotTextures.size()) {
+            view.d3d11Texture = pImpl->d3d11SlotTextures[impl.slot];
+            view.d3d11SRV = pImpl->d3d11SlotSRVs[impl.slot];
+        } else if (impl.slot < pImpl->d3d12SlotResources.size()) {
+            view.d3d12Resource = pImpl->d3d12SlotResources[impl.slot];
+        }
+        if (pImpl->is_d3d11_producer && pImpl->d3d11Fence) {
+            auto* ctx = reinterpret_cast<ID3D11DeviceContext4*>(pImpl->pDeviceContext);
+            ctx->Wait(pImpl->d3d11Fence.Get(), impl.frameValue);
+        }
+    }
+#endif
+    if (impl.frameValue > pImpl->lastSeenFrame) {
+        pImpl->record_acquisition(impl.metadata);
+        pImpl->lastSeenFrame = impl.frameValue;
+    }
+    return lease;
+}
+
+struct Producer::Impl {
+#ifdef _WIN32
+    ComPtr<ID3D11Fence> d3d11Fence;
+    ComPtr<ID3D12Fence> d3d12Fence;
+    HANDLE hManifest = nullptr;
+    HANDLE hTextureHandle = nullptr;
+    HANDLE hFenceHandle = nullptr;
+    void* pDeviceContext = nullptr;
+
+    std::vector<HANDLE> hSlotHandles;
+    std::vector<ComPtr<ID3D11Texture2D>> d3d11SlotTextures;
+    std::vector<ComPtr<ID3D12Resource>> d3d12SlotResources;
+    std::vector<ComPtr<ID3D12CommandAllocator>> d3d12SlotAllocators;
+    ComPtr<ID3D12GraphicsCommandList> d3d12CopyList;
+    HANDLE hCopyEvent = nullptr;
+
+    ComPtr<ID3D11Texture2D> d3d11UploadTexture;
+    ComPtr<ID3D12Resource> d3d12UploadBuffer;
+    ComPtr<ID3D12CommandAllocator> d3d12UploadAllocator;
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT d3d12UploadFootprint = {};
+    uint8_t* d3d12UploadData = nullptr;
+#endif
+    WriteBuffer writeBuffer = {};
+    bool writeBufferAcquired = false;
+    UINT64 frameValue = 0;
+    BroadcastManifest* pManifestView = nullptr;
+    RingManifest* pRingView = nullptr;
+    FrameMetadata* pMetadataView = nullptr;
+    FrameMetadata pendingMetadata = {};
+    StatsManifest* pStatsView = nullptr;
+    UINT32 writeSlot = 0;
+    Shm::Mapping hostManifest;
+    std::shared_ptr<Shm::Mapping> hostSlots;
+    size_t slotSize = 0;
+    std::shared_ptr<Texture> sourceTexture;
+    std::shared_ptr<StreamRegistry> streamRegistry;
+    UINT32 streamIndex = 0;
+    bool is_d3d11_producer = false;
+    bool is_host_producer = false;
+};
+Producer::Producer() : pImpl(std::make_unique<Impl>()) {}
+Producer::~Producer() {
+#ifdef _WIN32
+    if (pImpl->pManifestView && !pImpl->is_host_producer) UnmapViewOfFile(pImpl->pManifestView);
+    if (pImpl->hManifest) CloseHandle(pImpl->hManifest);
+    if (pImpl->hTextureHandle) CloseHandle(pImpl->hTextureHandle);
+    if (pImpl->hFenceHandle) CloseHandle(pImpl->hFenceHandle);
+    for (HANDLE hSlot : pImpl->hSlotHandles) CloseHandle(hSlot);
+    if (pImpl->hCopyEvent) CloseHandle(pImpl->hCopyEvent);
+#endif
+    if (pImpl->streamRegistry) pImpl->streamRegistry->release(pImpl->streamIndex);
+}
+void Producer::signal_frame() {
+    const UINT64 signalStart = Shm::monotonic_us();
+    pImpl->frameValue++;
+    // A committed host write buffer already is the slot, claimed and opened by acquire_write_buffer.
+    const bool slotWritten = pImpl->is_host_producer && pImpl->writeBufferAcquired;
+    if (pImpl->pRingView && !slotWritten) pImpl->writeSlot = claim_write_slot(*pImpl->pRingView, pImpl->writeSlot);
+    const UINT32 slot = pImpl->writeSlot;
+    RingSlot* ringSlot = pImpl->pRingView ? &pImpl->pRingView->slots[slot] : nullptr;
+
+    if (ringSlot && !slotWritten) begin_slot_write(*ringSlot);
+    if (pImpl->is_host_producer && !slotWritten) {
+        auto& src = *pImpl->sourceTexture->pImpl;
+        memcpy(static_cast<uint8_t*>(pImpl->hostSlots->data()) + slot * pImpl->slotSize, src.hostData, pImpl->slotSize);
+    }
+#ifdef _WIN32
+    if (pImpl->is_d3d11_producer && pImpl->d3d11Fence) {
+        auto* ctx = reinterpret_cast<ID3D11DeviceContext4*>(pImpl->pDeviceContext);
+        if (slot < pImpl->d3d11SlotTextures.size()) {
+            ctx->CopyResource(pImpl->d3d11SlotTextures[slot].Get(), pImpl->sourceTexture->pImpl->d3d11Texture.Get());
+        }
+        ctx->Signal(pImpl->d3d11Fence.Get(), pImpl->frameValue);
+    } else if (!pImpl->is_d3d11_producer && pImpl->d3d12Fence) {
+        auto* queue = reinterpret_cast<ID3D12CommandQueue*>(pImpl->pDeviceContext);
+        if (slot < pImpl->d3d12SlotResources.size()) {
+            // Each slot owns an allocator; it is only reset once the copy that last used it has retired.
+            UINT64 lastUse = ringSlot ? ringSlot->frameValue : 0;
+            if (pImpl->d3d12Fence->GetCompletedValue() < lastUse) {
+                pImpl->d3d12Fence->SetEventOnCompletion(lastUse, pImpl->hCopyEvent);
+                WaitForSingleObject(pImpl->hCopyEvent, INFINITE);
+            }
+            auto& allocator = pImpl->d3d12SlotAllocators[slot];
+            allocator->Reset();
+            pImpl->d3d12CopyList->Reset(allocator.Get(), nullptr);
+
+            D3D12_RESOURCE_BARRIER barriers[2] = {};
+            barriers[0].Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+            barriers[0].Transition = { pImpl->sourceTexture->pImpl->d3d12Resource.Get(), D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_SOURCE };
+            barriers[1].Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+            barriers[1].Transition = { pImpl->d3d12SlotResources[slot].Get(), D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST };
+            pImpl->d3d12CopyList->ResourceBarrier(2, barriers);
+            pImpl->d3d12CopyList->CopyResource(pImpl->d3d12SlotResources[slot].Get(), pImpl->sourceTexture->pImpl->d3d12Resource.Get());
+            std::swap(barriers[0].Transition.StateBefore, barriers[0].Transition.StateAfter);
+            std::swap(barriers[1].Transition.StateBefore, barriers[1].Transition.StateAfter);
+            pImpl->d3d12CopyList->ResourceBarrier(2, barriers);
+            pImpl->d3d12CopyList->Close();
+            ID3D12CommandList* lists[] = { pImpl->d3d12CopyList.Get() };
+            queue->ExecuteCommandLists(1, lists);
+        }
+        queue->Signal(pImpl->d3d12Fence.Get(), pImpl->frameValue);
+    }
+#endif
+    if (slotWritten) pImpl->writeBufferAcquired = false;
+    if (ringSlot) {
+        FrameMetadata& metadata = pImpl->pMetadataView[slot];
+        metadata = pImpl->pendingMetadata;
+        metadata.version = FRAME_METADATA_VERSION;
+        metadata.faceCount = std::min(metadata.faceCount, MAX_FRAME_FACES);
+        metadata.frameSequence = pImpl->frameValue;
+        metadata.signalTimeUs = Shm::monotonic_us();
+        pImpl->pendingMetadata = {};
+        end_slot_write(*ringSlot, pImpl->frameValue);
+        Shm::store_release(&pImpl->pRingView->latestSlot, slot);
+        release_write_slot(*ringSlot);
+        pImpl->writeSlot = (slot + 1) % pImpl->pRingView->slotCount;
+    }
+
+    if (pImpl->streamRegistry) pImpl->streamRegistry->heartbeat(pImpl->streamIndex);
+
+    if (pImpl->pManifestView) {
+        Shm::store_release(&pImpl->pManifestView->frameValue, pImpl->frameValue);
+        if (pImpl->is_host_producer) {
+            Shm::wake_all(&pImpl->pManifestView->frameValue);
+        }
+    }
+    if (pImpl->pStatsView) record_latency(pImpl->pStatsView->signalCost, Shm::monotonic_us() - signalStart);
+}
+std::shared_ptr<Texture> Producer::get_texture() { return pImpl->sourceTexture; }
+WriteBuffer Producer::acquire_write_buffer() {
+    if (pImpl->writeBufferAcquired) return pImpl->writeBuffer;
+    auto& src = *pImpl->sourceTexture->pImpl;
+    WriteBuffer buffer = { nullptr, src.width, src.height, 0, src.format };
+
+    if (pImpl->is_host_producer) {
+        // Readers skip the slot while its sequence is odd, so Python can fill it in place.
+        pImpl->writeSlot = claim_write_slot(*pImpl->pRingView, pImpl->writeSlot);
+        begin_slot_write(pImpl->pRingView->slots[pImpl->writeSlot]);
+        buffer.data = static_cast<uint8_t*>(pImpl->hostSlots->data()) + pImpl->writeSlot * pImpl->slotSize;
+        buffer.row_pitch = src.rowPitch;
+    }
+#ifdef _WIN32
+    else if (pImpl->is_d3d11_producer) {
+        auto* ctx = reinterpret_cast<ID3D11DeviceContext4*>(pImpl->pDeviceContext);
+        HRESULT hr;
+        if (!pImpl->d3d11UploadTexture) {
+            D3D11_TEXTURE2D_DESC desc;
+            src.d3d11Texture->GetDesc(&desc);
+            desc.Usage = D3D11_USAGE_DYNAMIC;
+            desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+            desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+            desc.MiscFlags = 0;
+            ComPtr<ID3D11Device> device;
+            ctx->GetDevice(&device);
+            hr = device->CreateTexture2D(&desc, nullptr, &pImpl->d3d11UploadTexture);
+            if (FAILED(hr)) { throw std::runtime_error("Failed to create D3D11 upload texture. HRESULT: " + std::to_string(hr)); }
+        }
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        hr = ctx->Map(pImpl->d3d11UploadTexture.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+        if (FAILED(hr)) { throw std::runtime_error("Failed to map D3D11 upload texture. HRESULT: " + std::to_string(hr)); }
+        buffer.data = static_cast<uint8_t*>(mapped.pData);
+        buffer.row_pitch = mapped.RowPitch;
+    } else {
+        auto* queue = reinterpret_cast<ID3D12CommandQueue*>(pImpl->pDeviceContext);
+        HRESULT hr;
+        if (!pImpl->d3d12UploadBuffer) {
+            ComPtr<ID3D12Device> device;
+            queue->GetDevice(IID_PPV_ARGS(&device));
+            D3D12_RESOURCE_DESC texDesc = src.d3d12Resource->GetDesc();
+            UINT64 uploadBufferSize;
+            device->GetCopyableFootprints(&texDesc, 0, 1, 0, &pImpl->d3d12UploadFootprint, nullptr, nullptr, &uploadBufferSize);
+
+            D3D12_HEAP_PROPERTIES uploadHeapProps = {D3D12_HEAP_TYPE_UPLOAD};
+            D3D12_RESOURCE_DESC bufferDesc = {};
+            bufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+            bufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+            bufferDesc.Width = uploadBufferSize;
+            bufferDesc.Height = 1;
+            bufferDesc.DepthOrArraySize = 1;
+            bufferDesc.MipLevels = 1;
+            bufferDesc.SampleDesc.Count = 1;
+            hr = device->CreateCommittedResource(&uploadHeapProps, D3D12_HEAP_FLAG_NONE, &bufferDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&pImpl->d3d12UploadBuffer));
+            if (FAILED(hr)) { throw std::runtime_error("Failed to create D3D12 upload heap. HRESULT: " + std::to_string(hr)); }
+            hr = device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&pImpl->d3d12UploadAllocator));
+            if (FAILED(hr)) { throw std::runtime_error("Failed to create D3D12 upload allocator. HRESULT: " + std::to_string(hr)); }
+            // Upload heaps may stay mapped for their whole lifetime; the CPU never reads them back.
+            D3D12_RANGE noRead = {0, 0};
+            hr = pImpl->d3d12UploadBuffer->Map(0, &noRead, reinterpret_cast<void**>(&pImpl->d3d12UploadData));
+            if (FAILED(hr)) { throw std::runtime_error("Failed to map D3D12 upload heap. HRESULT: " + std::to_string(hr)); }
+        }
+        // The previous commit's copy out of the buffer must retire before it is overwritten.
+        if (pImpl->d3d12Fence->GetCompletedValue() < pImpl->frameValue) {
+            pImpl->d3d12Fence->SetEventOnCompletion(pImpl->frameValue, pImpl->hCopyEvent);
+            WaitForSingleObject(pImpl->hCopyEvent, INFINITE);
+        }
+        buffer.data = pImpl->d3d12UploadData + pImpl->d3d12UploadFootprint.Offset;
+        buffer.row_pitch = pImpl->d3d12UploadFootprint.Footprint.RowPitch;
+    }
+#endif
+
+    pImpl->writeBuffer = buffer;
+    pImpl->writeBufferAcquired = true;
+    return buffer;
+}
+void Producer::set_frame_metadata(const FrameMetadata& metadata) { pImpl->pendingMetadata = metadata; }
+ProducerStats Producer::get_stats() const {
+    ProducerStats stats = {};
+    stats.frames = pImpl->frameValue;
+    if (!pImpl->pStatsView) return stats;
+    stats.signal_cost = summarize_latency(pImpl->pStatsView->signalCost);
+    for (const auto& entry : pImpl->pStatsView->consumers) {
+        UINT32 pid = Shm::load_acquire(&entry.pid);
+        if (pid == 0 || !Shm::is_process_alive(pid)) continue;
+        stats.consumers.push_back({ pid, Shm::load_acquire(&entry.lastFrame), summarize_latency(entry.latency) });
+    }
+    return stats;
+}
+void Producer::commit() {
+    if (!pImpl->writeBufferAcquired) {
+        throw std::runtime_error("commit() called without a preceding acquire_write_buffer().");
+    }
+#ifdef _WIN32
+    auto& src = *pImpl->sourceTexture->pImpl;
+    if (!pImpl->is_host_producer && pImpl->is_d3d11_producer) {
+        auto* ctx = reinterpret_cast<ID3D11DeviceContext4*>(pImpl->pDeviceContext);
+        ctx->Unmap(pImpl->d3d11UploadTexture.Get(), 0);
+        ctx->CopyResource(src.d3d11Texture.Get(), pImpl->d3d11UploadTexture.Get());
+    } else if (!pImpl->is_host_producer) {
+        auto* queue = reinterpret_cast<ID3D12CommandQueue*>(pImpl->pDeviceContext);
+        pImpl->d3d12UploadAllocator->Reset();
+        pImpl->d3d12CopyList->Reset(pImpl->d3d12UploadAllocator.Get(), nullptr);
+
+        D3D12_TEXTURE_COPY_LOCATION srcLocation = {};
+        srcLocation.pResource = pImpl->d3d12UploadBuffer.Get();
+        srcLocation.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+        srcLocation.PlacedFootprint = pImpl->d3d12UploadFootprint;
+        D3D12_TEXTURE_COPY_LOCATION dstLocation = { src.d3d12Resource.Get(), D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX, 0 };
+
+        D3D12_RESOURCE_BARRIER barrier = {};
+        barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+        barrier.Transition = { src.d3d12Resource.Get(), D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST };
+        pImpl->d3d12CopyList->ResourceBarrier(1, &barrier);
+        pImpl->d3d12CopyList->CopyTextureRegion(&dstLocation, 0, 0, 0, &srcLocation, nullptr);
+        std::swap(barrier.Transition.StateBefore, barrier.Transition.StateAfter);
+        pImpl->d3d12CopyList->ResourceBarrier(1, &barrier);
+        pImpl->d3d12CopyList->Close();
+        ID3D12CommandList* lists[] = { pImpl->d3d12CopyList.Get() };
+        queue->ExecuteCommandLists(1, lists);
+    }
+#endif
+    signal_frame();
+    pImpl->writeBufferAcquired = false;
+}
+void Producer::abort_write() {
+    if (!pImpl->writeBufferAcquired) return;
+    pImpl->writeBufferAcquired = false;
+    if (pImpl->is_host_producer) {
+        // The slot keeps its old frameValue but is not the latest, so no reader picks it up.
+        RingSlot& slot = pImpl->pRingView->slots[pImpl->writeSlot];
+        end_slot_write(slot, slot.frameValue);
+        release_write_slot(slot);
+        return;
+    }
+#ifdef _WIN32
+    if (pImpl->is_d3d11_producer) {
+        reinterpret_cast<ID3D11DeviceContext4*>(pImpl->pDeviceContext)->Unmap(pImpl->d3d11UploadTexture.Get(), 0);
+    }
+#endif
+}
+
+std::shared_ptr<Producer> DirectPort::create_host_producer(const std::string& stream_name, uint32_t width, uint32_t height, DXGI_FORMAT format, uint32_t slot_count) {
+    validate_stream_name(stream_name);
+    if (width == 0 || height == 0 || get_bytes_per_pixel(format) == 0) {
+        throw std::invalid_argument("Invalid dimensions or unsupported DXGI_FORMAT for create_host_producer.");
+    }
+    if (slot_count == 0 || slot_count > MAX_RING_SLOTS) {
+        throw std::invalid_argument("slot_count must be between 1 and " + std::to_string(MAX_RING_SLOTS) + ".");
+    }
+
+    unsigned long pid = Shm::current_process_id();
+    std::string textureName = g_hostTexturePrefix + std::to_string(pid) + "_" + stream_name;
+
+    auto prod = std::shared_ptr<Producer>(new Producer());
+    prod->pImpl->is_host_producer = true;
+    auto streamRegistry = StreamRegistry::get();
+    std::string manifestName = streamRegistry->claim(g_hostManifestPrefix, stream_name, string_to_wstring(textureName), prod->pImpl->streamIndex);
+    prod->pImpl->streamRegistry = streamRegistry;
+    prod->pImpl->sourceTexture = Texture::create_host(width, height, format);
+    prod->pImpl->slotSize = (size_t)prod->pImpl->sourceTexture->get_row_pitch() * height;
+    prod->pImpl->hostSlots = std::make_shared<Shm::Mapping>();
+    prod->pImpl->hostSlots->create(textureName, prod->pImpl->slotSize * slot_count);
+
+    prod->pImpl->hostManifest.create(manifestName, sizeof(ProducerManifest));
+    auto* manifest = static_cast<ProducerManifest*>(prod->pImpl->hostManifest.data());
+    memset(manifest, 0, sizeof(ProducerManifest));
+    init_ring_manifest(manifest->ring, slot_count);
+    begin_manifest_write(manifest->ring);
+    manifest->broadcast.width = width;
+    manifest->broadcast.height = height;
+    manifest->broadcast.format = format;
+    write_manifest_name(manifest->broadcast.textureName, textureName);
+    write_manifest_name(manifest->broadcast.fenceName, manifestName);
+    end_manifest_write(manifest->ring);
+    prod->pImpl->pManifestView = &manifest->broadcast;
+    prod->pImpl->pRingView = &manifest->ring;
+    prod->pImpl->pMetadataView = manifest->metadata;
+    prod->pImpl->pStatsView = &manifest->stats;
+
+    return prod;
+}
+
+std::shared_ptr<Consumer> DirectPort::connect_to_host_producer(unsigned long pid, const std::string& stream_name) {
+    auto cons = std::shared_ptr<Consumer>(new Consumer());
+    cons->pImpl->pid = pid;
+    cons->pImpl->is_host_producer = true;
+
+    BroadcastManifest manifest;
+    RingManifest ring;
+    if (!open_manifest(pid, stream_name, *cons->pImpl->manifest) || !read_manifest(*cons->pImpl->manifest, manifest, &ring)) {
+        return nullptr;
+    }
+    std::string textureName = narrow_name(read_manifest_name(manifest.textureName));
+    if (textureName.rfind(g_hostTexturePrefix, 0) != 0) {
+        return nullptr;
+    }
+    const UINT width = manifest.width;
+    const UINT height = manifest.height;
+    const DXGI_FORMAT format = manifest.format;
+    const UINT32 slotCount = ring.slotCount;
+    if (width == 0 || height == 0 || get_bytes_per_pixel(format) == 0 ||
+        ring.magic != RING_MANIFEST_MAGIC || slotCount == 0 || slotCount > MAX_RING_SLOTS) {
+        return nullptr;
+    }
+
+#ifdef _WIN32
+    cons->pImpl->hProcess = OpenProcess(SYNCHRONIZE | PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+    if (!cons->pImpl->hProcess) { return nullptr; }
+#endif
+
+    UINT rowPitch = get_host_row_pitch(width, format);
+    cons->pImpl->slotSize = (size_t)rowPitch * height;
+    cons->pImpl->hostSlots = std::make_shared<Shm::Mapping>();
+    if (!cons->pImpl->hostSlots->open(textureName, cons->pImpl->slotSize * slotCount)) {
+        return nullptr;
+    }
+
+    // The shared texture is a read-only view that wait_for_frame retargets at the latest complete slot.
+    cons->pImpl->sharedTexture = std::shared_ptr<Texture>(new Texture());
+    auto& shared = *cons->pImpl->sharedTexture->pImpl;
+    shared.is_host = true;
+    shared.width = width;
+    shared.height = height;
+    shared.format = format;
+    shared.rowPitch = rowPitch;
+    shared.hostData = static_cast<uint8_t*>(cons->pImpl->hostSlots->data()) + Shm::load_acquire(&cons->pImpl->ring_manifest()->latestSlot) * cons->pImpl->slotSize;
+    shared.hostStorage = cons->pImpl->hostSlots;
+
+    return cons;
+}
+
+static CPU::Surface get_host_surface(const std::shared_ptr<Texture>& texture, const char* operation) {
+    if (!texture || !texture->get_host_ptr()) {
+        throw std::invalid_argument(std::string("Invalid host texture for DeviceCPU::") + operation + ". Check for null or incorrect API type.");
+    }
+    return { reinterpret_cast<uint8_t*>(texture->get_host_ptr()), texture->get_width(), texture->get_height(), texture->get_row_pitch(), texture->get_format() };
+}
+
+struct Fence::Impl {
+    std::shared_ptr<CPU::JobEvent> event;
+#ifdef _WIN32
+    ComPtr<ID3D12Fence> d3d12Fence;
+    ComPtr<ID3D11Fence> d3d11Fence;
+    UINT64 value = 0;
+#endif
+};
+Fence::Fence() : pImpl(std::make_unique<Impl>()) {}
+Fence::~Fence() = default;
+
+bool Fence::is_complete() const {
+    if (pImpl->event) return pImpl->event->is_complete();
+#ifdef _WIN32
+    if (pImpl->d3d12Fence) return pImpl->d3d12Fence->GetCompletedValue() >= pImpl->value;
+    if (pImpl->d3d11Fence) return pImpl->d3d11Fence->GetCompletedValue() >= pImpl->value;
+#endif
+    return true;
+}
+
+bool Fence::wait(uint32_t timeout_ms) {
+    if (pImpl->event) return pImpl->event->wait(timeout_ms);
+#ifdef _WIN32
+    if (is_complete()) return true;
+    HANDLE completion = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+    if (!completion) throw std::runtime_error("Failed to create event for Fence::wait.");
+    HRESULT hr = pImpl->d3d12Fence ? pImpl->d3d12Fence->SetEventOnCompletion(pImpl->value, completion)
+                                   : pImpl->d3d11Fence->SetEventOnCompletion(pImpl->value, completion);
+    // INFINITE_TIMEOUT has the value of INFINITE.
+    const DWORD result = SUCCEEDED(hr) ? WaitForSingleObject(completion, timeout_ms) : WAIT_FAILED;
+    CloseHandle(completion);
+    if (FAILED(hr)) throw std::runtime_error("Failed to wait on device fence. HRESULT: " + std::to_string(hr));
+    return result == WAIT_OBJECT_0;
+#else
+    return true;
+#endif
+}
+
+struct PreparedShader::Impl {
+    const IDirectXDevice* device = nullptr;
+    std::string entryPoint;
+    DXGI_FORMAT outputFormat = DXGI_FORMAT_UNKNOWN;
+    CPU::Kernel kernel;
+#ifdef _WIN32
+    ComPtr<ID3D11PixelShader> d3d11PS;
+    ComPtr<ID3D12PipelineState> d3d12PSO;
+#endif
+};
+PreparedShader::PreparedShader() : pImpl(std::make_unique<Impl>()) {}
+PreparedShader::~PreparedShader() = default;
+const std::string& PreparedShader::get_entry_point() const { return pImpl->entryPoint; }
+DXGI_FORMAT PreparedShader::get_output_format() const { return pImpl->outputFormat; }
+
+struct CommandList::Impl {
+    enum class OpType { Copy, Run, Blit, Clear };
+    struct Op {
+        Op(OpType type, std::shared_ptr<Texture> output) : type(type), output(std::move(output)) {}
+        OpType type;
+        std::shared_ptr<Texture> output;
+        std::vector<std::shared_ptr<Texture>> inputs;
+        std::shared_ptr<PreparedShader> shader;
+        std::shared_ptr<const std::vector<uint8_t>> constants;
+        uint32_t x = 0, y = 0, width = 0, height = 0;
+        float color[4] = {};
+    };
+
+    std::shared_ptr<IDirectXDevice> device;
+    std::vector<Op> ops;
+
+    // What submit() executes: indices into ops, and for each the positions in schedule it has to wait
+    // for. Worked out on the first submit after a change and reused while the list stays the same.
+    bool planned = false;
+    std::vector<size_t> schedule;
+    std::vector<std::vector<size_t>> waits;
+
+    void record(Op op) {
+        if (!op.output) throw std::invalid_argument("CommandList operations need an output texture.");
+        for (const auto& input : op.inputs) {
+            if (!input) throw std::invalid_argument("CommandList operations cannot take a null input texture.");
+        }
+        ops.push_back(std::move(op));
+        planned = false;
+    }
+
+    // Copies, clears and blits covering the whole texture replace their output without looking at it.
+    // Shader runs never count, since a CPU kernel may read the texture it writes.
+    static bool replaces_output(const Op& op) {
+        switch (op.type) {
+            case OpType::Copy:
+            case OpType::Clear: return true;
+            case OpType::Blit: return op.x == 0 && op.y == 0 && op.width >= op.output->get_width() && op.height >= op.output->get_height();
+            default: return false;
+        }
+    }
+
+    static bool reads(const Op& op, const Texture* texture) {
+        if (op.output.get() == texture && !replaces_output(op)) return true;
+        for (const auto& input : op.inputs) {
+            if (input.get() == texture) return true;
+        }
+        return false;
+    }
+
+    static bool conflicts(const Op& earlier, const Op& later) {
+        if (earlier.output == later.output) return true;
+        for (const auto& input : later.inputs) {
+            if (input == earlier.output) return true;
+        }
+        for (const auto& input : earlier.inputs) {
+            if (input == later.output) return true;
+        }
+        return false;
+    }
+
+    void plan() {
+        if (planned) return;
+        const size_t count = ops.size();
+        std::vector<bool> dead(count, false);
+        // Walking backwards, an operation is dead if a live later one replaces its output before any
+        // live one reads it. Copies onto themselves and empty blits do nothing at all.
+        for (size_t i = count; i-- > 0;) {
+            const Op& op = ops[i];
+            if ((op.type == OpType::Copy && op.inputs[0] == op.output) || (op.type == OpType::Blit && (op.width == 0 || op.height == 0))) {
+                dead[i] = true;
+                continue;
+            }
+            for (size_t j = i + 1; j < count; ++j) {
+                if (dead[j]) continue;
+                if (reads(ops[j], op.output.get())) break;
+                if (ops[j].output == op.output && replaces_output(ops[j])) {
+                    dead[i] = true;
+                    break;
                 }
             }
         }
+
+        schedule.clear();
+        waits.clear();
+        for (size_t i = 0; i < count; ++i) {
+            if (dead[i]) continue;
+            std::vector<size_t> before;
+            for (size_t k = 0; k < schedule.size(); ++k) {
+                if (conflicts(ops[schedule[k]], ops[i])) before.push_back(k);
+            }
+            schedule.push_back(i);
+            waits.push_back(std::move(before));
+        }
+        planned = true;
+    }
+};
+
+CommandList::CommandList(std::shared_ptr<IDirectXDevice> device) : pImpl(std::make_unique<Impl>()) { pImpl->device = std::move(device); }
+CommandList::~CommandList() = default;
+
+void CommandList::copy_texture(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination) {
+    if (!source) throw std::invalid_argument("CommandList::copy_texture needs a source texture.");
+    if (destination && (source->get_width() != destination->get_width() || source->get_height() != destination->get_height() ||
+                        source->get_format() != destination->get_format())) {
+        throw std::invalid_argument("Source and destination textures must have matching dimensions and format for CommandList::copy_texture.");
+    }
+    Impl::Op op(Impl::OpType::Copy, std::move(destination));
+    op.inputs.push_back(std::move(source));
+    pImpl->record(std::move(op));
+}
+
+void CommandList::run(std::shared_ptr<PreparedShader> shader, std::shared_ptr<Texture> output, const std::vector<std::shared_ptr<Texture>>& inputs,
+                      const void* constants, size_t constants_size) {
+    if (!shader || shader->pImpl->device != pImpl->device.get()) {
+        throw std::invalid_argument("CommandList::run needs a PreparedShader prepared on the list's device.");
+    }
+    const uint8_t* bytes = static_cast<const uint8_t*>(constants);
+    Impl::Op op(Impl::OpType::Run, std::move(output));
+    op.inputs = inputs;
+    op.shader = std::move(shader);
+    op.constants = std::make_shared<const std::vector<uint8_t>>(bytes, bytes + (bytes ? constants_size : 0));
+    pImpl->record(std::move(op));
+}
+
+void CommandList::apply_shader(std::shared_ptr<Texture> output, const std::vector<uint8_t>& shader_bytes, const std::string& entry_point,
+                               const std::vector<std::shared_ptr<Texture>>& inputs, const std::vector<uint8_t>& constants) {
+    if (!output) throw std::invalid_argument("CommandList operations need an output texture.");
+    auto shader = pImpl->device->prepare_shader(shader_bytes, entry_point, output->get_format());
+    run(std::move(shader), std::move(output), inputs, constants.data(), constants.size());
+}
+
+void CommandList::blit_texture_to_region(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination,
+                                         uint32_t dest_x, uint32_t dest_y, uint32_t dest_width, uint32_t dest_height) {
+    if (!source) throw std::invalid_argument("CommandList::blit_texture_to_region needs a source texture.");
+    Impl::Op op(Impl::OpType::Blit, std::move(destination));
+    op.inputs.push_back(std::move(source));
+    op.x = dest_x;
+    op.y = dest_y;
+    op.width = dest_width;
+    op.height = dest_height;
+    pImpl->record(std::move(op));
+}
+
+void CommandList::clear(std::shared_ptr<Texture> texture, float r, float g, float b, float a) {
+    Impl::Op op(Impl::OpType::Clear, std::move(texture));
+    op.color[0] = r;
+    op.color[1] = g;
+    op.color[2] = b;
+    op.color[3] = a;
+    pImpl->record(std::move(op));
+}
+
+size_t CommandList::size() const { return pImpl->ops.size(); }
+
+void CommandList::reset() {
+    pImpl->ops.clear();
+    pImpl->planned = false;
+}
+
+std::shared_ptr<Fence> CommandList::submit(const std::vector<std::shared_ptr<Fence>>& dependencies) {
+    return pImpl->device->submit(*this, dependencies);
+}
+
+std::shared_ptr<IDirectXDevice> CommandList::get_device() const { return pImpl->device; }
+
+struct DeviceCPU::Impl {
+    std::shared_ptr<ResourcePool> pool = std::make_shared<ResourcePool>(DEFAULT_POOL_BUDGET);
+    Cache::LruCache<CPU::Kernel> kernelCache;
+    std::atomic<uint64_t> kernelGeneration{0};
+
+    // Host fences join events as job dependencies; fences of D3D devices are waited on by the job itself.
+    std::shared_ptr<CPU::JobEvent> enqueue(std::function<void()> job, std::vector<std::shared_ptr<CPU::JobEvent>> events,
+                                           const std::vector<std::shared_ptr<Fence>>& dependencies) {
+        std::vector<std::shared_ptr<Fence>> deviceFences;
+        for (const auto& dependency : dependencies) {
+            if (!dependency) continue;
+            if (dependency->pImpl->event) events.push_back(dependency->pImpl->event);
+            else if (!dependency->is_complete()) deviceFences.push_back(dependency);
+        }
+        if (!deviceFences.empty()) {
+            job = [job = std::move(job), deviceFences] {
+                for (const auto& fence : deviceFences) fence->wait();
+                job();
+            };
+        }
+        return CPU::JobQueue::shared().submit(std::move(job), events);
+    }
+
+    std::shared_ptr<Fence> submit(std::function<void()> job, const std::vector<std::shared_ptr<Fence>>& dependencies) {
+        auto fence = std::shared_ptr<Fence>(new Fence());
+        fence->pImpl->event = enqueue(std::move(job), {}, dependencies);
+        return fence;
+    }
+};
+
+DeviceCPU::DeviceCPU() : pImpl(std::make_unique<Impl>()) {}
+DeviceCPU::~DeviceCPU() = default;
+std::shared_ptr<DeviceCPU> DeviceCPU::create() {
+    return std::shared_ptr<DeviceCPU>(new DeviceCPU());
+}
+
+std::shared_ptr<Texture> DeviceCPU::create_texture(uint32_t width, uint32_t height, DXGI_FORMAT format, const void* data, size_t data_size) {
+    if (width == 0 || height == 0 || get_bytes_per_pixel(format) == 0) {
+        throw std::invalid_argument("Invalid dimensions or unsupported DXGI_FORMAT for DeviceCPU::create_texture.");
+    }
+    auto texture = Texture::create_host(width, height, format);
+    if (data && data_size > 0) {
+        // Initial data is tightly packed, as for the D3D devices.
+        const size_t rowBytes = (size_t)width * get_bytes_per_pixel(format);
+        if (data_size < rowBytes * height) {
+            throw std::invalid_argument("Initial data is smaller than width * height * bytes-per-pixel for DeviceCPU::create_texture.");
+        }
+        CPU::Surface source = { static_cast<uint8_t*>(const_cast<void*>(data)), width, height, (uint32_t)rowBytes, format };
+        CPU::copy_surface(source, get_host_surface(texture, "create_texture"));
+    }
+    return texture;
+}
+
+std::shared_ptr<Producer> DeviceCPU::create_producer(const std::string& stream_name, std::shared_ptr<Texture> texture) {
+    CPU::Surface surface = get_host_surface(texture, "create_producer");
+    auto prod = create_host_producer(stream_name, surface.width, surface.height, surface.format);
+    // Frames are published straight from the caller's texture, which has the same pitch as a slot.
+    prod->pImpl->sourceTexture = texture;
+    return prod;
+}
+
+std::shared_ptr<Consumer> DeviceCPU::connect_to_producer(unsigned long pid, const std::string& stream_name) {
+    return connect_to_host_producer(pid, stream_name);
+}
+
+std::shared_ptr<Window> DeviceCPU::create_window(uint32_t, uint32_t, const std::string&) {
+    throw std::runtime_error("DeviceCPU does not support windows.");
+}
+
+void DeviceCPU::resize_window(std::shared_ptr<Window>) {
+    throw std::runtime_error("DeviceCPU does not support windows.");
+}
+
+// Shaders are resolved to registered native kernels: by entry point first, then by treating the
+// shader bytes as a kernel name so HLSL-free callers can pass the name alone.
+std::shared_ptr<PreparedShader> DeviceCPU::prepare_shader(const std::vector<uint8_t>& shader_bytes, const std::string& entry_point, DXGI_FORMAT output_format) {
+    // Resolved kernels are cached like compiled shaders and dropped whenever the registry changes.
+    const uint64_t generation = CPU::get_kernel_generation();
+    if (pImpl->kernelGeneration.exchange(generation) != generation) pImpl->kernelCache.clear();
+    const uint64_t key = Cache::hash_shader(shader_bytes, entry_point, output_format);
+    CPU::Kernel kernel;
+    if (!pImpl->kernelCache.find(key, kernel)) {
+        kernel = CPU::find_kernel(entry_point);
+        if (!kernel && !shader_bytes.empty() && shader_bytes.size() <= 256) {
+            kernel = CPU::find_kernel(std::string(shader_bytes.begin(), shader_bytes.end()));
+        }
+        if (!kernel) {
+            throw std::runtime_error("DeviceCPU cannot compile shaders and has no native kernel for entry point '" + entry_point + "'.");
+        }
+        pImpl->kernelCache.insert(key, kernel);
+    }
+    auto shader = std::shared_ptr<PreparedShader>(new PreparedShader());
+    shader->pImpl->device = this;
+    shader->pImpl->entryPoint = entry_point;
+    shader->pImpl->outputFormat = output_format;
+    shader->pImpl->kernel = std::move(kernel);
+    return shader;
+}
+
+// A prepared shader keeps the kernel it resolved to, even if the name is re-registered afterwards.
+void DeviceCPU::run(const PreparedShader& shader, std::shared_ptr<Texture> output, const std::vector<std::shared_ptr<Texture>>& inputs, const void* constants, size_t constants_size) {
+    if (shader.pImpl->device != this) {
+        throw std::invalid_argument("PreparedShader was prepared on a different device.");
+    }
+    CPU::Surface target = get_host_surface(output, "run");
+    std::vector<CPU::Surface> sources;
+    sources.reserve(inputs.size());
+    for (const auto& input : inputs) sources.push_back(get_host_surface(input, "run"));
+    CPU::run_kernel(shader.pImpl->kernel, target, sources, static_cast<const uint8_t*>(constants), constants_size);
+}
+
+void DeviceCPU::apply_shader(std::shared_ptr<Texture> output, const std::vector<uint8_t>& shader_bytes, const std::string& entry_point, const std::vector<std::shared_ptr<Texture>>& inputs, const std::vector<uint8_t>& constants) {
+    CPU::Surface target = get_host_surface(output, "apply_shader");
+    run(*prepare_shader(shader_bytes, entry_point, target.format), output, inputs, constants.data(), constants.size());
+}
+
+// Surfaces and constants are captured at submission, so argument errors still throw here.
+std::shared_ptr<Fence> DeviceCPU::run_async(const PreparedShader& shader, std::shared_ptr<Texture> output, const std::vector<std::shared_ptr<Texture>>& inputs,
+                                            const void* constants, size_t constants_size, const std::vector<std::shared_ptr<Fence>>& dependencies) {
+    if (shader.pImpl->device != this) {
+        throw std::invalid_argument("PreparedShader was prepared on a different device.");
     }
-    return false;
+    CPU::Surface target = get_host_surface(output, "run_async");
+    std::vector<CPU::Surface> sources;
+    sources.reserve(inputs.size());
+    for (const auto& input : inputs) sources.push_back(get_host_surface(input, "run_async"));
+    const uint8_t* bytes = static_cast<const uint8_t*>(constants);
+    std::vector<uint8_t> blob(bytes, bytes + (bytes ? constants_size : 0));
+    return pImpl->submit([kernel = shader.pImpl->kernel, target, sources = std::move(sources), blob = std::move(blob), output, inputs] {
+        CPU::run_kernel(kernel, target, sources, blob);
+    }, dependencies);
 }
 
-struct Producer::Impl {
-    ComPtr<ID3D11Fence> d3d11Fence;
-    ComPtr<ID3D12Fence> d3d12Fence;
-    UINT64 frameValue = 0;
-    HANDLE hManifest = nullptr;
-    BroadcastManifest* pManifestView = nullptr;
-    HANDLE hTextureHandle = nullptr;
-    HANDLE hFenceHandle = nullptr;
-    void* pDeviceContext = nullptr;
-    std::shared_ptr<Texture> sourceTexture;
-    bool is_d3d11_producer = false;
-};
-Producer::Producer() : pImpl(std::make_unique<Impl>()) {}
-Producer::~Producer() {
-    if (pImpl->pManifestView) UnmapViewOfFile(pImpl->pManifestView);
-    if (pImpl->hManifest) CloseHandle(pImpl->hManifest);
-    if (pImpl->hTextureHandle) CloseHandle(pImpl->hTextureHandle);
-    if (pImpl->hFenceHandle) CloseHandle(pImpl->hFenceHandle);
-}
-void Producer::signal_frame() {
-    pImpl->frameValue++;
-    if (pImpl->is_d3d11_producer && pImpl->d3d11Fence) {
-        reinterpret_cast<ID3D11DeviceContext4*>(pImpl->pDeviceContext)->Signal(pImpl->d3d11Fence.Get(), pImpl->frameValue);
-    } else if (!pImpl->is_d3d11_producer && pImpl->d3d12Fence) {
-        reinterpret_cast<ID3D12CommandQueue*>(pImpl->pDeviceContext)->Signal(pImpl->d3d12Fence.Get(), pImpl->frameValue);
+std::shared_ptr<Fence> DeviceCPU::copy_texture_async(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination, const std::vector<std::shared_ptr<Fence>>& dependencies) {
+    CPU::Surface src = get_host_surface(source, "copy_texture_async");
+    CPU::Surface dst = get_host_surface(destination, "copy_texture_async");
+    if (src.width != dst.width || src.height != dst.height || src.format != dst.format) {
+        throw std::invalid_argument("Source and destination textures must have matching dimensions and format for DeviceCPU::copy_texture_async.");
     }
+    return pImpl->submit([src, dst, source, destination] { CPU::copy_surface(src, dst); }, dependencies);
+}
 
-    if (pImpl->pManifestView) {
-        InterlockedExchange64(reinterpret_cast<volatile LONGLONG*>(&pImpl->pManifestView->frameValue), pImpl->frameValue);
-        if (!pImpl->is_d3d11_producer) {
-            WakeByAddressAll(&pImpl->pManifestView->frameValue);
+std::shared_ptr<Fence> DeviceCPU::blit_texture_to_region_async(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination,
+                                                               uint32_t dest_x, uint32_t dest_y, uint32_t dest_width, uint32_t dest_height,
+                                                               const std::vector<std::shared_ptr<Fence>>& dependencies) {
+    CPU::Surface src = get_host_surface(source, "blit_texture_to_region_async");
+    CPU::Surface dst = get_host_surface(destination, "blit_texture_to_region_async");
+    return pImpl->submit([src, dst, dest_x, dest_y, dest_width, dest_height, source, destination] {
+        CPU::blit_bilinear(src, dst, dest_x, dest_y, dest_width, dest_height);
+    }, dependencies);
+}
+
+std::shared_ptr<CommandList> DeviceCPU::create_command_list() {
+    return std::shared_ptr<CommandList>(new CommandList(shared_from_this()));
+}
+
+// Each operation becomes a job that waits only for the earlier operations it shares a texture with,
+// so independent branches of the list run side by side on the job queue.
+std::shared_ptr<Fence> DeviceCPU::submit(const CommandList& list, const std::vector<std::shared_ptr<Fence>>& dependencies) {
+    auto& impl = *list.pImpl;
+    if (impl.device.get() != this) {
+        throw std::invalid_argument("CommandList was created on a different device.");
+    }
+    impl.plan();
+
+    // Everything is resolved before the first job is queued, so a bad texture leaves nothing half-submitted.
+    std::vector<std::function<void()>> jobs;
+    jobs.reserve(impl.schedule.size());
+    for (size_t index : impl.schedule) {
+        const CommandList::Impl::Op& op = impl.ops[index];
+        CPU::Surface target = get_host_surface(op.output, "submit");
+        std::vector<CPU::Surface> sources;
+        sources.reserve(op.inputs.size());
+        for (const auto& input : op.inputs) sources.push_back(get_host_surface(input, "submit"));
+        switch (op.type) {
+            case CommandList::Impl::OpType::Copy:
+                jobs.push_back([src = sources[0], target, output = op.output, inputs = op.inputs] { CPU::copy_surface(src, target); });
+                break;
+            case CommandList::Impl::OpType::Run:
+                jobs.push_back([kernel = op.shader->pImpl->kernel, target, sources = std::move(sources), constants = op.constants, output = op.output, inputs = op.inputs] {
+                    CPU::run_kernel(kernel, target, sources, *constants);
+                });
+                break;
+            case CommandList::Impl::OpType::Blit:
+                jobs.push_back([src = sources[0], target, x = op.x, y = op.y, width = op.width, height = op.height, output = op.output, inputs = op.inputs] {
+                    CPU::blit_bilinear(src, target, x, y, width, height);
+                });
+                break;
+            case CommandList::Impl::OpType::Clear:
+                jobs.push_back([target, color = CPU::Pixel{ op.color[0], op.color[1], op.color[2], op.color[3] }, output = op.output] {
+                    CPU::fill_surface(target, color);
+                });
+                break;
         }
     }
+
+    std::vector<std::shared_ptr<CPU::JobEvent>> events;
+    events.reserve(jobs.size());
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        std::vector<std::shared_ptr<CPU::JobEvent>> waits;
+        for (size_t position : impl.waits[i]) waits.push_back(events[position]);
+        events.push_back(pImpl->enqueue(std::move(jobs[i]), std::move(waits), dependencies));
+    }
+    // The list's fence inherits the error of any operation that failed.
+    auto fence = std::shared_ptr<Fence>(new Fence());
+    fence->pImpl->event = pImpl->enqueue([] {}, std::move(events), dependencies);
+    return fence;
+}
+
+void DeviceCPU::copy_texture(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination) {
+    CPU::Surface src = get_host_surface(source, "copy_texture");
+    CPU::Surface dst = get_host_surface(destination, "copy_texture");
+    if (src.width != dst.width || src.height != dst.height || src.format != dst.format) {
+        throw std::invalid_argument("Source and destination textures must have matching dimensions and format for DeviceCPU::copy_texture.");
+    }
+    CPU::copy_surface(src, dst);
+}
+
+void DeviceCPU::blit(std::shared_ptr<Texture>, std::shared_ptr<Window>) {
+    throw std::runtime_error("DeviceCPU does not support windows.");
+}
+
+void DeviceCPU::clear(std::shared_ptr<Window>, float, float, float, float) {
+    throw std::runtime_error("DeviceCPU does not support windows.");
+}
+
+void DeviceCPU::blit_texture_to_region(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination,
+                                       uint32_t dest_x, uint32_t dest_y, uint32_t dest_width, uint32_t dest_height) {
+    CPU::Surface src = get_host_surface(source, "blit_texture_to_region");
+    CPU::Surface dst = get_host_surface(destination, "blit_texture_to_region");
+    CPU::blit_bilinear(src, dst, dest_x, dest_y, dest_width, dest_height);
 }
 
+std::shared_ptr<Texture> DeviceCPU::acquire_texture(uint32_t width, uint32_t height, DXGI_FORMAT format) {
+    return acquire_pooled_texture(*this, pImpl->pool, width, height, format);
+}
+
+void DeviceCPU::set_pool_budget(uint64_t bytes) { pImpl->pool->set_budget(bytes); }
+PoolStats DeviceCPU::get_pool_stats() { return pImpl->pool->get_stats(); }
+void DeviceCPU::set_shader_cache_capacity(size_t entries) { pImpl->kernelCache.set_capacity(entries); }
+ShaderCacheStats DeviceCPU::get_shader_cache_stats() { return pImpl->kernelCache.get_stats(); }
+
+#ifdef _WIN32
 LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
     if (uMsg == WM_DESTROY) { PostQuitMessage(0); return 0; }
     return DefWindowProcW(hwnd, uMsg, wParam, lParam);
@@ -265,8 +1945,32 @@ struct DeviceD3D11::Impl {
     ComPtr<ID3D11PixelShader> blitPS;
     ComPtr<ID3D11SamplerState> blitSampler;
 
-    std::map<std::vector<uint8_t>, ComPtr<ID3D11PixelShader>> shaderCache;
+    Cache::LruCache<ComPtr<ID3D11PixelShader>> shaderCache;
     LUID adapterLuid = {};
+    std::shared_ptr<ResourcePool> pool = std::make_shared<ResourcePool>(DEFAULT_POOL_BUDGET);
+
+    // Signalled after every async op; the immediate context executes in order, so one fence covers all.
+    ComPtr<ID3D11Fence> queueFence;
+    UINT64 queueFenceValue = 0;
+
+    // Fences of this context are already ordered. Others cannot be waited on by the context unless
+    // opened on this device, so they are waited on here.
+    void wait_for(const std::vector<std::shared_ptr<Fence>>& dependencies) {
+        for (const auto& dependency : dependencies) {
+            if (!dependency || dependency->pImpl->d3d11Fence.Get() == queueFence.Get()) continue;
+            dependency->wait();
+        }
+    }
+
+    // Flushes so the signal is submitted even if nothing else follows.
+    std::shared_ptr<Fence> signal() {
+        context4->Signal(queueFence.Get(), ++queueFenceValue);
+        context->Flush();
+        auto fence = std::shared_ptr<Fence>(new Fence());
+        fence->pImpl->d3d11Fence = queueFence;
+        fence->pImpl->value = queueFenceValue;
+        return fence;
+    }
 };
 
 DeviceD3D11::DeviceD3D11() : pImpl(std::make_unique<Impl>()) {}
@@ -285,6 +1989,8 @@ std::shared_ptr<DeviceD3D11> DeviceD3D11::create() {
     self->pImpl->device.As(&self->pImpl->device5);
     self->pImpl->context.As(&self->pImpl->context4);
     if (!self->pImpl->device5 || !self->pImpl->context4) throw std::runtime_error("D3D11.5 interfaces (required for fences) not supported.");
+    hr = self->pImpl->device5->CreateFence(0, D3D11_FENCE_FLAG_NONE, IID_PPV_ARGS(&self->pImpl->queueFence));
+    if (FAILED(hr)) throw std::runtime_error("Failed to create D3D11 queue fence. HRESULT: " + std::to_string(hr));
 
     ComPtr<IDXGIDevice> dxgiDevice;
     self->pImpl->device.As(&dxgiDevice);
@@ -295,9 +2001,9 @@ std::shared_ptr<DeviceD3D11> DeviceD3D11::create() {
     self->pImpl->adapterLuid = desc.AdapterLuid;
     
     ComPtr<ID3DBlob> vsBlob, psBlob;
-    HRESULT compile_hr = D3DCompile(g_blitShaderHLSL, strlen(g_blitShaderHLSL), nullptr, nullptr, nullptr, "VSMain", "vs_5_0", 0, 0, &vsBlob, nullptr);
+    HRESULT compile_hr = compile_shader_cached(g_blitShaderHLSL, strlen(g_blitShaderHLSL), "VSMain", "vs_5_0", 0, vsBlob);
     if (FAILED(compile_hr)) throw std::runtime_error("Failed to compile internal blit VS. HRESULT: " + std::to_string(compile_hr));
-    compile_hr = D3DCompile(g_blitShaderHLSL, strlen(g_blitShaderHLSL), nullptr, nullptr, nullptr, "PSMain", "ps_5_0", 0, 0, &psBlob, nullptr);
+    compile_hr = compile_shader_cached(g_blitShaderHLSL, strlen(g_blitShaderHLSL), "PSMain", "ps_5_0", 0, psBlob);
     if (FAILED(compile_hr)) throw std::runtime_error("Failed to compile internal blit PS. HRESULT: " + std::to_string(compile_hr));
 
     self->pImpl->device->CreateVertexShader(vsBlob->GetBufferPointer(), vsBlob->GetBufferSize(), nullptr, &self->pImpl->blitVS);
@@ -406,7 +2112,9 @@ std::shared_ptr<Producer> DeviceD3D11::create_producer(const std::string& stream
     std::wstring w_stream_name = string_to_wstring(stream_name);
     std::wstring textureName = L"Global\\DirectPort_Texture_" + std::to_wstring(pid) + L"_" + w_stream_name;
     std::wstring fenceName = L"Global\\DirectPort_Fence_" + std::to_wstring(pid) + L"_" + w_stream_name;
-    std::wstring manifestName = L"DirectPort_Producer_Manifest_" + std::to_wstring(pid);
+    auto streamRegistry = StreamRegistry::get();
+    std::wstring manifestName = string_to_wstring(streamRegistry->claim("DirectPort_Producer_Manifest_", stream_name, textureName, prod->pImpl->streamIndex));
+    prod->pImpl->streamRegistry = streamRegistry;
 
     ComPtr<IDXGIResource1> dxgiResource;
     sharedTextureForHandle.As(&dxgiResource);
@@ -415,21 +2123,40 @@ std::shared_ptr<Producer> DeviceD3D11::create_producer(const std::string& stream
 
     hr = prod->pImpl->d3d11Fence->CreateSharedHandle(&sa, GENERIC_ALL, fenceName.c_str(), &prod->pImpl->hFenceHandle);
     if (FAILED(hr)) { CloseHandle(prod->pImpl->hTextureHandle); LocalFree(sd); throw std::runtime_error("Failed to create shared handle for fence. HRESULT: " + std::to_string(hr)); }
+
+    for (UINT32 i = 0; i < DEFAULT_RING_SLOTS; ++i) {
+        ComPtr<ID3D11Texture2D> slotTexture;
+        hr = pImpl->device->CreateTexture2D(&sharedTexDesc, nullptr, &slotTexture);
+        if (FAILED(hr)) { LocalFree(sd); throw std::runtime_error("Failed to create D3D11 ring slot texture. HRESULT: " + std::to_string(hr)); }
+        ComPtr<IDXGIResource1> slotResource;
+        slotTexture.As(&slotResource);
+        HANDLE hSlot = nullptr;
+        hr = slotResource->CreateSharedHandle(&sa, GENERIC_ALL, get_slot_texture_name(textureName, i).c_str(), &hSlot);
+        if (FAILED(hr)) { LocalFree(sd); throw std::runtime_error("Failed to create shared handle for ring slot texture. HRESULT: " + std::to_string(hr)); }
+        prod->pImpl->hSlotHandles.push_back(hSlot);
+        prod->pImpl->d3d11SlotTextures.push_back(slotTexture);
+    }
     
-    prod->pImpl->hManifest = CreateFileMappingW(INVALID_HANDLE_VALUE, &sa, PAGE_READWRITE, 0, sizeof(BroadcastManifest), manifestName.c_str());
+    prod->pImpl->hManifest = CreateFileMappingW(INVALID_HANDLE_VALUE, &sa, PAGE_READWRITE, 0, sizeof(ProducerManifest), manifestName.c_str());
     LocalFree(sd);
     if (!prod->pImpl->hManifest) { CloseHandle(prod->pImpl->hTextureHandle); CloseHandle(prod->pImpl->hFenceHandle); throw std::runtime_error("Failed to create file mapping for manifest. GetLastError: " + std::to_string(GetLastError())); }
     
-    prod->pImpl->pManifestView = (BroadcastManifest*)MapViewOfFile(prod->pImpl->hManifest, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(BroadcastManifest));
+    prod->pImpl->pManifestView = (BroadcastManifest*)MapViewOfFile(prod->pImpl->hManifest, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(ProducerManifest));
     if (!prod->pImpl->pManifestView) { CloseHandle(prod->pImpl->hTextureHandle); CloseHandle(prod->pImpl->hFenceHandle); CloseHandle(prod->pImpl->hManifest); throw std::runtime_error("Failed to map view of file for manifest. GetLastError: " + std::to_string(GetLastError())); }
     
-    ZeroMemory(prod->pImpl->pManifestView, sizeof(BroadcastManifest));
+    ZeroMemory(prod->pImpl->pManifestView, sizeof(ProducerManifest));
+    prod->pImpl->pRingView = &reinterpret_cast<ProducerManifest*>(prod->pImpl->pManifestView)->ring;
+    prod->pImpl->pMetadataView = reinterpret_cast<ProducerManifest*>(prod->pImpl->pManifestView)->metadata;
+    prod->pImpl->pStatsView = &reinterpret_cast<ProducerManifest*>(prod->pImpl->pManifestView)->stats;
+    init_ring_manifest(*prod->pImpl->pRingView, DEFAULT_RING_SLOTS);
+    begin_manifest_write(*prod->pImpl->pRingView);
     prod->pImpl->pManifestView->width = texture->get_width();
     prod->pImpl->pManifestView->height = texture->get_height();
     prod->pImpl->pManifestView->format = texture->get_format();
     prod->pImpl->pManifestView->adapterLuid = pImpl->adapterLuid;
     wcscpy_s(prod->pImpl->pManifestView->textureName, _countof(prod->pImpl->pManifestView->textureName), textureName.c_str());
     wcscpy_s(prod->pImpl->pManifestView->fenceName, _countof(prod->pImpl->pManifestView->fenceName), fenceName.c_str());
+    end_manifest_write(*prod->pImpl->pRingView);
 
     texture->pImpl->d3d11Texture = sharedTextureForHandle; 
     hr = pImpl->device->CreateShaderResourceView(sharedTextureForHandle.Get(), nullptr, &texture->pImpl->d3d11SRV);
@@ -440,13 +2167,14 @@ std::shared_ptr<Producer> DeviceD3D11::create_producer(const std::string& stream
     return prod;
 }
 
-std::shared_ptr<Consumer> DeviceD3D11::connect_to_producer(unsigned long pid) {
+std::shared_ptr<Consumer> DeviceD3D11::connect_to_producer(unsigned long pid, const std::string& stream_name) {
     auto cons = std::shared_ptr<Consumer>(new Consumer());
     cons->pImpl->pid = pid;
     cons->pImpl->pDeviceContext = pImpl->context4.Get();
 
     BroadcastManifest manifest;
-    if (!get_manifest_from_pid(pid, manifest)) {
+    RingManifest ring = {};
+    if (!open_manifest(pid, stream_name, *cons->pImpl->manifest) || !read_manifest(*cons->pImpl->manifest, manifest, &ring)) {
         return nullptr;
     }
 
@@ -495,6 +2223,33 @@ std::shared_ptr<Consumer> DeviceD3D11::connect_to_producer(unsigned long pid) {
         if (FAILED(hr)) { CloseHandle(hTexture); CloseHandle(cons->pImpl->hProcess); return nullptr; }
     }
     CloseHandle(hTexture);
+
+    if (ring.magic == RING_MANIFEST_MAGIC) {
+        ComPtr<ID3D12Device> tempD3D12Device;
+        if (!cons->pImpl->is_d3d11_producer) D3D12CreateDevice(nullptr, D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&tempD3D12Device));
+        for (UINT32 i = 0; i < ring.slotCount; ++i) {
+            HANDLE hSlot = get_handle_from_name(get_slot_texture_name(manifest.textureName, i).c_str());
+            if (!hSlot) break;
+            if (cons->pImpl->is_d3d11_producer) {
+                ComPtr<ID3D11Texture2D> slotTexture;
+                ComPtr<ID3D11ShaderResourceView> slotSRV;
+                hr = pImpl->device1->OpenSharedResource1(hSlot, IID_PPV_ARGS(&slotTexture));
+                if (SUCCEEDED(hr)) hr = pImpl->device->CreateShaderResourceView(slotTexture.Get(), nullptr, &slotSRV);
+                if (SUCCEEDED(hr)) { cons->pImpl->d3d11SlotTextures.push_back(slotTexture); cons->pImpl->d3d11SlotSRVs.push_back(slotSRV); }
+            } else {
+                ComPtr<ID3D12Resource> slotResource;
+                hr = tempD3D12Device ? tempD3D12Device->OpenSharedHandle(hSlot, IID_PPV_ARGS(&slotResource)) : E_FAIL;
+                if (SUCCEEDED(hr)) cons->pImpl->d3d12SlotResources.push_back(slotResource);
+            }
+            CloseHandle(hSlot);
+            if (FAILED(hr)) break;
+        }
+        if (cons->pImpl->d3d11SlotTextures.size() + cons->pImpl->d3d12SlotResources.size() != ring.slotCount) {
+            cons->pImpl->d3d11SlotTextures.clear();
+            cons->pImpl->d3d11SlotSRVs.clear();
+            cons->pImpl->d3d12SlotResources.clear();
+        }
+    }
     
     cons->pImpl->sharedTexture->pImpl->width = manifest.width;
     cons->pImpl->sharedTexture->pImpl->height = manifest.height;
@@ -519,11 +2274,7 @@ void DeviceD3D11::copy_texture(std::shared_ptr<Texture> source, std::shared_ptr<
     pImpl->context->CopyResource(destination->pImpl->d3d11Texture.Get(), source->pImpl->d3d11Texture.Get());
 }
 
-void DeviceD3D11::apply_shader(std::shared_ptr<Texture> output, const std::vector<uint8_t>& shader_bytes, const std::string& entry_point, const std::vector<std::shared_ptr<Texture>>& inputs, const std::vector<uint8_t>& constants) {
-    if (!output || !output->pImpl->is_d3d11 || !output->pImpl->d3d11RTV) {
-        throw std::invalid_argument("Invalid D3D11 output texture for apply_shader (must be D3D11 and have RTV).");
-    }
-
+std::shared_ptr<PreparedShader> DeviceD3D11::prepare_shader(const std::vector<uint8_t>& shader_bytes, const std::string& entry_point, DXGI_FORMAT output_format) {
     ComPtr<ID3D11PixelShader> ps;
     if (shader_bytes.empty() || (shader_bytes.size() == 1 && shader_bytes[0] == '\0')) {
         static ComPtr<ID3D11PixelShader> defaultBlackPS;
@@ -535,12 +2286,13 @@ void DeviceD3D11::apply_shader(std::shared_ptr<Texture> output, const std::vecto
         }
         ps = defaultBlackPS;
     } else {
-        auto it = pImpl->shaderCache.find(shader_bytes);
-        if (it != pImpl->shaderCache.end()) {
-            ps = it->second;
-        } else {
+        // D3D11 pixel shaders do not depend on the render target format, so it is left out of the key.
+        const uint64_t key = Cache::hash_shader(shader_bytes, entry_point, DXGI_FORMAT_UNKNOWN);
+        if (!pImpl->shaderCache.find(key, ps)) {
             ComPtr<ID3DBlob> psBlob, errorBlob;
-            HRESULT hr = D3DCompile(shader_bytes.data(), shader_bytes.size(), "hlsl_shader", nullptr, nullptr, entry_point.c_str(), "ps_5_0", D3DCOMPILE_ENABLE_STRICTNESS, 0, &psBlob, &errorBlob);
+            bool fromDisk = false;
+            HRESULT hr = compile_shader_cached(shader_bytes.data(), shader_bytes.size(), entry_point.c_str(), "ps_5_0", D3DCOMPILE_ENABLE_STRICTNESS, psBlob, &errorBlob, &fromDisk);
+            if (fromDisk) pImpl->shaderCache.note_disk_hit();
             if (SUCCEEDED(hr)) {
                 hr = pImpl->device->CreatePixelShader(psBlob->GetBufferPointer(), psBlob->GetBufferSize(), nullptr, &ps);
                 if (FAILED(hr)) { throw std::runtime_error("Failed to create pixel shader from HLSL blob. HRESULT: " + std::to_string(hr)); }
@@ -551,22 +2303,45 @@ void DeviceD3D11::apply_shader(std::shared_ptr<Texture> output, const std::vecto
                      else throw std::runtime_error("Failed to create pixel shader from HLSL or CSO bytes. HRESULT: " + std::to_string(hr));
                 }
             }
-            pImpl->shaderCache[shader_bytes] = ps;
+            pImpl->shaderCache.insert(key, ps);
         }
     }
 
+    auto shader = std::shared_ptr<PreparedShader>(new PreparedShader());
+    shader->pImpl->device = this;
+    shader->pImpl->entryPoint = entry_point;
+    shader->pImpl->outputFormat = output_format;
+    shader->pImpl->d3d11PS = std::move(ps);
+    return shader;
+}
+
+void DeviceD3D11::apply_shader(std::shared_ptr<Texture> output, const std::vector<uint8_t>& shader_bytes, const std::string& entry_point, const std::vector<std::shared_ptr<Texture>>& inputs, const std::vector<uint8_t>& constants) {
+    if (!output || !output->pImpl->is_d3d11 || !output->pImpl->d3d11RTV) {
+        throw std::invalid_argument("Invalid D3D11 output texture for apply_shader (must be D3D11 and have RTV).");
+    }
+    run(*prepare_shader(shader_bytes, entry_point, output->get_format()), output, inputs, constants.data(), constants.size());
+}
+
+void DeviceD3D11::run(const PreparedShader& shader, std::shared_ptr<Texture> output, const std::vector<std::shared_ptr<Texture>>& inputs, const void* constants, size_t constants_size) {
+    if (shader.pImpl->device != this || !shader.pImpl->d3d11PS) {
+        throw std::invalid_argument("PreparedShader was prepared on a different device.");
+    }
+    if (!output || !output->pImpl->is_d3d11 || !output->pImpl->d3d11RTV) {
+        throw std::invalid_argument("Invalid D3D11 output texture for run (must be D3D11 and have RTV).");
+    }
+
     D3D11_VIEWPORT vp = { 0.0f, 0.0f, (float)output->get_width(), (float)output->get_height(), 0.0f, 1.0f };
     pImpl->context->RSSetViewports(1, &vp);
     ID3D11RenderTargetView* rtv = output->pImpl->d3d11RTV.Get();
     pImpl->context->OMSetRenderTargets(1, &rtv, nullptr);
     pImpl->context->VSSetShader(pImpl->blitVS.Get(), nullptr, 0);
-    pImpl->context->PSSetShader(ps.Get(), nullptr, 0);
+    pImpl->context->PSSetShader(shader.pImpl->d3d11PS.Get(), nullptr, 0);
 
     std::vector<ID3D11ShaderResourceView*> srvs;
     srvs.reserve(inputs.size());
     for(const auto& input : inputs) {
         if (!input || !input->pImpl->is_d3d11 || !input->pImpl->d3d11SRV) {
-            throw std::invalid_argument("Invalid D3D11 input texture provided for apply_shader (must be D3D11 and have SRV).");
+            throw std::invalid_argument("Invalid D3D11 input texture provided for run (must be D3D11 and have SRV).");
         }
         srvs.push_back(input->pImpl->d3d11SRV.Get());
     }
@@ -575,22 +2350,27 @@ void DeviceD3D11::apply_shader(std::shared_ptr<Texture> output, const std::vecto
         pImpl->context->PSSetSamplers(0, 1, pImpl->blitSampler.GetAddressOf());
     }
 
-    if (!constants.empty()) {
-        ComPtr<ID3D11Buffer> cb;
-        D3D11_BUFFER_DESC desc = {};
-        desc.ByteWidth = static_cast<UINT>((constants.size() + 15) & ~15); 
-        desc.Usage = D3D11_USAGE_DYNAMIC;
-        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-        desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-        HRESULT hr = pImpl->device->CreateBuffer(&desc, nullptr, &cb);
-        if (FAILED(hr)) { throw std::runtime_error("Failed to create constant buffer for apply_shader. HRESULT: " + std::to_string(hr)); }
+    std::shared_ptr<ComPtr<ID3D11Buffer>> cb;
+    if (constants && constants_size > 0) {
+        const UINT byteWidth = static_cast<UINT>((constants_size + 15) & ~15);
+        cb = acquire_pooled<ComPtr<ID3D11Buffer>>(pImpl->pool, { PoolResource::ConstantBuffer, byteWidth, 1, 0 }, byteWidth, [&] {
+            auto buffer = std::make_shared<ComPtr<ID3D11Buffer>>();
+            D3D11_BUFFER_DESC desc = {};
+            desc.ByteWidth = byteWidth;
+            desc.Usage = D3D11_USAGE_DYNAMIC;
+            desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+            desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+            HRESULT hr = pImpl->device->CreateBuffer(&desc, nullptr, buffer->GetAddressOf());
+            if (FAILED(hr)) { throw std::runtime_error("Failed to create constant buffer for apply_shader. HRESULT: " + std::to_string(hr)); }
+            return buffer;
+        });
 
         D3D11_MAPPED_SUBRESOURCE mapped;
-        hr = pImpl->context->Map(cb.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+        HRESULT hr = pImpl->context->Map(cb->Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
         if (FAILED(hr)) { throw std::runtime_error("Failed to map constant buffer for apply_shader. HRESULT: " + std::to_string(hr)); }
-        memcpy(mapped.pData, constants.data(), constants.size());
-        pImpl->context->Unmap(cb.Get(), 0);
-        pImpl->context->PSSetConstantBuffers(0, 1, cb.GetAddressOf());
+        memcpy(mapped.pData, constants, constants_size);
+        pImpl->context->Unmap(cb->Get(), 0);
+        pImpl->context->PSSetConstantBuffers(0, 1, cb->GetAddressOf());
     }
     
     pImpl->context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
@@ -732,6 +2512,80 @@ void DeviceD3D11::blit_texture_to_region(std::shared_ptr<Texture> source, std::s
     pImpl->context->PSSetShaderResources(0, 1, nullSRV);
 }
 
+std::shared_ptr<Fence> DeviceD3D11::run_async(const PreparedShader& shader, std::shared_ptr<Texture> output, const std::vector<std::shared_ptr<Texture>>& inputs,
+                                              const void* constants, size_t constants_size, const std::vector<std::shared_ptr<Fence>>& dependencies) {
+    pImpl->wait_for(dependencies);
+    run(shader, output, inputs, constants, constants_size);
+    return pImpl->signal();
+}
+
+std::shared_ptr<Fence> DeviceD3D11::copy_texture_async(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination, const std::vector<std::shared_ptr<Fence>>& dependencies) {
+    pImpl->wait_for(dependencies);
+    copy_texture(source, destination);
+    return pImpl->signal();
+}
+
+std::shared_ptr<Fence> DeviceD3D11::blit_texture_to_region_async(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination,
+                                                                 uint32_t dest_x, uint32_t dest_y, uint32_t dest_width, uint32_t dest_height,
+                                                                 const std::vector<std::shared_ptr<Fence>>& dependencies) {
+    pImpl->wait_for(dependencies);
+    blit_texture_to_region(source, destination, dest_x, dest_y, dest_width, dest_height);
+    return pImpl->signal();
+}
+
+std::shared_ptr<CommandList> DeviceD3D11::create_command_list() {
+    return std::shared_ptr<CommandList>(new CommandList(shared_from_this()));
+}
+
+// The immediate context already serializes commands and tracks hazards itself, so the list is replayed
+// in order and covered by one signal.
+std::shared_ptr<Fence> DeviceD3D11::submit(const CommandList& list, const std::vector<std::shared_ptr<Fence>>& dependencies) {
+    auto& impl = *list.pImpl;
+    if (impl.device.get() != this) {
+        throw std::invalid_argument("CommandList was created on a different device.");
+    }
+    impl.plan();
+
+    for (size_t index : impl.schedule) {
+        const CommandList::Impl::Op& op = impl.ops[index];
+        const bool copy = op.type == CommandList::Impl::OpType::Copy;
+        bool valid = op.output->pImpl->is_d3d11 && (copy ? op.output->pImpl->d3d11Texture.Get() != nullptr : op.output->pImpl->d3d11RTV.Get() != nullptr);
+        for (const auto& input : op.inputs) {
+            valid = valid && input->pImpl->is_d3d11 && (copy ? input->pImpl->d3d11Texture.Get() != nullptr : input->pImpl->d3d11SRV.Get() != nullptr);
+        }
+        if (!valid) throw std::invalid_argument("CommandList holds a texture that is not a D3D11 texture with the views its operation needs.");
+    }
+
+    pImpl->wait_for(dependencies);
+    for (size_t index : impl.schedule) {
+        const CommandList::Impl::Op& op = impl.ops[index];
+        switch (op.type) {
+            case CommandList::Impl::OpType::Copy:
+                pImpl->context->CopyResource(op.output->pImpl->d3d11Texture.Get(), op.inputs[0]->pImpl->d3d11Texture.Get());
+                break;
+            case CommandList::Impl::OpType::Run:
+                run(*op.shader, op.output, op.inputs, op.constants->data(), op.constants->size());
+                break;
+            case CommandList::Impl::OpType::Blit:
+                blit_texture_to_region(op.inputs[0], op.output, op.x, op.y, op.width, op.height);
+                break;
+            case CommandList::Impl::OpType::Clear:
+                pImpl->context->ClearRenderTargetView(op.output->pImpl->d3d11RTV.Get(), op.color);
+                break;
+        }
+    }
+    return pImpl->signal();
+}
+
+std::shared_ptr<Texture> DeviceD3D11::acquire_texture(uint32_t width, uint32_t height, DXGI_FORMAT format) {
+    return acquire_pooled_texture(*this, pImpl->pool, width, height, format);
+}
+
+void DeviceD3D11::set_pool_budget(uint64_t bytes) { pImpl->pool->set_budget(bytes); }
+PoolStats DeviceD3D11::get_pool_stats() { return pImpl->pool->get_stats(); }
+void DeviceD3D11::set_shader_cache_capacity(size_t entries) { pImpl->shaderCache.set_capacity(entries); }
+ShaderCacheStats DeviceD3D11::get_shader_cache_stats() { return pImpl->shaderCache.get_stats(); }
+
 struct DeviceD3D12::Impl {
     ComPtr<ID3D12Device> device;
     ComPtr<ID3D12CommandQueue> commandQueue;
@@ -748,8 +2602,226 @@ struct DeviceD3D12::Impl {
     ComPtr<ID3D12DescriptorHeap> blitSrvHeap;
     ComPtr<ID3D12DescriptorHeap> blitRtvHeap;
 
-    std::map<std::vector<uint8_t>, ComPtr<ID3D12PipelineState>> psoCache;
+    Cache::LruCache<ComPtr<ID3D12PipelineState>> psoCache;
     ComPtr<ID3D12RootSignature> shaderRootSignature;
+    std::shared_ptr<ResourcePool> pool = std::make_shared<ResourcePool>(DEFAULT_POOL_BUDGET);
+
+    // Each submission records into its own allocator. The allocator and whatever the commands reference
+    // (textures, pipelines, pooled scratch) are held until the fence passes the submission's value.
+    struct Submission {
+        UINT64 fenceValue;
+        ComPtr<ID3D12CommandAllocator> allocator;
+        std::vector<std::shared_ptr<void>> leases;
+    };
+    std::deque<Submission> inFlight;
+    std::vector<ComPtr<ID3D12CommandAllocator>> idleAllocators;
+
+    void retire() {
+        const UINT64 completed = fence->GetCompletedValue();
+        while (!inFlight.empty() && inFlight.front().fenceValue <= completed) {
+            idleAllocators.push_back(std::move(inFlight.front().allocator));
+            inFlight.pop_front();
+        }
+    }
+
+    void begin(ID3D12PipelineState* pso) {
+        retire();
+        if (!commandAllocator) {
+            if (!idleAllocators.empty()) {
+                commandAllocator = std::move(idleAllocators.back());
+                idleAllocators.pop_back();
+            } else {
+                HRESULT hr = device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&commandAllocator));
+                if (FAILED(hr)) throw std::runtime_error("Failed to create D3D12 command allocator. HRESULT: " + std::to_string(hr));
+            }
+        }
+        commandAllocator->Reset();
+        commandList->Reset(commandAllocator.Get(), pso);
+    }
+
+    // Fences of this queue are already ordered and other D3D12 fences are waited on by the queue; host
+    // and D3D11 fences have to complete before the commands are handed over.
+    std::shared_ptr<Fence> submit(std::vector<std::shared_ptr<void>> leases, const std::vector<std::shared_ptr<Fence>>& dependencies = {}) {
+        commandList->Close();
+        for (const auto& dependency : dependencies) {
+            if (!dependency || dependency->pImpl->d3d12Fence.Get() == fence.Get()) continue;
+            if (dependency->pImpl->d3d12Fence) commandQueue->Wait(dependency->pImpl->d3d12Fence.Get(), dependency->pImpl->value);
+            else dependency->wait();
+        }
+        ID3D12CommandList* lists[] = { commandList.Get() };
+        commandQueue->ExecuteCommandLists(1, lists);
+        const UINT64 value = fenceValue++;
+        commandQueue->Signal(fence.Get(), value);
+        inFlight.push_back({ value, std::move(commandAllocator), std::move(leases) });
+
+        auto result = std::shared_ptr<Fence>(new Fence());
+        result->pImpl->d3d12Fence = fence;
+        result->pImpl->value = value;
+        return result;
+    }
+
+    std::shared_ptr<ComPtr<ID3D12DescriptorHeap>> acquire_srv_heap(UINT descriptorCount) {
+        const UINT srvSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+        return acquire_pooled<ComPtr<ID3D12DescriptorHeap>>(pool, { PoolResource::SrvHeap, descriptorCount, 1, 0 }, (uint64_t)descriptorCount * srvSize, [&] {
+            auto heap = std::make_shared<ComPtr<ID3D12DescriptorHeap>>();
+            D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
+            heapDesc.NumDescriptors = descriptorCount;
+            heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+            heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+            HRESULT heap_hr = device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(heap->GetAddressOf()));
+            if (FAILED(heap_hr)) { throw std::runtime_error("Failed to create SRV descriptor heap for shader inputs. HRESULT: " + std::to_string(heap_hr)); }
+            return heap;
+        });
+    }
+
+    // The record_* helpers append one operation to the open command list. Scratch the GPU reads at
+    // execution time goes into leases; the caller leases the textures and pipeline.
+    void record_copy(Texture& source, Texture& destination, ResourceStates& states) {
+        states.require(source.pImpl->d3d12Resource.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE);
+        states.require(destination.pImpl->d3d12Resource.Get(), D3D12_RESOURCE_STATE_COPY_DEST);
+        states.flush();
+        commandList->CopyResource(destination.pImpl->d3d12Resource.Get(), source.pImpl->d3d12Resource.Get());
+    }
+
+    void record_run(const PreparedShader& shader, Texture& output, const std::vector<std::shared_ptr<Texture>>& inputs, const void* constants, size_t constantsSize,
+                    ResourceStates& states, std::vector<std::shared_ptr<void>>& leases) {
+        commandList->SetPipelineState(shader.pImpl->d3d12PSO.Get());
+        commandList->SetGraphicsRootSignature(shaderRootSignature.Get());
+
+        ID3D12DescriptorHeap* srvHeap = nullptr;
+        if (!inputs.empty()) {
+            UINT srvSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+            auto srvHeapLease = acquire_srv_heap((UINT)inputs.size());
+            srvHeap = srvHeapLease->Get();
+            leases.push_back(srvHeapLease);
+
+            D3D12_CPU_DESCRIPTOR_HANDLE srvHandle = srvHeap->GetCPUDescriptorHandleForHeapStart();
+            for (const auto& input : inputs) {
+                D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+                srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+                srvDesc.Format = input->get_format();
+                srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+                srvDesc.Texture2D.MipLevels = 1;
+                device->CreateShaderResourceView(input->pImpl->d3d12Resource.Get(), &srvDesc, srvHandle);
+                srvHandle.ptr += srvSize;
+            }
+        }
+
+        if (constants && constantsSize > 0) {
+            const UINT bufferSize = (UINT)((constantsSize + 255) & ~255);
+            auto cbLease = acquire_pooled<ComPtr<ID3D12Resource>>(pool, { PoolResource::UploadBuffer, bufferSize, 1, 0 }, bufferSize, [&] {
+                auto buffer = std::make_shared<ComPtr<ID3D12Resource>>();
+                D3D12_HEAP_PROPERTIES uploadHeap = { D3D12_HEAP_TYPE_UPLOAD };
+                D3D12_RESOURCE_DESC bufferDesc = {};
+                bufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+                bufferDesc.Width = bufferSize;
+                bufferDesc.Height = 1;
+                bufferDesc.DepthOrArraySize = 1;
+                bufferDesc.MipLevels = 1;
+                bufferDesc.SampleDesc.Count = 1;
+                bufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+                HRESULT buffer_hr = device->CreateCommittedResource(&uploadHeap, D3D12_HEAP_FLAG_NONE, &bufferDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(buffer->GetAddressOf()));
+                if (FAILED(buffer_hr)) { throw std::runtime_error("Failed to create D3D12 constant buffer. HRESULT: " + std::to_string(buffer_hr)); }
+                return buffer;
+            });
+            leases.push_back(cbLease);
+            ID3D12Resource* cbUploadHeap = cbLease->Get();
+            void* p;
+            HRESULT hr = cbUploadHeap->Map(0, nullptr, &p);
+            if (FAILED(hr)) { throw std::runtime_error("Failed to map D3D12 constant buffer. HRESULT: " + std::to_string(hr)); }
+            memcpy(p, constants, constantsSize);
+            cbUploadHeap->Unmap(0, nullptr);
+            commandList->SetGraphicsRootConstantBufferView(1, cbUploadHeap->GetGPUVirtualAddress());
+        }
+
+        if (!inputs.empty()) {
+            ID3D12DescriptorHeap* heaps[] = { srvHeap };
+            commandList->SetDescriptorHeaps(_countof(heaps), heaps);
+            commandList->SetGraphicsRootDescriptorTable(0, srvHeap->GetGPUDescriptorHandleForHeapStart());
+        }
+
+        for (const auto& input : inputs) states.require(input->pImpl->d3d12Resource.Get(), D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+        states.require(output.pImpl->d3d12Resource.Get(), D3D12_RESOURCE_STATE_RENDER_TARGET);
+        states.flush();
+
+        auto rtvHeap = acquire_pooled<ComPtr<ID3D12DescriptorHeap>>(pool, { PoolResource::RtvHeap, 1, 1, 0 },
+                                                                    device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV), [&] {
+            auto heap = std::make_shared<ComPtr<ID3D12DescriptorHeap>>();
+            D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc = {};
+            rtvHeapDesc.NumDescriptors = 1;
+            rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
+            HRESULT heap_hr = device->CreateDescriptorHeap(&rtvHeapDesc, IID_PPV_ARGS(heap->GetAddressOf()));
+            if (FAILED(heap_hr)) { throw std::runtime_error("Failed to create RTV descriptor heap for shader output. HRESULT: " + std::to_string(heap_hr)); }
+            return heap;
+        });
+        leases.push_back(rtvHeap);
+        D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle = (*rtvHeap)->GetCPUDescriptorHandleForHeapStart();
+        device->CreateRenderTargetView(output.pImpl->d3d12Resource.Get(), nullptr, rtvHandle);
+
+        commandList->OMSetRenderTargets(1, &rtvHandle, FALSE, nullptr);
+        D3D12_VIEWPORT vp = { 0.0f, 0.0f, (float)output.get_width(), (float)output.get_height(), 0.0f, 1.0f };
+        D3D12_RECT sr = { 0, 0, (LONG)output.get_width(), (LONG)output.get_height() };
+        commandList->RSSetViewports(1, &vp);
+        commandList->RSSetScissorRects(1, &sr);
+        commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+        commandList->DrawInstanced(3, 1, 0, 0);
+    }
+
+    // The SRV is read when the GPU executes, so queued blits each get their own heap instead of sharing
+    // blitSrvHeap. Render target views are captured at record time, so blitRtvHeap can be reused.
+    void record_blit(Texture& source, Texture& destination, uint32_t destX, uint32_t destY, uint32_t destWidth, uint32_t destHeight,
+                     ResourceStates& states, std::vector<std::shared_ptr<void>>& leases) {
+        auto srvHeap = acquire_srv_heap(1);
+        leases.push_back(srvHeap);
+        commandList->SetPipelineState(blitPSO.Get());
+
+        D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+        srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+        srvDesc.Format = source.get_format();
+        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+        srvDesc.Texture2D.MipLevels = 1;
+        device->CreateShaderResourceView(source.pImpl->d3d12Resource.Get(), &srvDesc, (*srvHeap)->GetCPUDescriptorHandleForHeapStart());
+
+        states.require(source.pImpl->d3d12Resource.Get(), D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+        states.require(destination.pImpl->d3d12Resource.Get(), D3D12_RESOURCE_STATE_RENDER_TARGET);
+        states.flush();
+
+        D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle = blitRtvHeap->GetCPUDescriptorHandleForHeapStart();
+        device->CreateRenderTargetView(destination.pImpl->d3d12Resource.Get(), nullptr, rtvHandle);
+        commandList->OMSetRenderTargets(1, &rtvHandle, FALSE, nullptr);
+
+        D3D12_VIEWPORT vp = {
+            (float)destX,
+            (float)destY,
+            (float)destWidth,
+            (float)destHeight,
+            0.0f,
+            1.0f
+        };
+        D3D12_RECT sr = {
+            (LONG)destX,
+            (LONG)destY,
+            (LONG)(destX + destWidth),
+            (LONG)(destY + destHeight)
+        };
+        commandList->RSSetViewports(1, &vp);
+        commandList->RSSetScissorRects(1, &sr);
+
+        commandList->SetGraphicsRootSignature(blitRootSignature.Get());
+        ID3D12DescriptorHeap* heaps[] = { srvHeap->Get() };
+        commandList->SetDescriptorHeaps(1, heaps);
+        commandList->SetGraphicsRootDescriptorTable(0, (*srvHeap)->GetGPUDescriptorHandleForHeapStart());
+        commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+        commandList->DrawInstanced(3, 1, 0, 0);
+    }
+
+    void record_clear(Texture& texture, const float color[4], ResourceStates& states) {
+        states.require(texture.pImpl->d3d12Resource.Get(), D3D12_RESOURCE_STATE_RENDER_TARGET);
+        states.flush();
+        D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle = blitRtvHeap->GetCPUDescriptorHandleForHeapStart();
+        device->CreateRenderTargetView(texture.pImpl->d3d12Resource.Get(), nullptr, rtvHandle);
+        commandList->ClearRenderTargetView(rtvHandle, color, 0, nullptr);
+    }
 };
 
 void DeviceD3D12::WaitForGpu() {
@@ -815,8 +2887,8 @@ std::shared_ptr<DeviceD3D12> DeviceD3D12::create() {
     if (FAILED(hr)) throw std::runtime_error("Failed to create blit root signature. HRESULT: " + std::to_string(hr));
 
     ComPtr<ID3DBlob> blitVS, blitPS;
-    D3DCompile(g_blitShaderHLSL, strlen(g_blitShaderHLSL), nullptr, nullptr, nullptr, "VSMain", "vs_5_0", 0, 0, &blitVS, nullptr);
-    D3DCompile(g_blitShaderHLSL, strlen(g_blitShaderHLSL), nullptr, nullptr, nullptr, "PSMain", "ps_5_0", 0, 0, &blitPS, nullptr);
+    compile_shader_cached(g_blitShaderHLSL, strlen(g_blitShaderHLSL), "VSMain", "vs_5_0", 0, blitVS);
+    compile_shader_cached(g_blitShaderHLSL, strlen(g_blitShaderHLSL), "PSMain", "ps_5_0", 0, blitPS);
 
     D3D12_RASTERIZER_DESC rasterizerDesc = {};
     rasterizerDesc.FillMode = D3D12_FILL_MODE_SOLID;
@@ -947,8 +3019,7 @@ std::shared_ptr<Texture> DeviceD3D12::create_texture(uint32_t width, uint32_t he
         memcpy(p, data, data_size);
         uploadHeap->Unmap(0, nullptr);
 
-        pImpl->commandAllocator->Reset();
-        pImpl->commandList->Reset(pImpl->commandAllocator.Get(), nullptr);
+        pImpl->begin(nullptr);
 
         D3D12_TEXTURE_COPY_LOCATION src = {};
         src.pResource = uploadHeap.Get();
@@ -971,11 +3042,7 @@ std::shared_ptr<Texture> DeviceD3D12::create_texture(uint32_t width, uint32_t he
         barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COMMON;
         pImpl->commandList->ResourceBarrier(1, &barrier);
 
-        pImpl->commandList->Close();
-        ID3D12CommandList* lists[] = { pImpl->commandList.Get() };
-        pImpl->commandQueue->ExecuteCommandLists(1, lists);
-        
-        WaitForGpu();
+        pImpl->submit({ std::make_shared<ComPtr<ID3D12Resource>>(uploadHeap) })->wait();
     }
     return tex;
 }
@@ -1003,7 +3070,9 @@ std::shared_ptr<Producer> DeviceD3D12::create_producer(const std::string& stream
     std::wstring w_stream_name = string_to_wstring(stream_name);
     std::wstring textureName = L"Global\\D3D12_Texture_" + std::to_wstring(pid) + L"_" + w_stream_name;
     std::wstring fenceName = L"Global\\D3D12_Fence_" + std::to_wstring(pid) + L"_" + w_stream_name;
-    std::wstring manifestName = L"D3D12_Producer_Manifest_" + std::to_wstring(pid);
+    auto streamRegistry = StreamRegistry::get();
+    std::wstring manifestName = string_to_wstring(streamRegistry->claim("D3D12_Producer_Manifest_", stream_name, textureName, prod->pImpl->streamIndex));
+    prod->pImpl->streamRegistry = streamRegistry;
     
     hr = pImpl->device->CreateSharedHandle(texture->pImpl->d3d12Resource.Get(), &sa, GENERIC_ALL, textureName.c_str(), &prod->pImpl->hTextureHandle);
     if (FAILED(hr)) { LocalFree(sd); throw std::runtime_error("Failed to create shared handle for texture. HRESULT: " + std::to_string(hr)); }
@@ -1011,31 +3080,60 @@ std::shared_ptr<Producer> DeviceD3D12::create_producer(const std::string& stream
     hr = pImpl->device->CreateSharedHandle(prod->pImpl->d3d12Fence.Get(), &sa, GENERIC_ALL, fenceName.c_str(), &prod->pImpl->hFenceHandle);
     if (FAILED(hr)) { CloseHandle(prod->pImpl->hTextureHandle); LocalFree(sd); throw std::runtime_error("Failed to create shared handle for fence. HRESULT: " + std::to_string(hr)); }
 
-    prod->pImpl->hManifest = CreateFileMappingW(INVALID_HANDLE_VALUE, &sa, PAGE_READWRITE, 0, sizeof(BroadcastManifest), manifestName.c_str());
+    D3D12_HEAP_PROPERTIES slotHeapProps = {D3D12_HEAP_TYPE_DEFAULT};
+    D3D12_RESOURCE_DESC slotDesc = texture->pImpl->d3d12Resource->GetDesc();
+    for (UINT32 i = 0; i < DEFAULT_RING_SLOTS; ++i) {
+        ComPtr<ID3D12Resource> slotResource;
+        hr = pImpl->device->CreateCommittedResource(&slotHeapProps, D3D12_HEAP_FLAG_SHARED, &slotDesc, D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(&slotResource));
+        if (FAILED(hr)) { LocalFree(sd); throw std::runtime_error("Failed to create D3D12 ring slot texture. HRESULT: " + std::to_string(hr)); }
+        HANDLE hSlot = nullptr;
+        hr = pImpl->device->CreateSharedHandle(slotResource.Get(), &sa, GENERIC_ALL, get_slot_texture_name(textureName, i).c_str(), &hSlot);
+        if (FAILED(hr)) { LocalFree(sd); throw std::runtime_error("Failed to create shared handle for ring slot texture. HRESULT: " + std::to_string(hr)); }
+        ComPtr<ID3D12CommandAllocator> slotAllocator;
+        hr = pImpl->device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&slotAllocator));
+        if (FAILED(hr)) { CloseHandle(hSlot); LocalFree(sd); throw std::runtime_error("Failed to create D3D12 ring slot allocator. HRESULT: " + std::to_string(hr)); }
+        prod->pImpl->hSlotHandles.push_back(hSlot);
+        prod->pImpl->d3d12SlotResources.push_back(slotResource);
+        prod->pImpl->d3d12SlotAllocators.push_back(slotAllocator);
+    }
+    hr = pImpl->device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, prod->pImpl->d3d12SlotAllocators[0].Get(), nullptr, IID_PPV_ARGS(&prod->pImpl->d3d12CopyList));
+    if (FAILED(hr)) { LocalFree(sd); throw std::runtime_error("Failed to create D3D12 ring copy command list. HRESULT: " + std::to_string(hr)); }
+    prod->pImpl->d3d12CopyList->Close();
+    prod->pImpl->hCopyEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    if (!prod->pImpl->hCopyEvent) { LocalFree(sd); throw std::runtime_error("Failed to create ring copy event. GetLastError: " + std::to_string(GetLastError())); }
+
+    prod->pImpl->hManifest = CreateFileMappingW(INVALID_HANDLE_VALUE, &sa, PAGE_READWRITE, 0, sizeof(ProducerManifest), manifestName.c_str());
     LocalFree(sd);
     if (!prod->pImpl->hManifest) { CloseHandle(prod->pImpl->hTextureHandle); CloseHandle(prod->pImpl->hFenceHandle); throw std::runtime_error("Failed to create file mapping for manifest. GetLastError: " + std::to_string(GetLastError())); }
     
-    prod->pImpl->pManifestView = (BroadcastManifest*)MapViewOfFile(prod->pImpl->hManifest, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(BroadcastManifest));
+    prod->pImpl->pManifestView = (BroadcastManifest*)MapViewOfFile(prod->pImpl->hManifest, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(ProducerManifest));
     if (!prod->pImpl->pManifestView) { CloseHandle(prod->pImpl->hTextureHandle); CloseHandle(prod->pImpl->hFenceHandle); CloseHandle(prod->pImpl->hManifest); throw std::runtime_error("Failed to map view of file for manifest. GetLastError: " + std::to_string(GetLastError())); }
     
-    ZeroMemory(prod->pImpl->pManifestView, sizeof(BroadcastManifest));
+    ZeroMemory(prod->pImpl->pManifestView, sizeof(ProducerManifest));
+    prod->pImpl->pRingView = &reinterpret_cast<ProducerManifest*>(prod->pImpl->pManifestView)->ring;
+    prod->pImpl->pMetadataView = reinterpret_cast<ProducerManifest*>(prod->pImpl->pManifestView)->metadata;
+    prod->pImpl->pStatsView = &reinterpret_cast<ProducerManifest*>(prod->pImpl->pManifestView)->stats;
+    init_ring_manifest(*prod->pImpl->pRingView, DEFAULT_RING_SLOTS);
+    begin_manifest_write(*prod->pImpl->pRingView);
     prod->pImpl->pManifestView->width = texture->get_width();
     prod->pImpl->pManifestView->height = texture->get_height();
     prod->pImpl->pManifestView->format = texture->get_format();
     prod->pImpl->pManifestView->adapterLuid = pImpl->adapterLuid;
     wcscpy_s(prod->pImpl->pManifestView->textureName, _countof(prod->pImpl->pManifestView->textureName), textureName.c_str());
     wcscpy_s(prod->pImpl->pManifestView->fenceName, _countof(prod->pImpl->pManifestView->fenceName), fenceName.c_str());
+    end_manifest_write(*prod->pImpl->pRingView);
 
     return prod;
 }
 
-std::shared_ptr<Consumer> DeviceD3D12::connect_to_producer(unsigned long pid) {
+std::shared_ptr<Consumer> DeviceD3D12::connect_to_producer(unsigned long pid, const std::string& stream_name) {
     auto cons = std::shared_ptr<Consumer>(new Consumer());
     cons->pImpl->pid = pid;
     cons->pImpl->pDeviceContext = pImpl->commandQueue.Get();
 
     BroadcastManifest manifest;
-    if (!get_manifest_from_pid(pid, manifest)) {
+    RingManifest ring = {};
+    if (!open_manifest(pid, stream_name, *cons->pImpl->manifest) || !read_manifest(*cons->pImpl->manifest, manifest, &ring)) {
         return nullptr;
     }
 
@@ -1088,6 +3186,36 @@ std::shared_ptr<Consumer> DeviceD3D12::connect_to_producer(unsigned long pid) {
         if (FAILED(hr)) { CloseHandle(hTexture); CloseHandle(cons->pImpl->hProcess); return nullptr; }
     }
     CloseHandle(hTexture);
+
+    if (ring.magic == RING_MANIFEST_MAGIC) {
+        ComPtr<ID3D11Device> tempD3D11Device;
+        ComPtr<ID3D11Device1> tempD3D11Device1;
+        if (cons->pImpl->is_d3d11_producer && SUCCEEDED(D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, 0, nullptr, 0, D3D11_SDK_VERSION, &tempD3D11Device, nullptr, nullptr))) {
+            tempD3D11Device.As(&tempD3D11Device1);
+        }
+        for (UINT32 i = 0; i < ring.slotCount; ++i) {
+            HANDLE hSlot = get_handle_from_name(get_slot_texture_name(manifest.textureName, i).c_str());
+            if (!hSlot) break;
+            if (cons->pImpl->is_d3d11_producer) {
+                ComPtr<ID3D11Texture2D> slotTexture;
+                ComPtr<ID3D11ShaderResourceView> slotSRV;
+                hr = tempD3D11Device1 ? tempD3D11Device1->OpenSharedResource1(hSlot, IID_PPV_ARGS(&slotTexture)) : E_FAIL;
+                if (SUCCEEDED(hr)) hr = tempD3D11Device->CreateShaderResourceView(slotTexture.Get(), nullptr, &slotSRV);
+                if (SUCCEEDED(hr)) { cons->pImpl->d3d11SlotTextures.push_back(slotTexture); cons->pImpl->d3d11SlotSRVs.push_back(slotSRV); }
+            } else {
+                ComPtr<ID3D12Resource> slotResource;
+                hr = pImpl->device->OpenSharedHandle(hSlot, IID_PPV_ARGS(&slotResource));
+                if (SUCCEEDED(hr)) cons->pImpl->d3d12SlotResources.push_back(slotResource);
+            }
+            CloseHandle(hSlot);
+            if (FAILED(hr)) break;
+        }
+        if (cons->pImpl->d3d11SlotTextures.size() + cons->pImpl->d3d12SlotResources.size() != ring.slotCount) {
+            cons->pImpl->d3d11SlotTextures.clear();
+            cons->pImpl->d3d11SlotSRVs.clear();
+            cons->pImpl->d3d12SlotResources.clear();
+        }
+    }
     
     cons->pImpl->sharedTexture->pImpl->width = manifest.width;
     cons->pImpl->sharedTexture->pImpl->height = manifest.height;
@@ -1099,6 +3227,11 @@ std::shared_ptr<Consumer> DeviceD3D12::connect_to_producer(unsigned long pid) {
 }
 
 void DeviceD3D12::copy_texture(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination) {
+    copy_texture_async(source, destination)->wait();
+    pImpl->retire();
+}
+
+std::shared_ptr<Fence> DeviceD3D12::copy_texture_async(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination, const std::vector<std::shared_ptr<Fence>>& dependencies) {
     if (!source || !destination || !source->pImpl->is_d3d12 || !destination->pImpl->is_d3d12 ||
         !source->pImpl->d3d12Resource || !destination->pImpl->d3d12Resource) {
         throw std::invalid_argument("Invalid D3D12 source or destination texture for copy_texture. Check for null or incorrect API type.");
@@ -1109,40 +3242,25 @@ void DeviceD3D12::copy_texture(std::shared_ptr<Texture> source, std::shared_ptr<
         throw std::invalid_argument("Source and destination textures must have matching dimensions and format for D3D12::copy_texture.");
     }
 
-    pImpl->commandAllocator->Reset();
-    pImpl->commandList->Reset(pImpl->commandAllocator.Get(), nullptr);
-
-    D3D12_RESOURCE_BARRIER barriers[2] = {};
-    barriers[0].Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-    barriers[0].Transition = { source->pImpl->d3d12Resource.Get(), D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_SOURCE };
-    barriers[1].Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-    barriers[1].Transition = { destination->pImpl->d3d12Resource.Get(), D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST };
-    pImpl->commandList->ResourceBarrier(2, barriers);
-
-    pImpl->commandList->CopyResource(destination->pImpl->d3d12Resource.Get(), source->pImpl->d3d12Resource.Get());
-
-    std::swap(barriers[0].Transition.StateBefore, barriers[0].Transition.StateAfter);
-    std::swap(barriers[1].Transition.StateBefore, barriers[1].Transition.StateAfter);
-    pImpl->commandList->ResourceBarrier(2, barriers);
-
-    pImpl->commandList->Close();
-    ID3D12CommandList* ppCommandLists[] = { pImpl->commandList.Get() };
-    pImpl->commandQueue->ExecuteCommandLists(1, ppCommandLists);
-    
-    WaitForGpu();
+    pImpl->begin(nullptr);
+    ResourceStates states(pImpl->commandList.Get());
+    pImpl->record_copy(*source, *destination, states);
+    states.restore();
+    return pImpl->submit({ source, destination }, dependencies);
 }
 
-void DeviceD3D12::apply_shader(std::shared_ptr<Texture> output, const std::vector<uint8_t>& shader_bytes, const std::string& entry_point, const std::vector<std::shared_ptr<Texture>>& inputs, const std::vector<uint8_t>& constants) {
-    if (!output || !output->pImpl->is_d3d12 || !output->pImpl->d3d12Resource) {
-        throw std::invalid_argument("Invalid D3D12 output texture for apply_shader (must be D3D12).");
+std::shared_ptr<PreparedShader> DeviceD3D12::prepare_shader(const std::vector<uint8_t>& shader_bytes, const std::string& entry_point, DXGI_FORMAT output_format) {
+    if (output_format == DXGI_FORMAT_UNKNOWN) {
+        throw std::invalid_argument("DeviceD3D12::prepare_shader needs the output format the pipeline will render to.");
     }
-    
+
     HRESULT hr;
 
     ComPtr<ID3D12PipelineState> pso;
     if (shader_bytes.empty() || (shader_bytes.size() == 1 && shader_bytes[0] == '\0')) {
-        static ComPtr<ID3D12PipelineState> defaultBlackPSO;
-        if (!defaultBlackPSO) {
+        // Cached per output format like any other pipeline; a single static PSO would only fit the first.
+        const uint64_t key = Cache::hash_shader(nullptr, 0, "PSMain", output_format);
+        if (!pImpl->psoCache.find(key, pso)) {
             ComPtr<ID3DBlob> vsBlob, psBlob;
             HRESULT compile_hr = D3DCompile(g_blitShaderHLSL, strlen(g_blitShaderHLSL), nullptr, nullptr, nullptr, "VSMain", "vs_5_0", 0, 0, &vsBlob, nullptr);
             if (FAILED(compile_hr)) throw std::runtime_error("Failed to compile internal VS for default black PS. HRESULT: " + std::to_string(compile_hr));
@@ -1158,21 +3276,23 @@ void DeviceD3D12::apply_shader(std::shared_ptr<Texture> output, const std::vecto
             psoDesc.SampleMask = UINT_MAX;
             psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
             psoDesc.NumRenderTargets = 1;
-            psoDesc.RTVFormats[0] = output->get_format();
+            psoDesc.RTVFormats[0] = output_format;
             psoDesc.SampleDesc.Count = 1;
-            pImpl->device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&defaultBlackPSO));
+            hr = pImpl->device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&pso));
+            if (FAILED(hr)) { throw std::runtime_error("Failed to create default black pipeline state. HRESULT: " + std::to_string(hr)); }
+            pImpl->psoCache.insert(key, pso);
         }
-        pso = defaultBlackPSO;
     } else {
-        auto it = pImpl->psoCache.find(shader_bytes);
-        if (it != pImpl->psoCache.end()) {
-            pso = it->second;
-        } else {
+        // The PSO bakes in RTVFormats[0], so the output format is part of the key.
+        const uint64_t key = Cache::hash_shader(shader_bytes, entry_point, output_format);
+        if (!pImpl->psoCache.find(key, pso)) {
             ComPtr<ID3DBlob> vsBlob, psBlob, errorBlob;
-            HRESULT compile_hr = D3DCompile(g_blitShaderHLSL, strlen(g_blitShaderHLSL), nullptr, nullptr, nullptr, "VSMain", "vs_5_0", 0, 0, &vsBlob, nullptr);
+            HRESULT compile_hr = compile_shader_cached(g_blitShaderHLSL, strlen(g_blitShaderHLSL), "VSMain", "vs_5_0", 0, vsBlob);
             if (FAILED(compile_hr)) throw std::runtime_error("Failed to compile internal VS for apply_shader. HRESULT: " + std::to_string(compile_hr));
 
-            hr = D3DCompile(shader_bytes.data(), shader_bytes.size(), "hlsl_shader", nullptr, nullptr, entry_point.c_str(), "ps_5_0", D3DCOMPILE_ENABLE_STRICTNESS, 0, &psBlob, &errorBlob);
+            bool fromDisk = false;
+            hr = compile_shader_cached(shader_bytes.data(), shader_bytes.size(), entry_point.c_str(), "ps_5_0", D3DCOMPILE_ENABLE_STRICTNESS, psBlob, &errorBlob, &fromDisk);
+            if (fromDisk) pImpl->psoCache.note_disk_hit();
             if (FAILED(hr)) {
                 if (errorBlob) {
                     throw std::runtime_error("HLSL compile failed for apply_shader: " + std::string((char*)errorBlob->GetBufferPointer()));
@@ -1193,105 +3313,64 @@ void DeviceD3D12::apply_shader(std::shared_ptr<Texture> output, const std::vecto
             psoDesc.SampleMask = UINT_MAX;
             psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
             psoDesc.NumRenderTargets = 1;
-            psoDesc.RTVFormats[0] = output->get_format();
+            psoDesc.RTVFormats[0] = output_format;
             psoDesc.SampleDesc.Count = 1;
             
             hr = pImpl->device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&pso));
             if (FAILED(hr)) { throw std::runtime_error("Failed to create graphics pipeline state for shader. HRESULT: " + std::to_string(hr)); }
-            pImpl->psoCache[shader_bytes] = pso;
+            pImpl->psoCache.insert(key, pso);
         }
     }
 
-    pImpl->commandAllocator->Reset();
-    pImpl->commandList->Reset(pImpl->commandAllocator.Get(), pso.Get());
-    pImpl->commandList->SetGraphicsRootSignature(pImpl->shaderRootSignature.Get());
-
-    ComPtr<ID3D12DescriptorHeap> srvHeap;
-    if (!inputs.empty()) {
-        D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
-        heapDesc.NumDescriptors = (UINT)inputs.size();
-        heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-        heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-        hr = pImpl->device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&srvHeap));
-        if (FAILED(hr)) { throw std::runtime_error("Failed to create SRV descriptor heap for shader inputs. HRESULT: " + std::to_string(hr)); }
+    auto shader = std::shared_ptr<PreparedShader>(new PreparedShader());
+    shader->pImpl->device = this;
+    shader->pImpl->entryPoint = entry_point;
+    shader->pImpl->outputFormat = output_format;
+    shader->pImpl->d3d12PSO = std::move(pso);
+    return shader;
+}
 
-        UINT srvSize = pImpl->device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-        D3D12_CPU_DESCRIPTOR_HANDLE srvHandle = srvHeap->GetCPUDescriptorHandleForHeapStart();
-        for (const auto& input : inputs) {
-            if (!input || !input->pImpl->is_d3d12 || !input->pImpl->d3d12Resource) {
-                throw std::invalid_argument("Invalid D3D12 input texture for apply_shader (must be D3D12).");
-            }
-            D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-            srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-            srvDesc.Format = input->get_format();
-            srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-            srvDesc.Texture2D.MipLevels = 1;
-            pImpl->device->CreateShaderResourceView(input->pImpl->d3d12Resource.Get(), &srvDesc, srvHandle);
-            srvHandle.ptr += srvSize;
-        }
+void DeviceD3D12::apply_shader(std::shared_ptr<Texture> output, const std::vector<uint8_t>& shader_bytes, const std::string& entry_point, const std::vector<std::shared_ptr<Texture>>& inputs, const std::vector<uint8_t>& constants) {
+    if (!output || !output->pImpl->is_d3d12 || !output->pImpl->d3d12Resource) {
+        throw std::invalid_argument("Invalid D3D12 output texture for apply_shader (must be D3D12).");
     }
+    run(*prepare_shader(shader_bytes, entry_point, output->get_format()), output, inputs, constants.data(), constants.size());
+}
 
-    ComPtr<ID3D12Resource> cbUploadHeap;
-    if (!constants.empty()) {
-        D3D12_HEAP_PROPERTIES uploadHeap = { D3D12_HEAP_TYPE_UPLOAD };
-        D3D12_RESOURCE_DESC bufferDesc = {};
-        bufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-        bufferDesc.Width = (constants.size() + 255) & ~255;
-        bufferDesc.Height = 1;
-        bufferDesc.DepthOrArraySize = 1;
-        bufferDesc.MipLevels = 1;
-        bufferDesc.SampleDesc.Count = 1;
-        bufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-        hr = pImpl->device->CreateCommittedResource(&uploadHeap, D3D12_HEAP_FLAG_NONE, &bufferDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&cbUploadHeap));
-        if (FAILED(hr)) { throw std::runtime_error("Failed to create D3D12 constant buffer. HRESULT: " + std::to_string(hr)); }
-        void* p;
-        hr = cbUploadHeap->Map(0, nullptr, &p);
-        if (FAILED(hr)) { throw std::runtime_error("Failed to map D3D12 constant buffer. HRESULT: " + std::to_string(hr)); }
-        memcpy(p, constants.data(), constants.size());
-        cbUploadHeap->Unmap(0, nullptr);
-        pImpl->commandList->SetGraphicsRootConstantBufferView(1, cbUploadHeap->GetGPUVirtualAddress());
-    }
+void DeviceD3D12::run(const PreparedShader& shader, std::shared_ptr<Texture> output, const std::vector<std::shared_ptr<Texture>>& inputs, const void* constants, size_t constants_size) {
+    run_async(shader, output, inputs, constants, constants_size)->wait();
+    pImpl->retire();
+}
 
-    if (!inputs.empty()) {
-        ID3D12DescriptorHeap* heaps[] = { srvHeap.Get() };
-        pImpl->commandList->SetDescriptorHeaps(_countof(heaps), heaps);
-        pImpl->commandList->SetGraphicsRootDescriptorTable(0, srvHeap->GetGPUDescriptorHandleForHeapStart());
+std::shared_ptr<Fence> DeviceD3D12::run_async(const PreparedShader& shader, std::shared_ptr<Texture> output, const std::vector<std::shared_ptr<Texture>>& inputs,
+                                              const void* constants, size_t constants_size, const std::vector<std::shared_ptr<Fence>>& dependencies) {
+    if (shader.pImpl->device != this || !shader.pImpl->d3d12PSO) {
+        throw std::invalid_argument("PreparedShader was prepared on a different device.");
+    }
+    if (!output || !output->pImpl->is_d3d12 || !output->pImpl->d3d12Resource) {
+        throw std::invalid_argument("Invalid D3D12 output texture for run (must be D3D12).");
+    }
+    if (output->get_format() != shader.pImpl->outputFormat) {
+        throw std::invalid_argument("Output texture format does not match the format the PreparedShader's pipeline was built for.");
     }
 
-    D3D12_RESOURCE_BARRIER barrier = {};
-    barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-    barrier.Transition.pResource = output->pImpl->d3d12Resource.Get();
-    barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COMMON;
-    barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_RENDER_TARGET;
-    barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-    pImpl->commandList->ResourceBarrier(1, &barrier);
+    // Inputs are checked before recording starts, so a bad one cannot leave the command list open.
+    for (const auto& input : inputs) {
+        if (!input || !input->pImpl->is_d3d12 || !input->pImpl->d3d12Resource) {
+            throw std::invalid_argument("Invalid D3D12 input texture for run (must be D3D12).");
+        }
+    }
 
-    D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle;
-    ComPtr<ID3D12DescriptorHeap> rtvHeap;
-    D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc = {};
-    rtvHeapDesc.NumDescriptors = 1;
-    rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
-    hr = pImpl->device->CreateDescriptorHeap(&rtvHeapDesc, IID_PPV_ARGS(&rtvHeap));
-    if (FAILED(hr)) { throw std::runtime_error("Failed to create RTV descriptor heap for shader output. HRESULT: " + std::to_string(hr)); }
-    rtvHandle = rtvHeap->GetCPUDescriptorHandleForHeapStart();
-    pImpl->device->CreateRenderTargetView(output->pImpl->d3d12Resource.Get(), nullptr, rtvHandle);
+    // Everything the commands touch rides along with the submission until the GPU is done with it.
+    std::vector<std::shared_ptr<void>> leases = { std::make_shared<ComPtr<ID3D12PipelineState>>(shader.pImpl->d3d12PSO), output };
+    leases.insert(leases.end(), inputs.begin(), inputs.end());
 
-    pImpl->commandList->OMSetRenderTargets(1, &rtvHandle, FALSE, nullptr);
-    D3D12_VIEWPORT vp = { 0.0f, 0.0f, (float)output->get_width(), (float)output->get_height(), 0.0f, 1.0f };
-    D3D12_RECT sr = { 0, 0, (LONG)output->get_width(), (LONG)output->get_height() };
-    pImpl->commandList->RSSetViewports(1, &vp);
-    pImpl->commandList->RSSetScissorRects(1, &sr);
-    pImpl->commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    pImpl->commandList->DrawInstanced(3, 1, 0, 0);
+    pImpl->begin(nullptr);
+    ResourceStates states(pImpl->commandList.Get());
+    pImpl->record_run(shader, *output, inputs, constants, constants_size, states, leases);
+    states.restore();
 
-    barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET;
-    barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COMMON;
-    pImpl->commandList->ResourceBarrier(1, &barrier);
-    
-    pImpl->commandList->Close();
-    ID3D12CommandList* lists[] = { pImpl->commandList.Get() };
-    pImpl->commandQueue->ExecuteCommandLists(1, lists);
-    WaitForGpu();
+    return pImpl->submit(std::move(leases), dependencies);
 }
 
 void DeviceD3D12::blit(std::shared_ptr<Texture> source, std::shared_ptr<Window> destination) {
@@ -1301,8 +3380,7 @@ void DeviceD3D12::blit(std::shared_ptr<Texture> source, std::shared_ptr<Window>
     }
     auto& winImpl = *destination->pImpl;
     
-    pImpl->commandAllocator->Reset();
-    pImpl->commandList->Reset(pImpl->commandAllocator.Get(), pImpl->blitPSO.Get());
+    pImpl->begin(pImpl->blitPSO.Get());
 
     D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
     srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
@@ -1339,9 +3417,7 @@ void DeviceD3D12::blit(std::shared_ptr<Texture> source, std::shared_ptr<Window>
     std::swap(barriers[1].Transition.StateBefore, barriers[1].Transition.StateAfter);
     pImpl->commandList->ResourceBarrier(2, barriers);
     
-    pImpl->commandList->Close();
-    ID3D12CommandList* lists[] = { pImpl->commandList.Get() };
-    pImpl->commandQueue->ExecuteCommandLists(1, lists);
+    pImpl->submit({ source });
 }
 
 void DeviceD3D12::clear(std::shared_ptr<Window> window, float r, float g, float b, float a) {
@@ -1350,8 +3426,7 @@ void DeviceD3D12::clear(std::shared_ptr<Window> window, float r, float g, float
     }
     auto& winImpl = *window->pImpl;
 
-    pImpl->commandAllocator->Reset();
-    pImpl->commandList->Reset(pImpl->commandAllocator.Get(), nullptr);
+    pImpl->begin(nullptr);
 
     D3D12_RESOURCE_BARRIER barrier = {};
     barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
@@ -1367,9 +3442,7 @@ void DeviceD3D12::clear(std::shared_ptr<Window> window, float r, float g, float
     barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_PRESENT;
     pImpl->commandList->ResourceBarrier(1, &barrier);
     
-    pImpl->commandList->Close();
-    ID3D12CommandList* lists[] = { pImpl->commandList.Get() };
-    pImpl->commandQueue->ExecuteCommandLists(1, lists);
+    pImpl->submit({});
 }
 
 std::shared_ptr<Window> DeviceD3D12::create_window(uint32_t width, uint32_t height, const std::string& title) {
@@ -1456,107 +3529,134 @@ void DeviceD3D12::resize_window(std::shared_ptr<Window> window) {
 
 void DeviceD3D12::blit_texture_to_region(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination,
                                         uint32_t dest_x, uint32_t dest_y, uint32_t dest_width, uint32_t dest_height) {
+    blit_texture_to_region_async(source, destination, dest_x, dest_y, dest_width, dest_height)->wait();
+    pImpl->retire();
+}
+
+std::shared_ptr<Fence> DeviceD3D12::blit_texture_to_region_async(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination,
+                                                                 uint32_t dest_x, uint32_t dest_y, uint32_t dest_width, uint32_t dest_height,
+                                                                 const std::vector<std::shared_ptr<Fence>>& dependencies) {
     if (!source || !destination || !source->pImpl->is_d3d12 || !destination->pImpl->is_d3d12 ||
         !source->pImpl->d3d12Resource || !destination->pImpl->d3d12Resource) {
         throw std::invalid_argument("Invalid D3D12 source or destination texture for blit_texture_to_region. Check for null or incorrect API type.");
     }
-    if (dest_width == 0 || dest_height == 0) return;
-
-    pImpl->commandAllocator->Reset();
-    pImpl->commandList->Reset(pImpl->commandAllocator.Get(), pImpl->blitPSO.Get());
 
-    D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-    srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-    srvDesc.Format = source->get_format();
-    srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-    srvDesc.Texture2D.MipLevels = 1;
-    pImpl->device->CreateShaderResourceView(source->pImpl->d3d12Resource.Get(), &srvDesc, pImpl->blitSrvHeap->GetCPUDescriptorHandleForHeapStart());
+    pImpl->begin(nullptr);
+    if (dest_width == 0 || dest_height == 0) return pImpl->submit({}, dependencies);
 
-    D3D12_RESOURCE_BARRIER barriers[2] = {};
-    barriers[0].Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-    barriers[0].Transition = { source->pImpl->d3d12Resource.Get(), D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE };
-    barriers[1].Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-    barriers[1].Transition = { destination->pImpl->d3d12Resource.Get(), D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_RENDER_TARGET };
-    pImpl->commandList->ResourceBarrier(2, barriers);
+    std::vector<std::shared_ptr<void>> leases = { source, destination };
+    ResourceStates states(pImpl->commandList.Get());
+    pImpl->record_blit(*source, *destination, dest_x, dest_y, dest_width, dest_height, states, leases);
+    states.restore();
+    return pImpl->submit(std::move(leases), dependencies);
+}
 
-    D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle = pImpl->blitRtvHeap->GetCPUDescriptorHandleForHeapStart();
-    pImpl->device->CreateRenderTargetView(destination->pImpl->d3d12Resource.Get(), nullptr, rtvHandle);
-    pImpl->commandList->OMSetRenderTargets(1, &rtvHandle, FALSE, nullptr);
+std::shared_ptr<CommandList> DeviceD3D12::create_command_list() {
+    return std::shared_ptr<CommandList>(new CommandList(shared_from_this()));
+}
 
-    D3D12_VIEWPORT vp = {
-        (float)dest_x,
-        (float)dest_y,
-        (float)dest_width,
-        (float)dest_height,
-        0.0f,
-        1.0f
-    };
-    D3D12_RECT sr = {
-        (LONG)dest_x,
-        (LONG)dest_y,
-        (LONG)(dest_x + dest_width),
-        (LONG)(dest_y + dest_height)
-    };
-    pImpl->commandList->RSSetViewports(1, &vp);
-    pImpl->commandList->RSSetScissorRects(1, &sr);
+// The whole list is recorded into one command list and submitted once. A texture only transitions
+// when the next operation needs it in another state, so a chain of shader runs reading each other's
+// output pays one barrier per hand-off instead of two.
+std::shared_ptr<Fence> DeviceD3D12::submit(const CommandList& list, const std::vector<std::shared_ptr<Fence>>& dependencies) {
+    auto& impl = *list.pImpl;
+    if (impl.device.get() != this) {
+        throw std::invalid_argument("CommandList was created on a different device.");
+    }
+    impl.plan();
+
+    // Checked before recording starts, so a bad operation cannot leave the command list open.
+    std::vector<std::shared_ptr<void>> leases;
+    for (size_t index : impl.schedule) {
+        const CommandList::Impl::Op& op = impl.ops[index];
+        bool valid = op.output->pImpl->is_d3d12 && op.output->pImpl->d3d12Resource;
+        for (const auto& input : op.inputs) valid = valid && input->pImpl->is_d3d12 && input->pImpl->d3d12Resource;
+        if (!valid) throw std::invalid_argument("CommandList holds a texture that is not a D3D12 texture.");
+        if (op.type == CommandList::Impl::OpType::Run) {
+            if (op.output->get_format() != op.shader->pImpl->outputFormat) {
+                throw std::invalid_argument("Output texture format does not match the format the PreparedShader's pipeline was built for.");
+            }
+            leases.push_back(std::make_shared<ComPtr<ID3D12PipelineState>>(op.shader->pImpl->d3d12PSO));
+        }
+        leases.push_back(op.output);
+        leases.insert(leases.end(), op.inputs.begin(), op.inputs.end());
+    }
 
-    pImpl->commandList->SetGraphicsRootSignature(pImpl->blitRootSignature.Get());
-    ID3D12DescriptorHeap* heaps[] = { pImpl->blitSrvHeap.Get() };
-    pImpl->commandList->SetDescriptorHeaps(1, heaps);
-    pImpl->commandList->SetGraphicsRootDescriptorTable(0, pImpl->blitSrvHeap->GetGPUDescriptorHandleForHeapStart());
-    pImpl->commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    pImpl->commandList->DrawInstanced(3, 1, 0, 0);
+    pImpl->begin(nullptr);
+    ResourceStates states(pImpl->commandList.Get());
+    for (size_t index : impl.schedule) {
+        const CommandList::Impl::Op& op = impl.ops[index];
+        switch (op.type) {
+            case CommandList::Impl::OpType::Copy:
+                pImpl->record_copy(*op.inputs[0], *op.output, states);
+                break;
+            case CommandList::Impl::OpType::Run:
+                pImpl->record_run(*op.shader, *op.output, op.inputs, op.constants->data(), op.constants->size(), states, leases);
+                break;
+            case CommandList::Impl::OpType::Blit:
+                pImpl->record_blit(*op.inputs[0], *op.output, op.x, op.y, op.width, op.height, states, leases);
+                break;
+            case CommandList::Impl::OpType::Clear:
+                pImpl->record_clear(*op.output, op.color, states);
+                break;
+        }
+    }
+    states.restore();
+    return pImpl->submit(std::move(leases), dependencies);
+}
 
-    std::swap(barriers[0].Transition.StateBefore, barriers[0].Transition.StateAfter);
-    std::swap(barriers[1].Transition.StateBefore, barriers[1].Transition.StateAfter);
-    pImpl->commandList->ResourceBarrier(2, barriers);
-    
-    pImpl->commandList->Close();
-    ID3D12CommandList* lists[] = { pImpl->commandList.Get() };
-    pImpl->commandQueue->ExecuteCommandLists(1, lists);
-    WaitForGpu();
+std::shared_ptr<Texture> DeviceD3D12::acquire_texture(uint32_t width, uint32_t height, DXGI_FORMAT format) {
+    return acquire_pooled_texture(*this, pImpl->pool, width, height, format);
 }
 
+void DeviceD3D12::set_pool_budget(uint64_t bytes) { pImpl->pool->set_budget(bytes); }
+PoolStats DeviceD3D12::get_pool_stats() { return pImpl->pool->get_stats(); }
+void DeviceD3D12::set_shader_cache_capacity(size_t entries) { pImpl->psoCache.set_capacity(entries); }
+ShaderCacheStats DeviceD3D12::get_shader_cache_stats() { return pImpl->psoCache.get_stats(); }
+#endif
+
+uint64_t DirectPort::monotonic_us() { return Shm::monotonic_us(); }
+
 std::vector<ProducerInfo> DirectPort::discover() {
     std::vector<ProducerInfo> discovered;
-    HANDLE hSnapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
-    if (hSnapshot == INVALID_HANDLE_VALUE) return discovered;
-    PROCESSENTRY32W pe32 = {sizeof(PROCESSENTRY32W)};
-    if (Process32FirstW(hSnapshot, &pe32)) {
-        do {
-            BroadcastManifest manifest;
-            if (get_manifest_from_pid(pe32.th32ProcessID, manifest)) {
-                std::wstring exeFileName(pe32.szExeFile);
-                std::transform(exeFileName.begin(), exeFileName.end(), exeFileName.begin(), ::towlower);
-                std::wstring type_str;
-                if (wcsstr(manifest.textureName, L"D3D12_Texture_") != nullptr) {
-                    if (wcsstr(exeFileName.c_str(), L"multiplexer") != nullptr) type_str = L"D3D12 Multiplexer";
-                    else if (wcsstr(exeFileName.c_str(), L"camera") != nullptr) type_str = L"D3D12 Camera";
-                    else if (wcsstr(exeFileName.c_str(), L"shaderfilter") != nullptr) type_str = L"D3D12 Shader Filter";
-                    else if (wcsstr(exeFileName.c_str(), L"producer") != nullptr) type_str = L"D3D12 Producer";
-                    else type_str = L"Python D3D12 Producer";
-                } else {
-                    if (wcsstr(exeFileName.c_str(), L"multiplexer") != nullptr) type_str = L"D3D11 Multiplexer";
-                    else if (wcsstr(exeFileName.c_str(), L"camera") != nullptr) type_str = L"D3D11 Camera";
-                    else if (wcsstr(exeFileName.c_str(), L"shaderfilter") != nullptr) type_str = L"D3D11 Shader Filter";
-                    else if (wcsstr(exeFileName.c_str(), L"producer") != nullptr) type_str = L"D3D11 Producer";
-                    else type_str = L"Python D3D11 Producer";
-                }
-
-                std::wstring w_stream_name(manifest.textureName);
-                size_t pid_str_len = std::to_wstring(pe32.th32ProcessID).length();
-                size_t first_underscore_after_pid = w_stream_name.find(L"_", w_stream_name.find(std::to_wstring(pe32.th32ProcessID)) + pid_str_len);
-                
-                if (first_underscore_after_pid != std::wstring::npos) {
-                    w_stream_name = w_stream_name.substr(first_underscore_after_pid + 1);
-                } else {
-                    w_stream_name = L"Unknown";
-                }
-                
-                discovered.push_back({pe32.th32ProcessID, pe32.szExeFile, w_stream_name, type_str});
-            }
-        } while (Process32NextW(hSnapshot, &pe32));
+    Shm::Mapping mapping;
+    auto registry = std::make_unique<Registry>();
+    if (!mapping.open(g_registryName, sizeof(Registry)) || !read_registry(*static_cast<const Registry*>(mapping.data()), *registry)) {
+        return discovered;
+    }
+    const UINT64 now = Shm::monotonic_ms();
+    for (const auto& entry : registry->entries) {
+        if (!is_registry_entry_live(entry, now)) continue;
+        discovered.push_back({entry.pid, read_manifest_name(entry.executableName), read_manifest_name(entry.streamName), read_manifest_name(entry.type)});
     }
-    CloseHandle(hSnapshot);
     return discovered;
-}
\ No newline at end of file
+}
+
+uint64_t DirectPort::get_discovery_generation() {
+    Shm::Mapping mapping;
+    if (!mapping.open(g_registryName, sizeof(Registry))) return 0;
+    return Shm::load_acquire(&static_cast<const Registry*>(mapping.data())->generation) & ~1ull;
+}
+
+bool DirectPort::wait_for_discovery_change(uint64_t generation, uint32_t timeout_ms) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    Shm::Mapping mapping;
+    for (;;) {
+        if (!mapping) mapping.open(g_registryName, sizeof(Registry), true);
+        auto* registry = static_cast<Registry*>(mapping.data());
+        UINT64 current = 0;
+        if (registry) {
+            // Producers that crash never deregister, so the waiter withdraws them to surface the change.
+            lock_registry(*registry);
+            reclaim_dead_registry_entries(*registry);
+            unlock_registry(*registry);
+            current = Shm::load_acquire(&registry->generation) & ~1ull;
+            if (current != generation) return true;
+        }
+        auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0) return false;
+        uint32_t slice = (uint32_t)std::min<long long>((remaining + 999) / 1000, g_livenessPollIntervalMs);
+        if (registry) Shm::wait_on_address(&registry->generation, current, slice);
+        else std::this_thread::sleep_for(std::chrono::milliseconds(slice));
+    }
+}
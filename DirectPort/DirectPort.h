@@ -5,14 +5,41 @@
 #include <memory>
 #include <cstdint>
 
+#ifdef _WIN32
 #ifndef WIN32_LEAN_AND_MEAN
 #define WIN32_LEAN_AND_MEAN
 #endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
 #include <windows.h>
 #include <d3d11_4.h>
 #include <d3d12.h>
 #include <dxgi1_6.h>
 #include <wrl/client.h>
+#else
+typedef uint32_t UINT;
+typedef uint32_t UINT32;
+typedef uint64_t UINT64;
+typedef uint32_t DWORD;
+typedef int32_t LONG;
+typedef wchar_t WCHAR;
+typedef struct _LUID { DWORD LowPart; LONG HighPart; } LUID;
+
+// Subset of dxgiformat.h used by DirectPort; values match the Windows SDK so manifests stay comparable.
+typedef enum DXGI_FORMAT {
+    DXGI_FORMAT_UNKNOWN = 0,
+    DXGI_FORMAT_R32G32B32A32_FLOAT = 2,
+    DXGI_FORMAT_R16G16B16A16_FLOAT = 10,
+    DXGI_FORMAT_R10G10B10A2_UNORM = 24,
+    DXGI_FORMAT_R8G8B8A8_UNORM = 28,
+    DXGI_FORMAT_R32_FLOAT = 41,
+    DXGI_FORMAT_R8G8_UNORM = 49,
+    DXGI_FORMAT_R16_FLOAT = 54,
+    DXGI_FORMAT_R8_UNORM = 61,
+    DXGI_FORMAT_B8G8R8A8_UNORM = 87,
+} DXGI_FORMAT;
+#endif
 
 namespace DirectPort {
 
@@ -26,12 +53,204 @@ namespace DirectPort {
         WCHAR fenceName[256];
     };
 
+    constexpr UINT32 RING_MANIFEST_MAGIC = 0x47525044; // "DPRG"
+    constexpr UINT32 RING_MANIFEST_VERSION = 1;
+    constexpr UINT32 MAX_RING_SLOTS = 8;
+    constexpr UINT32 DEFAULT_RING_SLOTS = 3;
+
+    constexpr UINT32 RING_SLOT_WRITER = 0x80000000u;
+
+    struct RingSlot {
+        UINT64 sequence;    // Seqlock counter: odd while the producer is writing the slot.
+        UINT64 frameValue;  // Frame held by the slot once sequence is even.
+        UINT32 pinState;    // Count of reader leases, plus RING_SLOT_WRITER while the producer owns the slot.
+        UINT32 reserved;
+    };
+
+    // Appended after BroadcastManifest so readers that only map the legacy prefix keep working.
+    struct RingManifest {
+        UINT32 magic;
+        UINT32 version;
+        UINT32 slotCount;
+        UINT32 latestSlot;
+        UINT64 headerSequence; // Seqlock over the BroadcastManifest header; odd while the producer rewrites it.
+        RingSlot slots[MAX_RING_SLOTS];
+    };
+
+    constexpr UINT32 FRAME_METADATA_VERSION = 1;
+    constexpr UINT32 MAX_FRAME_FACES = 16;
+
+    struct FaceBox {
+        float left, top, right, bottom;
+        float score;
+        float landmarks[10]; // Five (x, y) keypoints; zero when the detector provides none.
+    };
+
+    // Sideband data that travels with the pixels of one ring slot and is covered by the slot's seqlock.
+    // version stays 0 until the producer publishes a frame. Times come from monotonic_us().
+    struct FrameMetadata {
+        UINT32 version;
+        UINT32 faceCount;
+        UINT64 frameSequence;    // frameValue of the frame; stamped by signal_frame.
+        UINT64 captureTimeUs;
+        UINT64 signalTimeUs;     // Stamped by signal_frame.
+        UINT64 processingTimeUs;
+        FaceBox faces[MAX_FRAME_FACES];
+    };
+
+    constexpr UINT32 LATENCY_BUCKETS = 96;
+    constexpr UINT32 MAX_STREAM_CONSUMERS = 16;
+
+    // Log-linear histogram: exact below 16us, then four buckets per power of two up to ~16s.
+    // Each histogram has a single writer, so updates need no locks; readers tolerate slightly stale counts.
+    struct LatencyHistogram {
+        UINT64 count;
+        UINT64 sumUs;
+        UINT64 maxUs;
+        UINT32 buckets[LATENCY_BUCKETS];
+    };
+
+    struct ConsumerStatsEntry {
+        UINT32 pid;       // Owning consumer process; 0 when free. Claimed with a CAS.
+        UINT32 reserved;
+        UINT64 lastFrame;
+        LatencyHistogram latency; // signal_frame to consumer acquisition.
+    };
+
+    struct StatsManifest {
+        LatencyHistogram signalCost; // Time spent inside signal_frame.
+        ConsumerStatsEntry consumers[MAX_STREAM_CONSUMERS];
+    };
+
+    struct ProducerManifest {
+        BroadcastManifest broadcast;
+        RingManifest ring;
+        FrameMetadata metadata[MAX_RING_SLOTS];
+        StatsManifest stats;
+    };
+
+    constexpr UINT32 STREAM_TABLE_MAGIC = 0x54535044; // "DPST"
+    constexpr UINT32 STREAM_TABLE_VERSION = 1;
+    constexpr UINT32 MAX_STREAMS_PER_PROCESS = 16;
+
+    // Per-process index of published streams, so one process can publish several (pid, stream_name) pairs.
+    // The first stream of each producer type keeps the legacy per-pid manifest name.
+    struct StreamTableEntry {
+        UINT32 active;
+        UINT32 reserved;
+        WCHAR streamName[128];
+        WCHAR manifestName[256];
+    };
+
+    struct StreamTable {
+        UINT32 magic;
+        UINT32 version;
+        UINT64 sequence; // Seqlock; odd while an entry is being added or removed.
+        StreamTableEntry entries[MAX_STREAMS_PER_PROCESS];
+    };
+
+    constexpr UINT32 REGISTRY_MAGIC = 0x45525044; // "DPRE"
+    constexpr UINT32 REGISTRY_VERSION = 1;
+    constexpr UINT32 MAX_REGISTRY_ENTRIES = 64;
+
+    // Machine-wide list of published streams. Producers register into it so discovery is one mapped read.
+    struct RegistryEntry {
+        UINT32 pid;
+        UINT32 active;
+        UINT64 heartbeat; // Shm::monotonic_ms() of the stream's registration or latest frame.
+        WCHAR streamName[128];
+        WCHAR executableName[260];
+        WCHAR type[64];
+    };
+
+    struct Registry {
+        UINT32 magic;
+        UINT32 version;
+        UINT32 lockOwner; // pid of the process currently editing entries, 0 when free.
+        UINT32 reserved;
+        UINT64 generation; // Seqlock and change counter; odd while an entry is being changed.
+        RegistryEntry entries[MAX_REGISTRY_ENTRIES];
+    };
+
     class DeviceD3D11;
     class DeviceD3D12;
+    class DeviceCPU;
     class Texture;
+    class ReadLease;
     class Consumer;
     class Producer;
     class Window;
+    class PreparedShader;
+    class Fence;
+    class CommandList;
+    class IDirectXDevice;
+
+    enum class FrameStatus {
+        NewFrame,
+        Timeout,
+        ProducerGone
+    };
+
+    // CPU-writable view of a producer's next frame. Rows are row_pitch bytes apart, of which only
+    // width * bytes-per-pixel are pixels.
+    struct WriteBuffer {
+        uint8_t* data;
+        uint32_t width;
+        uint32_t height;
+        uint32_t row_pitch;
+        DXGI_FORMAT format;
+    };
+
+    struct LatencyStats {
+        uint64_t count;
+        uint64_t p50_us;
+        uint64_t p99_us;
+        uint64_t max_us;
+        double mean_us;
+    };
+
+    struct ConsumerStats {
+        unsigned long pid;
+        uint64_t last_frame;
+        LatencyStats latency;
+    };
+
+    struct ProducerStats {
+        uint64_t frames;
+        LatencyStats signal_cost;
+        std::vector<ConsumerStats> consumers;
+    };
+
+    // Counters of a device's resource pool. bytes_held is idle memory kept for reuse and is what the
+    // budget caps; bytes_in_use is pooled memory currently handed out.
+    struct PoolStats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        uint64_t bytes_held;
+        uint64_t bytes_in_use;
+        uint64_t budget_bytes;
+    };
+
+    constexpr uint64_t DEFAULT_POOL_BUDGET = 256ull * 1024 * 1024;
+
+    // Counters of a device's compiled-shader cache. disk_hits counts misses served from the on-disk
+    // blob cache instead of the compiler.
+    struct ShaderCacheStats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        uint64_t disk_hits;
+        uint64_t entries;
+        uint64_t capacity;
+    };
+
+    constexpr size_t DEFAULT_SHADER_CACHE_CAPACITY = 256;
+
+    // Directory for compiled shader blobs shared across runs; empty disables it. Defaults to the
+    // DIRECTPORT_SHADER_CACHE environment variable.
+    void set_shader_cache_directory(const std::string& directory);
+    std::string get_shader_cache_directory();
 
     struct ProducerInfo {
         unsigned long pid;
@@ -40,7 +259,19 @@ namespace DirectPort {
         std::wstring type;
     };
 
+    // Microseconds on a clock shared by every process on the machine, for FrameMetadata timestamps.
+    uint64_t monotonic_us();
+
     std::vector<ProducerInfo> discover();
+    // Changes whenever a stream is published or withdrawn. Pass it to wait_for_discovery_change to
+    // sleep until discover() would return something different.
+    uint64_t get_discovery_generation();
+    bool wait_for_discovery_change(uint64_t generation, uint32_t timeout_ms);
+
+    // Host (CPU-resident) transport: pixels travel through named shared memory and frame
+    // notifications through the manifest's frameValue, so no GPU or D3D runtime is needed.
+    std::shared_ptr<Producer> create_host_producer(const std::string& stream_name, uint32_t width, uint32_t height, DXGI_FORMAT format, uint32_t slot_count = DEFAULT_RING_SLOTS);
+    std::shared_ptr<Consumer> connect_to_host_producer(unsigned long pid, const std::string& stream_name = "");
 
     class Texture {
     public:
@@ -48,17 +279,43 @@ namespace DirectPort {
         uint32_t get_width() const;
         uint32_t get_height() const;
         DXGI_FORMAT get_format() const;
+        uintptr_t get_host_ptr();
+        uint32_t get_row_pitch() const;
+#ifdef _WIN32
         uintptr_t get_d3d11_texture_ptr();
         uintptr_t get_d3d11_srv_ptr();
         uintptr_t get_d3d11_rtv_ptr();
         uintptr_t get_d3d12_resource_ptr();
+#endif
 
     private:
         friend class DeviceD3D11;
         friend class DeviceD3D12;
+        friend class DeviceCPU;
         friend class Consumer;
         friend class Producer;
+        friend std::shared_ptr<Producer> create_host_producer(const std::string&, uint32_t, uint32_t, DXGI_FORMAT, uint32_t);
+        friend std::shared_ptr<Consumer> connect_to_host_producer(unsigned long, const std::string&);
         Texture();
+        static std::shared_ptr<Texture> create_host(uint32_t width, uint32_t height, DXGI_FORMAT format);
+        struct Impl;
+        std::unique_ptr<Impl> pImpl;
+    };
+
+    // Pins one ring slot so its frame can be read in place, without a copy. The producer writes around
+    // pinned slots; only when every other slot is pinned does it overwrite one, which is_valid() reports.
+    // Leases are meant to be held for about a frame.
+    class ReadLease {
+    public:
+        ~ReadLease();
+        void release();
+        bool is_valid() const;
+        uint64_t get_frame() const;
+        const FrameMetadata& get_metadata() const;
+        std::shared_ptr<Texture> get_texture();
+    private:
+        friend class Consumer;
+        ReadLease();
         struct Impl;
         std::unique_ptr<Impl> pImpl;
     };
@@ -67,6 +324,16 @@ namespace DirectPort {
     public:
         ~Consumer();
         bool wait_for_frame();
+        // Blocks until a frame newer than the last one seen is published, the timeout elapses,
+        // or the producer exits. A timeout of 0 polls without sleeping.
+        FrameStatus wait_for_frame(uint32_t timeout_ms);
+        // Leases the newest published frame. Returns nullptr if nothing has been published yet or the
+        // producer has no ring.
+        std::shared_ptr<ReadLease> acquire_read();
+        // Metadata of the frame the last successful wait_for_frame() moved to.
+        const FrameMetadata& get_frame_metadata() const;
+        // Time from signal_frame to this consumer picking the frame up, over the consumer's lifetime.
+        LatencyStats get_latency_stats() const;
         bool is_alive() const;
         std::shared_ptr<Texture> get_texture();
         std::shared_ptr<Texture> get_shared_texture();
@@ -74,6 +341,7 @@ namespace DirectPort {
     private:
         friend class DeviceD3D11;
         friend class DeviceD3D12;
+        friend std::shared_ptr<Consumer> connect_to_host_producer(unsigned long, const std::string&);
         Consumer();
         struct Impl;
         std::unique_ptr<Impl> pImpl;
@@ -83,9 +351,22 @@ namespace DirectPort {
     public:
         ~Producer();
         void signal_frame();
+        std::shared_ptr<Texture> get_texture();
+        // Maps the next frame for CPU writing; commit() unmaps and publishes it. Host producers hand out
+        // the ring slot itself, D3D producers a persistently reused upload resource.
+        WriteBuffer acquire_write_buffer();
+        void commit();
+        // Drops an acquired write buffer without publishing it, e.g. when filling it failed. A host slot
+        // goes back to the ring untouched by readers unless the ring has a single slot.
+        void abort_write();
+        // Staged for the next signal_frame() only; frameSequence and signalTimeUs are filled in there.
+        void set_frame_metadata(const FrameMetadata& metadata);
+        ProducerStats get_stats() const;
     private:
         friend class DeviceD3D11;
         friend class DeviceD3D12;
+        friend class DeviceCPU;
+        friend std::shared_ptr<Producer> create_host_producer(const std::string&, uint32_t, uint32_t, DXGI_FORMAT, uint32_t);
         Producer();
         struct Impl;
         std::unique_ptr<Impl> pImpl;
@@ -107,25 +388,176 @@ namespace DirectPort {
         std::unique_ptr<Impl> pImpl;
     };
 
+    constexpr uint32_t INFINITE_TIMEOUT = 0xFFFFFFFF;
+
+    // Completion of work queued by one of the *_async calls. Passing fences as dependencies to later
+    // async calls chains work without the caller blocking in between.
+    class Fence {
+    public:
+        ~Fence();
+        bool is_complete() const;
+        // Returns false if timeout_ms passes first. Rethrows the error of a failed CPU device job.
+        bool wait(uint32_t timeout_ms = INFINITE_TIMEOUT);
+    private:
+        friend class DeviceD3D11;
+        friend class DeviceD3D12;
+        friend class DeviceCPU;
+        Fence();
+        struct Impl;
+        std::unique_ptr<Impl> pImpl;
+    };
+
+    // A shader resolved once by prepare_shader: compiled to a pixel shader (D3D11), baked into a pipeline
+    // for one output format (D3D12) or bound to a native kernel (CPU). run() uses it directly, skipping
+    // the hashing, copying and cache lookups apply_shader repeats per call. Only valid on the device
+    // that prepared it.
+    class PreparedShader {
+    public:
+        ~PreparedShader();
+        const std::string& get_entry_point() const;
+        DXGI_FORMAT get_output_format() const;
+    private:
+        friend class DeviceD3D11;
+        friend class DeviceD3D12;
+        friend class DeviceCPU;
+        friend class CommandList;
+        PreparedShader();
+        struct Impl;
+        std::unique_ptr<Impl> pImpl;
+    };
+
+    // Operations recorded for a single submit(), so a frame of copies, shader runs, blits and clears
+    // costs one call and one device submission. submit() skips operations whose output is replaced by
+    // a later copy, clear or covering blit before anything reads it, records only the resource
+    // transitions the sequence needs (D3D12) and runs operations that share no texture concurrently
+    // (CPU). Textures and shaders are held until reset() and constants are copied when recorded, so
+    // a list can be recorded once and submitted every frame.
+    class CommandList {
+    public:
+        ~CommandList();
+        void copy_texture(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination);
+        void run(std::shared_ptr<PreparedShader> shader, std::shared_ptr<Texture> output, const std::vector<std::shared_ptr<Texture>>& inputs = {},
+                 const void* constants = nullptr, size_t constants_size = 0);
+        // Prepares the shader while recording, so compile errors surface here rather than in submit().
+        void apply_shader(std::shared_ptr<Texture> output, const std::vector<uint8_t>& shader_bytes, const std::string& entry_point,
+                          const std::vector<std::shared_ptr<Texture>>& inputs, const std::vector<uint8_t>& constants);
+        void blit_texture_to_region(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination,
+                                    uint32_t dest_x, uint32_t dest_y, uint32_t dest_width, uint32_t dest_height);
+        // Fills a texture with one colour; IDirectXDevice::clear is the window counterpart.
+        void clear(std::shared_ptr<Texture> texture, float r, float g, float b, float a);
+
+        size_t size() const;
+        void reset();
+        // Same as get_device()->submit(*this, dependencies).
+        std::shared_ptr<Fence> submit(const std::vector<std::shared_ptr<Fence>>& dependencies = {});
+        std::shared_ptr<IDirectXDevice> get_device() const;
+    private:
+        friend class DeviceD3D11;
+        friend class DeviceD3D12;
+        friend class DeviceCPU;
+        explicit CommandList(std::shared_ptr<IDirectXDevice> device);
+        struct Impl;
+        std::unique_ptr<Impl> pImpl;
+    };
+
     class IDirectXDevice {
     public:
         virtual ~IDirectXDevice() = default;
 
         virtual std::shared_ptr<Texture> create_texture(uint32_t width, uint32_t height, DXGI_FORMAT format, const void* data = nullptr, size_t data_size = 0) = 0;
         virtual std::shared_ptr<Producer> create_producer(const std::string& stream_name, std::shared_ptr<Texture> texture) = 0;
-        virtual std::shared_ptr<Consumer> connect_to_producer(unsigned long pid) = 0;
+        // An empty stream_name connects to the first stream the process published.
+        virtual std::shared_ptr<Consumer> connect_to_producer(unsigned long pid, const std::string& stream_name = "") = 0;
         virtual std::shared_ptr<Window> create_window(uint32_t width, uint32_t height, const std::string& title) = 0;
         virtual void resize_window(std::shared_ptr<Window> window) = 0;
 
         virtual void apply_shader(std::shared_ptr<Texture> output, const std::vector<uint8_t>& shader_bytes, const std::string& entry_point, const std::vector<std::shared_ptr<Texture>>& inputs, const std::vector<uint8_t>& constants) = 0;
+        // D3D12 pipelines are built for output_format and run() rejects outputs of any other format;
+        // the other devices accept any output.
+        virtual std::shared_ptr<PreparedShader> prepare_shader(const std::vector<uint8_t>& shader_bytes, const std::string& entry_point, DXGI_FORMAT output_format) = 0;
+        virtual void run(const PreparedShader& shader, std::shared_ptr<Texture> output, const std::vector<std::shared_ptr<Texture>>& inputs, const void* constants = nullptr, size_t constants_size = 0) = 0;
         virtual void copy_texture(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination) = 0;
         virtual void blit(std::shared_ptr<Texture> source, std::shared_ptr<Window> destination) = 0;
         virtual void clear(std::shared_ptr<Window> window, float r, float g, float b, float a) = 0;
         
         virtual void blit_texture_to_region(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination,
                                             uint32_t dest_x, uint32_t dest_y, uint32_t dest_width, uint32_t dest_height) = 0;
+
+        // Queue the operation and return without waiting for it. Textures and constants are kept alive
+        // until the fence completes. A D3D device executes its own work in submission order, so
+        // dependencies matter for fences of other devices, which D3D12 and D3D11 wait on in their queue
+        // where the fence allows and on the host otherwise. The CPU device runs jobs on
+        // CPU::JobQueue::shared(), where only dependencies order them. Synchronous calls never wait for
+        // queued work, so wait on its fence before touching its textures from the host.
+        virtual std::shared_ptr<Fence> run_async(const PreparedShader& shader, std::shared_ptr<Texture> output, const std::vector<std::shared_ptr<Texture>>& inputs,
+                                                 const void* constants = nullptr, size_t constants_size = 0, const std::vector<std::shared_ptr<Fence>>& dependencies = {}) = 0;
+        virtual std::shared_ptr<Fence> copy_texture_async(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination, const std::vector<std::shared_ptr<Fence>>& dependencies = {}) = 0;
+        virtual std::shared_ptr<Fence> blit_texture_to_region_async(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination,
+                                                                    uint32_t dest_x, uint32_t dest_y, uint32_t dest_width, uint32_t dest_height,
+                                                                    const std::vector<std::shared_ptr<Fence>>& dependencies = {}) = 0;
+
+        virtual std::shared_ptr<CommandList> create_command_list() = 0;
+        // Executes a list recorded on this device as one submission, with the same dependency and
+        // lifetime rules as the *_async calls. Invalid operations throw before anything is queued.
+        virtual std::shared_ptr<Fence> submit(const CommandList& list, const std::vector<std::shared_ptr<Fence>>& dependencies = {}) = 0;
+
+        // Hands out a recycled texture of this size and format when the device's pool has one idle, and
+        // takes it back when the last reference drops. Contents are undefined. Per-call scratch (constant
+        // buffers, descriptor heaps) comes from the same pool, so steady-state frames allocate nothing.
+        virtual std::shared_ptr<Texture> acquire_texture(uint32_t width, uint32_t height, DXGI_FORMAT format) = 0;
+        // Caps the idle bytes the pool keeps, evicting least recently used resources; 0 empties it.
+        virtual void set_pool_budget(uint64_t bytes) = 0;
+        virtual PoolStats get_pool_stats() = 0;
+
+        // Compiled shaders (pipelines on D3D12, kernels on the CPU device) are cached by a hash of the
+        // shader bytes, entry point and output format, least recently used first out past the capacity.
+        virtual void set_shader_cache_capacity(size_t entries) = 0;
+        virtual ShaderCacheStats get_shader_cache_stats() = 0;
+    };
+
+    // Headless software backend. Textures are cache-line aligned, pitch-padded host buffers and streams
+    // use the host shared-memory transport, so it runs anywhere and gives a baseline for the GPU devices.
+    // Windows are not supported.
+    class DeviceCPU : public IDirectXDevice, public std::enable_shared_from_this<DeviceCPU> {
+    public:
+        static std::shared_ptr<DeviceCPU> create();
+        ~DeviceCPU() override;
+
+        std::shared_ptr<Texture> create_texture(uint32_t width, uint32_t height, DXGI_FORMAT format, const void* data = nullptr, size_t data_size = 0) override;
+        std::shared_ptr<Producer> create_producer(const std::string& stream_name, std::shared_ptr<Texture> texture) override;
+        std::shared_ptr<Consumer> connect_to_producer(unsigned long pid, const std::string& stream_name = "") override;
+        std::shared_ptr<Window> create_window(uint32_t width, uint32_t height, const std::string& title) override;
+        void resize_window(std::shared_ptr<Window> window) override;
+
+        void apply_shader(std::shared_ptr<Texture> output, const std::vector<uint8_t>& shader_bytes, const std::string& entry_point, const std::vector<std::shared_ptr<Texture>>& inputs, const std::vector<uint8_t>& constants) override;
+        std::shared_ptr<PreparedShader> prepare_shader(const std::vector<uint8_t>& shader_bytes, const std::string& entry_point, DXGI_FORMAT output_format) override;
+        void run(const PreparedShader& shader, std::shared_ptr<Texture> output, const std::vector<std::shared_ptr<Texture>>& inputs, const void* constants = nullptr, size_t constants_size = 0) override;
+        void copy_texture(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination) override;
+        void blit(std::shared_ptr<Texture> source, std::shared_ptr<Window> destination) override;
+        void clear(std::shared_ptr<Window> window, float r, float g, float b, float a) override;
+        void blit_texture_to_region(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination,
+                                    uint32_t dest_x, uint32_t dest_y, uint32_t dest_width, uint32_t dest_height) override;
+        std::shared_ptr<Fence> run_async(const PreparedShader& shader, std::shared_ptr<Texture> output, const std::vector<std::shared_ptr<Texture>>& inputs,
+                                         const void* constants = nullptr, size_t constants_size = 0, const std::vector<std::shared_ptr<Fence>>& dependencies = {}) override;
+        std::shared_ptr<Fence> copy_texture_async(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination, const std::vector<std::shared_ptr<Fence>>& dependencies = {}) override;
+        std::shared_ptr<Fence> blit_texture_to_region_async(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination,
+                                                            uint32_t dest_x, uint32_t dest_y, uint32_t dest_width, uint32_t dest_height,
+                                                            const std::vector<std::shared_ptr<Fence>>& dependencies = {}) override;
+        std::shared_ptr<CommandList> create_command_list() override;
+        std::shared_ptr<Fence> submit(const CommandList& list, const std::vector<std::shared_ptr<Fence>>& dependencies = {}) override;
+        std::shared_ptr<Texture> acquire_texture(uint32_t width, uint32_t height, DXGI_FORMAT format) override;
+        void set_pool_budget(uint64_t bytes) override;
+        PoolStats get_pool_stats() override;
+        void set_shader_cache_capacity(size_t entries) override;
+        ShaderCacheStats get_shader_cache_stats() override;
+
+    private:
+        DeviceCPU();
+        struct Impl;
+        std::unique_ptr<Impl> pImpl;
     };
 
+#ifdef _WIN32
     class DeviceD3D11 : public IDirectXDevice, public std::enable_shared_from_this<DeviceD3D11> {
     public:
         static std::shared_ptr<DeviceD3D11> create();
@@ -133,16 +565,31 @@ namespace DirectPort {
 
         std::shared_ptr<Texture> create_texture(uint32_t width, uint32_t height, DXGI_FORMAT format, const void* data = nullptr, size_t data_size = 0) override;
         std::shared_ptr<Producer> create_producer(const std::string& stream_name, std::shared_ptr<Texture> texture) override;
-        std::shared_ptr<Consumer> connect_to_producer(unsigned long pid) override;
+        std::shared_ptr<Consumer> connect_to_producer(unsigned long pid, const std::string& stream_name = "") override;
         std::shared_ptr<Window> create_window(uint32_t width, uint32_t height, const std::string& title) override;
         void resize_window(std::shared_ptr<Window> window) override;
 
         void apply_shader(std::shared_ptr<Texture> output, const std::vector<uint8_t>& shader_bytes, const std::string& entry_point, const std::vector<std::shared_ptr<Texture>>& inputs, const std::vector<uint8_t>& constants) override;
+        std::shared_ptr<PreparedShader> prepare_shader(const std::vector<uint8_t>& shader_bytes, const std::string& entry_point, DXGI_FORMAT output_format) override;
+        void run(const PreparedShader& shader, std::shared_ptr<Texture> output, const std::vector<std::shared_ptr<Texture>>& inputs, const void* constants = nullptr, size_t constants_size = 0) override;
         void copy_texture(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination) override;
         void blit(std::shared_ptr<Texture> source, std::shared_ptr<Window> destination) override;
         void clear(std::shared_ptr<Window> window, float r, float g, float b, float a) override;
         void blit_texture_to_region(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination,
                                     uint32_t dest_x, uint32_t dest_y, uint32_t dest_width, uint32_t dest_height) override;
+        std::shared_ptr<Fence> run_async(const PreparedShader& shader, std::shared_ptr<Texture> output, const std::vector<std::shared_ptr<Texture>>& inputs,
+                                         const void* constants = nullptr, size_t constants_size = 0, const std::vector<std::shared_ptr<Fence>>& dependencies = {}) override;
+        std::shared_ptr<Fence> copy_texture_async(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination, const std::vector<std::shared_ptr<Fence>>& dependencies = {}) override;
+        std::shared_ptr<Fence> blit_texture_to_region_async(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination,
+                                                            uint32_t dest_x, uint32_t dest_y, uint32_t dest_width, uint32_t dest_height,
+                                                            const std::vector<std::shared_ptr<Fence>>& dependencies = {}) override;
+        std::shared_ptr<CommandList> create_command_list() override;
+        std::shared_ptr<Fence> submit(const CommandList& list, const std::vector<std::shared_ptr<Fence>>& dependencies = {}) override;
+        std::shared_ptr<Texture> acquire_texture(uint32_t width, uint32_t height, DXGI_FORMAT format) override;
+        void set_pool_budget(uint64_t bytes) override;
+        PoolStats get_pool_stats() override;
+        void set_shader_cache_capacity(size_t entries) override;
+        ShaderCacheStats get_shader_cache_stats() override;
 
     private:
         DeviceD3D11();
@@ -157,16 +604,31 @@ namespace DirectPort {
 
         std::shared_ptr<Texture> create_texture(uint32_t width, uint32_t height, DXGI_FORMAT format, const void* data = nullptr, size_t data_size = 0) override;
         std::shared_ptr<Producer> create_producer(const std::string& stream_name, std::shared_ptr<Texture> texture) override;
-        std::shared_ptr<Consumer> connect_to_producer(unsigned long pid) override;
+        std::shared_ptr<Consumer> connect_to_producer(unsigned long pid, const std::string& stream_name = "") override;
         std::shared_ptr<Window> create_window(uint32_t width, uint32_t height, const std::string& title) override;
         void resize_window(std::shared_ptr<Window> window) override;
         
         void apply_shader(std::shared_ptr<Texture> output, const std::vector<uint8_t>& shader_bytes, const std::string& entry_point, const std::vector<std::shared_ptr<Texture>>& inputs, const std::vector<uint8_t>& constants) override;
+        std::shared_ptr<PreparedShader> prepare_shader(const std::vector<uint8_t>& shader_bytes, const std::string& entry_point, DXGI_FORMAT output_format) override;
+        void run(const PreparedShader& shader, std::shared_ptr<Texture> output, const std::vector<std::shared_ptr<Texture>>& inputs, const void* constants = nullptr, size_t constants_size = 0) override;
         void copy_texture(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination) override;
         void blit(std::shared_ptr<Texture> source, std::shared_ptr<Window> destination) override;
         void clear(std::shared_ptr<Window> window, float r, float g, float b, float a) override;
         void blit_texture_to_region(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination,
                                     uint32_t dest_x, uint32_t dest_y, uint32_t dest_width, uint32_t dest_height) override;
+        std::shared_ptr<Fence> run_async(const PreparedShader& shader, std::shared_ptr<Texture> output, const std::vector<std::shared_ptr<Texture>>& inputs,
+                                         const void* constants = nullptr, size_t constants_size = 0, const std::vector<std::shared_ptr<Fence>>& dependencies = {}) override;
+        std::shared_ptr<Fence> copy_texture_async(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination, const std::vector<std::shared_ptr<Fence>>& dependencies = {}) override;
+        std::shared_ptr<Fence> blit_texture_to_region_async(std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination,
+                                                            uint32_t dest_x, uint32_t dest_y, uint32_t dest_width, uint32_t dest_height,
+                                                            const std::vector<std::shared_ptr<Fence>>& dependencies = {}) override;
+        std::shared_ptr<CommandList> create_command_list() override;
+        std::shared_ptr<Fence> submit(const CommandList& list, const std::vector<std::shared_ptr<Fence>>& dependencies = {}) override;
+        std::shared_ptr<Texture> acquire_texture(uint32_t width, uint32_t height, DXGI_FORMAT format) override;
+        void set_pool_budget(uint64_t bytes) override;
+        PoolStats get_pool_stats() override;
+        void set_shader_cache_capacity(size_t entries) override;
+        ShaderCacheStats get_shader_cache_stats() override;
 
     private:
         DeviceD3D12();
@@ -174,4 +636,5 @@ namespace DirectPort {
         void WaitForGpu();
         std::unique_ptr<Impl> pImpl;
     };
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,2250 @@
+#include "DirectPortCPU.h"
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <map>
+#include <deque>
+#include <chrono>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define DP_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#else
+#define DP_X86 0
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define DP_NEON 1
+#include <arm_neon.h>
+#else
+#define DP_NEON 0
+#endif
+
+// GCC and Clang only emit wider instructions inside functions that opt in; MSVC allows them anywhere.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define DP_TARGET(isa)
+#else
+#define DP_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+using namespace DirectPort;
+using namespace DirectPort::CPU;
+
+namespace {
+    inline Pixel lerp(const Pixel& a, const Pixel& b, float t) {
+        return { a.r + (b.r - a.r) * t, a.g + (b.g - a.g) * t, a.b + (b.b - a.b) * t, a.a + (b.a - a.a) * t };
+    }
+
+    inline uint32_t load32(const uint8_t* p) {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+
+    // Clamp-addressed bilinear taps along one axis. Offsets are index * stride, weights the fraction
+    // towards `second`, both as float and as Q15 for the fixed-point kernels.
+    struct AxisTaps {
+        std::vector<int32_t> first;
+        std::vector<int32_t> second;
+        std::vector<float> weight;
+        std::vector<int16_t> fixedWeight;
+    };
+
+    AxisTaps make_axis_taps(uint32_t sourceSize, uint32_t destSize, uint32_t count, uint32_t stride) {
+        AxisTaps taps;
+        taps.first.resize(count);
+        taps.second.resize(count);
+        taps.weight.resize(count);
+        taps.fixedWeight.resize(count);
+        const float scale = (float)sourceSize / (float)destSize;
+        for (uint32_t i = 0; i < count; ++i) {
+            float coordinate = (i + 0.5f) * scale - 0.5f;
+            float base = std::floor(coordinate);
+            int32_t index = (int32_t)base;
+            taps.first[i] = std::min(std::max(index, 0), (int32_t)sourceSize - 1) * (int32_t)stride;
+            taps.second[i] = std::min(std::max(index + 1, 0), (int32_t)sourceSize - 1) * (int32_t)stride;
+            taps.weight[i] = coordinate - base;
+            taps.fixedWeight[i] = (int16_t)std::min(32767L, std::lround(taps.weight[i] * 32768.0f));
+        }
+        return taps;
+    }
+
+    struct BlitRow {
+        const uint8_t* top;
+        const uint8_t* bottom;
+        uint8_t* out;
+        uint32_t columns;
+        int16_t fixedWeight;
+        float weight;
+    };
+
+    struct BlitColumns {
+        AxisTaps x;
+        std::vector<int16_t> fixedWeight4; // x.fixedWeight repeated for each channel of a pixel.
+        DXGI_FORMAT sourceFormat;
+        DXGI_FORMAT destFormat;
+        uint32_t sourceBpp;
+        uint32_t destBpp;
+        bool swapRedBlue;
+    };
+
+    // 8-bit four-channel kernels work on channels scaled to Q7 in 16-bit lanes and blend with a Q15
+    // rounding multiply, t = a + ((b - a) * w + 2^14) >> 15, which every ISA below computes bit-exactly.
+    inline int32_t lerp_q15(int32_t a, int32_t b, int32_t w) {
+        return a + (((b - a) * w + 16384) >> 15);
+    }
+
+    void blit_row_rgba8_scalar(const BlitRow& row, const BlitColumns& cols, uint32_t begin) {
+        static const int swizzle[2][4] = { { 0, 1, 2, 3 }, { 2, 1, 0, 3 } };
+        const int* map = swizzle[cols.swapRedBlue ? 1 : 0];
+        for (uint32_t x = begin; x < row.columns; ++x) {
+            const uint8_t* a0 = row.top + cols.x.first[x];
+            const uint8_t* a1 = row.top + cols.x.second[x];
+            const uint8_t* b0 = row.bottom + cols.x.first[x];
+            const uint8_t* b1 = row.bottom + cols.x.second[x];
+            const int32_t wx = cols.x.fixedWeight[x];
+            for (int c = 0; c < 4; ++c) {
+                int32_t top = lerp_q15(a0[c] << 7, a1[c] << 7, wx);
+                int32_t bottom = lerp_q15(b0[c] << 7, b1[c] << 7, wx);
+                row.out[x * 4 + map[c]] = (uint8_t)((lerp_q15(top, bottom, row.fixedWeight) + 64) >> 7);
+            }
+        }
+    }
+
+#if DP_X86
+    DP_TARGET("sse4.1") inline __m128i lerp_q15_sse(__m128i a, __m128i b, __m128i w) {
+        return _mm_add_epi16(a, _mm_mulhrs_epi16(_mm_sub_epi16(b, a), w));
+    }
+
+    DP_TARGET("sse4.1") void blit_row_rgba8_sse41(const BlitRow& row, const BlitColumns& cols, uint32_t) {
+        const __m128i wy = _mm_set1_epi16(row.fixedWeight);
+        const __m128i round = _mm_set1_epi16(64);
+        const __m128i swap = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+        const int32_t* first = cols.x.first.data();
+        const int32_t* second = cols.x.second.data();
+        uint32_t x = 0;
+        for (; x + 4 <= row.columns; x += 4) {
+            __m128i a0 = _mm_setr_epi32(load32(row.top + first[x]), load32(row.top + first[x + 1]), load32(row.top + first[x + 2]), load32(row.top + first[x + 3]));
+            __m128i a1 = _mm_setr_epi32(load32(row.top + second[x]), load32(row.top + second[x + 1]), load32(row.top + second[x + 2]), load32(row.top + second[x + 3]));
+            __m128i b0 = _mm_setr_epi32(load32(row.bottom + first[x]), load32(row.bottom + first[x + 1]), load32(row.bottom + first[x + 2]), load32(row.bottom + first[x + 3]));
+            __m128i b1 = _mm_setr_epi32(load32(row.bottom + second[x]), load32(row.bottom + second[x + 1]), load32(row.bottom + second[x + 2]), load32(row.bottom + second[x + 3]));
+            __m128i wlo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&cols.fixedWeight4[x * 4]));
+            __m128i whi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&cols.fixedWeight4[x * 4 + 8]));
+
+            __m128i lo = lerp_q15_sse(lerp_q15_sse(_mm_slli_epi16(_mm_cvtepu8_epi16(a0), 7), _mm_slli_epi16(_mm_cvtepu8_epi16(a1), 7), wlo),
+                                      lerp_q15_sse(_mm_slli_epi16(_mm_cvtepu8_epi16(b0), 7), _mm_slli_epi16(_mm_cvtepu8_epi16(b1), 7), wlo), wy);
+            __m128i hi = lerp_q15_sse(lerp_q15_sse(_mm_slli_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(a0, 8)), 7), _mm_slli_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(a1, 8)), 7), whi),
+                                      lerp_q15_sse(_mm_slli_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(b0, 8)), 7), _mm_slli_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(b1, 8)), 7), whi), wy);
+            __m128i result = _mm_packus_epi16(_mm_srli_epi16(_mm_add_epi16(lo, round), 7), _mm_srli_epi16(_mm_add_epi16(hi, round), 7));
+            if (cols.swapRedBlue) result = _mm_shuffle_epi8(result, swap);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(row.out + x * 4), result);
+        }
+        blit_row_rgba8_scalar(row, cols, x);
+    }
+
+    DP_TARGET("avx2") inline __m256i lerp_q15_avx2(__m256i a, __m256i b, __m256i w) {
+        return _mm256_add_epi16(a, _mm256_mulhrs_epi16(_mm256_sub_epi16(b, a), w));
+    }
+
+    DP_TARGET("avx2") inline __m256i widen_q7_avx2(__m256i pixels, bool high) {
+        const __m256i zero = _mm256_setzero_si256();
+        return _mm256_slli_epi16(high ? _mm256_unpackhi_epi8(pixels, zero) : _mm256_unpacklo_epi8(pixels, zero), 7);
+    }
+
+    DP_TARGET("avx2") void blit_row_rgba8_avx2(const BlitRow& row, const BlitColumns& cols, uint32_t) {
+        const __m256i wy = _mm256_set1_epi16(row.fixedWeight);
+        const __m256i round = _mm256_set1_epi16(64);
+        const __m256i swap = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15, 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+        const int* top = reinterpret_cast<const int*>(row.top);
+        const int* bottom = reinterpret_cast<const int*>(row.bottom);
+        uint32_t x = 0;
+        for (; x + 8 <= row.columns; x += 8) {
+            __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&cols.x.first[x]));
+            __m256i second = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&cols.x.second[x]));
+            __m256i a0 = _mm256_i32gather_epi32(top, first, 1);
+            __m256i a1 = _mm256_i32gather_epi32(top, second, 1);
+            __m256i b0 = _mm256_i32gather_epi32(bottom, first, 1);
+            __m256i b1 = _mm256_i32gather_epi32(bottom, second, 1);
+            // unpacklo/hi work per 128-bit lane, so the low half holds pixels {0,1,4,5} and the high half {2,3,6,7}.
+            __m256i w0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&cols.fixedWeight4[x * 4]));
+            __m256i w1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&cols.fixedWeight4[x * 4 + 16]));
+            __m256i wlo = _mm256_permute2x128_si256(w0, w1, 0x20);
+            __m256i whi = _mm256_permute2x128_si256(w0, w1, 0x31);
+
+            __m256i lo = lerp_q15_avx2(lerp_q15_avx2(widen_q7_avx2(a0, false), widen_q7_avx2(a1, false), wlo),
+                                       lerp_q15_avx2(widen_q7_avx2(b0, false), widen_q7_avx2(b1, false), wlo), wy);
+            __m256i hi = lerp_q15_avx2(lerp_q15_avx2(widen_q7_avx2(a0, true), widen_q7_avx2(a1, true), whi),
+                                       lerp_q15_avx2(widen_q7_avx2(b0, true), widen_q7_avx2(b1, true), whi), wy);
+            __m256i result = _mm256_packus_epi16(_mm256_srli_epi16(_mm256_add_epi16(lo, round), 7), _mm256_srli_epi16(_mm256_add_epi16(hi, round), 7));
+            if (cols.swapRedBlue) result = _mm256_shuffle_epi8(result, swap);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(row.out + x * 4), result);
+        }
+        blit_row_rgba8_scalar(row, cols, x);
+    }
+
+    void blit_row_float4_sse(const BlitRow& row, const BlitColumns& cols, uint32_t) {
+        const __m128 wy = _mm_set1_ps(row.weight);
+        for (uint32_t x = 0; x < row.columns; ++x) {
+            const __m128 wx = _mm_set1_ps(cols.x.weight[x]);
+            __m128 a0 = _mm_loadu_ps(reinterpret_cast<const float*>(row.top + cols.x.first[x]));
+            __m128 a1 = _mm_loadu_ps(reinterpret_cast<const float*>(row.top + cols.x.second[x]));
+            __m128 b0 = _mm_loadu_ps(reinterpret_cast<const float*>(row.bottom + cols.x.first[x]));
+            __m128 b1 = _mm_loadu_ps(reinterpret_cast<const float*>(row.bottom + cols.x.second[x]));
+            __m128 t = _mm_add_ps(a0, _mm_mul_ps(_mm_sub_ps(a1, a0), wx));
+            __m128 b = _mm_add_ps(b0, _mm_mul_ps(_mm_sub_ps(b1, b0), wx));
+            _mm_storeu_ps(reinterpret_cast<float*>(row.out + x * 16), _mm_add_ps(t, _mm_mul_ps(_mm_sub_ps(b, t), wy)));
+        }
+    }
+#endif
+
+#if DP_NEON
+    inline int16x8_t lerp_q15_neon(int16x8_t a, int16x8_t b, int16x8_t w) {
+        return vaddq_s16(a, vqrdmulhq_s16(vsubq_s16(b, a), w));
+    }
+
+    inline uint8x16_t gather4_neon(const uint8_t* base, const int32_t* offsets) {
+        uint32_t pixels[4] = { load32(base + offsets[0]), load32(base + offsets[1]), load32(base + offsets[2]), load32(base + offsets[3]) };
+        return vreinterpretq_u8_u32(vld1q_u32(pixels));
+    }
+
+    inline int16x8_t widen_q7_neon(uint8x8_t pixels) {
+        return vreinterpretq_s16_u16(vshll_n_u8(pixels, 7));
+    }
+
+    void blit_row_rgba8_neon(const BlitRow& row, const BlitColumns& cols, uint32_t) {
+        static const uint8_t swapTable[16] = { 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15 };
+        const uint8x16_t swap = vld1q_u8(swapTable);
+        const int16x8_t wy = vdupq_n_s16(row.fixedWeight);
+        const int32_t* first = cols.x.first.data();
+        const int32_t* second = cols.x.second.data();
+        uint32_t x = 0;
+        for (; x + 4 <= row.columns; x += 4) {
+            uint8x16_t a0 = gather4_neon(row.top, first + x), a1 = gather4_neon(row.top, second + x);
+            uint8x16_t b0 = gather4_neon(row.bottom, first + x), b1 = gather4_neon(row.bottom, second + x);
+            int16x8_t wlo = vld1q_s16(&cols.fixedWeight4[x * 4]);
+            int16x8_t whi = vld1q_s16(&cols.fixedWeight4[x * 4 + 8]);
+            int16x8_t lo = lerp_q15_neon(lerp_q15_neon(widen_q7_neon(vget_low_u8(a0)), widen_q7_neon(vget_low_u8(a1)), wlo),
+                                         lerp_q15_neon(widen_q7_neon(vget_low_u8(b0)), widen_q7_neon(vget_low_u8(b1)), wlo), wy);
+            int16x8_t hi = lerp_q15_neon(lerp_q15_neon(widen_q7_neon(vget_high_u8(a0)), widen_q7_neon(vget_high_u8(a1)), whi),
+                                         lerp_q15_neon(widen_q7_neon(vget_high_u8(b0)), widen_q7_neon(vget_high_u8(b1)), whi), wy);
+            uint8x16_t result = vcombine_u8(vqrshrun_n_s16(lo, 7), vqrshrun_n_s16(hi, 7));
+            if (cols.swapRedBlue) result = vqtbl1q_u8(result, swap);
+            vst1q_u8(row.out + x * 4, result);
+        }
+        blit_row_rgba8_scalar(row, cols, x);
+    }
+
+    void blit_row_float4_neon(const BlitRow& row, const BlitColumns& cols, uint32_t) {
+        for (uint32_t x = 0; x < row.columns; ++x) {
+            const float wx = cols.x.weight[x];
+            float32x4_t a0 = vld1q_f32(reinterpret_cast<const float*>(row.top + cols.x.first[x]));
+            float32x4_t a1 = vld1q_f32(reinterpret_cast<const float*>(row.top + cols.x.second[x]));
+            float32x4_t b0 = vld1q_f32(reinterpret_cast<const float*>(row.bottom + cols.x.first[x]));
+            float32x4_t b1 = vld1q_f32(reinterpret_cast<const float*>(row.bottom + cols.x.second[x]));
+            float32x4_t t = vmlaq_n_f32(a0, vsubq_f32(a1, a0), wx);
+            float32x4_t b = vmlaq_n_f32(b0, vsubq_f32(b1, b0), wx);
+            vst1q_f32(reinterpret_cast<float*>(row.out + x * 16), vmlaq_n_f32(t, vsubq_f32(b, t), row.weight));
+        }
+    }
+#endif
+
+    // Any format pair: decode to float RGBA, filter, encode. Both conversions are resolved per row.
+    void blit_row_generic(const BlitRow& row, const BlitColumns& cols, uint32_t) {
+        with_pixel_format(cols.sourceFormat, [&](auto in) {
+            using In = decltype(in);
+            with_pixel_format(cols.destFormat, [&](auto out) {
+                using Out = decltype(out);
+                for (uint32_t x = 0; x < row.columns; ++x) {
+                    const uint8_t* a0 = row.top + cols.x.first[x];
+                    const uint8_t* a1 = row.top + cols.x.second[x];
+                    const uint8_t* b0 = row.bottom + cols.x.first[x];
+                    const uint8_t* b1 = row.bottom + cols.x.second[x];
+                    Pixel top = lerp(In::load(a0), In::load(a1), cols.x.weight[x]);
+                    Pixel bottom = lerp(In::load(b0), In::load(b1), cols.x.weight[x]);
+                    Out::store(row.out + (size_t)x * Out::size, lerp(top, bottom, row.weight));
+                }
+            });
+        });
+    }
+
+    using BlitRowFn = void (*)(const BlitRow&, const BlitColumns&, uint32_t);
+
+    bool is_rgba8(DXGI_FORMAT format) {
+        return format == DXGI_FORMAT_B8G8R8A8_UNORM || format == DXGI_FORMAT_R8G8B8A8_UNORM;
+    }
+
+    BlitRowFn select_blit_row(DXGI_FORMAT sourceFormat, DXGI_FORMAT destFormat) {
+        const Isa isa = get_isa();
+        (void)isa;
+        if (is_rgba8(sourceFormat) && is_rgba8(destFormat)) {
+#if DP_X86
+            if (isa == Isa::AVX2) return blit_row_rgba8_avx2;
+            if (isa == Isa::SSE41) return blit_row_rgba8_sse41;
+#endif
+#if DP_NEON
+            if (isa == Isa::NEON) return blit_row_rgba8_neon;
+#endif
+            return blit_row_rgba8_scalar;
+        }
+        if (sourceFormat == DXGI_FORMAT_R32G32B32A32_FLOAT && destFormat == DXGI_FORMAT_R32G32B32A32_FLOAT) {
+#if DP_X86
+            return blit_row_float4_sse;
+#endif
+#if DP_NEON
+            return blit_row_float4_neon;
+#endif
+        }
+        return blit_row_generic;
+    }
+
+    // Below this many output pixels a blit or kernel is cheaper to run on the calling thread than to distribute.
+    const uint64_t g_parallelBlitPixels = 64 * 1024;
+    const uint32_t g_bandsPerThread = 4;
+
+    thread_local bool t_inPoolTask = false;
+
+    Isa detect_isa() {
+        Isa detected = Isa::Scalar;
+#if DP_NEON
+        detected = Isa::NEON;
+#elif DP_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 0);
+        const int maxLeaf = info[0];
+        __cpuid(info, 1);
+        const bool sse41 = (info[2] & (1 << 19)) != 0;
+        const bool f16c = (info[2] & (1 << 29)) != 0;
+        const bool osAvx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+        bool avx2 = false;
+        if (maxLeaf >= 7 && osAvx) {
+            __cpuidex(info, 7, 0);
+            avx2 = (info[1] & (1 << 5)) != 0;
+        }
+#else
+        __builtin_cpu_init();
+        const bool sse41 = __builtin_cpu_supports("sse4.1");
+        const bool avx2 = __builtin_cpu_supports("avx2");
+        const bool f16c = __builtin_cpu_supports("f16c");
+#endif
+        // Every AVX2 part also has F16C; requiring both lets AVX2 kernels pack half floats.
+        detected = avx2 && f16c ? Isa::AVX2 : sse41 ? Isa::SSE41 : Isa::Scalar;
+#endif
+        // DIRECTPORT_ISA can only lower the level, for benchmarking against the narrower kernels.
+        if (const char* requested = std::getenv("DIRECTPORT_ISA")) {
+            const std::string name = requested;
+            if (name == "scalar") return Isa::Scalar;
+            if (name == "sse41" && detected == Isa::AVX2) return Isa::SSE41;
+        }
+        return detected;
+    }
+}
+
+Isa CPU::get_isa() {
+    static const Isa isa = detect_isa();
+    return isa;
+}
+
+const char* CPU::get_isa_name(Isa isa) {
+    switch (isa) {
+        case Isa::SSE41: return "sse4.1";
+        case Isa::AVX2: return "avx2";
+        case Isa::NEON: return "neon";
+        default: return "scalar";
+    }
+}
+
+struct ThreadPool::Impl {
+    std::vector<std::thread> workers;
+    std::mutex submitMutex;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(uint32_t)>* task = nullptr;
+    uint32_t count = 0;
+    std::atomic<uint32_t> next{0};
+    size_t pending = 0;
+    uint64_t generation = 0;
+    std::exception_ptr error;
+    bool stopping = false;
+
+    void run_tasks() {
+        t_inPoolTask = true;
+        for (uint32_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+            try {
+                (*task)(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) error = std::current_exception();
+            }
+        }
+        t_inPoolTask = false;
+    }
+
+    void worker_loop() {
+        uint64_t seen = 0;
+        for (;;) {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            lock.unlock();
+            run_tasks();
+            lock.lock();
+            if (--pending == 0) done.notify_all();
+        }
+    }
+};
+
+ThreadPool::ThreadPool(unsigned thread_count) : pImpl(std::make_unique<Impl>()) {
+    // The thread calling parallel_for is one of the thread_count.
+    for (unsigned i = 1; i < thread_count; ++i) {
+        pImpl->workers.emplace_back([impl = pImpl.get()] { impl->worker_loop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(pImpl->mutex);
+        pImpl->stopping = true;
+    }
+    pImpl->wake.notify_all();
+    for (auto& worker : pImpl->workers) worker.join();
+}
+
+void ThreadPool::parallel_for(uint32_t count, const std::function<void(uint32_t)>& task) {
+    if (count == 0) return;
+    if (count == 1 || pImpl->workers.empty() || t_inPoolTask) {
+        for (uint32_t i = 0; i < count; ++i) task(i);
+        return;
+    }
+    std::lock_guard<std::mutex> submit(pImpl->submitMutex);
+    {
+        std::lock_guard<std::mutex> lock(pImpl->mutex);
+        pImpl->task = &task;
+        pImpl->count = count;
+        pImpl->next = 0;
+        pImpl->pending = pImpl->workers.size();
+        pImpl->error = nullptr;
+        ++pImpl->generation;
+    }
+    pImpl->wake.notify_all();
+    pImpl->run_tasks();
+    std::unique_lock<std::mutex> lock(pImpl->mutex);
+    // Every worker must have left the job before `task` goes out of scope.
+    pImpl->done.wait(lock, [&] { return pImpl->pending == 0; });
+    if (pImpl->error) std::rethrow_exception(pImpl->error);
+}
+
+unsigned ThreadPool::get_thread_count() const {
+    return (unsigned)pImpl->workers.size() + 1;
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
+
+struct JobEvent::Impl {
+    mutable std::mutex mutex;
+    std::condition_variable completed;
+    bool complete = false;
+    std::exception_ptr error;
+    std::vector<std::function<void(const std::exception_ptr&)>> continuations;
+
+    void finish(std::exception_ptr failure) {
+        std::vector<std::function<void(const std::exception_ptr&)>> pending;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            complete = true;
+            error = failure;
+            pending.swap(continuations);
+        }
+        completed.notify_all();
+        for (auto& continuation : pending) continuation(failure);
+    }
+
+    // Calls continuation(error) once the job completes, right away if it already has.
+    void then(std::function<void(const std::exception_ptr&)> continuation) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!complete) {
+            continuations.push_back(std::move(continuation));
+            return;
+        }
+        std::exception_ptr failure = error;
+        lock.unlock();
+        continuation(failure);
+    }
+};
+
+JobEvent::JobEvent() : pImpl(std::make_unique<Impl>()) {}
+JobEvent::~JobEvent() = default;
+
+bool JobEvent::is_complete() const {
+    std::lock_guard<std::mutex> lock(pImpl->mutex);
+    return pImpl->complete;
+}
+
+bool JobEvent::wait(uint32_t timeout_ms) {
+    std::unique_lock<std::mutex> lock(pImpl->mutex);
+    if (timeout_ms == INFINITE_TIMEOUT) {
+        pImpl->completed.wait(lock, [&] { return pImpl->complete; });
+    } else if (!pImpl->completed.wait_for(lock, std::chrono::milliseconds(timeout_ms), [&] { return pImpl->complete; })) {
+        return false;
+    }
+    if (pImpl->error) std::rethrow_exception(pImpl->error);
+    return true;
+}
+
+struct JobQueue::Impl {
+    // A submitted job and the dependencies it is still waiting for; the last one to finish queues it.
+    struct Pending {
+        std::function<void()> job;
+        std::shared_ptr<JobEvent> event;
+        std::atomic<size_t> remaining{1};
+        std::mutex mutex;
+        std::exception_ptr failedDependency;
+    };
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::shared_ptr<Pending>> ready;
+    bool stopping = false;
+
+    void release(const std::shared_ptr<Pending>& pending) {
+        if (--pending->remaining != 0) return;
+        std::exception_ptr failure;
+        {
+            std::lock_guard<std::mutex> lock(pending->mutex);
+            failure = pending->failedDependency;
+        }
+        if (failure) {
+            pending->event->pImpl->finish(failure);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.push_back(pending);
+        }
+        wake.notify_one();
+    }
+
+    void worker_loop() {
+        for (;;) {
+            std::shared_ptr<Pending> pending;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || !ready.empty(); });
+                if (ready.empty()) return;
+                pending = std::move(ready.front());
+                ready.pop_front();
+            }
+            std::exception_ptr failure;
+            try {
+                pending->job();
+            } catch (...) {
+                failure = std::current_exception();
+            }
+            // Drop the job's captures before anyone waiting on the event can observe completion.
+            pending->job = nullptr;
+            pending->event->pImpl->finish(failure);
+        }
+    }
+};
+
+JobQueue::JobQueue(unsigned thread_count) : pImpl(std::make_unique<Impl>()) {
+    for (unsigned i = 0; i < std::max(1u, thread_count); ++i) {
+        pImpl->workers.emplace_back([impl = pImpl.get()] { impl->worker_loop(); });
+    }
+}
+
+// Jobs already queued still run; jobs whose dependencies never complete are dropped.
+JobQueue::~JobQueue() {
+    {
+        std::lock_guard<std::mutex> lock(pImpl->mutex);
+        pImpl->stopping = true;
+    }
+    pImpl->wake.notify_all();
+    for (auto& worker : pImpl->workers) worker.join();
+}
+
+std::shared_ptr<JobEvent> JobQueue::submit(std::function<void()> job, const std::vector<std::shared_ptr<JobEvent>>& dependencies) {
+    auto pending = std::make_shared<Impl::Pending>();
+    pending->job = std::move(job);
+    pending->event = std::make_shared<JobEvent>();
+    std::shared_ptr<JobEvent> event = pending->event;
+    // `remaining` starts at one so the job cannot be queued before every dependency is registered.
+    for (const auto& dependency : dependencies) {
+        if (!dependency) continue;
+        ++pending->remaining;
+        dependency->pImpl->then([impl = pImpl.get(), pending](const std::exception_ptr& failure) {
+            if (failure) {
+                std::lock_guard<std::mutex> lock(pending->mutex);
+                if (!pending->failedDependency) pending->failedDependency = failure;
+            }
+            impl->release(pending);
+        });
+    }
+    pImpl->release(pending);
+    return event;
+}
+
+JobQueue& JobQueue::shared() {
+    static JobQueue queue(std::max(2u, std::thread::hardware_concurrency() / 2));
+    return queue;
+}
+
+namespace {
+    struct KernelRegistry {
+        std::mutex mutex;
+        std::map<std::string, Kernel> kernels;
+        std::atomic<uint64_t> generation{0};
+    };
+
+    KernelRegistry& get_kernel_registry() {
+        static KernelRegistry* registry = [] {
+            auto* created = new KernelRegistry();
+            // Built-in: writes input 0 into the output's format.
+            created->kernels["convert"] = make_pixel_kernel([](const KernelArgs&) {
+                return [](const Pixel* inputs, uint32_t, uint32_t) { return inputs[0]; };
+            });
+            return created;
+        }();
+        return *registry;
+    }
+}
+
+void CPU::register_kernel(const std::string& name, Kernel kernel) {
+    if (name.empty() || !kernel) {
+        throw std::invalid_argument("register_kernel requires a name and a callable kernel.");
+    }
+    KernelRegistry& registry = get_kernel_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.kernels[name] = std::move(kernel);
+    registry.generation++;
+}
+
+bool CPU::unregister_kernel(const std::string& name) {
+    KernelRegistry& registry = get_kernel_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.generation++;
+    return registry.kernels.erase(name) != 0;
+}
+
+uint64_t CPU::get_kernel_generation() {
+    return get_kernel_registry().generation.load();
+}
+
+Kernel CPU::find_kernel(const std::string& name) {
+    KernelRegistry& registry = get_kernel_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    auto it = registry.kernels.find(name);
+    return it != registry.kernels.end() ? it->second : Kernel();
+}
+
+std::vector<std::string> CPU::get_kernel_names() {
+    KernelRegistry& registry = get_kernel_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    std::vector<std::string> names;
+    for (const auto& entry : registry.kernels) names.push_back(entry.first);
+    return names;
+}
+
+void CPU::run_kernel(const Kernel& kernel, const Surface& output, const std::vector<Surface>& inputs, const std::vector<uint8_t>& constants) {
+    run_kernel(kernel, output, inputs, constants.data(), constants.size());
+}
+
+void CPU::run_kernel(const Kernel& kernel, const Surface& output, const std::vector<Surface>& inputs, const uint8_t* constants, size_t constantsSize) {
+    if (output.height == 0 || output.width == 0) return;
+    ThreadPool& pool = ThreadPool::shared();
+    const uint32_t bands = (uint64_t)output.width * output.height < g_parallelBlitPixels ? 1 : std::min(output.height, pool.get_thread_count() * g_bandsPerThread);
+    pool.parallel_for(bands, [&](uint32_t band) {
+        KernelArgs args = { output, inputs.data(), inputs.size(), constants, constantsSize,
+                            (uint32_t)((uint64_t)output.height * band / bands), (uint32_t)((uint64_t)output.height * (band + 1) / bands) };
+        kernel(args);
+    });
+}
+
+uint32_t CPU::bytes_per_pixel(DXGI_FORMAT format) {
+    switch (format) {
+        case DXGI_FORMAT_B8G8R8A8_UNORM:
+        case DXGI_FORMAT_R8G8B8A8_UNORM:
+        case DXGI_FORMAT_R32_FLOAT:
+        case DXGI_FORMAT_R10G10B10A2_UNORM: return 4;
+        case DXGI_FORMAT_R16_FLOAT:
+        case DXGI_FORMAT_R8G8_UNORM: return 2;
+        case DXGI_FORMAT_R16G16B16A16_FLOAT: return 8;
+        case DXGI_FORMAT_R32G32B32A32_FLOAT: return 16;
+        case DXGI_FORMAT_R8_UNORM: return 1;
+        default: return 0;
+    }
+}
+
+float CPU::half_to_float(uint16_t value) {
+    uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+    int32_t exponent = (value >> 10) & 0x1F;
+    uint32_t mantissa = value & 0x3FF;
+    uint32_t bits;
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            bits = sign;
+        } else {
+            // Subnormal half: renormalize into a float exponent.
+            exponent = 1;
+            while (!(mantissa & 0x400)) { mantissa <<= 1; --exponent; }
+            bits = sign | ((uint32_t)(exponent + 112) << 23) | ((mantissa & 0x3FF) << 13);
+        }
+    } else if (exponent == 31) {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    } else {
+        bits = sign | ((uint32_t)(exponent + 112) << 23) | (mantissa << 13);
+    }
+    float result;
+    memcpy(&result, &bits, 4);
+    return result;
+}
+
+uint16_t CPU::float_to_half(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = (int32_t)((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mantissa = bits & 0x7FFFFF;
+    if (((bits >> 23) & 0xFF) == 0xFF) return (uint16_t)(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+    if (exponent >= 31) return (uint16_t)(sign | 0x7C00);
+    if (exponent <= 0) {
+        if (exponent < -10) return (uint16_t)sign;
+        mantissa |= 0x800000;
+        uint32_t shift = (uint32_t)(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t midpoint = 1u << (shift - 1);
+        if (remainder > midpoint || (remainder == midpoint && (half & 1))) ++half;
+        return (uint16_t)(sign | half);
+    }
+    // Round to nearest even; a carry out of the mantissa correctly bumps the exponent, up to infinity.
+    uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+    uint32_t remainder = mantissa & 0x1FFF;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) ++half;
+    return (uint16_t)(sign | half);
+}
+
+void CPU::copy_surface(const Surface& source, const Surface& destination) {
+    if (source.width != destination.width || source.height != destination.height || source.format != destination.format) {
+        throw std::invalid_argument("Source and destination surfaces must have matching dimensions and format for copy_surface.");
+    }
+    const size_t rowBytes = (size_t)source.width * bytes_per_pixel(source.format);
+    if (source.rowPitch == destination.rowPitch && rowBytes == source.rowPitch) {
+        memcpy(destination.data, source.data, rowBytes * source.height);
+        return;
+    }
+    for (uint32_t y = 0; y < source.height; ++y) {
+        memcpy(destination.data + (size_t)y * destination.rowPitch, source.data + (size_t)y * source.rowPitch, rowBytes);
+    }
+}
+
+void CPU::fill_surface(const Surface& destination, const Pixel& color) {
+    const uint32_t bpp = bytes_per_pixel(destination.format);
+    if (bpp == 0) throw std::invalid_argument("Unsupported DXGI_FORMAT for fill_surface.");
+    if (destination.width == 0 || destination.height == 0) return;
+    // The colour is encoded once; the first row is built by doubling and every other row copies it.
+    const size_t rowBytes = (size_t)destination.width * bpp;
+    uint8_t* first = destination.data;
+    with_pixel_format(destination.format, [&](auto format) { decltype(format)::store(first, color); });
+    for (size_t filled = bpp; filled < rowBytes; filled *= 2) memcpy(first + filled, first, std::min(filled, rowBytes - filled));
+    for (uint32_t y = 1; y < destination.height; ++y) memcpy(destination.data + (size_t)y * destination.rowPitch, first, rowBytes);
+}
+
+void CPU::blit_bilinear(const Surface& source, const Surface& destination,
+                        uint32_t destX, uint32_t destY, uint32_t destWidth, uint32_t destHeight) {
+    const uint32_t sourceBpp = bytes_per_pixel(source.format);
+    const uint32_t destBpp = bytes_per_pixel(destination.format);
+    if (sourceBpp == 0 || destBpp == 0) {
+        throw std::invalid_argument("Unsupported DXGI_FORMAT for blit_bilinear.");
+    }
+    if (destWidth == 0 || destHeight == 0 || destX >= destination.width || destY >= destination.height) return;
+
+    // Like the rasterizer, only the part of the rectangle inside the destination is written, but the
+    // sampling positions stay those of the full rectangle.
+    const uint32_t columns = std::min(destWidth, destination.width - destX);
+    const uint32_t rows = std::min(destHeight, destination.height - destY);
+
+    BlitColumns cols;
+    cols.x = make_axis_taps(source.width, destWidth, columns, sourceBpp);
+    cols.fixedWeight4.resize((size_t)columns * 4);
+    for (uint32_t x = 0; x < columns; ++x) {
+        std::fill_n(&cols.fixedWeight4[(size_t)x * 4], 4, cols.x.fixedWeight[x]);
+    }
+    cols.sourceFormat = source.format;
+    cols.destFormat = destination.format;
+    cols.sourceBpp = sourceBpp;
+    cols.destBpp = destBpp;
+    cols.swapRedBlue = source.format != destination.format;
+    const AxisTaps yTaps = make_axis_taps(source.height, destHeight, rows, 1);
+    const BlitRowFn blitRow = select_blit_row(source.format, destination.format);
+
+    ThreadPool& pool = ThreadPool::shared();
+    const uint32_t bands = (uint64_t)columns * rows < g_parallelBlitPixels ? 1 : std::min(rows, pool.get_thread_count() * g_bandsPerThread);
+    pool.parallel_for(bands, [&](uint32_t band) {
+        const uint32_t begin = (uint32_t)((uint64_t)rows * band / bands);
+        const uint32_t end = (uint32_t)((uint64_t)rows * (band + 1) / bands);
+        for (uint32_t y = begin; y < end; ++y) {
+            BlitRow row;
+            row.top = source.data + (size_t)yTaps.first[y] * source.rowPitch;
+            row.bottom = source.data + (size_t)yTaps.second[y] * source.rowPitch;
+            row.out = destination.data + (size_t)(destY + y) * destination.rowPitch + (size_t)destX * destBpp;
+            row.columns = columns;
+            row.fixedWeight = yTaps.fixedWeight[y];
+            row.weight = yTaps.weight[y];
+            blitRow(row, cols, 0);
+        }
+    });
+}
+
+namespace {
+    template <HostLayout L> struct HostFormat;
+
+    template <> struct HostFormat<HostLayout::BGR8> {
+        static constexpr uint32_t size = 3;
+        static Pixel load(const uint8_t* p) { return { unorm_to_float(p[2], 255.0f), unorm_to_float(p[1], 255.0f), unorm_to_float(p[0], 255.0f), 1.0f }; }
+        static void store(uint8_t* p, const Pixel& c) {
+            p[0] = (uint8_t)float_to_unorm(c.b, 255.0f); p[1] = (uint8_t)float_to_unorm(c.g, 255.0f); p[2] = (uint8_t)float_to_unorm(c.r, 255.0f);
+        }
+    };
+
+    template <> struct HostFormat<HostLayout::RGB8> {
+        static constexpr uint32_t size = 3;
+        static Pixel load(const uint8_t* p) { return { unorm_to_float(p[0], 255.0f), unorm_to_float(p[1], 255.0f), unorm_to_float(p[2], 255.0f), 1.0f }; }
+        static void store(uint8_t* p, const Pixel& c) {
+            p[0] = (uint8_t)float_to_unorm(c.r, 255.0f); p[1] = (uint8_t)float_to_unorm(c.g, 255.0f); p[2] = (uint8_t)float_to_unorm(c.b, 255.0f);
+        }
+    };
+
+    template <> struct HostFormat<HostLayout::BGRA8> : PixelFormat<DXGI_FORMAT_B8G8R8A8_UNORM> {};
+    template <> struct HostFormat<HostLayout::RGBA8> : PixelFormat<DXGI_FORMAT_R8G8B8A8_UNORM> {};
+
+    template <> struct HostFormat<HostLayout::Gray8> {
+        static constexpr uint32_t size = 1;
+        static Pixel load(const uint8_t* p) {
+            float v = unorm_to_float(p[0], 255.0f);
+            return { v, v, v, 1.0f };
+        }
+        static void store(uint8_t* p, const Pixel& c) { p[0] = (uint8_t)float_to_unorm(0.299f * c.r + 0.587f * c.g + 0.114f * c.b, 255.0f); }
+    };
+
+    template <typename Fn>
+    decltype(auto) with_host_layout(HostLayout layout, Fn&& fn) {
+        switch (layout) {
+            case HostLayout::BGR8: return fn(HostFormat<HostLayout::BGR8>{});
+            case HostLayout::RGB8: return fn(HostFormat<HostLayout::RGB8>{});
+            case HostLayout::BGRA8: return fn(HostFormat<HostLayout::BGRA8>{});
+            case HostLayout::RGBA8: return fn(HostFormat<HostLayout::RGBA8>{});
+            case HostLayout::Gray8: return fn(HostFormat<HostLayout::Gray8>{});
+            default: throw std::invalid_argument("Unsupported host pixel layout.");
+        }
+    }
+
+    // Byte offset of red, green, blue and alpha within one 8-bit pixel; -1 where the channel is absent.
+    struct ByteChannels {
+        int8_t offset[4];
+        uint32_t size;
+    };
+
+    const ByteChannels g_rgba8Channels = { { 0, 1, 2, 3 }, 4 };
+    const ByteChannels g_bgra8Channels = { { 2, 1, 0, 3 }, 4 };
+
+    bool get_byte_channels(HostLayout layout, ByteChannels& channels) {
+        switch (layout) {
+            case HostLayout::BGR8: channels = { { 2, 1, 0, -1 }, 3 }; return true;
+            case HostLayout::RGB8: channels = { { 0, 1, 2, -1 }, 3 }; return true;
+            case HostLayout::BGRA8: channels = g_bgra8Channels; return true;
+            case HostLayout::RGBA8: channels = g_rgba8Channels; return true;
+            default: return false;
+        }
+    }
+
+    bool get_byte_channels(DXGI_FORMAT format, ByteChannels& channels) {
+        if (format == DXGI_FORMAT_B8G8R8A8_UNORM) { channels = g_bgra8Channels; return true; }
+        if (format == DXGI_FORMAT_R8G8B8A8_UNORM) { channels = g_rgba8Channels; return true; }
+        return false;
+    }
+
+    // A pshufb control moving four pixels from one byte layout to another, plus the bytes to OR in
+    // for an alpha the source lacks. Planar output groups the pixels as RRRR GGGG BBBB AAAA.
+    struct ByteShuffle {
+        alignas(16) uint8_t control[16];
+        alignas(16) uint8_t alpha[16];
+    };
+
+    ByteShuffle make_byte_shuffle(const ByteChannels& from, const ByteChannels& to, bool planar) {
+        ByteShuffle shuffle;
+        memset(shuffle.control, 0x80, 16);
+        memset(shuffle.alpha, 0, 16);
+        for (uint32_t pixel = 0; pixel < 4; ++pixel) {
+            for (uint32_t c = 0; c < 4; ++c) {
+                const int32_t target = planar ? (int32_t)(c * 4 + pixel) : (to.offset[c] < 0 ? -1 : (int32_t)(pixel * to.size) + to.offset[c]);
+                if (target < 0) continue;
+                if (from.offset[c] < 0) {
+                    shuffle.alpha[target] = 0xFF;
+                } else {
+                    shuffle.control[target] = (uint8_t)(pixel * from.size + from.offset[c]);
+                }
+            }
+        }
+        return shuffle;
+    }
+
+    // Converts `count` pixels of one row. SIMD rows handle a prefix and finish with the generic row.
+    using ConvertRowFn = std::function<void(const uint8_t*, uint8_t*, uint32_t)>;
+
+    template <typename From, typename To>
+    void convert_row_generic(const uint8_t* src, uint8_t* dst, uint32_t count) {
+        for (uint32_t x = 0; x < count; ++x) To::store(dst + (size_t)x * To::size, From::load(src + (size_t)x * From::size));
+    }
+
+#if DP_X86
+    // Each kernel returns how many leading pixels it converted; 16-byte loads and stores stay inside the row.
+    DP_TARGET("sse4.1")
+    uint32_t shuffle_row_sse41(const uint8_t* src, uint8_t* dst, uint32_t count, uint32_t srcSize, uint32_t dstSize, const ByteShuffle& shuffle) {
+        const __m128i control = _mm_load_si128((const __m128i*)shuffle.control);
+        const __m128i alpha = _mm_load_si128((const __m128i*)shuffle.alpha);
+        const uint64_t srcEnd = (uint64_t)count * srcSize, dstEnd = (uint64_t)count * dstSize;
+        uint32_t x = 0;
+        for (; (uint64_t)x * srcSize + 16 <= srcEnd && (uint64_t)x * dstSize + 16 <= dstEnd; x += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(src + (size_t)x * srcSize));
+            _mm_storeu_si128((__m128i*)(dst + (size_t)x * dstSize), _mm_or_si128(_mm_shuffle_epi8(v, control), alpha));
+        }
+        return x;
+    }
+
+    // Four-byte output only: each 128-bit lane takes four source pixels.
+    DP_TARGET("avx2")
+    uint32_t shuffle_row_avx2(const uint8_t* src, uint8_t* dst, uint32_t count, uint32_t srcSize, const ByteShuffle& shuffle) {
+        const __m256i control = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)shuffle.control));
+        const __m256i alpha = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)shuffle.alpha));
+        const uint64_t srcEnd = (uint64_t)count * srcSize;
+        uint32_t x = 0;
+        for (; (uint64_t)(x + 4) * srcSize + 16 <= srcEnd; x += 8) {
+            const uint8_t* p = src + (size_t)x * srcSize;
+            __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)p)), _mm_loadu_si128((const __m128i*)(p + 4 * srcSize)), 1);
+            _mm256_storeu_si256((__m256i*)(dst + (size_t)x * 4), _mm256_or_si256(_mm256_shuffle_epi8(v, control), alpha));
+        }
+        return x;
+    }
+
+    // 8-bit channels to R16G16B16A16_FLOAT: c * (1/255) rounded to nearest-even half, as float_to_half does.
+    DP_TARGET("avx2,f16c")
+    uint32_t half4_row_avx2(const uint8_t* src, uint8_t* dst, uint32_t count, uint32_t srcSize, const ByteShuffle& toRgba) {
+        const __m128i control = _mm_load_si128((const __m128i*)toRgba.control);
+        const __m128i alpha = _mm_load_si128((const __m128i*)toRgba.alpha);
+        const __m256 scale = _mm256_set1_ps(1.0f / 255.0f);
+        const uint64_t srcEnd = (uint64_t)count * srcSize;
+        uint32_t x = 0;
+        for (; (uint64_t)x * srcSize + 16 <= srcEnd; x += 4) {
+            __m128i rgba = _mm_or_si128(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + (size_t)x * srcSize)), control), alpha);
+            __m256 lo = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(rgba)), scale);
+            __m256 hi = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(rgba, 8))), scale);
+            _mm_storeu_si128((__m128i*)(dst + (size_t)x * 8), _mm256_cvtps_ph(lo, _MM_FROUND_TO_NEAREST_INT));
+            _mm_storeu_si128((__m128i*)(dst + (size_t)x * 8 + 16), _mm256_cvtps_ph(hi, _MM_FROUND_TO_NEAREST_INT));
+        }
+        return x;
+    }
+
+    DP_TARGET("avx2,f16c")
+    uint32_t half1_row_avx2(const uint8_t* src, uint8_t* dst, uint32_t count) {
+        const __m256 scale = _mm256_set1_ps(1.0f / 255.0f);
+        uint32_t x = 0;
+        for (; x + 8 <= count; x += 8) {
+            __m256 v = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + x)))), scale);
+            _mm_storeu_si128((__m128i*)(dst + (size_t)x * 2), _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+        }
+        return x;
+    }
+
+    // R16G16B16A16_FLOAT back to four 8-bit channels with float_to_unorm's clamp and round-half-up.
+    DP_TARGET("avx2,f16c")
+    uint32_t unhalf4_row_avx2(const uint8_t* src, uint8_t* dst, uint32_t count, const ByteShuffle& fromRgba) {
+        const __m128i control = _mm_load_si128((const __m128i*)fromRgba.control);
+        const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), scale = _mm256_set1_ps(255.0f), half = _mm256_set1_ps(0.5f);
+        uint32_t x = 0;
+        for (; x + 4 <= count; x += 4) {
+            __m256i q[2];
+            for (int i = 0; i < 2; ++i) {
+                __m256 v = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(src + (size_t)x * 8 + i * 16)));
+                v = _mm256_min_ps(_mm256_max_ps(v, zero), one);
+                q[i] = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(v, scale), half));
+            }
+            __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(q[0]), _mm256_extracti128_si256(q[0], 1));
+            __m128i words2 = _mm_packus_epi32(_mm256_castsi256_si128(q[1]), _mm256_extracti128_si256(q[1], 1));
+            _mm_storeu_si128((__m128i*)(dst + (size_t)x * 4), _mm_shuffle_epi8(_mm_packus_epi16(words, words2), control));
+        }
+        return x;
+    }
+
+    // 8-bit channels to R10G10B10A2_UNORM. The pixels are transposed to planes so each channel is one
+    // vector; the float steps mirror float_to_unorm(unorm_to_float(c, 255), 1023) so results are exact.
+    DP_TARGET("sse4.1")
+    uint32_t rgb10a2_row_sse41(const uint8_t* src, uint8_t* dst, uint32_t count, uint32_t srcSize, const ByteShuffle& toPlanes) {
+        const __m128i control = _mm_load_si128((const __m128i*)toPlanes.control);
+        const __m128i alpha = _mm_load_si128((const __m128i*)toPlanes.alpha);
+        const __m128 unorm = _mm_set1_ps(1.0f / 255.0f), half = _mm_set1_ps(0.5f);
+        const __m128 scale10 = _mm_set1_ps(1023.0f), scale2 = _mm_set1_ps(3.0f);
+        const uint64_t srcEnd = (uint64_t)count * srcSize;
+        uint32_t x = 0;
+        for (; (uint64_t)x * srcSize + 16 <= srcEnd; x += 4) {
+            __m128i planes = _mm_or_si128(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + (size_t)x * srcSize)), control), alpha);
+            __m128i packed = _mm_setzero_si128();
+            for (int c = 0; c < 4; ++c) {
+                __m128 v = _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(planes)), unorm);
+                __m128i q = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, c == 3 ? scale2 : scale10), half));
+                packed = _mm_or_si128(packed, _mm_sll_epi32(q, _mm_cvtsi32_si128(c * 10)));
+                planes = _mm_srli_si128(planes, 4);
+            }
+            _mm_storeu_si128((__m128i*)(dst + (size_t)x * 4), packed);
+        }
+        return x;
+    }
+#endif
+
+    // Wraps a SIMD prefix kernel so the generic row finishes the tail.
+    template <typename Simd>
+    ConvertRowFn with_tail(Simd simd, ConvertRowFn tail, uint32_t srcSize, uint32_t dstSize) {
+        return [simd, tail, srcSize, dstSize](const uint8_t* src, uint8_t* dst, uint32_t count) {
+            const uint32_t done = simd(src, dst, count);
+            if (done < count) tail(src + (size_t)done * srcSize, dst + (size_t)done * dstSize, count - done);
+        };
+    }
+
+    ConvertRowFn select_upload_row(HostLayout layout, DXGI_FORMAT format) {
+        ConvertRowFn generic = with_host_layout(layout, [&](auto from) -> ConvertRowFn {
+            return with_pixel_format(format, [&](auto to) -> ConvertRowFn {
+                return &convert_row_generic<decltype(from), decltype(to)>;
+            });
+        });
+        const uint32_t srcSize = bytes_per_pixel(layout), dstSize = bytes_per_pixel(format);
+        if ((layout == HostLayout::BGRA8 && format == DXGI_FORMAT_B8G8R8A8_UNORM) || (layout == HostLayout::RGBA8 && format == DXGI_FORMAT_R8G8B8A8_UNORM) ||
+            (layout == HostLayout::Gray8 && format == DXGI_FORMAT_R8_UNORM)) {
+            return [dstSize](const uint8_t* src, uint8_t* dst, uint32_t count) { memcpy(dst, src, (size_t)count * dstSize); };
+        }
+#if DP_X86
+        const Isa isa = get_isa();
+        ByteChannels from, to;
+        if (isa == Isa::Scalar) return generic;
+        if (layout == HostLayout::Gray8) {
+            if (format == DXGI_FORMAT_R16_FLOAT && isa == Isa::AVX2) {
+                return with_tail([](const uint8_t* src, uint8_t* dst, uint32_t count) { return half1_row_avx2(src, dst, count); }, generic, srcSize, dstSize);
+            }
+            return generic;
+        }
+        get_byte_channels(layout, from);
+        if (get_byte_channels(format, to)) {
+            const ByteShuffle shuffle = make_byte_shuffle(from, to, false);
+            if (isa == Isa::AVX2) {
+                return with_tail([shuffle, srcSize](const uint8_t* src, uint8_t* dst, uint32_t count) { return shuffle_row_avx2(src, dst, count, srcSize, shuffle); }, generic, srcSize, dstSize);
+            }
+            return with_tail([shuffle, srcSize](const uint8_t* src, uint8_t* dst, uint32_t count) { return shuffle_row_sse41(src, dst, count, srcSize, 4, shuffle); }, generic, srcSize, dstSize);
+        }
+        if (format == DXGI_FORMAT_R16G16B16A16_FLOAT && isa == Isa::AVX2) {
+            const ByteShuffle shuffle = make_byte_shuffle(from, g_rgba8Channels, false);
+            return with_tail([shuffle, srcSize](const uint8_t* src, uint8_t* dst, uint32_t count) { return half4_row_avx2(src, dst, count, srcSize, shuffle); }, generic, srcSize, dstSize);
+        }
+        if (format == DXGI_FORMAT_R10G10B10A2_UNORM) {
+            const ByteShuffle shuffle = make_byte_shuffle(from, g_rgba8Channels, true);
+            return with_tail([shuffle, srcSize](const uint8_t* src, uint8_t* dst, uint32_t count) { return rgb10a2_row_sse41(src, dst, count, srcSize, shuffle); }, generic, srcSize, dstSize);
+        }
+#endif
+        return generic;
+    }
+
+    ConvertRowFn select_download_row(DXGI_FORMAT format, HostLayout layout) {
+        ConvertRowFn generic = with_pixel_format(format, [&](auto from) -> ConvertRowFn {
+            return with_host_layout(layout, [&](auto to) -> ConvertRowFn {
+                return &convert_row_generic<decltype(from), decltype(to)>;
+            });
+        });
+        const uint32_t srcSize = bytes_per_pixel(format), dstSize = bytes_per_pixel(layout);
+        if ((layout == HostLayout::BGRA8 && format == DXGI_FORMAT_B8G8R8A8_UNORM) || (layout == HostLayout::RGBA8 && format == DXGI_FORMAT_R8G8B8A8_UNORM) ||
+            (layout == HostLayout::Gray8 && format == DXGI_FORMAT_R8_UNORM)) {
+            return [srcSize](const uint8_t* src, uint8_t* dst, uint32_t count) { memcpy(dst, src, (size_t)count * srcSize); };
+        }
+#if DP_X86
+        const Isa isa = get_isa();
+        ByteChannels from, to;
+        if (isa == Isa::Scalar || !get_byte_channels(layout, to)) return generic;
+        if (get_byte_channels(format, from)) {
+            const ByteShuffle shuffle = make_byte_shuffle(from, to, false);
+            return with_tail([shuffle, dstSize](const uint8_t* src, uint8_t* dst, uint32_t count) { return shuffle_row_sse41(src, dst, count, 4, dstSize, shuffle); }, generic, srcSize, dstSize);
+        }
+        if (format == DXGI_FORMAT_R16G16B16A16_FLOAT && isa == Isa::AVX2 && to.size == 4) {
+            const ByteShuffle shuffle = make_byte_shuffle(g_rgba8Channels, to, false);
+            return with_tail([shuffle](const uint8_t* src, uint8_t* dst, uint32_t count) { return unhalf4_row_avx2(src, dst, count, shuffle); }, generic, srcSize, dstSize);
+        }
+#endif
+        return generic;
+    }
+
+    void convert_rows(const ConvertRowFn& convertRow, const uint8_t* source, uint32_t sourcePitch, uint8_t* destination, uint32_t destinationPitch, uint32_t width, uint32_t height) {
+        if (width == 0 || height == 0) return;
+        ThreadPool& pool = ThreadPool::shared();
+        const uint32_t bands = (uint64_t)width * height < g_parallelBlitPixels ? 1 : std::min(height, pool.get_thread_count() * g_bandsPerThread);
+        pool.parallel_for(bands, [&](uint32_t band) {
+            const uint32_t end = (uint32_t)((uint64_t)height * (band + 1) / bands);
+            for (uint32_t y = (uint32_t)((uint64_t)height * band / bands); y < end; ++y) {
+                convertRow(source + (size_t)y * sourcePitch, destination + (size_t)y * destinationPitch, width);
+            }
+        });
+    }
+}
+
+uint32_t CPU::bytes_per_pixel(HostLayout layout) {
+    switch (layout) {
+        case HostLayout::BGR8:
+        case HostLayout::RGB8: return 3;
+        case HostLayout::BGRA8:
+        case HostLayout::RGBA8: return 4;
+        case HostLayout::Gray8: return 1;
+        default: throw std::invalid_argument("Unsupported host pixel layout.");
+    }
+}
+
+void CPU::convert_from_host(const uint8_t* source, uint32_t sourcePitch, HostLayout layout, const Surface& destination) {
+    if (sourcePitch < (uint64_t)destination.width * bytes_per_pixel(layout)) {
+        throw std::invalid_argument("Source row pitch is smaller than one row of host pixels.");
+    }
+    convert_rows(select_upload_row(layout, destination.format), source, sourcePitch, destination.data, destination.rowPitch, destination.width, destination.height);
+}
+
+void CPU::convert_to_host(const Surface& source, uint8_t* destination, uint32_t destinationPitch, HostLayout layout) {
+    if (destinationPitch < (uint64_t)source.width * bytes_per_pixel(layout)) {
+        throw std::invalid_argument("Destination row pitch is smaller than one row of host pixels.");
+    }
+    convert_rows(select_download_row(source.format, layout), source.data, source.rowPitch, destination, destinationPitch, source.width, source.height);
+}
+
+namespace {
+    // Box-filter taps of one axis: output i reads taps [begin[i], begin[i + 1]) with weights summing to 1.
+    struct AreaTaps {
+        std::vector<uint32_t> begin;
+        std::vector<uint32_t> index;
+        std::vector<float> weight;
+    };
+
+    AreaTaps make_area_taps(uint32_t sourceSize, uint32_t destSize, bool mirror) {
+        AreaTaps taps;
+        taps.begin.reserve(destSize + 1);
+        const double scale = (double)sourceSize / destSize;
+        for (uint32_t i = 0; i < destSize; ++i) {
+            taps.begin.push_back((uint32_t)taps.index.size());
+            const uint32_t cell = mirror ? destSize - 1 - i : i;
+            const double start = cell * scale, end = start + scale;
+            for (uint32_t s = (uint32_t)start; s < sourceSize && s < end; ++s) {
+                const double coverage = std::min(end, s + 1.0) - std::max(start, (double)s);
+                if (coverage <= 1e-6) continue;
+                taps.index.push_back(s);
+                taps.weight.push_back((float)(coverage / scale));
+            }
+        }
+        taps.begin.push_back((uint32_t)taps.index.size());
+        return taps;
+    }
+
+    // Accumulates one source row, weighted, into four floats per pixel in BGRA order. The first tap of
+    // an output row stores instead of adding, which saves clearing the accumulator.
+    void accumulate_row_scalar(const uint8_t* src, float* acc, uint32_t begin, uint32_t count, const ByteChannels& channels, float weight, bool first) {
+        static const int order[4] = { 2, 1, 0, 3 };
+        for (uint32_t x = begin; x < count; ++x) {
+            const uint8_t* p = src + (size_t)x * channels.size;
+            for (int c = 0; c < 4; ++c) {
+                const int offset = channels.offset[order[c]];
+                const float value = (float)(offset < 0 ? 255 : p[offset]) * weight;
+                acc[x * 4 + c] = first ? value : acc[x * 4 + c] + value;
+            }
+        }
+    }
+
+    void area_row_scalar(const float* acc, uint8_t* out, uint32_t begin, uint32_t count, const AreaTaps& taps) {
+        for (uint32_t x = begin; x < count; ++x) {
+            for (int c = 0; c < 4; ++c) {
+                float sum = 0.0f;
+                for (uint32_t t = taps.begin[x]; t < taps.begin[x + 1]; ++t) sum += acc[taps.index[t] * 4 + c] * taps.weight[t];
+                out[x * 4 + c] = (uint8_t)std::min(255.0f, sum + 0.5f);
+            }
+        }
+    }
+
+#if DP_X86
+    // Vector forms of the two loops above with the same operation order, so their output is identical.
+    DP_TARGET("sse4.1")
+    uint32_t accumulate_row_sse41(const uint8_t* src, float* acc, uint32_t count, uint32_t srcSize, const ByteShuffle& toBgra, float weight, bool first) {
+        const __m128i control = _mm_load_si128((const __m128i*)toBgra.control);
+        const __m128i alpha = _mm_load_si128((const __m128i*)toBgra.alpha);
+        const __m128 w = _mm_set1_ps(weight);
+        const uint64_t srcEnd = (uint64_t)count * srcSize;
+        uint32_t x = 0;
+        for (; (uint64_t)x * srcSize + 16 <= srcEnd; x += 4) {
+            __m128i bgra = _mm_or_si128(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + (size_t)x * srcSize)), control), alpha);
+            for (int p = 0; p < 4; ++p) {
+                float* a = acc + (size_t)(x + p) * 4;
+                const __m128 value = _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(bgra)), w);
+                _mm_storeu_ps(a, first ? value : _mm_add_ps(_mm_loadu_ps(a), value));
+                bgra = _mm_srli_si128(bgra, 4);
+            }
+        }
+        return x;
+    }
+
+    DP_TARGET("avx2")
+    uint32_t accumulate_row_avx2(const uint8_t* src, float* acc, uint32_t count, uint32_t srcSize, const ByteShuffle& toBgra, float weight, bool first) {
+        const __m128i control = _mm_load_si128((const __m128i*)toBgra.control);
+        const __m128i alpha = _mm_load_si128((const __m128i*)toBgra.alpha);
+        const __m256 w = _mm256_set1_ps(weight);
+        const uint64_t srcEnd = (uint64_t)count * srcSize;
+        uint32_t x = 0;
+        for (; (uint64_t)x * srcSize + 16 <= srcEnd; x += 4) {
+            __m128i bgra = _mm_or_si128(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + (size_t)x * srcSize)), control), alpha);
+            float* a = acc + (size_t)x * 4;
+            __m256 lo = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bgra)), w);
+            __m256 hi = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(bgra, 8))), w);
+            _mm256_storeu_ps(a, first ? lo : _mm256_add_ps(_mm256_loadu_ps(a), lo));
+            _mm256_storeu_ps(a + 8, first ? hi : _mm256_add_ps(_mm256_loadu_ps(a + 8), hi));
+        }
+        return x;
+    }
+
+    // One pixel per 128-bit vector; sums of weights of 1 keep every lane in [0, 255.5).
+    DP_TARGET("sse4.1")
+    void area_row_sse41(const float* acc, uint8_t* out, uint32_t count, const AreaTaps& taps) {
+        const __m128 half = _mm_set1_ps(0.5f), top = _mm_set1_ps(255.0f);
+        for (uint32_t x = 0; x < count; ++x) {
+            __m128 sum = _mm_setzero_ps();
+            for (uint32_t t = taps.begin[x]; t < taps.begin[x + 1]; ++t) {
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(acc + (size_t)taps.index[t] * 4), _mm_set1_ps(taps.weight[t])));
+            }
+            __m128i q = _mm_cvttps_epi32(_mm_min_ps(top, _mm_add_ps(sum, half)));
+            q = _mm_packus_epi16(_mm_packus_epi32(q, q), q);
+            uint32_t pixel = (uint32_t)_mm_cvtsi128_si32(q);
+            memcpy(out + (size_t)x * 4, &pixel, 4);
+        }
+    }
+#endif
+}
+
+void CPU::resample_area(const uint8_t* source, uint32_t sourceWidth, uint32_t sourceHeight, uint32_t sourcePitch, HostLayout layout,
+                        const Surface& destination, bool mirror) {
+    if (destination.width == 0 || destination.height == 0) return;
+    if (sourceWidth == 0 || sourceHeight == 0 || sourcePitch < (uint64_t)sourceWidth * bytes_per_pixel(layout)) {
+        throw std::invalid_argument("Invalid source frame for resample_area.");
+    }
+    ByteChannels channels;
+    if (!get_byte_channels(layout, channels)) channels = { { 0, 0, 0, -1 }, 1 };
+    const ByteShuffle toBgra = make_byte_shuffle(channels, g_bgra8Channels, false);
+    const AreaTaps xTaps = make_area_taps(sourceWidth, destination.width, mirror);
+    const AreaTaps yTaps = make_area_taps(sourceHeight, destination.height, false);
+    // Rows are filtered to BGRA8 and, for any other format, finished by the upload converter.
+    const bool direct = destination.format == DXGI_FORMAT_B8G8R8A8_UNORM;
+    const ConvertRowFn finishRow = direct ? ConvertRowFn() : select_upload_row(HostLayout::BGRA8, destination.format);
+    const Isa isa = get_isa();
+
+    ThreadPool& pool = ThreadPool::shared();
+    const uint64_t work = (uint64_t)std::max(sourceWidth, destination.width) * std::max(sourceHeight, destination.height);
+    const uint32_t bands = work < g_parallelBlitPixels ? 1 : std::min(destination.height, pool.get_thread_count() * g_bandsPerThread);
+    pool.parallel_for(bands, [&](uint32_t band) {
+        std::vector<float> acc((size_t)sourceWidth * 4);
+        std::vector<uint8_t> staging(direct ? 0 : (size_t)destination.width * 4);
+        const uint32_t end = (uint32_t)((uint64_t)destination.height * (band + 1) / bands);
+        for (uint32_t y = (uint32_t)((uint64_t)destination.height * band / bands); y < end; ++y) {
+            for (uint32_t t = yTaps.begin[y]; t < yTaps.begin[y + 1]; ++t) {
+                const uint8_t* row = source + (size_t)yTaps.index[t] * sourcePitch;
+                const bool first = t == yTaps.begin[y];
+                uint32_t done = 0;
+#if DP_X86
+                if (isa == Isa::AVX2) done = accumulate_row_avx2(row, acc.data(), sourceWidth, channels.size, toBgra, yTaps.weight[t], first);
+                else if (isa == Isa::SSE41) done = accumulate_row_sse41(row, acc.data(), sourceWidth, channels.size, toBgra, yTaps.weight[t], first);
+#endif
+                accumulate_row_scalar(row, acc.data(), done, sourceWidth, channels, yTaps.weight[t], first);
+            }
+            uint8_t* out = direct ? destination.data + (size_t)y * destination.rowPitch : staging.data();
+#if DP_X86
+            if (isa != Isa::Scalar) area_row_sse41(acc.data(), out, destination.width, xTaps);
+            else
+#endif
+            area_row_scalar(acc.data(), out, 0, destination.width, xTaps);
+            if (!direct) finishRow(out, destination.data + (size_t)y * destination.rowPitch, destination.width);
+        }
+    });
+}
+
+namespace {
+    // cv2's warpAffine fixed point: map coordinates carry 10 fractional bits and are rounded to 5-bit
+    // subpixel positions, whose bilinear weights are products of 5-bit fractions summing to 1024.
+    const int g_warpMapBits = 10;
+    const int g_warpSubpixelBits = 5;
+    const int32_t g_warpSubpixels = 1 << g_warpSubpixelBits;
+    const double g_warpMapScale = 1 << g_warpMapBits;
+    const int32_t g_warpRoundDelta = 1 << (g_warpMapBits - g_warpSubpixelBits - 1);
+
+    inline int32_t warp_round(double value) {
+        return (int32_t)std::lrint(std::min(std::max(value, (double)INT32_MIN), (double)INT32_MAX));
+    }
+
+    struct WarpSource {
+        const uint8_t* data;
+        int32_t width;
+        int32_t height;
+        int32_t pitch;
+        uint32_t channels;
+    };
+
+    // The column terms of a destination-to-source map, shared by every row.
+    struct WarpColumns {
+        std::vector<int32_t> dx;
+        std::vector<int32_t> dy;
+        bool increasingX;
+        bool increasingY;
+    };
+
+    WarpColumns make_warp_columns(const double inverse[6], uint32_t width) {
+        WarpColumns columns = { std::vector<int32_t>(width), std::vector<int32_t>(width), inverse[0] >= 0.0, inverse[3] >= 0.0 };
+        for (uint32_t x = 0; x < width; ++x) {
+            columns.dx[x] = warp_round(inverse[0] * x * g_warpMapScale);
+            columns.dy[x] = warp_round(inverse[3] * x * g_warpMapScale);
+        }
+        return columns;
+    }
+
+    // Destination column x of a row starting at (rowX, rowY) samples subpixel position
+    // ((rowX + dx[x]) >> 5, (rowY + dy[x]) >> 5); the shift by 10 gives the top-left tap.
+    struct WarpRow {
+        uint8_t* out;
+        int32_t rowX;
+        int32_t rowY;
+        const int32_t* dx;
+        const int32_t* dy;
+    };
+
+    WarpRow make_warp_row(const WarpColumns& columns, const double inverse[6], uint32_t y, uint8_t* out) {
+        return { out, warp_round((inverse[1] * y + inverse[2]) * g_warpMapScale) + g_warpRoundDelta,
+                 warp_round((inverse[4] * y + inverse[5]) * g_warpMapScale) + g_warpRoundDelta, columns.dx.data(), columns.dy.data() };
+    }
+
+    // Narrows [begin, end) to the columns whose tap index (base + delta[x]) >> 10 lies in [lo, hi]. delta
+    // is monotonic in x, so those columns are an interval found by two binary searches.
+    void clip_warp_span(int32_t base, const int32_t* delta, bool increasing, int32_t lo, int32_t hi, uint32_t& begin, uint32_t& end) {
+        auto tap = [&](uint32_t x) { return (base + delta[x]) >> g_warpMapBits; };
+        auto first = [&](auto predicate) {
+            uint32_t low = begin, high = end;
+            while (low < high) {
+                const uint32_t mid = low + (high - low) / 2;
+                if (predicate(mid)) high = mid;
+                else low = mid + 1;
+            }
+            return low;
+        };
+        uint32_t clippedBegin, clippedEnd;
+        if (increasing) {
+            clippedBegin = first([&](uint32_t x) { return tap(x) >= lo; });
+            clippedEnd = first([&](uint32_t x) { return tap(x) > hi; });
+        } else {
+            clippedBegin = first([&](uint32_t x) { return tap(x) <= hi; });
+            clippedEnd = first([&](uint32_t x) { return tap(x) < lo; });
+        }
+        begin = clippedBegin;
+        end = std::max(clippedBegin, clippedEnd);
+    }
+
+    // The four taps of column x, top-left first, and their weights; taps outside the source are null.
+    inline void warp_taps(const WarpSource& src, const WarpRow& row, uint32_t x, const uint8_t* taps[4], int32_t weight[4]) {
+        const int32_t sx = (row.rowX + row.dx[x]) >> (g_warpMapBits - g_warpSubpixelBits);
+        const int32_t sy = (row.rowY + row.dy[x]) >> (g_warpMapBits - g_warpSubpixelBits);
+        const int32_t ix = sx >> g_warpSubpixelBits, iy = sy >> g_warpSubpixelBits;
+        const int32_t fx = sx & (g_warpSubpixels - 1), fy = sy & (g_warpSubpixels - 1);
+        weight[0] = (g_warpSubpixels - fx) * (g_warpSubpixels - fy);
+        weight[1] = fx * (g_warpSubpixels - fy);
+        weight[2] = (g_warpSubpixels - fx) * fy;
+        weight[3] = fx * fy;
+        for (int t = 0; t < 4; ++t) {
+            const int32_t tx = ix + (t & 1), ty = iy + (t >> 1);
+            const bool inside = tx >= 0 && ty >= 0 && tx < src.width && ty < src.height;
+            taps[t] = inside ? src.data + (size_t)ty * src.pitch + (size_t)tx * src.channels : nullptr;
+        }
+    }
+
+    inline uint8_t warp_descale(int32_t sum) {
+        return (uint8_t)((sum + (1 << (2 * g_warpSubpixelBits - 1))) >> (2 * g_warpSubpixelBits));
+    }
+
+    void warp_pixels_scalar(const WarpSource& src, const WarpRow& row, uint32_t begin, uint32_t end) {
+        const uint8_t* taps[4];
+        int32_t weight[4];
+        for (uint32_t x = begin; x < end; ++x) {
+            warp_taps(src, row, x, taps, weight);
+            uint8_t* out = row.out + (size_t)x * src.channels;
+            for (uint32_t c = 0; c < src.channels; ++c) {
+                int32_t sum = 0;
+                for (int t = 0; t < 4; ++t) {
+                    if (taps[t]) sum += taps[t][c] * weight[t];
+                }
+                out[c] = warp_descale(sum);
+            }
+        }
+    }
+
+#if DP_X86
+    // Gathers the pixel at each byte offset into the low bytes of a lane. Pixels narrower than four bytes
+    // near the end of the source are read from a window moved back inside it and shifted down.
+    template <uint32_t Channels>
+    DP_TARGET("avx2") inline __m256i gather_pixels_avx2(const uint8_t* base, __m256i offset, __m256i lastWindow) {
+        if (Channels == 4) return _mm256_i32gather_epi32(reinterpret_cast<const int*>(base), offset, 1);
+        const __m256i window = _mm256_min_epi32(offset, lastWindow);
+        const __m256i shift = _mm256_slli_epi32(_mm256_sub_epi32(offset, window), 3);
+        return _mm256_srlv_epi32(_mm256_i32gather_epi32(reinterpret_cast<const int*>(base), window, 1), shift);
+    }
+
+    // Blends channel C of the four taps: each pair of taps becomes two 16-bit lanes, so one madd per pair
+    // applies both weights. Returns the rounded channel in its byte position.
+    template <int C>
+    DP_TARGET("avx2") inline __m256i warp_channel_avx2(__m256i t00, __m256i t01, __m256i t10, __m256i t11, __m256i topWeights, __m256i bottomWeights) {
+        const __m256i low = _mm256_set1_epi32(0xFF), high = _mm256_set1_epi32(0xFF0000);
+        const __m256i top = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(t00, 8 * C), low),
+                                            _mm256_and_si256(C < 2 ? _mm256_slli_epi32(t01, 16 - 8 * C) : _mm256_srli_epi32(t01, 8 * C - 16), high));
+        const __m256i bottom = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(t10, 8 * C), low),
+                                               _mm256_and_si256(C < 2 ? _mm256_slli_epi32(t11, 16 - 8 * C) : _mm256_srli_epi32(t11, 8 * C - 16), high));
+        __m256i sum = _mm256_add_epi32(_mm256_madd_epi16(top, topWeights), _mm256_madd_epi16(bottom, bottomWeights));
+        sum = _mm256_srli_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(1 << (2 * g_warpSubpixelBits - 1))), 2 * g_warpSubpixelBits);
+        return _mm256_slli_epi32(sum, 8 * C);
+    }
+
+    // Eight pixels per step over columns whose four taps all lie inside the source, with the scalar
+    // loop's arithmetic. Returns the first column left undone.
+    template <uint32_t Channels>
+    DP_TARGET("avx2") uint32_t warp_pixels_avx2(const WarpSource& src, const WarpRow& row, uint32_t begin, uint32_t end) {
+        const __m256i rowX = _mm256_set1_epi32(row.rowX), rowY = _mm256_set1_epi32(row.rowY);
+        const __m256i fraction = _mm256_set1_epi32(g_warpSubpixels - 1);
+        const __m256i full = _mm256_set1_epi32(g_warpSubpixels * g_warpSubpixels);
+        const __m256i pitch = _mm256_set1_epi32(src.pitch);
+        const __m256i lastWindow = _mm256_set1_epi32((src.height - 1) * src.pitch + src.width * (int32_t)Channels - 4);
+        const __m256i compact3 = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                                  0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+        const __m256i compact1 = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                  0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        uint32_t x = begin;
+        for (; x + 8 <= end; x += 8) {
+            const __m256i sx = _mm256_srai_epi32(_mm256_add_epi32(rowX, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row.dx + x))), g_warpMapBits - g_warpSubpixelBits);
+            const __m256i sy = _mm256_srai_epi32(_mm256_add_epi32(rowY, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row.dy + x))), g_warpMapBits - g_warpSubpixelBits);
+            const __m256i fx = _mm256_and_si256(sx, fraction), fy = _mm256_and_si256(sy, fraction);
+            const __m256i ix = _mm256_srai_epi32(sx, g_warpSubpixelBits), iy = _mm256_srai_epi32(sy, g_warpSubpixelBits);
+            const __m256i offset = _mm256_add_epi32(_mm256_mullo_epi32(iy, pitch), _mm256_mullo_epi32(ix, _mm256_set1_epi32(Channels)));
+
+            const __m256i t00 = gather_pixels_avx2<Channels>(src.data, offset, lastWindow);
+            const __m256i t01 = gather_pixels_avx2<Channels>(src.data, _mm256_add_epi32(offset, _mm256_set1_epi32(Channels)), lastWindow);
+            const __m256i t10 = gather_pixels_avx2<Channels>(src.data, _mm256_add_epi32(offset, pitch), lastWindow);
+            const __m256i t11 = gather_pixels_avx2<Channels>(src.data, _mm256_add_epi32(offset, _mm256_add_epi32(pitch, _mm256_set1_epi32(Channels))), lastWindow);
+
+            // w11 = fx*fy, w01 = fx*32 - w11, w10 = fy*32 - w11, w00 = 1024 - fx*32 - fy*32 + w11.
+            const __m256i w11 = _mm256_mullo_epi32(fx, fy);
+            const __m256i fx32 = _mm256_slli_epi32(fx, g_warpSubpixelBits), fy32 = _mm256_slli_epi32(fy, g_warpSubpixelBits);
+            const __m256i w01 = _mm256_sub_epi32(fx32, w11), w10 = _mm256_sub_epi32(fy32, w11);
+            const __m256i w00 = _mm256_add_epi32(_mm256_sub_epi32(_mm256_sub_epi32(full, fx32), fy32), w11);
+            const __m256i topWeights = _mm256_or_si256(w00, _mm256_slli_epi32(w01, 16));
+            const __m256i bottomWeights = _mm256_or_si256(w10, _mm256_slli_epi32(w11, 16));
+
+            __m256i result = warp_channel_avx2<0>(t00, t01, t10, t11, topWeights, bottomWeights);
+            if (Channels > 1) result = _mm256_or_si256(result, warp_channel_avx2<1>(t00, t01, t10, t11, topWeights, bottomWeights));
+            if (Channels > 2) result = _mm256_or_si256(result, warp_channel_avx2<2>(t00, t01, t10, t11, topWeights, bottomWeights));
+            if (Channels > 3) result = _mm256_or_si256(result, warp_channel_avx2<3>(t00, t01, t10, t11, topWeights, bottomWeights));
+
+            uint8_t* out = row.out + (size_t)x * Channels;
+            if (Channels == 4) {
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), result);
+            } else if (Channels == 3) {
+                // Twelve bytes per 128-bit lane; the stores stop exactly at the eighth pixel.
+                result = _mm256_shuffle_epi8(result, compact3);
+                const __m128i high = _mm256_extracti128_si256(result, 1);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm256_castsi256_si128(result));
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(out + 12), high);
+                const uint32_t tail = (uint32_t)_mm_extract_epi32(high, 2);
+                memcpy(out + 20, &tail, 4);
+            } else {
+                result = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(result, compact1), _mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1));
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm256_castsi256_si128(result));
+            }
+        }
+        return x;
+    }
+#endif
+
+    using WarpPixelsFn = uint32_t (*)(const WarpSource&, const WarpRow&, uint32_t, uint32_t);
+
+    WarpPixelsFn select_warp_pixels(uint32_t channels, uint64_t sourceBytes) {
+#if DP_X86
+        // Gathers address the source with 32-bit offsets.
+        if (get_isa() == Isa::AVX2 && sourceBytes <= (uint64_t)INT32_MAX) {
+            if (channels == 4) return warp_pixels_avx2<4>;
+            if (channels == 3) return warp_pixels_avx2<3>;
+            return warp_pixels_avx2<1>;
+        }
+#endif
+        (void)channels;
+        (void)sourceBytes;
+        return nullptr;
+    }
+
+    // Some tap of columns [begin, end) reaches the source; all four do on [innerBegin, innerEnd), which is
+    // empty or inside the former.
+    struct WarpSpan {
+        uint32_t begin;
+        uint32_t end;
+        uint32_t innerBegin;
+        uint32_t innerEnd;
+    };
+
+    WarpSpan clip_warp_row(const WarpSource& src, const WarpColumns& columns, const WarpRow& row, uint32_t width) {
+        WarpSpan span = { 0, width, 0, 0 };
+        clip_warp_span(row.rowX, row.dx, columns.increasingX, -1, src.width - 1, span.begin, span.end);
+        clip_warp_span(row.rowY, row.dy, columns.increasingY, -1, src.height - 1, span.begin, span.end);
+        span.innerBegin = span.begin;
+        span.innerEnd = span.end;
+        if (span.begin == span.end) return span;
+        clip_warp_span(row.rowX, row.dx, columns.increasingX, 0, src.width - 2, span.innerBegin, span.innerEnd);
+        clip_warp_span(row.rowY, row.dy, columns.increasingY, 0, src.height - 2, span.innerBegin, span.innerEnd);
+        if (span.innerBegin == span.innerEnd) span.innerBegin = span.innerEnd = span.begin;
+        return span;
+    }
+
+    void warp_row(const WarpSource& src, const WarpRow& row, const WarpSpan& span, uint32_t width, WarpPixelsFn vectorPixels, WarpBorder border) {
+        if (border == WarpBorder::Zero) {
+            memset(row.out, 0, (size_t)span.begin * src.channels);
+            memset(row.out + (size_t)span.end * src.channels, 0, (size_t)(width - span.end) * src.channels);
+        }
+        warp_pixels_scalar(src, row, span.begin, span.innerBegin);
+        const uint32_t done = vectorPixels ? vectorPixels(src, row, span.innerBegin, span.innerEnd) : span.innerBegin;
+        warp_pixels_scalar(src, row, done, span.end);
+    }
+
+    void check_warp_source(const uint8_t* source, uint32_t width, uint32_t height, uint32_t pitch, uint32_t channels, const char* what) {
+        if (channels != 1 && channels != 3 && channels != 4) throw std::invalid_argument(std::string(what) + " takes 1, 3 or 4 channels.");
+        if (!source || width == 0 || height == 0 || width > (uint32_t)INT32_MAX / channels || height > (uint32_t)INT32_MAX ||
+            pitch < width * channels || pitch > (uint32_t)INT32_MAX) {
+            throw std::invalid_argument(std::string("Invalid source image for ") + what + ".");
+        }
+    }
+}
+
+void CPU::invert_affine(const double matrix[6], double inverse[6]) {
+    double determinant = matrix[0] * matrix[4] - matrix[1] * matrix[3];
+    determinant = determinant != 0.0 ? 1.0 / determinant : 0.0;
+    const double a11 = matrix[4] * determinant, a22 = matrix[0] * determinant;
+    const double a12 = -matrix[1] * determinant, a21 = -matrix[3] * determinant;
+    inverse[0] = a11;
+    inverse[1] = a12;
+    inverse[2] = -a11 * matrix[2] - a12 * matrix[5];
+    inverse[3] = a21;
+    inverse[4] = a22;
+    inverse[5] = -a21 * matrix[2] - a22 * matrix[5];
+}
+
+void CPU::warp_affine(const uint8_t* source, uint32_t sourceWidth, uint32_t sourceHeight, uint32_t sourcePitch,
+                      uint8_t* destination, uint32_t destWidth, uint32_t destHeight, uint32_t destPitch,
+                      uint32_t channels, const double inverse[6], WarpBorder border) {
+    if (destWidth == 0 || destHeight == 0) return;
+    check_warp_source(source, sourceWidth, sourceHeight, sourcePitch, channels, "warp_affine");
+    if (!destination || destPitch < (uint64_t)destWidth * channels) throw std::invalid_argument("Invalid destination image for warp_affine.");
+
+    const WarpColumns columns = make_warp_columns(inverse, destWidth);
+    const WarpSource src = { source, (int32_t)sourceWidth, (int32_t)sourceHeight, (int32_t)sourcePitch, channels };
+    const WarpPixelsFn vectorPixels = select_warp_pixels(channels, (uint64_t)sourcePitch * sourceHeight);
+
+    ThreadPool& pool = ThreadPool::shared();
+    const uint32_t bands = (uint64_t)destWidth * destHeight < g_parallelBlitPixels ? 1 : std::min(destHeight, pool.get_thread_count() * g_bandsPerThread);
+    pool.parallel_for(bands, [&](uint32_t band) {
+        const uint32_t end = (uint32_t)((uint64_t)destHeight * (band + 1) / bands);
+        for (uint32_t y = (uint32_t)((uint64_t)destHeight * band / bands); y < end; ++y) {
+            const WarpRow row = make_warp_row(columns, inverse, y, destination + (size_t)y * destPitch);
+            warp_row(src, row, clip_warp_row(src, columns, row, destWidth), destWidth, vectorPixels, border);
+        }
+    });
+}
+
+namespace {
+    // warp_affine of a constant 255 image the size of src: 255 wherever all four taps land inside it, the
+    // share of the weight that does along its edges, 0 beyond.
+    void warp_coverage_row(const WarpSource& src, const WarpRow& row, const WarpSpan& span, uint32_t width) {
+        const uint8_t* taps[4];
+        int32_t weight[4];
+        auto edge = [&](uint32_t begin, uint32_t end) {
+            for (uint32_t x = begin; x < end; ++x) {
+                warp_taps(src, row, x, taps, weight);
+                int32_t sum = 0;
+                for (int t = 0; t < 4; ++t) {
+                    if (taps[t]) sum += 255 * weight[t];
+                }
+                row.out[x] = warp_descale(sum);
+            }
+        };
+        memset(row.out, 0, span.begin);
+        edge(span.begin, span.innerBegin);
+        memset(row.out + span.innerBegin, 255, span.innerEnd - span.innerBegin);
+        edge(std::max(span.begin, span.innerEnd), span.end);
+        memset(row.out + span.end, 0, width - span.end);
+    }
+
+    // Mask planes are filtered in two kinds of pass: the horizontal half of a separable kernel over bands of
+    // rows, the vertical half over strips of columns, so that every task sweeps its columns top to bottom
+    // once instead of re-reading a kernel's height of rows for each output row.
+    const uint32_t g_maskStripColumns = 64;
+
+    template <typename Body>
+    void for_row_bands(uint32_t height, uint64_t pixels, Body body) {
+        ThreadPool& pool = ThreadPool::shared();
+        const uint32_t bands = pixels < g_parallelBlitPixels ? 1 : std::min(height, pool.get_thread_count() * g_bandsPerThread);
+        pool.parallel_for(bands, [&](uint32_t band) {
+            body((uint32_t)((uint64_t)height * band / bands), (uint32_t)((uint64_t)height * (band + 1) / bands));
+        });
+    }
+
+    template <typename Body>
+    void for_column_strips(uint32_t width, uint64_t pixels, Body body) {
+        const uint32_t units = (width + g_maskStripColumns - 1) / g_maskStripColumns;
+        for_row_bands(units, pixels, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t unit = begin; unit < end; ++unit) {
+                body(unit * g_maskStripColumns, std::min(width, (unit + 1) * g_maskStripColumns));
+            }
+        });
+    }
+
+    template <bool Dilate>
+    inline uint8_t extremum(uint8_t a, uint8_t b) {
+        return Dilate ? std::max(a, b) : std::min(a, b);
+    }
+
+    // out[x] = extremum(a[x], b[x]); out may be a or b.
+    template <bool Dilate>
+    DP_TARGET("sse2") void extremum_rows(const uint8_t* a, const uint8_t* b, uint8_t* out, uint32_t count) {
+        uint32_t x = 0;
+#if DP_X86
+        for (; x + 16 <= count; x += 16) {
+            const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + x));
+            const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), Dilate ? _mm_max_epu8(va, vb) : _mm_min_epu8(va, vb));
+        }
+#elif DP_NEON
+        for (; x + 16 <= count; x += 16) {
+            const uint8x16_t va = vld1q_u8(a + x), vb = vld1q_u8(b + x);
+            vst1q_u8(out + x, Dilate ? vmaxq_u8(va, vb) : vminq_u8(va, vb));
+        }
+#endif
+        for (; x < count; ++x) out[x] = extremum<Dilate>(a[x], b[x]);
+    }
+
+    // Square morphology with cv2's anchor: a window of `size` covers offsets [-size / 2, size - 1 - size / 2],
+    // and the mask edge never wins, as if padded with 255 for erosion and 0 for dilation. Both halves use
+    // van Herk/Gil-Werman: with the padded sequence cut into blocks of `size`, every window is the suffix
+    // of one block and the prefix of the next, so it costs three comparisons whatever the size.
+    template <bool Dilate>
+    void morph_row(const uint8_t* in, uint8_t* out, uint32_t width, uint32_t size, std::vector<uint8_t>& scratch) {
+        const uint32_t count = width + size - 1, before = size / 2;
+        scratch.resize((size_t)count * 3);
+        uint8_t* padded = scratch.data();
+        uint8_t* prefix = padded + count;
+        uint8_t* suffix = prefix + count;
+        memset(padded, Dilate ? 0 : 255, before);
+        memcpy(padded + before, in, width);
+        memset(padded + before + width, Dilate ? 0 : 255, count - before - width);
+        for (uint32_t block = 0; block < count; block += size) {
+            const uint32_t last = std::min(count, block + size) - 1;
+            uint8_t running = prefix[block] = padded[block];
+            for (uint32_t i = block + 1; i <= last; ++i) prefix[i] = running = extremum<Dilate>(running, padded[i]);
+            running = suffix[last] = padded[last];
+            for (uint32_t i = last; i > block; --i) suffix[i - 1] = running = extremum<Dilate>(running, padded[i - 1]);
+        }
+        extremum_rows<Dilate>(suffix, prefix + size - 1, out, width);
+    }
+
+    // The vertical half over columns [begin, end) of a plane, in place: the strip's prefix and suffix rows
+    // are complete before the first result is written.
+    template <bool Dilate>
+    void morph_columns(uint8_t* plane, size_t pitch, uint32_t height, uint32_t begin, uint32_t end, uint32_t size, std::vector<uint8_t>& scratch) {
+        const uint32_t strip = end - begin, count = height + size - 1, top = size / 2;
+        scratch.resize((size_t)count * strip * 2 + strip);
+        uint8_t* prefix = scratch.data();
+        uint8_t* suffix = prefix + (size_t)count * strip;
+        uint8_t* neutral = suffix + (size_t)count * strip;
+        memset(neutral, Dilate ? 0 : 255, strip);
+        auto row = [&](uint32_t i) -> const uint8_t* {
+            return i < top || i - top >= height ? neutral : plane + (size_t)(i - top) * pitch + begin;
+        };
+        for (uint32_t block = 0; block < count; block += size) {
+            const uint32_t last = std::min(count, block + size) - 1;
+            memcpy(prefix + (size_t)block * strip, row(block), strip);
+            for (uint32_t i = block + 1; i <= last; ++i) {
+                uint8_t* p = prefix + (size_t)i * strip;
+                extremum_rows<Dilate>(p - strip, row(i), p, strip);
+            }
+            memcpy(suffix + (size_t)last * strip, row(last), strip);
+            for (uint32_t i = last; i > block; --i) {
+                uint8_t* s = suffix + (size_t)(i - 1) * strip;
+                extremum_rows<Dilate>(s + strip, row(i - 1), s, strip);
+            }
+        }
+        for (uint32_t y = 0; y < height; ++y) {
+            extremum_rows<Dilate>(suffix + (size_t)y * strip, prefix + (size_t)(y + size - 1) * strip, plane + (size_t)y * pitch + begin, strip);
+        }
+    }
+
+    // cv2's BORDER_REFLECT_101 for any offset, including ones more than a size away.
+    inline int32_t reflect_101(int32_t i, int32_t size) {
+        if (size == 1) return 0;
+        while (i < 0 || i >= size) i = i < 0 ? -i : 2 * size - 2 - i;
+        return i;
+    }
+
+    // values[-radius, count + radius + extra) of a row, reflected at both ends.
+    template <typename T>
+    void pad_reflected(const T* values, uint32_t count, uint32_t radius, uint32_t extra, std::vector<T>& padded) {
+        padded.resize((size_t)count + 2 * radius + extra);
+        const int32_t end = (int32_t)padded.size();
+        for (int32_t i = 0; i < (int32_t)radius; ++i) padded[i] = values[reflect_101(i - (int32_t)radius, (int32_t)count)];
+        memcpy(padded.data() + radius, values, (size_t)count * sizeof(T));
+        for (int32_t i = (int32_t)(radius + count); i < end; ++i) padded[i] = values[reflect_101(i - (int32_t)radius, (int32_t)count)];
+    }
+
+    // The feather approximates cv2.GaussianBlur(ksize=size, sigma=0). Small kernels convolve with the
+    // Gaussian itself in Q15; from g_featherBoxSize on, where that would grow with the size, three box
+    // passes per axis whose widths match the Gaussian's variance (Kovesi's "boxes for Gauss") stay within
+    // a few levels of it at a fixed cost. Values stay in Q8 between passes.
+    const uint32_t g_featherBoxSize = 17;
+
+    struct FeatherKernel {
+        std::vector<int32_t> taps;
+        std::vector<uint32_t> boxes;
+    };
+
+    FeatherKernel make_feather_kernel(uint32_t size) {
+        static const double binomialTaps[][7] = {
+            { 1.0 },
+            { 0.25, 0.5, 0.25 },
+            { 0.0625, 0.25, 0.375, 0.25, 0.0625 },
+            { 0.03125, 0.109375, 0.21875, 0.28125, 0.21875, 0.109375, 0.03125 }
+        };
+        FeatherKernel kernel;
+        const double sigma = ((size - 1) * 0.5 - 1) * 0.3 + 0.8;
+        if (size >= g_featherBoxSize) {
+            const int passes = 3;
+            const double variance = 12.0 * sigma * sigma;
+            int lower = (int)std::floor(std::sqrt(variance / passes + 1.0));
+            if (lower % 2 == 0) --lower;
+            const long lowerCount = std::lround((variance - passes * lower * lower - 4.0 * passes * lower - 3.0 * passes) / (-4.0 * lower - 4.0));
+            for (int i = 0; i < passes; ++i) kernel.boxes.push_back((uint32_t)(i < lowerCount ? lower : lower + 2));
+            return kernel;
+        }
+        std::vector<double> weight(size);
+        if (size <= 7) {
+            std::copy(binomialTaps[size / 2], binomialTaps[size / 2] + size, weight.begin());
+        } else {
+            double sum = 0.0;
+            for (uint32_t i = 0; i < size; ++i) {
+                const double x = (double)i - (size - 1) * 0.5;
+                sum += weight[i] = std::exp(-x * x / (2 * sigma * sigma));
+            }
+            for (double& w : weight) w /= sum;
+        }
+        // The rounding error goes to the centre tap so the taps sum to exactly 1.
+        kernel.taps.resize(size);
+        int32_t total = 0;
+        for (uint32_t i = 0; i < size; ++i) total += kernel.taps[i] = (int32_t)std::lround(weight[i] * 32768.0);
+        kernel.taps[size / 2] += 32768 - total;
+        return kernel;
+    }
+
+    inline uint16_t box_average(uint32_t sum, float scale) {
+        return (uint16_t)((float)sum * scale + 0.5f);
+    }
+
+    // One running-sum box pass of odd width along a row of Q8 values. The row is padded first, so in may be out.
+    void box_row(const uint16_t* in, uint16_t* out, uint32_t count, uint32_t width, std::vector<uint16_t>& padded) {
+        // One value past the last window keeps the running update branch-free.
+        pad_reflected(in, count, width / 2, 1, padded);
+        const float scale = 1.0f / width;
+        uint32_t sum = 0;
+        for (uint32_t i = 0; i < width; ++i) sum += padded[i];
+        for (uint32_t x = 0; x < count; ++x) {
+            out[x] = box_average(sum, scale);
+            sum += padded[x + width] - padded[x];
+        }
+    }
+
+    // One row of the same pass down a strip: out = average(sums), then sums += add - sub.
+    DP_TARGET("sse2") void box_step(uint32_t* sums, const uint16_t* add, const uint16_t* sub, uint16_t* out, uint32_t count, float scale) {
+        uint32_t x = 0;
+#if DP_X86
+        const __m128 vscale = _mm_set1_ps(scale), half = _mm_set1_ps(0.5f);
+        const __m128i zero = _mm_setzero_si128(), bias = _mm_set1_epi32(32768), flip = _mm_set1_epi16(-32768);
+        for (; x + 8 <= count; x += 8) {
+            __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + x));
+            __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + x + 4));
+            // Averages reach 65281, past packs_epi32's signed range, so they are packed offset by 32768.
+            const __m128i avgLo = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(lo), vscale), half)), bias);
+            const __m128i avgHi = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(hi), vscale), half)), bias);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_xor_si128(_mm_packs_epi32(avgLo, avgHi), flip));
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(add + x));
+            const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sub + x));
+            lo = _mm_sub_epi32(_mm_add_epi32(lo, _mm_unpacklo_epi16(a, zero)), _mm_unpacklo_epi16(s, zero));
+            hi = _mm_sub_epi32(_mm_add_epi32(hi, _mm_unpackhi_epi16(a, zero)), _mm_unpackhi_epi16(s, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + x), lo);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + x + 4), hi);
+        }
+#endif
+        for (; x < count; ++x) {
+            out[x] = box_average(sums[x], scale);
+            sums[x] += add[x] - sub[x];
+        }
+    }
+
+    // The box pass down a strip of columns, one running sum per column.
+    void box_columns(const uint16_t* in, size_t inPitch, uint16_t* out, size_t outPitch, uint32_t height, uint32_t strip, uint32_t width, std::vector<uint32_t>& sums) {
+        const int32_t radius = (int32_t)width / 2;
+        auto row = [&](int32_t i) { return in + (size_t)reflect_101(i, (int32_t)height) * inPitch; };
+        sums.assign(strip, 0);
+        for (int32_t i = -radius; i <= radius; ++i) {
+            const uint16_t* r = row(i);
+            for (uint32_t x = 0; x < strip; ++x) sums[x] += r[x];
+        }
+        for (uint32_t y = 0; y < height; ++y) {
+            box_step(sums.data(), row((int32_t)y + radius + 1), row((int32_t)y - radius), out + (size_t)y * outPitch, strip, 1.0f / width);
+        }
+    }
+
+    // sums[x] += values[x] * weight for the Q15 taps of small feathers.
+    DP_TARGET("sse2") void accumulate_row(uint32_t* sums, const uint16_t* values, uint16_t weight, uint32_t count) {
+        uint32_t x = 0;
+#if DP_X86
+        const __m128i w = _mm_set1_epi16((short)weight);
+        for (; x + 8 <= count; x += 8) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + x));
+            const __m128i low = _mm_mullo_epi16(v, w), high = _mm_mulhi_epu16(v, w);
+            __m128i* s = reinterpret_cast<__m128i*>(sums + x);
+            _mm_storeu_si128(s, _mm_add_epi32(_mm_loadu_si128(s), _mm_unpacklo_epi16(low, high)));
+            _mm_storeu_si128(s + 1, _mm_add_epi32(_mm_loadu_si128(s + 1), _mm_unpackhi_epi16(low, high)));
+        }
+#endif
+        for (; x < count; ++x) sums[x] += (uint32_t)values[x] * weight;
+    }
+
+    // Horizontal half of the feather: an 8-bit row into Q8.
+    void feather_row(const uint8_t* in, uint16_t* out, uint32_t width, const FeatherKernel& kernel, std::vector<uint16_t>& padded, std::vector<uint32_t>& sums) {
+        const bool boxes = kernel.taps.empty();
+        for (uint32_t x = 0; x < width; ++x) out[x] = (uint16_t)(boxes ? in[x] << 8 : in[x]);
+        if (boxes) {
+            for (uint32_t box : kernel.boxes) box_row(out, out, width, box, padded);
+            return;
+        }
+        pad_reflected(out, width, (uint32_t)kernel.taps.size() / 2, 0, padded);
+        sums.assign(width, 1u << 6);
+        for (size_t t = 0; t < kernel.taps.size(); ++t) accumulate_row(sums.data(), padded.data() + t, (uint16_t)kernel.taps[t], width);
+        for (uint32_t x = 0; x < width; ++x) out[x] = (uint16_t)(sums[x] >> 7);
+    }
+
+    // Vertical half over columns [begin, end) of a Q8 plane, which it may overwrite, finishing in 8 bits.
+    void feather_columns(uint16_t* plane, size_t pitch, uint32_t height, uint32_t begin, uint32_t end, const FeatherKernel& kernel,
+                         uint8_t* out, size_t outPitch, std::vector<uint16_t>& scratch, std::vector<uint32_t>& sums) {
+        const uint32_t strip = end - begin;
+        if (!kernel.taps.empty()) {
+            // 65281 * 32768 still fits the unsigned sums.
+            const int32_t radius = (int32_t)kernel.taps.size() / 2;
+            for (uint32_t y = 0; y < height; ++y) {
+                sums.assign(strip, 1u << 22);
+                for (size_t t = 0; t < kernel.taps.size(); ++t) {
+                    const uint16_t* r = plane + (size_t)reflect_101((int32_t)(y + t) - radius, (int32_t)height) * pitch + begin;
+                    accumulate_row(sums.data(), r, (uint16_t)kernel.taps[t], strip);
+                }
+                uint8_t* o = out + (size_t)y * outPitch + begin;
+                for (uint32_t x = 0; x < strip; ++x) o[x] = (uint8_t)(sums[x] >> 23);
+            }
+            return;
+        }
+        scratch.resize((size_t)height * strip);
+        bool inScratch = false;
+        for (uint32_t box : kernel.boxes) {
+            if (inScratch) box_columns(scratch.data(), strip, plane + begin, pitch, height, strip, box, sums);
+            else box_columns(plane + begin, pitch, scratch.data(), strip, height, strip, box, sums);
+            inScratch = !inScratch;
+        }
+        const uint16_t* result = inScratch ? scratch.data() : plane + begin;
+        const size_t resultPitch = inScratch ? strip : pitch;
+        for (uint32_t y = 0; y < height; ++y) {
+            const uint16_t* r = result + (size_t)y * resultPitch;
+            uint8_t* o = out + (size_t)y * outPitch + begin;
+            for (uint32_t x = 0; x < strip; ++x) o[x] = (uint8_t)((r[x] + 128) >> 8);
+        }
+    }
+
+    // Exact round(v / 255) for v up to 255 * 255.
+    inline uint32_t div255(uint32_t v) {
+        v += 128;
+        return (v + (v >> 8)) >> 8;
+    }
+
+    // frame = (face * alpha + frame * (255 - alpha)) / 255 per byte, with alpha already repeated per channel.
+    void blend_bytes_scalar(const uint8_t* face, const uint8_t* alpha, uint8_t* frame, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) frame[i] = (uint8_t)div255(face[i] * alpha[i] + frame[i] * (255 - alpha[i]));
+    }
+
+#if DP_X86
+    // Same arithmetic in 16-bit lanes: the weighted sum is at most 255 * 255 + 128, so nothing wraps.
+    DP_TARGET("avx2") size_t blend_bytes_avx2(const uint8_t* face, const uint8_t* alpha, uint8_t* frame, size_t begin, size_t end) {
+        const __m256i zero = _mm256_setzero_si256(), full = _mm256_set1_epi16(255), half = _mm256_set1_epi16(128);
+        size_t i = begin;
+        for (; i + 32 <= end; i += 32) {
+            const __m256i f = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(face + i));
+            const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(alpha + i));
+            const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(frame + i));
+            __m256i half16[2];
+            for (int h = 0; h < 2; ++h) {
+                const __m256i f16 = h ? _mm256_unpackhi_epi8(f, zero) : _mm256_unpacklo_epi8(f, zero);
+                const __m256i a16 = h ? _mm256_unpackhi_epi8(a, zero) : _mm256_unpacklo_epi8(a, zero);
+                const __m256i b16 = h ? _mm256_unpackhi_epi8(b, zero) : _mm256_unpacklo_epi8(b, zero);
+                __m256i v = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(f16, a16), _mm256_mullo_epi16(b16, _mm256_sub_epi16(full, a16))), half);
+                half16[h] = _mm256_srli_epi16(_mm256_add_epi16(v, _mm256_srli_epi16(v, 8)), 8);
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(frame + i), _mm256_packus_epi16(half16[0], half16[1]));
+        }
+        return i;
+    }
+#endif
+
+    // Per-band scratch of blend_face_row.
+    struct FaceBlendRows {
+        std::vector<uint8_t> warped;
+        std::vector<uint8_t> expandedAlpha;
+        Isa isa;
+
+        FaceBlendRows(uint32_t width, uint32_t channels)
+            : warped((size_t)width * channels), expandedAlpha(channels > 1 ? (size_t)width * channels : 0), isa(get_isa()) {}
+    };
+
+    // Blends row y of the warped face into out under alpha, which is zero outside [first, last); only the
+    // columns the mask reaches are warped and blended.
+    void blend_face_row(const WarpSource& src, const WarpColumns& columns, const double inverse[6], uint32_t y, const uint8_t* alpha,
+                        uint32_t first, uint32_t last, WarpPixelsFn vectorPixels, uint8_t* out, FaceBlendRows& rows) {
+        while (first < last && !alpha[first]) ++first;
+        while (last > first && !alpha[last - 1]) --last;
+        if (first == last) return;
+
+        const uint32_t width = (uint32_t)columns.dx.size(), channels = src.channels;
+        const WarpRow row = make_warp_row(columns, inverse, y, rows.warped.data());
+        warp_row(src, row, clip_warp_row(src, columns, row, width), width, vectorPixels, WarpBorder::Zero);
+
+        const uint8_t* perByte = alpha;
+        if (channels > 1) {
+            for (uint32_t x = first; x < last; ++x) memset(&rows.expandedAlpha[(size_t)x * channels], alpha[x], channels);
+            perByte = rows.expandedAlpha.data();
+        }
+        size_t done = (size_t)first * channels;
+#if DP_X86
+        if (rows.isa == Isa::AVX2) done = blend_bytes_avx2(rows.warped.data(), perByte, out, done, (size_t)last * channels);
+#endif
+        blend_bytes_scalar(rows.warped.data(), perByte, out, done, (size_t)last * channels);
+    }
+}
+
+void CPU::morph_mask(const uint8_t* source, uint32_t sourcePitch, uint8_t* destination, uint32_t destPitch,
+                     uint32_t width, uint32_t height, uint32_t size, bool dilate) {
+    if (width == 0 || height == 0) return;
+    if (!source || !destination || sourcePitch < width || destPitch < width || size == 0) throw std::invalid_argument("Invalid mask for morph_mask.");
+    const uint64_t pixels = (uint64_t)width * height;
+    for_row_bands(height, pixels, [&](uint32_t begin, uint32_t end) {
+        std::vector<uint8_t> scratch;
+        for (uint32_t y = begin; y < end; ++y) {
+            const uint8_t* in = source + (size_t)y * sourcePitch;
+            if (dilate) morph_row<true>(in, destination + (size_t)y * destPitch, width, size, scratch);
+            else morph_row<false>(in, destination + (size_t)y * destPitch, width, size, scratch);
+        }
+    });
+    for_column_strips(width, pixels, [&](uint32_t begin, uint32_t end) {
+        std::vector<uint8_t> scratch;
+        if (dilate) morph_columns<true>(destination, destPitch, height, begin, end, size, scratch);
+        else morph_columns<false>(destination, destPitch, height, begin, end, size, scratch);
+    });
+}
+
+void CPU::feather_mask(const uint8_t* source, uint32_t sourcePitch, uint8_t* destination, uint32_t destPitch,
+                       uint32_t width, uint32_t height, uint32_t size) {
+    if (width == 0 || height == 0) return;
+    if (!source || !destination || sourcePitch < width || destPitch < width) throw std::invalid_argument("Invalid mask for feather_mask.");
+    const FeatherKernel feather = make_feather_kernel(std::max(3u, size | 1u));
+    const uint64_t pixels = (uint64_t)width * height;
+    std::vector<uint16_t> plane(pixels);
+    for_row_bands(height, pixels, [&](uint32_t begin, uint32_t end) {
+        std::vector<uint16_t> padded;
+        std::vector<uint32_t> sums;
+        for (uint32_t y = begin; y < end; ++y) feather_row(source + (size_t)y * sourcePitch, plane.data() + (size_t)y * width, width, feather, padded, sums);
+    });
+    for_column_strips(width, pixels, [&](uint32_t begin, uint32_t end) {
+        std::vector<uint16_t> scratch;
+        std::vector<uint32_t> sums;
+        feather_columns(plane.data(), width, height, begin, end, feather, destination, destPitch, scratch, sums);
+    });
+}
+
+void CPU::composite_face(const uint8_t* face, uint32_t faceWidth, uint32_t faceHeight, uint32_t facePitch,
+                         uint8_t* destination, uint32_t destWidth, uint32_t destHeight, uint32_t destPitch,
+                         uint32_t channels, const double inverse[6], const FaceMask& mask) {
+    if (destWidth == 0 || destHeight == 0) return;
+    check_warp_source(face, faceWidth, faceHeight, facePitch, channels, "composite_face");
+    if (!destination || destPitch < (uint64_t)destWidth * channels) throw std::invalid_argument("Invalid destination image for composite_face.");
+
+    const uint32_t width = destWidth, height = destHeight;
+    const uint64_t pixels = (uint64_t)width * height;
+    const WarpColumns columns = make_warp_columns(inverse, width);
+    const WarpSource src = { face, (int32_t)faceWidth, (int32_t)faceHeight, (int32_t)facePitch, channels };
+    const WarpPixelsFn vectorPixels = select_warp_pixels(channels, (uint64_t)facePitch * faceHeight);
+    const uint32_t expansion = (uint32_t)std::abs(mask.expansion);
+    const bool dilate = mask.expansion > 0;
+    const FeatherKernel feather = make_feather_kernel(std::max(3u, mask.feather | 1u));
+    const uint32_t core = mask.coreTightness;
+
+    // The stages alternate between row bands and column strips and hand over whole planes: the shaped
+    // mask, which later takes the final alpha, the feather in Q8, and the core erosion.
+    std::vector<uint8_t> shaped(pixels);
+    std::vector<uint16_t> feathered(pixels);
+    std::vector<uint8_t> cored(core ? pixels : 0);
+
+    for_row_bands(height, pixels, [&](uint32_t begin, uint32_t end) {
+        std::vector<uint8_t> coverage(width), scratch;
+        for (uint32_t y = begin; y < end; ++y) {
+            uint8_t* out = shaped.data() + (size_t)y * width;
+            const WarpRow row = make_warp_row(columns, inverse, y, expansion > 1 ? coverage.data() : out);
+            warp_coverage_row(src, row, clip_warp_row(src, columns, row, width), width);
+            if (expansion <= 1) continue;
+            if (dilate) morph_row<true>(coverage.data(), out, width, expansion, scratch);
+            else morph_row<false>(coverage.data(), out, width, expansion, scratch);
+        }
+    });
+    if (expansion > 1) {
+        for_column_strips(width, pixels, [&](uint32_t begin, uint32_t end) {
+            std::vector<uint8_t> scratch;
+            if (dilate) morph_columns<true>(shaped.data(), width, height, begin, end, expansion, scratch);
+            else morph_columns<false>(shaped.data(), width, height, begin, end, expansion, scratch);
+        });
+    }
+
+    for_row_bands(height, pixels, [&](uint32_t begin, uint32_t end) {
+        std::vector<uint8_t> scratch;
+        std::vector<uint16_t> padded;
+        std::vector<uint32_t> sums;
+        for (uint32_t y = begin; y < end; ++y) {
+            const uint8_t* in = shaped.data() + (size_t)y * width;
+            feather_row(in, feathered.data() + (size_t)y * width, width, feather, padded, sums);
+            if (core) morph_row<false>(in, cored.data() + (size_t)y * width, width, core, scratch);
+        }
+    });
+    for_column_strips(width, pixels, [&](uint32_t begin, uint32_t end) {
+        std::vector<uint8_t> scratch;
+        std::vector<uint16_t> featherScratch;
+        std::vector<uint32_t> sums;
+        feather_columns(feathered.data(), width, height, begin, end, feather, shaped.data(), width, featherScratch, sums);
+        if (!core) return;
+        morph_columns<false>(cored.data(), width, height, begin, end, core, scratch);
+        for (uint32_t y = 0; y < height; ++y) {
+            uint8_t* alpha = shaped.data() + (size_t)y * width;
+            const uint8_t* kept = cored.data() + (size_t)y * width;
+            for (uint32_t x = begin; x < end; ++x) alpha[x] = std::max(alpha[x], kept[x]);
+        }
+    });
+
+    for_row_bands(height, pixels, [&](uint32_t begin, uint32_t end) {
+        FaceBlendRows blend(width, channels);
+        for (uint32_t y = begin; y < end; ++y) {
+            blend_face_row(src, columns, inverse, y, shaped.data() + (size_t)y * width, 0, width, vectorPixels, destination + (size_t)y * destPitch, blend);
+        }
+    });
+}
+
+void CPU::composite_face(const uint8_t* face, uint32_t faceWidth, uint32_t faceHeight, uint32_t facePitch,
+                         const uint8_t* alpha, uint32_t alphaWidth, uint32_t alphaHeight, uint32_t alphaPitch, uint32_t alphaMargin,
+                         uint8_t* destination, uint32_t destWidth, uint32_t destHeight, uint32_t destPitch,
+                         uint32_t channels, const double inverse[6]) {
+    if (destWidth == 0 || destHeight == 0) return;
+    check_warp_source(face, faceWidth, faceHeight, facePitch, channels, "composite_face");
+    check_warp_source(alpha, alphaWidth, alphaHeight, alphaPitch, 1, "composite_face");
+    if (!destination || destPitch < (uint64_t)destWidth * channels) throw std::invalid_argument("Invalid destination image for composite_face.");
+
+    const uint32_t width = destWidth, height = destHeight;
+    // The alpha plane is the face plane moved by the margin, so only the row terms differ; the column
+    // terms of the map are shared.
+    const double alphaInverse[6] = { inverse[0], inverse[1], inverse[2] + alphaMargin, inverse[3], inverse[4], inverse[5] + alphaMargin };
+    const WarpColumns columns = make_warp_columns(inverse, width);
+    const WarpSource src = { face, (int32_t)faceWidth, (int32_t)faceHeight, (int32_t)facePitch, channels };
+    const WarpSource mask = { alpha, (int32_t)alphaWidth, (int32_t)alphaHeight, (int32_t)alphaPitch, 1 };
+    const WarpPixelsFn vectorPixels = select_warp_pixels(channels, (uint64_t)facePitch * faceHeight);
+    const WarpPixelsFn maskPixels = select_warp_pixels(1, (uint64_t)alphaPitch * alphaHeight);
+
+    for_row_bands(height, (uint64_t)width * height, [&](uint32_t begin, uint32_t end) {
+        FaceBlendRows blend(width, channels);
+        std::vector<uint8_t> warpedAlpha(width);
+        for (uint32_t y = begin; y < end; ++y) {
+            const WarpRow row = make_warp_row(columns, alphaInverse, y, warpedAlpha.data());
+            const WarpSpan span = clip_warp_row(mask, columns, row, width);
+            if (span.begin == span.end) continue;
+            warp_row(mask, row, span, width, maskPixels, WarpBorder::Zero);
+            blend_face_row(src, columns, inverse, y, warpedAlpha.data(), span.begin, span.end, vectorPixels, destination + (size_t)y * destPitch, blend);
+        }
+    });
+}
+
+namespace {
+    // Appends the anchor indices of scores[0, count) that reach threshold. Most anchors do not, so scores
+    // are compared four at a time and groups without a hit are skipped.
+    DP_TARGET("sse2") void find_scores(const float* scores, uint32_t count, float threshold, std::vector<uint32_t>& hits) {
+        uint32_t i = 0;
+#if DP_X86
+        const __m128 limit = _mm_set1_ps(threshold);
+        for (; i + 4 <= count; i += 4) {
+            const int mask = _mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(scores + i), limit));
+            if (!mask) continue;
+            for (uint32_t lane = 0; lane < 4; ++lane) {
+                if (mask & (1 << lane)) hits.push_back(i + lane);
+            }
+        }
+#elif DP_NEON
+        const float32x4_t limit = vdupq_n_f32(threshold);
+        for (; i + 4 <= count; i += 4) {
+            const uint32x4_t reached = vcgeq_f32(vld1q_f32(scores + i), limit);
+            if (!vmaxvq_u32(reached)) continue;
+            for (uint32_t lane = 0; lane < 4; ++lane) {
+                if (scores[i + lane] >= threshold) hits.push_back(i + lane);
+            }
+        }
+#endif
+        for (; i < count; ++i) {
+            if (scores[i] >= threshold) hits.push_back(i);
+        }
+    }
+
+    // Kept faces for the NMS test, as planes of x1, y1, x2, y2 and area.
+    struct KeptBounds {
+        float* x1;
+        float* y1;
+        float* x2;
+        float* y2;
+        float* area;
+        size_t count;
+    };
+
+    inline float box_area(const float* box) {
+        return (box[2] - box[0] + 1.0f) * (box[3] - box[1] + 1.0f);
+    }
+
+    // Whether box overlaps any kept face by more than nmsThreshold.
+    DP_TARGET("sse2") bool overlaps_kept(const KeptBounds& kept, const float* box, float area, float nmsThreshold) {
+        size_t j = 0;
+#if DP_X86
+        const __m128 x1 = _mm_set1_ps(box[0]), y1 = _mm_set1_ps(box[1]), x2 = _mm_set1_ps(box[2]), y2 = _mm_set1_ps(box[3]);
+        const __m128 one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps(), own = _mm_set1_ps(area), limit = _mm_set1_ps(nmsThreshold);
+        for (; j + 4 <= kept.count; j += 4) {
+            const __m128 w = _mm_max_ps(zero, _mm_add_ps(_mm_sub_ps(_mm_min_ps(x2, _mm_loadu_ps(kept.x2 + j)), _mm_max_ps(x1, _mm_loadu_ps(kept.x1 + j))), one));
+            const __m128 h = _mm_max_ps(zero, _mm_add_ps(_mm_sub_ps(_mm_min_ps(y2, _mm_loadu_ps(kept.y2 + j)), _mm_max_ps(y1, _mm_loadu_ps(kept.y1 + j))), one));
+            const __m128 inter = _mm_mul_ps(w, h);
+            const __m128 iou = _mm_div_ps(inter, _mm_sub_ps(_mm_add_ps(own, _mm_loadu_ps(kept.area + j)), inter));
+            if (_mm_movemask_ps(_mm_cmpgt_ps(iou, limit))) return true;
+        }
+#elif DP_NEON
+        const float32x4_t x1 = vdupq_n_f32(box[0]), y1 = vdupq_n_f32(box[1]), x2 = vdupq_n_f32(box[2]), y2 = vdupq_n_f32(box[3]);
+        const float32x4_t one = vdupq_n_f32(1.0f), zero = vdupq_n_f32(0.0f), own = vdupq_n_f32(area), limit = vdupq_n_f32(nmsThreshold);
+        for (; j + 4 <= kept.count; j += 4) {
+            const float32x4_t w = vmaxq_f32(zero, vaddq_f32(vsubq_f32(vminq_f32(x2, vld1q_f32(kept.x2 + j)), vmaxq_f32(x1, vld1q_f32(kept.x1 + j))), one));
+            const float32x4_t h = vmaxq_f32(zero, vaddq_f32(vsubq_f32(vminq_f32(y2, vld1q_f32(kept.y2 + j)), vmaxq_f32(y1, vld1q_f32(kept.y1 + j))), one));
+            const float32x4_t inter = vmulq_f32(w, h);
+            const float32x4_t iou = vdivq_f32(inter, vsubq_f32(vaddq_f32(own, vld1q_f32(kept.area + j)), inter));
+            if (vmaxvq_u32(vcgtq_f32(iou, limit))) return true;
+        }
+#endif
+        for (; j < kept.count; ++j) {
+            const float w = std::max(0.0f, std::min(box[2], kept.x2[j]) - std::max(box[0], kept.x1[j]) + 1.0f);
+            const float h = std::max(0.0f, std::min(box[3], kept.y2[j]) - std::max(box[1], kept.y1[j]) + 1.0f);
+            const float inter = w * h;
+            if (inter / (area + kept.area[j] - inter) > nmsThreshold) return true;
+        }
+        return false;
+    }
+}
+
+void CPU::decode_faces(const DetectionLevel* levels, size_t levelCount, float threshold, float nmsThreshold, float scale,
+                       size_t maxFaces, FaceDetections& detections) {
+    if (!(scale > 0.0f)) throw std::invalid_argument("decode_faces needs a positive scale.");
+    const bool keypoints = levelCount > 0 && levels[0].keypoints;
+    // order first collects each level's hits, then holds the candidate heap.
+    std::vector<uint32_t>& hits = detections.order;
+    detections.kept.clear();
+    detections.boxes.clear();
+    detections.keypoints.clear();
+
+    for (size_t l = 0; l < levelCount; ++l) {
+        const DetectionLevel& level = levels[l];
+        if (!level.scores || !level.boxes || !level.keypoints != !keypoints || level.anchorsPerCell == 0) {
+            throw std::invalid_argument("Invalid detection level for decode_faces.");
+        }
+        const uint64_t anchors = (uint64_t)level.gridWidth * level.gridHeight * level.anchorsPerCell;
+        if (anchors > UINT32_MAX) throw std::invalid_argument("Invalid detection level for decode_faces.");
+        hits.clear();
+        find_scores(level.scores, (uint32_t)anchors, threshold, hits);
+
+        const float stride = (float)level.stride;
+        for (uint32_t anchor : hits) {
+            const uint32_t cell = anchor / level.anchorsPerCell;
+            const float cx = (float)(cell % level.gridWidth) * stride, cy = (float)(cell / level.gridWidth) * stride;
+            const float* distance = level.boxes + (size_t)anchor * 4;
+            detections.boxes.insert(detections.boxes.end(), {
+                (cx - distance[0] * stride) / scale, (cy - distance[1] * stride) / scale,
+                (cx + distance[2] * stride) / scale, (cy + distance[3] * stride) / scale, level.scores[anchor] });
+            if (!keypoints) continue;
+            const float* offset = level.keypoints + (size_t)anchor * 10;
+            for (int k = 0; k < 10; k += 2) {
+                detections.keypoints.push_back((cx + offset[k] * stride) / scale);
+                detections.keypoints.push_back((cy + offset[k + 1] * stride) / scale);
+            }
+        }
+    }
+
+    // Best score first, ties by anchor order.
+    const size_t candidates = detections.boxes.size() / 5;
+    const float* boxes = detections.boxes.data();
+    std::vector<uint32_t>& heap = detections.order;
+    heap.resize(candidates);
+    for (size_t i = 0; i < candidates; ++i) heap[i] = (uint32_t)i;
+    auto worse = [boxes](uint32_t a, uint32_t b) { return boxes[(size_t)a * 5 + 4] < boxes[(size_t)b * 5 + 4] || (boxes[(size_t)a * 5 + 4] == boxes[(size_t)b * 5 + 4] && a > b); };
+    std::make_heap(heap.begin(), heap.end(), worse);
+
+    const size_t limit = maxFaces ? std::min(maxFaces, candidates) : candidates;
+    const size_t plane = limit;
+    detections.keptBounds.resize(plane * 5);
+    float* bounds = detections.keptBounds.data();
+    KeptBounds kept = { bounds, bounds + plane, bounds + plane * 2, bounds + plane * 3, bounds + plane * 4, 0 };
+    for (auto end = heap.end(); end != heap.begin() && kept.count < limit; --end) {
+        std::pop_heap(heap.begin(), end, worse);
+        const uint32_t candidate = *(end - 1);
+        const float* box = boxes + (size_t)candidate * 5;
+        const float area = box_area(box);
+        if (overlaps_kept(kept, box, area, nmsThreshold)) continue;
+        kept.x1[kept.count] = box[0];
+        kept.y1[kept.count] = box[1];
+        kept.x2[kept.count] = box[2];
+        kept.y2[kept.count] = box[3];
+        kept.area[kept.count] = area;
+        ++kept.count;
+        detections.kept.push_back(candidate);
+    }
+}
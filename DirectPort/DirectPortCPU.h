@@ -0,0 +1,450 @@
+#pragma once
+
+#include "DirectPort.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+
+namespace DirectPort {
+namespace CPU {
+
+    // Pitched view of host pixel memory. Rows are rowPitch bytes apart.
+    struct Surface {
+        uint8_t* data;
+        uint32_t width;
+        uint32_t height;
+        uint32_t rowPitch;
+        DXGI_FORMAT format;
+    };
+
+    enum class Isa {
+        Scalar,
+        SSE41,
+        AVX2,
+        NEON
+    };
+
+    // Best instruction set the running machine supports, detected once. Kernels built for several ISAs
+    // dispatch on it, so one binary runs everywhere.
+    Isa get_isa();
+    const char* get_isa_name(Isa isa);
+
+    // Persistent workers for data-parallel pixel work. parallel_for runs task(i) for every i in [0, count)
+    // on the workers and the calling thread, and returns once all have finished. A parallel_for issued
+    // from inside a task runs inline, so kernels can nest without deadlocking the pool.
+    class ThreadPool {
+    public:
+        explicit ThreadPool(unsigned thread_count);
+        ~ThreadPool();
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        void parallel_for(uint32_t count, const std::function<void(uint32_t)>& task);
+        unsigned get_thread_count() const;
+
+        // Process-wide pool with one thread per hardware thread.
+        static ThreadPool& shared();
+
+    private:
+        struct Impl;
+        std::unique_ptr<Impl> pImpl;
+    };
+
+    // Completion of a job run by a JobQueue. A job that throws stores the exception, which wait()
+    // rethrows and which every job depending on it inherits instead of running.
+    class JobEvent {
+    public:
+        JobEvent();
+        ~JobEvent();
+        bool is_complete() const;
+        // Returns false if timeout_ms passes first; INFINITE_TIMEOUT waits for good.
+        bool wait(uint32_t timeout_ms = INFINITE_TIMEOUT);
+
+    private:
+        friend class JobQueue;
+        struct Impl;
+        std::unique_ptr<Impl> pImpl;
+    };
+
+    // Dedicated threads for asynchronous work. A submitted job runs once every dependency has
+    // completed, so independent jobs overlap while chains stay ordered without the submitter blocking.
+    // Jobs use ThreadPool::shared() for their own data parallelism.
+    class JobQueue {
+    public:
+        explicit JobQueue(unsigned thread_count);
+        ~JobQueue();
+        JobQueue(const JobQueue&) = delete;
+        JobQueue& operator=(const JobQueue&) = delete;
+
+        std::shared_ptr<JobEvent> submit(std::function<void()> job, const std::vector<std::shared_ptr<JobEvent>>& dependencies = {});
+
+        static JobQueue& shared();
+
+    private:
+        struct Impl;
+        std::unique_ptr<Impl> pImpl;
+    };
+
+    uint32_t bytes_per_pixel(DXGI_FORMAT format);
+
+    float half_to_float(uint16_t value);
+    uint16_t float_to_half(float value);
+
+    // A texel as a shader sees it: RGBA floats, with missing channels read as 0 and alpha as 1.
+    struct Pixel {
+        float r, g, b, a;
+    };
+
+    inline float unorm_to_float(uint32_t value, float scale) { return value * (1.0f / scale); }
+    inline uint32_t float_to_unorm(float value, float scale) {
+        value = std::min(std::max(value, 0.0f), 1.0f);
+        return (uint32_t)(value * scale + 0.5f);
+    }
+
+    // Compile-time format traits, so templated kernels inline the texel conversion instead of
+    // switching on the format per pixel.
+    template <DXGI_FORMAT Format> struct PixelFormat;
+
+    template <> struct PixelFormat<DXGI_FORMAT_B8G8R8A8_UNORM> {
+        static constexpr DXGI_FORMAT format = DXGI_FORMAT_B8G8R8A8_UNORM;
+        static constexpr uint32_t size = 4;
+        static Pixel load(const uint8_t* p) { return { unorm_to_float(p[2], 255.0f), unorm_to_float(p[1], 255.0f), unorm_to_float(p[0], 255.0f), unorm_to_float(p[3], 255.0f) }; }
+        static void store(uint8_t* p, const Pixel& c) {
+            p[0] = (uint8_t)float_to_unorm(c.b, 255.0f); p[1] = (uint8_t)float_to_unorm(c.g, 255.0f);
+            p[2] = (uint8_t)float_to_unorm(c.r, 255.0f); p[3] = (uint8_t)float_to_unorm(c.a, 255.0f);
+        }
+    };
+
+    template <> struct PixelFormat<DXGI_FORMAT_R8G8B8A8_UNORM> {
+        static constexpr DXGI_FORMAT format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        static constexpr uint32_t size = 4;
+        static Pixel load(const uint8_t* p) { return { unorm_to_float(p[0], 255.0f), unorm_to_float(p[1], 255.0f), unorm_to_float(p[2], 255.0f), unorm_to_float(p[3], 255.0f) }; }
+        static void store(uint8_t* p, const Pixel& c) {
+            p[0] = (uint8_t)float_to_unorm(c.r, 255.0f); p[1] = (uint8_t)float_to_unorm(c.g, 255.0f);
+            p[2] = (uint8_t)float_to_unorm(c.b, 255.0f); p[3] = (uint8_t)float_to_unorm(c.a, 255.0f);
+        }
+    };
+
+    template <> struct PixelFormat<DXGI_FORMAT_R8G8_UNORM> {
+        static constexpr DXGI_FORMAT format = DXGI_FORMAT_R8G8_UNORM;
+        static constexpr uint32_t size = 2;
+        static Pixel load(const uint8_t* p) { return { unorm_to_float(p[0], 255.0f), unorm_to_float(p[1], 255.0f), 0.0f, 1.0f }; }
+        static void store(uint8_t* p, const Pixel& c) { p[0] = (uint8_t)float_to_unorm(c.r, 255.0f); p[1] = (uint8_t)float_to_unorm(c.g, 255.0f); }
+    };
+
+    template <> struct PixelFormat<DXGI_FORMAT_R8_UNORM> {
+        static constexpr DXGI_FORMAT format = DXGI_FORMAT_R8_UNORM;
+        static constexpr uint32_t size = 1;
+        static Pixel load(const uint8_t* p) { return { unorm_to_float(p[0], 255.0f), 0.0f, 0.0f, 1.0f }; }
+        static void store(uint8_t* p, const Pixel& c) { p[0] = (uint8_t)float_to_unorm(c.r, 255.0f); }
+    };
+
+    template <> struct PixelFormat<DXGI_FORMAT_R10G10B10A2_UNORM> {
+        static constexpr DXGI_FORMAT format = DXGI_FORMAT_R10G10B10A2_UNORM;
+        static constexpr uint32_t size = 4;
+        static Pixel load(const uint8_t* p) {
+            uint32_t v;
+            memcpy(&v, p, 4);
+            return { unorm_to_float(v & 0x3FF, 1023.0f), unorm_to_float((v >> 10) & 0x3FF, 1023.0f), unorm_to_float((v >> 20) & 0x3FF, 1023.0f), unorm_to_float(v >> 30, 3.0f) };
+        }
+        static void store(uint8_t* p, const Pixel& c) {
+            uint32_t v = float_to_unorm(c.r, 1023.0f) | (float_to_unorm(c.g, 1023.0f) << 10) | (float_to_unorm(c.b, 1023.0f) << 20) | (float_to_unorm(c.a, 3.0f) << 30);
+            memcpy(p, &v, 4);
+        }
+    };
+
+    template <> struct PixelFormat<DXGI_FORMAT_R16_FLOAT> {
+        static constexpr DXGI_FORMAT format = DXGI_FORMAT_R16_FLOAT;
+        static constexpr uint32_t size = 2;
+        static Pixel load(const uint8_t* p) {
+            uint16_t v;
+            memcpy(&v, p, 2);
+            return { half_to_float(v), 0.0f, 0.0f, 1.0f };
+        }
+        static void store(uint8_t* p, const Pixel& c) {
+            uint16_t v = float_to_half(c.r);
+            memcpy(p, &v, 2);
+        }
+    };
+
+    template <> struct PixelFormat<DXGI_FORMAT_R16G16B16A16_FLOAT> {
+        static constexpr DXGI_FORMAT format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+        static constexpr uint32_t size = 8;
+        static Pixel load(const uint8_t* p) {
+            uint16_t v[4];
+            memcpy(v, p, 8);
+            return { half_to_float(v[0]), half_to_float(v[1]), half_to_float(v[2]), half_to_float(v[3]) };
+        }
+        static void store(uint8_t* p, const Pixel& c) {
+            uint16_t v[4] = { float_to_half(c.r), float_to_half(c.g), float_to_half(c.b), float_to_half(c.a) };
+            memcpy(p, v, 8);
+        }
+    };
+
+    template <> struct PixelFormat<DXGI_FORMAT_R32_FLOAT> {
+        static constexpr DXGI_FORMAT format = DXGI_FORMAT_R32_FLOAT;
+        static constexpr uint32_t size = 4;
+        static Pixel load(const uint8_t* p) {
+            float v;
+            memcpy(&v, p, 4);
+            return { v, 0.0f, 0.0f, 1.0f };
+        }
+        static void store(uint8_t* p, const Pixel& c) { memcpy(p, &c.r, 4); }
+    };
+
+    template <> struct PixelFormat<DXGI_FORMAT_R32G32B32A32_FLOAT> {
+        static constexpr DXGI_FORMAT format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+        static constexpr uint32_t size = 16;
+        static Pixel load(const uint8_t* p) {
+            Pixel v;
+            memcpy(&v, p, 16);
+            return v;
+        }
+        static void store(uint8_t* p, const Pixel& c) { memcpy(p, &c, 16); }
+    };
+
+    // Calls fn(PixelFormat<F>{}) for the runtime format, turning one switch into a compile-time type.
+    template <typename Fn>
+    decltype(auto) with_pixel_format(DXGI_FORMAT format, Fn&& fn) {
+        switch (format) {
+            case DXGI_FORMAT_B8G8R8A8_UNORM: return fn(PixelFormat<DXGI_FORMAT_B8G8R8A8_UNORM>{});
+            case DXGI_FORMAT_R8G8B8A8_UNORM: return fn(PixelFormat<DXGI_FORMAT_R8G8B8A8_UNORM>{});
+            case DXGI_FORMAT_R8G8_UNORM: return fn(PixelFormat<DXGI_FORMAT_R8G8_UNORM>{});
+            case DXGI_FORMAT_R8_UNORM: return fn(PixelFormat<DXGI_FORMAT_R8_UNORM>{});
+            case DXGI_FORMAT_R10G10B10A2_UNORM: return fn(PixelFormat<DXGI_FORMAT_R10G10B10A2_UNORM>{});
+            case DXGI_FORMAT_R16_FLOAT: return fn(PixelFormat<DXGI_FORMAT_R16_FLOAT>{});
+            case DXGI_FORMAT_R16G16B16A16_FLOAT: return fn(PixelFormat<DXGI_FORMAT_R16G16B16A16_FLOAT>{});
+            case DXGI_FORMAT_R32_FLOAT: return fn(PixelFormat<DXGI_FORMAT_R32_FLOAT>{});
+            case DXGI_FORMAT_R32G32B32A32_FLOAT: return fn(PixelFormat<DXGI_FORMAT_R32G32B32A32_FLOAT>{});
+            default: throw std::invalid_argument("Unsupported DXGI_FORMAT for a CPU pixel kernel.");
+        }
+    }
+
+    // What a native kernel sees of one apply_shader call: the same output, inputs and constants blob a
+    // pixel shader gets, restricted to the output rows [rowBegin, rowEnd).
+    struct KernelArgs {
+        Surface output;
+        const Surface* inputs;
+        size_t inputCount;
+        const uint8_t* constants;
+        size_t constantsSize;
+        uint32_t rowBegin;
+        uint32_t rowEnd;
+
+        // Reads the constants blob as a cbuffer-like struct; throws if the blob is too small.
+        template <typename T>
+        T get_constants() const {
+            if (constantsSize < sizeof(T)) {
+                throw std::invalid_argument("Constants blob is smaller than the kernel's constant struct.");
+            }
+            T value;
+            memcpy(&value, constants, sizeof(T));
+            return value;
+        }
+    };
+
+    // Native counterpart of a pixel shader. Called concurrently for disjoint row bands of one output.
+    using Kernel = std::function<void(const KernelArgs&)>;
+
+    // Named kernels DeviceCPU::apply_shader dispatches to. Registering an existing name replaces it.
+    void register_kernel(const std::string& name, Kernel kernel);
+    bool unregister_kernel(const std::string& name);
+    Kernel find_kernel(const std::string& name);
+    std::vector<std::string> get_kernel_names();
+    // Bumped by every register/unregister, so callers caching find_kernel results know when to drop them.
+    uint64_t get_kernel_generation();
+
+    // Runs kernel over output in row bands across ThreadPool::shared().
+    void run_kernel(const Kernel& kernel, const Surface& output, const std::vector<Surface>& inputs, const std::vector<uint8_t>& constants);
+    void run_kernel(const Kernel& kernel, const Surface& output, const std::vector<Surface>& inputs, const uint8_t* constants, size_t constantsSize);
+
+    // Builds a Kernel from a per-pixel operation. factory(args) is called once per band and returns
+    // op(const Pixel* inputs, uint32_t x, uint32_t y) -> Pixel, so constants are unpacked once per band.
+    // Inputs must match the output size. The loop is instantiated for every (input, output) format pair
+    // of single-input kernels; further inputs are decoded a row at a time by format-specialized loops.
+    template <typename Factory>
+    Kernel make_pixel_kernel(Factory factory) {
+        return [factory](const KernelArgs& args) {
+            for (size_t i = 0; i < args.inputCount; ++i) {
+                if (args.inputs[i].width != args.output.width || args.inputs[i].height != args.output.height) {
+                    throw std::invalid_argument("Pixel kernel inputs must have the same size as the output.");
+                }
+            }
+            auto op = factory(args);
+            const uint32_t width = args.output.width;
+            with_pixel_format(args.output.format, [&](auto out) {
+                using Out = decltype(out);
+                if (args.inputCount == 0) {
+                    for (uint32_t y = args.rowBegin; y < args.rowEnd; ++y) {
+                        uint8_t* dst = args.output.data + (size_t)y * args.output.rowPitch;
+                        for (uint32_t x = 0; x < width; ++x) Out::store(dst + (size_t)x * Out::size, op(nullptr, x, y));
+                    }
+                } else if (args.inputCount == 1) {
+                    with_pixel_format(args.inputs[0].format, [&](auto in) {
+                        using In = decltype(in);
+                        for (uint32_t y = args.rowBegin; y < args.rowEnd; ++y) {
+                            const uint8_t* src = args.inputs[0].data + (size_t)y * args.inputs[0].rowPitch;
+                            uint8_t* dst = args.output.data + (size_t)y * args.output.rowPitch;
+                            for (uint32_t x = 0; x < width; ++x) {
+                                Pixel texel = In::load(src + (size_t)x * In::size);
+                                Out::store(dst + (size_t)x * Out::size, op(&texel, x, y));
+                            }
+                        }
+                    });
+                } else {
+                    std::vector<Pixel> rows(args.inputCount * (size_t)width);
+                    std::vector<Pixel> texels(args.inputCount);
+                    for (uint32_t y = args.rowBegin; y < args.rowEnd; ++y) {
+                        for (size_t i = 0; i < args.inputCount; ++i) {
+                            with_pixel_format(args.inputs[i].format, [&](auto in) {
+                                using In = decltype(in);
+                                const uint8_t* src = args.inputs[i].data + (size_t)y * args.inputs[i].rowPitch;
+                                Pixel* decoded = &rows[i * width];
+                                for (uint32_t x = 0; x < width; ++x) decoded[x] = In::load(src + (size_t)x * In::size);
+                            });
+                        }
+                        uint8_t* dst = args.output.data + (size_t)y * args.output.rowPitch;
+                        for (uint32_t x = 0; x < width; ++x) {
+                            for (size_t i = 0; i < args.inputCount; ++i) texels[i] = rows[i * width + x];
+                            Out::store(dst + (size_t)x * Out::size, op(texels.data(), x, y));
+                        }
+                    }
+                }
+            });
+        };
+    }
+
+    // Copies pixels row by row; both surfaces must have the same size and format.
+    void copy_surface(const Surface& source, const Surface& destination);
+
+    // Sets every pixel to color, converted to the surface's format the way a shader output would be.
+    void fill_surface(const Surface& destination, const Pixel& color);
+
+    // Scales source into the destination rectangle the way the D3D blit does: pixel-centre sampling,
+    // bilinear filter, clamp addressing. The rectangle is clipped to the destination surface.
+    // 8-bit RGBA/BGRA and 32-bit float RGBA have SIMD paths; the other formats are filtered in float.
+    // Rows are split into bands across ThreadPool::shared().
+    void blit_bilinear(const Surface& source, const Surface& destination,
+                       uint32_t destX, uint32_t destY, uint32_t destWidth, uint32_t destHeight);
+
+    // Caller-owned 8-bit pixels as OpenCV (BGR8), PIL (RGB8) and numpy frames hold them. The
+    // three-channel layouts have no DXGI_FORMAT, so they only reach textures through a conversion.
+    enum class HostLayout {
+        BGR8,
+        RGB8,
+        BGRA8,
+        RGBA8,
+        Gray8
+    };
+
+    uint32_t bytes_per_pixel(HostLayout layout);
+
+    // Converts host pixels into destination's format; the size is the destination's. Three-channel
+    // layouts gain an opaque alpha and Gray8 is replicated to RGB. 24->32-bit swizzles, red/blue swaps,
+    // half-float packing and 10:10:10:2 packing have SIMD paths; other pairs run the PixelFormat loop.
+    void convert_from_host(const uint8_t* source, uint32_t sourcePitch, HostLayout layout, const Surface& destination);
+    // The reverse, for reading frames back into 8-bit arrays. Gray8 takes BT.601 luma.
+    void convert_to_host(const Surface& source, uint8_t* destination, uint32_t destinationPitch, HostLayout layout);
+
+    // One-pass ingestion of a camera frame: area-resamples host pixels of any size to the destination
+    // (box filter with fractional edge coverage, like cv2.INTER_AREA), optionally mirrors it horizontally,
+    // and writes the destination's format. Rows are accumulated in float with SIMD and banded over the pool.
+    void resample_area(const uint8_t* source, uint32_t sourceWidth, uint32_t sourceHeight, uint32_t sourcePitch, HostLayout layout,
+                       const Surface& destination, bool mirror);
+
+    // What warp_affine writes where no tap reaches the source: zeros, like cv2.BORDER_CONSTANT with the
+    // default value, or nothing, like cv2.BORDER_TRANSPARENT.
+    enum class WarpBorder {
+        Zero,
+        Transparent
+    };
+
+    // Inverts a 2x3 affine matrix the way cv2.invertAffineTransform does; a singular matrix gives zeros.
+    void invert_affine(const double matrix[6], double inverse[6]);
+
+    // cv2.warpAffine with INTER_LINEAR for 8-bit pixels of 1, 3 or 4 channels, where inverse maps destination
+    // pixels to source coordinates (cv2.WARP_INVERSE_MAP) and taps outside the source read zero. Coordinates
+    // and weights use cv2's fixed-point steps, so the output matches it exactly. Every row is clipped to the
+    // span whose taps reach the source before anything is sampled; the span's interior runs on AVX2, its
+    // edges and other ISAs on a scalar loop. Rows are banded over ThreadPool::shared().
+    void warp_affine(const uint8_t* source, uint32_t sourceWidth, uint32_t sourceHeight, uint32_t sourcePitch,
+                     uint8_t* destination, uint32_t destWidth, uint32_t destHeight, uint32_t destPitch,
+                     uint32_t channels, const double inverse[6], WarpBorder border);
+
+    // Square erosion or dilation of an 8-bit mask with cv2.erode/cv2.dilate's centred anchor and a border
+    // that never wins. van Herk/Gil-Werman keeps the cost per pixel the same for any size. Rows and then
+    // column strips are spread over ThreadPool::shared(); source may be destination.
+    void morph_mask(const uint8_t* source, uint32_t sourcePitch, uint8_t* destination, uint32_t destPitch,
+                    uint32_t width, uint32_t height, uint32_t size, bool dilate);
+
+    // cv2.GaussianBlur(mask, (size, size), 0) with reflected edges, approximated by three running-sum box
+    // passes per axis so that it too costs the same for any size. size is made odd and at least 3, as the
+    // feather slider's is.
+    void feather_mask(const uint8_t* source, uint32_t sourcePitch, uint8_t* destination, uint32_t destPitch,
+                      uint32_t width, uint32_t height, uint32_t size);
+
+    // How composite_face shapes the warped face rectangle into its blend mask, in FaceOn Studio's slider
+    // units: expansion dilates (positive) or erodes (negative) it by a square of that size, feather is the
+    // Gaussian kernel size (made odd, at least 3), and a positive coreTightness keeps the mask eroded by
+    // that square fully opaque under the feather.
+    struct FaceMask {
+        int32_t expansion;
+        uint32_t feather;
+        uint32_t coreTightness;
+    };
+
+    // Pastes a face into the destination ROI in place: the warp_affine of the face rectangle becomes the
+    // mask, is shaped per FaceMask with the kernels of morph_mask and feather_mask, and blends the warped
+    // face over the destination with 8-bit alpha in 16-bit fixed point. inverse maps ROI pixels to face
+    // coordinates as in warp_affine; where the mask spreads past the face it blends black, like the cv2
+    // pipeline this replaces. The stages are fused into passes over row bands and column strips of
+    // ThreadPool::shared(), and only columns the mask reaches are warped and blended.
+    void composite_face(const uint8_t* face, uint32_t faceWidth, uint32_t faceHeight, uint32_t facePitch,
+                        uint8_t* destination, uint32_t destWidth, uint32_t destHeight, uint32_t destPitch,
+                        uint32_t channels, const double inverse[6], const FaceMask& mask);
+
+    // composite_face under a blend mask shaped ahead of time in face space, as FaceOn Studio caches it per
+    // slider setting: alpha pixel (u, v) covers face coordinate (u - alphaMargin, v - alphaMargin), and each
+    // frame only warps it alongside the face in one pass over row bands.
+    void composite_face(const uint8_t* face, uint32_t faceWidth, uint32_t faceHeight, uint32_t facePitch,
+                        const uint8_t* alpha, uint32_t alphaWidth, uint32_t alphaHeight, uint32_t alphaPitch, uint32_t alphaMargin,
+                        uint8_t* destination, uint32_t destWidth, uint32_t destHeight, uint32_t destPitch,
+                        uint32_t channels, const double inverse[6]);
+
+    // One pyramid level of a RetinaFace/SCRFD detector head as the session returns it: a score per anchor,
+    // (left, top, right, bottom) box distances and, unless null, five (x, y) keypoint offsets, all in units
+    // of stride. There are anchorsPerCell anchors per cell of a gridWidth x gridHeight grid, row-major.
+    struct DetectionLevel {
+        const float* scores;
+        const float* boxes;
+        const float* keypoints;
+        uint32_t stride;
+        uint32_t gridWidth;
+        uint32_t gridHeight;
+        uint32_t anchorsPerCell;
+    };
+
+    // Result and scratch of decode_faces. Kept across frames, its buffers stop growing once they fit the
+    // busiest frame. kept indexes the faces in boxes (x1, y1, x2, y2, score) and keypoints (five x, y
+    // pairs), best first.
+    struct FaceDetections {
+        std::vector<uint32_t> kept;
+        std::vector<float> boxes;
+        std::vector<float> keypoints;
+        std::vector<uint32_t> order;
+        std::vector<float> keptBounds;
+    };
+
+    // Detector post-processing: anchors scoring at least threshold are decoded as they are found, with
+    // centers taken from the anchor index, and divided by scale. Greedy NMS then keeps each candidate whose
+    // IoU (in the +1 pixel convention) with every face kept so far is at most nmsThreshold, at most maxFaces
+    // of them unless it is 0. Candidates come off a heap only until that many are kept, and each is tested
+    // against the kept boxes four at a time.
+    void decode_faces(const DetectionLevel* levels, size_t levelCount, float threshold, float nmsThreshold, float scale,
+                      size_t maxFaces, FaceDetections& detections);
+}
+}
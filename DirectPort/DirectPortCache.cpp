@@ -0,0 +1,124 @@
+#include "DirectPortCache.h"
+#include "DirectPortShm.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+using namespace DirectPort;
+using namespace DirectPort::Cache;
+
+namespace {
+    constexpr UINT32 BLOB_MAGIC = 0x43535044; // "DPSC"
+    constexpr UINT32 BLOB_VERSION = 1;
+
+    struct BlobHeader {
+        UINT32 magic;
+        UINT32 version;
+        UINT64 key;
+        UINT64 size;
+    };
+
+    // MurmurHash64A; seeding each part with the previous hash chains them into one key.
+    uint64_t murmur64(const void* data, size_t length, uint64_t seed) {
+        const uint64_t m = 0xc6a4a7935bd1e995ull;
+        const int r = 47;
+        uint64_t h = seed ^ (length * m);
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        const size_t blocks = length / 8;
+        for (size_t i = 0; i < blocks; ++i) {
+            uint64_t k;
+            memcpy(&k, bytes + i * 8, 8);
+            k *= m;
+            k ^= k >> r;
+            k *= m;
+            h ^= k;
+            h *= m;
+        }
+        const uint8_t* tail = bytes + blocks * 8;
+        const size_t remaining = length & 7;
+        if (remaining) {
+            for (size_t i = 0; i < remaining; ++i) h ^= (uint64_t)tail[i] << (8 * i);
+            h *= m;
+        }
+        h ^= h >> r;
+        h *= m;
+        h ^= h >> r;
+        return h;
+    }
+
+    struct DiskCacheSettings {
+        std::mutex mutex;
+        std::string directory;
+    };
+
+    DiskCacheSettings& get_disk_cache_settings() {
+        static DiskCacheSettings* settings = [] {
+            auto* created = new DiskCacheSettings();
+            if (const char* directory = std::getenv("DIRECTPORT_SHADER_CACHE")) created->directory = directory;
+            return created;
+        }();
+        return *settings;
+    }
+
+    std::filesystem::path get_blob_path(const std::string& directory, uint64_t key) {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.dpsc", (unsigned long long)key);
+        return std::filesystem::path(directory) / name;
+    }
+}
+
+void DirectPort::set_shader_cache_directory(const std::string& directory) {
+    DiskCacheSettings& settings = get_disk_cache_settings();
+    std::lock_guard<std::mutex> lock(settings.mutex);
+    settings.directory = directory;
+}
+
+std::string DirectPort::get_shader_cache_directory() {
+    DiskCacheSettings& settings = get_disk_cache_settings();
+    std::lock_guard<std::mutex> lock(settings.mutex);
+    return settings.directory;
+}
+
+uint64_t Cache::hash_shader(const void* bytes, size_t size, const std::string& entry_point, uint32_t format) {
+    uint64_t h = murmur64(bytes, size, 0);
+    h = murmur64(entry_point.data(), entry_point.size(), h);
+    return murmur64(&format, sizeof(format), h);
+}
+
+bool Cache::load_blob(uint64_t key, std::vector<uint8_t>& blob) {
+    const std::string directory = get_shader_cache_directory();
+    if (directory.empty()) return false;
+    std::ifstream file(get_blob_path(directory, key), std::ios::binary);
+    BlobHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+    if (header.magic != BLOB_MAGIC || header.version != BLOB_VERSION || header.key != key || header.size > (64ull << 20)) return false;
+    blob.resize((size_t)header.size);
+    return (bool)file.read(reinterpret_cast<char*>(blob.data()), (std::streamsize)blob.size());
+}
+
+// Written under a per-process temporary name and renamed into place, so concurrent writers and
+// readers never see a partial blob. Failures only cost a recompile next time, so they are ignored.
+void Cache::store_blob(uint64_t key, const std::vector<uint8_t>& blob) {
+    const std::string directory = get_shader_cache_directory();
+    if (directory.empty()) return;
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    const std::filesystem::path path = get_blob_path(directory, key);
+    std::filesystem::path temporary = path;
+    temporary += "." + std::to_string(Shm::current_process_id()) + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        BlobHeader header = { BLOB_MAGIC, BLOB_VERSION, key, blob.size() };
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(blob.data()), (std::streamsize)blob.size());
+        if (!file) {
+            file.close();
+            std::filesystem::remove(temporary, ec);
+            return;
+        }
+    }
+    std::filesystem::rename(temporary, path, ec);
+    if (ec) std::filesystem::remove(temporary, ec);
+}
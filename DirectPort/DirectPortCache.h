@@ -0,0 +1,97 @@
+#pragma once
+
+#include "DirectPort.h"
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace DirectPort {
+namespace Cache {
+
+    // 64-bit content hash of a shader: its bytes, entry point and the output format it is built for.
+    uint64_t hash_shader(const void* bytes, size_t size, const std::string& entry_point, uint32_t format);
+    inline uint64_t hash_shader(const std::vector<uint8_t>& bytes, const std::string& entry_point, uint32_t format) {
+        return hash_shader(bytes.data(), bytes.size(), entry_point, format);
+    }
+
+    // Compiled blobs persisted as <directory>/<hash>.dpsc across runs. Both calls are no-ops without a
+    // directory (see set_shader_cache_directory); load fails on a missing, truncated or foreign file.
+    bool load_blob(uint64_t key, std::vector<uint8_t>& blob);
+    void store_blob(uint64_t key, const std::vector<uint8_t>& blob);
+
+    // Thread-safe map from hash to compiled object, evicting the least recently used entry past capacity.
+    template <typename Value>
+    class LruCache {
+    public:
+        explicit LruCache(size_t capacity = DEFAULT_SHADER_CACHE_CAPACITY) : capacity(capacity) {}
+
+        bool find(uint64_t key, Value& value) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = index.find(key);
+            if (it == index.end()) {
+                stats.misses++;
+                return false;
+            }
+            entries.splice(entries.begin(), entries, it->second);
+            value = it->second->second;
+            stats.hits++;
+            return true;
+        }
+
+        void insert(uint64_t key, Value value) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = index.find(key);
+            if (it != index.end()) {
+                it->second->second = std::move(value);
+                entries.splice(entries.begin(), entries, it->second);
+                return;
+            }
+            entries.emplace_front(key, std::move(value));
+            index[key] = entries.begin();
+            trim();
+        }
+
+        void note_disk_hit() {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.disk_hits++;
+        }
+
+        void clear() {
+            std::lock_guard<std::mutex> lock(mutex);
+            entries.clear();
+            index.clear();
+        }
+
+        void set_capacity(size_t entryCount) {
+            std::lock_guard<std::mutex> lock(mutex);
+            capacity = entryCount;
+            trim();
+        }
+
+        ShaderCacheStats get_stats() {
+            std::lock_guard<std::mutex> lock(mutex);
+            ShaderCacheStats result = stats;
+            result.entries = entries.size();
+            result.capacity = capacity;
+            return result;
+        }
+
+    private:
+        void trim() {
+            while (entries.size() > capacity) {
+                index.erase(entries.back().first);
+                entries.pop_back();
+                stats.evictions++;
+            }
+        }
+
+        std::mutex mutex;
+        std::list<std::pair<uint64_t, Value>> entries;
+        std::unordered_map<uint64_t, typename std::list<std::pair<uint64_t, Value>>::iterator> index;
+        ShaderCacheStats stats = {};
+        size_t capacity;
+    };
+}
+}
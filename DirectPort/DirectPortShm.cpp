@@ -0,0 +1,260 @@
+#include "DirectPortShm.h"
+#include <stdexcept>
+#include <chrono>
+#include <thread>
+
+#ifdef _WIN32
+#include <sddl.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <climits>
+#include <fstream>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+using namespace DirectPort;
+using namespace DirectPort::Shm;
+
+namespace {
+#ifdef _WIN32
+    std::wstring widen(const std::string& str) {
+        return std::wstring(str.begin(), str.end());
+    }
+#else
+    std::string posix_name(const std::string& name) {
+        return "/" + name;
+    }
+#endif
+
+#if defined(__linux__)
+    // Futexes are 32-bit; wait on the low half of the 64-bit counter. A frame counter that
+    // changes always changes its low word, so this never misses a signal.
+    uint32_t* futex_word(const volatile UINT64* address) {
+        auto* words = reinterpret_cast<uint32_t*>(const_cast<UINT64*>(address));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return words + 1;
+#else
+        return words;
+#endif
+    }
+#endif
+}
+
+Mapping::~Mapping() { close(); }
+
+void Mapping::create(const std::string& name, size_t size, bool unlinkOnClose) {
+    close();
+#ifdef _WIN32
+    PSECURITY_DESCRIPTOR sd = nullptr;
+    if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(L"D:P(A;;GA;;;AU)", SDDL_REVISION_1, &sd, NULL)) {
+        throw std::runtime_error("Failed to convert SDDL string to security descriptor. GetLastError: " + std::to_string(GetLastError()));
+    }
+    SECURITY_ATTRIBUTES sa = {sizeof(sa), sd, FALSE};
+    hMapping = CreateFileMappingW(INVALID_HANDLE_VALUE, &sa, PAGE_READWRITE, (DWORD)((UINT64)size >> 32), (DWORD)(size & 0xFFFFFFFF), widen(name).c_str());
+    LocalFree(sd);
+    if (!hMapping) throw std::runtime_error("Failed to create shared memory '" + name + "'. GetLastError: " + std::to_string(GetLastError()));
+    pView = MapViewOfFile(hMapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (!pView) {
+        DWORD err = GetLastError();
+        CloseHandle(hMapping); hMapping = nullptr;
+        throw std::runtime_error("Failed to map shared memory '" + name + "'. GetLastError: " + std::to_string(err));
+    }
+#else
+    int fd = shm_open(posix_name(name).c_str(), O_CREAT | O_RDWR, 0666);
+    if (fd < 0) throw std::runtime_error("Failed to create shared memory '" + name + "'. errno: " + std::to_string(errno));
+    fchmod(fd, 0666);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || ((size_t)st.st_size < size && ftruncate(fd, (off_t)size) != 0)) {
+        int err = errno;
+        ::close(fd); shm_unlink(posix_name(name).c_str());
+        throw std::runtime_error("Failed to size shared memory '" + name + "'. errno: " + std::to_string(err));
+    }
+    void* view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED) {
+        int err = errno;
+        shm_unlink(posix_name(name).c_str());
+        throw std::runtime_error("Failed to map shared memory '" + name + "'. errno: " + std::to_string(err));
+    }
+    pView = view;
+#endif
+    viewSize = size;
+    segmentName = name;
+    owner = unlinkOnClose;
+}
+
+bool Mapping::open(const std::string& name, size_t size, bool writable) {
+    close();
+#ifdef _WIN32
+    hMapping = OpenFileMappingW(writable ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, FALSE, widen(name).c_str());
+    if (!hMapping) return false;
+    pView = MapViewOfFile(hMapping, writable ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, size);
+    if (!pView) { CloseHandle(hMapping); hMapping = nullptr; return false; }
+#else
+    int fd = shm_open(posix_name(name).c_str(), writable ? O_RDWR : O_RDONLY, 0);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < size) { ::close(fd); return false; }
+    void* view = mmap(nullptr, size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED) return false;
+    pView = view;
+#endif
+    viewSize = size;
+    segmentName = name;
+    owner = false;
+    return true;
+}
+
+void Mapping::close() {
+#ifdef _WIN32
+    if (pView) UnmapViewOfFile(pView);
+    if (hMapping) CloseHandle(hMapping);
+    hMapping = nullptr;
+#else
+    if (pView) munmap(pView, viewSize);
+    if (owner) shm_unlink(posix_name(segmentName).c_str());
+#endif
+    pView = nullptr;
+    viewSize = 0;
+    owner = false;
+    segmentName.clear();
+}
+
+UINT64 Shm::load_acquire(const volatile UINT64* address) {
+#ifdef _WIN32
+    return (UINT64)InterlockedCompareExchange64(reinterpret_cast<volatile LONGLONG*>(const_cast<volatile UINT64*>(address)), 0, 0);
+#else
+    return __atomic_load_n(address, __ATOMIC_ACQUIRE);
+#endif
+}
+
+UINT32 Shm::load_acquire(const volatile UINT32* address) {
+#ifdef _WIN32
+    return (UINT32)InterlockedCompareExchange(reinterpret_cast<volatile LONG*>(const_cast<volatile UINT32*>(address)), 0, 0);
+#else
+    return __atomic_load_n(address, __ATOMIC_ACQUIRE);
+#endif
+}
+
+void Shm::store_release(volatile UINT64* address, UINT64 value) {
+#ifdef _WIN32
+    InterlockedExchange64(reinterpret_cast<volatile LONGLONG*>(address), (LONGLONG)value);
+#else
+    __atomic_store_n(address, value, __ATOMIC_RELEASE);
+#endif
+}
+
+void Shm::store_release(volatile UINT32* address, UINT32 value) {
+#ifdef _WIN32
+    InterlockedExchange(reinterpret_cast<volatile LONG*>(address), (LONG)value);
+#else
+    __atomic_store_n(address, value, __ATOMIC_RELEASE);
+#endif
+}
+
+bool Shm::compare_exchange(volatile UINT32* address, UINT32 expected, UINT32 desired) {
+#ifdef _WIN32
+    return (UINT32)InterlockedCompareExchange(reinterpret_cast<volatile LONG*>(address), (LONG)desired, (LONG)expected) == expected;
+#else
+    return __atomic_compare_exchange_n(address, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+}
+
+UINT32 Shm::fetch_add(volatile UINT32* address, UINT32 value) {
+#ifdef _WIN32
+    return (UINT32)InterlockedExchangeAdd(reinterpret_cast<volatile LONG*>(address), (LONG)value);
+#else
+    return __atomic_fetch_add(address, value, __ATOMIC_ACQ_REL);
+#endif
+}
+
+bool Shm::wait_on_address(const volatile UINT64* address, UINT64 expected, uint32_t timeout_ms) {
+    if (load_acquire(address) != expected) return true;
+#if defined(__linux__)
+    struct timespec ts = { (time_t)(timeout_ms / 1000), (long)(timeout_ms % 1000) * 1000000L };
+    long rc = syscall(SYS_futex, futex_word(address), FUTEX_WAIT, (uint32_t)expected, &ts, nullptr, 0);
+    if (rc == 0 || errno == EAGAIN || errno == EINTR) return load_acquire(address) != expected;
+    return false;
+#else
+    // WaitOnAddress only wakes threads of the same process, so cross-process waits poll.
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (load_acquire(address) == expected) {
+        if (std::chrono::steady_clock::now() >= deadline) return false;
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+    return true;
+#endif
+}
+
+void Shm::wake_all(volatile UINT64* address) {
+#if defined(__linux__)
+    syscall(SYS_futex, futex_word(address), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#else
+    (void)address;
+#endif
+}
+
+UINT64 Shm::monotonic_ms() {
+#ifdef _WIN32
+    return GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (UINT64)ts.tv_sec * 1000 + (UINT64)ts.tv_nsec / 1000000;
+#endif
+}
+
+UINT64 Shm::monotonic_us() {
+#ifdef _WIN32
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    UINT64 ticks = (UINT64)counter.QuadPart, hz = (UINT64)frequency.QuadPart;
+    return ticks / hz * 1000000 + ticks % hz * 1000000 / hz;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (UINT64)ts.tv_sec * 1000000 + (UINT64)ts.tv_nsec / 1000;
+#endif
+}
+
+bool Shm::is_process_alive(unsigned long pid) {
+#ifdef _WIN32
+    HANDLE hProcess = OpenProcess(SYNCHRONIZE, FALSE, (DWORD)pid);
+    if (!hProcess) return false;
+    bool alive = WaitForSingleObject(hProcess, 0) == WAIT_TIMEOUT;
+    CloseHandle(hProcess);
+    return alive;
+#else
+    if (kill((pid_t)pid, 0) != 0 && errno != EPERM) return false;
+#if defined(__linux__)
+    // kill() still succeeds for a process that has exited but not yet been reaped.
+    std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+    std::string line;
+    if (std::getline(stat, line)) {
+        size_t commEnd = line.rfind(')');
+        if (commEnd != std::string::npos && commEnd + 2 < line.size() && line[commEnd + 2] == 'Z') return false;
+    }
+#endif
+    return true;
+#endif
+}
+
+unsigned long Shm::current_process_id() {
+#ifdef _WIN32
+    return GetCurrentProcessId();
+#else
+    return (unsigned long)getpid();
+#endif
+}
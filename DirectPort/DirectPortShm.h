@@ -0,0 +1,58 @@
+#pragma once
+
+#include "DirectPort.h"
+#include <string>
+
+namespace DirectPort {
+namespace Shm {
+
+    // Named, process-shared memory region. Backed by CreateFileMappingW on Windows and
+    // shm_open/mmap everywhere else. The creating side owns the name and unlinks it on close,
+    // unless it was created as a shared segment that outlives its creator.
+    class Mapping {
+    public:
+        Mapping() = default;
+        ~Mapping();
+        Mapping(const Mapping&) = delete;
+        Mapping& operator=(const Mapping&) = delete;
+
+        // Creates the segment, or maps it if it already exists. Newly created memory is zeroed.
+        void create(const std::string& name, size_t size, bool unlinkOnClose = true);
+        bool open(const std::string& name, size_t size, bool writable = false);
+        void close();
+
+        void* data() const { return pView; }
+        size_t size() const { return viewSize; }
+        const std::string& name() const { return segmentName; }
+        explicit operator bool() const { return pView != nullptr; }
+
+    private:
+        void* pView = nullptr;
+        size_t viewSize = 0;
+        std::string segmentName;
+        bool owner = false;
+#ifdef _WIN32
+        HANDLE hMapping = nullptr;
+#endif
+    };
+
+    UINT64 load_acquire(const volatile UINT64* address);
+    UINT32 load_acquire(const volatile UINT32* address);
+    void store_release(volatile UINT64* address, UINT64 value);
+    void store_release(volatile UINT32* address, UINT32 value);
+    bool compare_exchange(volatile UINT32* address, UINT32 expected, UINT32 desired);
+    UINT32 fetch_add(volatile UINT32* address, UINT32 value);
+
+    // Sleeps while *address == expected, for at most timeout_ms. Returns false on timeout.
+    // Spurious wake-ups are possible; callers must re-read the value.
+    bool wait_on_address(const volatile UINT64* address, UINT64 expected, uint32_t timeout_ms);
+    void wake_all(volatile UINT64* address);
+
+    // Milliseconds on a clock shared by every process on the machine.
+    UINT64 monotonic_ms();
+    UINT64 monotonic_us();
+
+    bool is_process_alive(unsigned long pid);
+    unsigned long current_process_id();
+}
+}
@@ -1,19 +1,370 @@
 #include "DirectPort.h"
+#include "DirectPortCPU.h"
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 #include <pybind11/numpy.h>
+#include <algorithm>
 
 namespace py = pybind11;
 using namespace DirectPort;
 
 static std::string wstring_to_string(const std::wstring& wstr) {
     if (wstr.empty()) return std::string();
+#ifdef _WIN32
     int size_needed = WideCharToMultiByte(CP_UTF8, 0, wstr.data(), (int)wstr.size(), NULL, 0, NULL, NULL);
     std::string strTo(size_needed, 0);
     WideCharToMultiByte(CP_UTF8, 0, wstr.data(), (int)wstr.size(), &strTo[0], size_needed, NULL, NULL);
     return strTo;
+#else
+    std::string strTo;
+    for (wchar_t wc : wstr) {
+        uint32_t c = static_cast<uint32_t>(wc);
+        if (c < 0x80) {
+            strTo += static_cast<char>(c);
+        } else if (c < 0x800) {
+            strTo += static_cast<char>(0xC0 | (c >> 6));
+            strTo += static_cast<char>(0x80 | (c & 0x3F));
+        } else if (c < 0x10000) {
+            strTo += static_cast<char>(0xE0 | (c >> 12));
+            strTo += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            strTo += static_cast<char>(0x80 | (c & 0x3F));
+        } else {
+            strTo += static_cast<char>(0xF0 | (c >> 18));
+            strTo += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+            strTo += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            strTo += static_cast<char>(0x80 | (c & 0x3F));
+        }
+    }
+    return strTo;
+#endif
+}
+
+// Wraps pitched pixel memory as an (h, w[, c]) numpy view without copying. `base` keeps the owner alive.
+static py::array pixels_to_array(uint8_t* data, uint32_t width, uint32_t height, uint32_t row_pitch, DXGI_FORMAT format, py::handle base) {
+    py::dtype dtype;
+    py::ssize_t channels;
+    switch (format) {
+        case DXGI_FORMAT_B8G8R8A8_UNORM:
+        case DXGI_FORMAT_R8G8B8A8_UNORM: dtype = py::dtype::of<uint8_t>(); channels = 4; break;
+        case DXGI_FORMAT_R8G8_UNORM: dtype = py::dtype::of<uint8_t>(); channels = 2; break;
+        case DXGI_FORMAT_R8_UNORM: dtype = py::dtype::of<uint8_t>(); channels = 1; break;
+        case DXGI_FORMAT_R10G10B10A2_UNORM: dtype = py::dtype::of<uint32_t>(); channels = 1; break;
+        case DXGI_FORMAT_R16_FLOAT: dtype = py::dtype("float16"); channels = 1; break;
+        case DXGI_FORMAT_R16G16B16A16_FLOAT: dtype = py::dtype("float16"); channels = 4; break;
+        case DXGI_FORMAT_R32_FLOAT: dtype = py::dtype::of<float>(); channels = 1; break;
+        case DXGI_FORMAT_R32G32B32A32_FLOAT: dtype = py::dtype::of<float>(); channels = 4; break;
+        default: throw std::invalid_argument("Unsupported DXGI_FORMAT for a numpy frame view.");
+    }
+    const py::ssize_t itemsize = dtype.itemsize();
+    if (channels == 1) {
+        return py::array(dtype, {(py::ssize_t)height, (py::ssize_t)width}, {(py::ssize_t)row_pitch, itemsize}, data, base);
+    }
+    return py::array(dtype, {(py::ssize_t)height, (py::ssize_t)width, channels}, {(py::ssize_t)row_pitch, itemsize * channels, itemsize}, data, base);
+}
+
+// FrameMetadata travels as a plain dict; faces are dicts with "bbox" (l, t, r, b), "score" and "kps" [(x, y) * 5].
+static py::dict metadata_to_dict(const FrameMetadata& metadata) {
+    py::list faces;
+    for (UINT32 i = 0; i < std::min(metadata.faceCount, MAX_FRAME_FACES); ++i) {
+        const FaceBox& box = metadata.faces[i];
+        py::list kps;
+        for (int k = 0; k < 5; ++k) kps.append(py::make_tuple(box.landmarks[k * 2], box.landmarks[k * 2 + 1]));
+        py::dict face;
+        face["bbox"] = py::make_tuple(box.left, box.top, box.right, box.bottom);
+        face["score"] = box.score;
+        face["kps"] = kps;
+        faces.append(face);
+    }
+    py::dict result;
+    result["version"] = metadata.version;
+    result["frame_sequence"] = metadata.frameSequence;
+    result["capture_time_us"] = metadata.captureTimeUs;
+    result["signal_time_us"] = metadata.signalTimeUs;
+    result["processing_time_us"] = metadata.processingTimeUs;
+    result["faces"] = faces;
+    return result;
+}
+
+static FrameMetadata dict_to_metadata(const py::dict& values) {
+    FrameMetadata metadata = {};
+    if (values.contains("capture_time_us")) metadata.captureTimeUs = values["capture_time_us"].cast<UINT64>();
+    if (values.contains("processing_time_us")) metadata.processingTimeUs = values["processing_time_us"].cast<UINT64>();
+    if (values.contains("faces")) {
+        for (py::handle item : values["faces"]) {
+            if (metadata.faceCount == MAX_FRAME_FACES) throw std::invalid_argument("Too many faces for FrameMetadata (max " + std::to_string(MAX_FRAME_FACES) + ").");
+            py::dict face = py::reinterpret_borrow<py::dict>(item);
+            FaceBox& box = metadata.faces[metadata.faceCount++];
+            auto bbox = face["bbox"].cast<std::vector<float>>();
+            if (bbox.size() < 4) throw std::invalid_argument("Face bbox needs four values (left, top, right, bottom).");
+            box.left = bbox[0]; box.top = bbox[1]; box.right = bbox[2]; box.bottom = bbox[3];
+            if (face.contains("score")) box.score = face["score"].cast<float>();
+            if (face.contains("kps") && !face["kps"].is_none()) {
+                int k = 0;
+                for (py::handle point : face["kps"]) {
+                    if (k == 5) break;
+                    auto xy = point.cast<std::vector<float>>();
+                    if (xy.size() < 2) throw std::invalid_argument("Face keypoints must be (x, y) pairs.");
+                    box.landmarks[k * 2] = xy[0];
+                    box.landmarks[k * 2 + 1] = xy[1];
+                    ++k;
+                }
+            }
+        }
+    }
+    return metadata;
+}
+
+static py::dict latency_to_dict(const LatencyStats& stats) {
+    py::dict result;
+    result["count"] = stats.count;
+    result["p50_us"] = stats.p50_us;
+    result["p99_us"] = stats.p99_us;
+    result["max_us"] = stats.max_us;
+    result["mean_us"] = stats.mean_us;
+    return result;
+}
+
+static py::dict pool_stats_to_dict(const PoolStats& stats) {
+    py::dict result;
+    result["hits"] = stats.hits;
+    result["misses"] = stats.misses;
+    result["evictions"] = stats.evictions;
+    result["bytes_held"] = stats.bytes_held;
+    result["bytes_in_use"] = stats.bytes_in_use;
+    result["budget_bytes"] = stats.budget_bytes;
+    return result;
+}
+
+static py::dict shader_cache_stats_to_dict(const ShaderCacheStats& stats) {
+    py::dict result;
+    result["hits"] = stats.hits;
+    result["misses"] = stats.misses;
+    result["evictions"] = stats.evictions;
+    result["disk_hits"] = stats.disk_hits;
+    result["entries"] = stats.entries;
+    result["capacity"] = stats.capacity;
+    return result;
+}
+
+// Pixels of an (h, w[, c]) uint8 array whose channel count matches a host layout.
+struct HostPixels {
+    const uint8_t* data;
+    uint32_t width;
+    uint32_t height;
+    uint32_t rowPitch;
+};
+
+static HostPixels host_pixels(const py::array& source, CPU::HostLayout layout) {
+    py::buffer_info info = source.request();
+    const py::ssize_t channels = CPU::bytes_per_pixel(layout);
+    if (info.format != py::format_descriptor<uint8_t>::format()) throw std::invalid_argument("Host pixels must be a uint8 array.");
+    const bool shaped = info.ndim == 3 ? info.shape[2] == channels : (info.ndim == 2 && channels == 1);
+    if (!shaped) throw std::invalid_argument("Array shape does not match the pixel layout.");
+    if ((info.ndim == 3 && info.strides[2] != 1) || info.strides[1] != channels || info.strides[0] < info.shape[1] * channels) {
+        throw std::invalid_argument("Host pixel rows must be contiguous.");
+    }
+    return { static_cast<const uint8_t*>(info.ptr), (uint32_t)info.shape[1], (uint32_t)info.shape[0], (uint32_t)info.strides[0] };
+}
+
+// Layout of an (h, w[, c]) uint8 image by channel count alone, for kernels that treat every channel alike.
+static CPU::HostLayout channel_layout(const py::array& image) {
+    const py::ssize_t channels = image.ndim() == 2 ? 1 : image.ndim() == 3 ? image.shape(2) : 0;
+    if (channels == 1) return CPU::HostLayout::Gray8;
+    if (channels == 3) return CPU::HostLayout::BGR8;
+    if (channels == 4) return CPU::HostLayout::BGRA8;
+    throw std::invalid_argument("Images must have 1, 3 or 4 channels.");
+}
+
+// A 2x3 affine matrix as the destination-to-source map warp_affine samples with, for a destination whose
+// first pixel sits at (origin_x, origin_y) of the space the matrix maps into.
+static void affine_inverse(const py::array_t<double, py::array::c_style | py::array::forcecast>& matrix, bool inverse_map, double inverse[6],
+                           double origin_x = 0.0, double origin_y = 0.0) {
+    if (matrix.ndim() != 2 || matrix.shape(0) != 2 || matrix.shape(1) != 3) throw std::invalid_argument("Affine matrix must be 2x3.");
+    double m[6];
+    std::copy(matrix.data(), matrix.data() + 6, m);
+    if (inverse_map) {
+        std::copy(m, m + 6, inverse);
+        inverse[2] += inverse[0] * origin_x + inverse[1] * origin_y;
+        inverse[5] += inverse[3] * origin_x + inverse[4] * origin_y;
+    } else {
+        m[2] -= origin_x;
+        m[5] -= origin_y;
+        CPU::invert_affine(m, inverse);
+    }
+}
+
+// Initial texture data: a raw buffer already in the texture's format, or host pixels converted when a layout is given.
+static std::vector<uint8_t> convert_upload(const py::object& data, CPU::HostLayout layout, uint32_t w, uint32_t h, DXGI_FORMAT f) {
+    HostPixels pixels = host_pixels(py::array(data), layout);
+    if (pixels.width != w || pixels.height != h) throw std::invalid_argument("Host pixels do not match the texture size.");
+    std::vector<uint8_t> converted((size_t)w * h * CPU::bytes_per_pixel(f));
+    py::gil_scoped_release release;
+    CPU::convert_from_host(pixels.data, pixels.rowPitch, layout, { converted.data(), w, h, w * CPU::bytes_per_pixel(f), f });
+    return converted;
+}
+
+// Adapts a Python callable to a native kernel. The callable runs once per row band as
+// fn(output_rows, inputs, constants, row_begin) where output_rows covers [row_begin, row_end).
+static CPU::Kernel python_kernel(py::function fn) {
+    auto callable = std::shared_ptr<py::function>(new py::function(std::move(fn)), [](py::function* f) {
+        py::gil_scoped_acquire acquire;
+        delete f;
+    });
+    return [callable](const CPU::KernelArgs& args) {
+        py::gil_scoped_acquire acquire;
+        py::capsule owner(args.constants, [](void*) {});
+        const CPU::Surface& out = args.output;
+        py::array output = pixels_to_array(out.data + (size_t)args.rowBegin * out.rowPitch, out.width, args.rowEnd - args.rowBegin, out.rowPitch, out.format, owner);
+        py::list inputs;
+        for (size_t i = 0; i < args.inputCount; ++i) {
+            const CPU::Surface& in = args.inputs[i];
+            inputs.append(pixels_to_array(in.data, in.width, in.height, in.rowPitch, in.format, owner));
+        }
+        (*callable)(output, inputs, py::bytes(reinterpret_cast<const char*>(args.constants), args.constantsSize), args.rowBegin);
+    };
+}
+
+static std::vector<uint8_t> shader_to_bytes(const py::object& shader) {
+    if (shader.is_none()) return {};
+    if (!py::isinstance<py::str>(shader) && !py::isinstance<py::bytes>(shader)) {
+        throw py::type_error("Shader must be bytes (CSO/HLSL) or str (HLSL source).");
+    }
+    std::string bytes = shader.cast<std::string>();
+    return { bytes.begin(), bytes.end() };
+}
+
+static std::shared_ptr<PreparedShader> prepare_shader_from_python(IDirectXDevice& device, const py::object& shader, const std::string& entry_point, DXGI_FORMAT output_format) {
+    std::vector<uint8_t> shader_bytes = shader_to_bytes(shader);
+    py::gil_scoped_release release;
+    return device.prepare_shader(shader_bytes, entry_point, output_format);
 }
 
+// One run() with its arguments converted up front, so a batch executes without touching Python.
+// constants borrows the caller's buffer and has to be released with the GIL held.
+struct PreparedRun {
+    std::shared_ptr<PreparedShader> shader;
+    std::shared_ptr<Texture> output;
+    std::vector<std::shared_ptr<Texture>> inputs;
+    py::buffer_info constants;
+};
+
+static PreparedRun make_prepared_run(std::shared_ptr<PreparedShader> shader, std::shared_ptr<Texture> output, const py::object& inputs, const py::object& constants) {
+    if (!shader) throw std::invalid_argument("run needs a PreparedShader from prepare_shader.");
+    PreparedRun run;
+    run.shader = std::move(shader);
+    run.output = std::move(output);
+    if (!inputs.is_none()) {
+        for (py::handle item : inputs) run.inputs.push_back(item.cast<std::shared_ptr<Texture>>());
+    }
+    if (!constants.is_none()) run.constants = py::buffer(constants).request();
+    return run;
+}
+
+static void execute_runs(IDirectXDevice& device, const std::vector<PreparedRun>& runs) {
+    py::gil_scoped_release release;
+    for (const PreparedRun& run : runs) {
+        device.run(*run.shader, run.output, run.inputs, run.constants.ptr, (size_t)(run.constants.size * run.constants.itemsize));
+    }
+}
+
+static std::vector<std::shared_ptr<Fence>> fences_from_python(const py::object& dependencies) {
+    std::vector<std::shared_ptr<Fence>> fences;
+    if (dependencies.is_none()) return fences;
+    if (py::isinstance<Fence>(dependencies)) {
+        fences.push_back(dependencies.cast<std::shared_ptr<Fence>>());
+        return fences;
+    }
+    for (py::handle item : dependencies) fences.push_back(item.cast<std::shared_ptr<Fence>>());
+    return fences;
+}
+
+// Constants are copied or uploaded before run_async returns, so the buffer is only borrowed for the call.
+static std::shared_ptr<Fence> run_async_from_python(IDirectXDevice& device, std::shared_ptr<PreparedShader> shader, std::shared_ptr<Texture> output,
+                                                    const py::object& inputs, const py::object& constants, const py::object& dependencies) {
+    PreparedRun run = make_prepared_run(std::move(shader), std::move(output), inputs, constants);
+    std::vector<std::shared_ptr<Fence>> fences = fences_from_python(dependencies);
+    py::gil_scoped_release release;
+    return device.run_async(*run.shader, run.output, run.inputs, run.constants.ptr, (size_t)(run.constants.size * run.constants.itemsize), fences);
+}
+
+// Each item is (shader, output[, inputs[, constants]]); all of them run under a single GIL release.
+static void run_batch_from_python(IDirectXDevice& device, const py::iterable& items) {
+    std::vector<PreparedRun> runs;
+    for (py::handle item : items) {
+        if (!py::isinstance<py::sequence>(item)) throw py::type_error("Each run must be a (shader, output[, inputs[, constants]]) tuple.");
+        py::sequence args = py::reinterpret_borrow<py::sequence>(item);
+        if (args.size() < 2 || args.size() > 4) throw std::invalid_argument("Each run must be a (shader, output[, inputs[, constants]]) tuple.");
+        runs.push_back(make_prepared_run(args[0].cast<std::shared_ptr<PreparedShader>>(), args[1].cast<std::shared_ptr<Texture>>(),
+                                         args.size() > 2 ? py::object(args[2]) : py::object(py::none()),
+                                         args.size() > 3 ? py::object(args[3]) : py::object(py::none())));
+    }
+    execute_runs(device, runs);
+}
+
+// net_outs as a RetinaFace/SCRFD session returns them: the score outputs of every level in strides, then
+// the box outputs, then optionally the keypoint outputs, for an input of input_size = (width, height).
+// Returns (det, kpss) as RetinaFace.detect does, with kpss None when the model has no keypoints.
+static py::tuple decode_faces_from_python(CPU::FaceDetections& detections, const py::sequence& net_outs, std::tuple<uint32_t, uint32_t> input_size,
+                                          const std::vector<uint32_t>& strides, float threshold, float nms_threshold, float scale, size_t max_num) {
+    using FloatArray = py::array_t<float, py::array::c_style | py::array::forcecast>;
+    const size_t levelCount = strides.size();
+    const size_t outputCount = py::len(net_outs);
+    if (levelCount == 0 || (outputCount != levelCount * 2 && outputCount != levelCount * 3)) {
+        throw std::invalid_argument("net_outs must hold scores and boxes, and optionally keypoints, for every stride.");
+    }
+    const bool keypoints = outputCount == levelCount * 3;
+    std::vector<FloatArray> outputs;
+    for (const auto& output : net_outs) outputs.push_back(output.cast<FloatArray>());
+
+    std::vector<CPU::DetectionLevel> levels(levelCount);
+    for (size_t l = 0; l < levelCount; ++l) {
+        const uint32_t stride = strides[l];
+        const uint64_t cells = stride ? (uint64_t)(std::get<0>(input_size) / stride) * (std::get<1>(input_size) / stride) : 0;
+        const uint64_t anchors = (uint64_t)outputs[l].size();
+        if (cells == 0 || anchors == 0 || anchors % cells != 0 || (uint64_t)outputs[levelCount + l].size() != anchors * 4 ||
+            (keypoints && (uint64_t)outputs[levelCount * 2 + l].size() != anchors * 10)) {
+            throw std::invalid_argument("net_outs do not match input_size and strides.");
+        }
+        levels[l] = { outputs[l].data(), outputs[levelCount + l].data(), keypoints ? outputs[levelCount * 2 + l].data() : nullptr,
+                      stride, std::get<0>(input_size) / stride, std::get<1>(input_size) / stride, (uint32_t)(anchors / cells) };
+    }
+    {
+        py::gil_scoped_release release;
+        CPU::decode_faces(levels.data(), levelCount, threshold, nms_threshold, scale, max_num, detections);
+    }
+
+    const py::ssize_t count = (py::ssize_t)detections.kept.size();
+    py::array_t<float> det({ count, (py::ssize_t)5 });
+    float* boxes = det.mutable_data();
+    for (py::ssize_t i = 0; i < count; ++i) memcpy(boxes + i * 5, &detections.boxes[(size_t)detections.kept[i] * 5], 5 * sizeof(float));
+    if (!keypoints) return py::make_tuple(det, py::none());
+    py::array_t<float> kpss({ count, (py::ssize_t)5, (py::ssize_t)2 });
+    float* points = kpss.mutable_data();
+    for (py::ssize_t i = 0; i < count; ++i) memcpy(points + i * 10, &detections.keypoints[(size_t)detections.kept[i] * 10], 10 * sizeof(float));
+    return py::make_tuple(det, kpss);
+}
+
+// Holds an acquired write buffer until commit(); if filling it throws first, the buffer is dropped so the
+// next acquire_write_buffer() does not hand back a half-written frame.
+class ProducerWrite {
+public:
+    explicit ProducerWrite(Producer& target) : producer(target), buffer(target.acquire_write_buffer()) {}
+    ~ProducerWrite() { if (!committed) producer.abort_write(); }
+    ProducerWrite(const ProducerWrite&) = delete;
+    ProducerWrite& operator=(const ProducerWrite&) = delete;
+
+    CPU::Surface surface() const { return { buffer.data, buffer.width, buffer.height, buffer.row_pitch, buffer.format }; }
+    void commit() {
+        producer.commit();
+        committed = true;
+    }
+
+private:
+    Producer& producer;
+    WriteBuffer buffer;
+    bool committed = false;
+};
+
 PYBIND11_MODULE(directport, m) {
     m.doc() = "GPU texture sharing and processing framework.";
 
@@ -28,6 +379,18 @@ PYBIND11_MODULE(directport, m) {
         .value("R8_UNORM", DXGI_FORMAT_R8_UNORM, "")
         .export_values();
 
+    py::enum_<CPU::HostLayout>(m, "PixelLayout", "")
+        .value("BGR8", CPU::HostLayout::BGR8, "")
+        .value("RGB8", CPU::HostLayout::RGB8, "")
+        .value("BGRA8", CPU::HostLayout::BGRA8, "")
+        .value("RGBA8", CPU::HostLayout::RGBA8, "")
+        .value("GRAY8", CPU::HostLayout::Gray8, "");
+
+    py::enum_<FrameStatus>(m, "FrameStatus", "")
+        .value("NEW_FRAME", FrameStatus::NewFrame, "")
+        .value("TIMEOUT", FrameStatus::Timeout, "")
+        .value("PRODUCER_GONE", FrameStatus::ProducerGone, "");
+
     py::class_<ProducerInfo>(m, "ProducerInfo", "")
         .def_readonly("pid", &ProducerInfo::pid, "")
         .def_property_readonly("executable_name", [](const ProducerInfo &p) { return wstring_to_string(p.executable_name); }, "")
@@ -35,26 +398,327 @@ PYBIND11_MODULE(directport, m) {
         .def_property_readonly("type", [](const ProducerInfo &p) { return wstring_to_string(p.type); }, "");
     
     m.def("discover", &discover, "", py::call_guard<py::gil_scoped_release>());
+    m.def("get_discovery_generation", &get_discovery_generation, "");
+    m.def("wait_for_discovery_change", &wait_for_discovery_change, py::arg("generation"), py::arg("timeout_ms"), "", py::call_guard<py::gil_scoped_release>());
+    m.attr("MAX_FRAME_FACES") = MAX_FRAME_FACES;
+    m.attr("DEFAULT_POOL_BUDGET") = DEFAULT_POOL_BUDGET;
+    m.def("monotonic_us", &monotonic_us, "");
+    m.def("set_shader_cache_directory", &set_shader_cache_directory, py::arg("directory"), "");
+    m.def("get_shader_cache_directory", &get_shader_cache_directory, "");
+    m.def("register_kernel", [](const std::string& name, py::function fn) { CPU::register_kernel(name, python_kernel(std::move(fn))); }, py::arg("name"), py::arg("fn"), "");
+    m.def("unregister_kernel", &CPU::unregister_kernel, py::arg("name"), "");
+    m.def("get_kernel_names", &CPU::get_kernel_names, "");
+    m.def("convert_pixels", [](const py::array& source, CPU::HostLayout layout, DXGI_FORMAT format) {
+        HostPixels pixels = host_pixels(source, layout);
+        const uint32_t pitch = pixels.width * CPU::bytes_per_pixel(format);
+        py::array result = pixels_to_array(nullptr, pixels.width, pixels.height, pitch, format, py::handle());
+        CPU::Surface destination = { static_cast<uint8_t*>(result.mutable_data()), pixels.width, pixels.height, pitch, format };
+        {
+            py::gil_scoped_release release;
+            CPU::convert_from_host(pixels.data, pixels.rowPitch, layout, destination);
+        }
+        return result;
+    }, py::arg("source"), py::arg("layout"), py::arg("format"), "");
+    // cv2.warpAffine(source, matrix, dsize) with bilinear filtering and a zero border. Given a destination
+    // of that size, warps into it instead and leaves the pixels the source does not cover untouched.
+    m.def("warp_affine", [](py::array_t<uint8_t, py::array::c_style | py::array::forcecast> source,
+                            py::array_t<double, py::array::c_style | py::array::forcecast> matrix,
+                            std::pair<uint32_t, uint32_t> dsize, bool inverse_map, py::object destination) {
+        const CPU::HostLayout layout = channel_layout(source);
+        const uint32_t channels = CPU::bytes_per_pixel(layout);
+        HostPixels pixels = host_pixels(source, layout);
+        double inverse[6];
+        affine_inverse(matrix, inverse_map, inverse);
+        const CPU::WarpBorder border = destination.is_none() ? CPU::WarpBorder::Zero : CPU::WarpBorder::Transparent;
+        py::array result;
+        if (destination.is_none()) {
+            std::vector<py::ssize_t> shape = { (py::ssize_t)dsize.second, (py::ssize_t)dsize.first };
+            if (channels > 1) shape.push_back(channels);
+            result = py::array_t<uint8_t>(shape);
+        } else {
+            result = destination.cast<py::array>();
+            if (channel_layout(result) != layout) throw std::invalid_argument("Destination channels do not match the source.");
+        }
+        HostPixels out = host_pixels(result, layout);
+        if (out.width != dsize.first || out.height != dsize.second) throw std::invalid_argument("Destination does not match dsize.");
+        uint8_t* data = static_cast<uint8_t*>(result.mutable_data());
+        {
+            py::gil_scoped_release release;
+            CPU::warp_affine(pixels.data, pixels.width, pixels.height, pixels.rowPitch, data, out.width, out.height, out.rowPitch, channels, inverse, border);
+        }
+        return result;
+    }, py::arg("source"), py::arg("matrix"), py::arg("dsize"), py::arg("inverse_map") = false, py::arg("destination") = py::none(), "");
+    // cv2.erode (or cv2.dilate) of a uint8 mask by a size x size square, and the feather's Gaussian blur,
+    // both at a cost per pixel that does not grow with size.
+    m.def("morph_mask", [](py::array_t<uint8_t, py::array::c_style | py::array::forcecast> mask, uint32_t size, bool dilate) {
+        HostPixels pixels = host_pixels(mask, CPU::HostLayout::Gray8);
+        py::array_t<uint8_t> result({ (py::ssize_t)pixels.height, (py::ssize_t)pixels.width });
+        uint8_t* data = result.mutable_data();
+        py::gil_scoped_release release;
+        CPU::morph_mask(pixels.data, pixels.rowPitch, data, pixels.width, pixels.width, pixels.height, size, dilate);
+        return result;
+    }, py::arg("mask"), py::arg("size"), py::arg("dilate") = false, "");
+    m.def("feather_mask", [](py::array_t<uint8_t, py::array::c_style | py::array::forcecast> mask, uint32_t size) {
+        HostPixels pixels = host_pixels(mask, CPU::HostLayout::Gray8);
+        py::array_t<uint8_t> result({ (py::ssize_t)pixels.height, (py::ssize_t)pixels.width });
+        uint8_t* data = result.mutable_data();
+        py::gil_scoped_release release;
+        CPU::feather_mask(pixels.data, pixels.rowPitch, data, pixels.width, pixels.width, pixels.height, size);
+        return result;
+    }, py::arg("mask"), py::arg("size"), "");
+    // Pastes face into frame in place within roi = (x, y, w, h). matrix maps face pixels to frame pixels
+    // (the reverse with inverse_map); expansion, feather and core_tightness are the MASK_* sliders.
+    m.def("composite_face", [](py::array frame, py::array_t<uint8_t, py::array::c_style | py::array::forcecast> face,
+                               py::array_t<double, py::array::c_style | py::array::forcecast> matrix, std::tuple<int64_t, int64_t, int64_t, int64_t> roi,
+                               int32_t expansion, uint32_t feather, uint32_t core_tightness, bool inverse_map) {
+        const CPU::HostLayout layout = channel_layout(frame);
+        if (channel_layout(face) != layout) throw std::invalid_argument("Face channels do not match the frame.");
+        const uint32_t channels = CPU::bytes_per_pixel(layout);
+        HostPixels target = host_pixels(frame, layout);
+        HostPixels source = host_pixels(face, layout);
+        const int64_t x = std::get<0>(roi), y = std::get<1>(roi), w = std::get<2>(roi), h = std::get<3>(roi);
+        if (x < 0 || y < 0 || w < 0 || h < 0 || x + w > target.width || y + h > target.height) throw std::invalid_argument("ROI must lie inside the frame.");
+        double inverse[6];
+        affine_inverse(matrix, inverse_map, inverse, (double)x, (double)y);
+        uint8_t* data = static_cast<uint8_t*>(frame.mutable_data()) + (size_t)y * target.rowPitch + (size_t)x * channels;
+        py::gil_scoped_release release;
+        CPU::composite_face(source.data, source.width, source.height, source.rowPitch, data, (uint32_t)w, (uint32_t)h, target.rowPitch, channels, inverse,
+                            { expansion, feather, core_tightness });
+    }, py::arg("frame"), py::arg("face"), py::arg("matrix"), py::arg("roi"), py::arg("expansion"), py::arg("feather"), py::arg("core_tightness"),
+       py::arg("inverse_map") = false, "");
+    // The same under a blend mask already shaped in face space: alpha is a gray mask over the face
+    // padded by alpha_margin pixels on every side.
+    m.def("composite_face_alpha", [](py::array frame, py::array_t<uint8_t, py::array::c_style | py::array::forcecast> face,
+                                     py::array_t<uint8_t, py::array::c_style | py::array::forcecast> alpha, uint32_t alpha_margin,
+                                     py::array_t<double, py::array::c_style | py::array::forcecast> matrix, std::tuple<int64_t, int64_t, int64_t, int64_t> roi,
+                                     bool inverse_map) {
+        const CPU::HostLayout layout = channel_layout(frame);
+        if (channel_layout(face) != layout) throw std::invalid_argument("Face channels do not match the frame.");
+        const uint32_t channels = CPU::bytes_per_pixel(layout);
+        HostPixels target = host_pixels(frame, layout);
+        HostPixels source = host_pixels(face, layout);
+        HostPixels mask = host_pixels(alpha, CPU::HostLayout::Gray8);
+        if ((uint64_t)source.width + 2ull * alpha_margin != mask.width || (uint64_t)source.height + 2ull * alpha_margin != mask.height) {
+            throw std::invalid_argument("Alpha must cover the face plus alpha_margin on every side.");
+        }
+        const int64_t x = std::get<0>(roi), y = std::get<1>(roi), w = std::get<2>(roi), h = std::get<3>(roi);
+        if (x < 0 || y < 0 || w < 0 || h < 0 || x + w > target.width || y + h > target.height) throw std::invalid_argument("ROI must lie inside the frame.");
+        double inverse[6];
+        affine_inverse(matrix, inverse_map, inverse, (double)x, (double)y);
+        uint8_t* data = static_cast<uint8_t*>(frame.mutable_data()) + (size_t)y * target.rowPitch + (size_t)x * channels;
+        py::gil_scoped_release release;
+        CPU::composite_face(source.data, source.width, source.height, source.rowPitch, mask.data, mask.width, mask.height, mask.rowPitch, alpha_margin,
+                            data, (uint32_t)w, (uint32_t)h, target.rowPitch, channels, inverse);
+    }, py::arg("frame"), py::arg("face"), py::arg("alpha"), py::arg("alpha_margin"), py::arg("matrix"), py::arg("roi"), py::arg("inverse_map") = false, "");
+    // Holds decode_faces' buffers between frames; one per detector.
+    py::class_<CPU::FaceDetections>(m, "FaceDecoder", "")
+        .def(py::init<>())
+        .def("decode", &decode_faces_from_python, py::arg("net_outs"), py::arg("input_size"), py::arg("strides"), py::arg("threshold"),
+             py::arg("nms_threshold"), py::arg("scale") = 1.0f, py::arg("max_num") = 0, "");
+    m.def("create_host_producer", &create_host_producer, py::arg("stream_name"), py::arg("width"), py::arg("height"), py::arg("format"), py::arg("slot_count") = DEFAULT_RING_SLOTS, "");
+    m.def("connect_to_host_producer", &connect_to_host_producer, py::arg("pid"), py::arg("stream_name") = "", "");
 
     py::class_<Texture, std::shared_ptr<Texture>>(m, "Texture", "")
         .def_property_readonly("width", &Texture::get_width, "")
         .def_property_readonly("height", &Texture::get_height, "")
         .def_property_readonly("format", &Texture::get_format, "")
+        .def_property_readonly("row_pitch", &Texture::get_row_pitch, "")
+        .def("get_host_ptr", &Texture::get_host_ptr, "")
+#ifdef _WIN32
         .def("get_d3d11_texture_ptr", &Texture::get_d3d11_texture_ptr, "")
         .def("get_d3d11_srv_ptr", &Texture::get_d3d11_srv_ptr, "")
         .def("get_d3d11_rtv_ptr", &Texture::get_d3d11_rtv_ptr, "")
-        .def("get_d3d12_resource_ptr", &Texture::get_d3d12_resource_ptr, "");
+        .def("get_d3d12_resource_ptr", &Texture::get_d3d12_resource_ptr, "")
+#endif
+        ;
+
+    m.attr("INFINITE_TIMEOUT") = INFINITE_TIMEOUT;
+
+    py::class_<Fence, std::shared_ptr<Fence>>(m, "Fence", "")
+        .def("is_complete", &Fence::is_complete, "")
+        .def("wait", &Fence::wait, py::arg("timeout_ms") = INFINITE_TIMEOUT, "", py::call_guard<py::gil_scoped_release>());
+
+    py::class_<PreparedShader, std::shared_ptr<PreparedShader>>(m, "PreparedShader", "")
+        .def_property_readonly("entry_point", &PreparedShader::get_entry_point, "")
+        .def_property_readonly("output_format", &PreparedShader::get_output_format, "");
+
+    // Recording only copies references and constants, so it keeps the GIL; submit() releases it.
+    py::class_<CommandList, std::shared_ptr<CommandList>>(m, "CommandList", "")
+        .def("copy_texture", &CommandList::copy_texture, py::arg("source"), py::arg("destination"), "")
+        .def("run", [](CommandList& self, std::shared_ptr<PreparedShader> shader, std::shared_ptr<Texture> output, const py::object& inputs, const py::object& constants) {
+            PreparedRun run = make_prepared_run(std::move(shader), std::move(output), inputs, constants);
+            self.run(run.shader, run.output, run.inputs, run.constants.ptr, (size_t)(run.constants.size * run.constants.itemsize));
+        }, py::arg("shader"), py::arg("output"), py::arg("inputs") = py::none(), py::arg("constants") = py::none(), "")
+        .def("apply_shader", [](CommandList& self, std::shared_ptr<Texture> output, const py::object& shader, const std::string& entry_point, const py::list& inputs, const py::bytes& constants) {
+            std::vector<uint8_t> shader_bytes = shader_to_bytes(shader);
+            std::vector<std::shared_ptr<Texture>> cpp_inputs;
+            for (const auto& item : inputs) {
+                cpp_inputs.push_back(item.cast<std::shared_ptr<Texture>>());
+            }
+            std::string_view const_sv(constants);
+            py::gil_scoped_release release;
+            self.apply_shader(output, shader_bytes, entry_point, cpp_inputs, {const_sv.begin(), const_sv.end()});
+        }, py::arg("output"), py::arg("shader") = py::none(), py::arg("entry_point") = "PSMain", py::arg("inputs") = py::list(), py::arg("constants") = py::bytes(""), "")
+        .def("blit_texture_to_region", &CommandList::blit_texture_to_region, py::arg("source"), py::arg("destination"),
+             py::arg("dest_x"), py::arg("dest_y"), py::arg("dest_width"), py::arg("dest_height"), "")
+        .def("clear", &CommandList::clear, py::arg("texture"), py::arg("r"), py::arg("g"), py::arg("b"), py::arg("a"), "")
+        .def("reset", &CommandList::reset, "")
+        .def("__len__", &CommandList::size, "")
+        .def("submit", [](CommandList& self, const py::object& dependencies) {
+            std::vector<std::shared_ptr<Fence>> fences = fences_from_python(dependencies);
+            py::gil_scoped_release release;
+            return self.submit(fences);
+        }, py::arg("dependencies") = py::none(), "");
+
+    py::class_<ReadLease, std::shared_ptr<ReadLease>>(m, "ReadLease", "")
+        .def("release", &ReadLease::release, "")
+        .def("is_valid", &ReadLease::is_valid, "")
+        .def_property_readonly("frame", &ReadLease::get_frame, "")
+        .def_property_readonly("metadata", [](ReadLease& self) { return metadata_to_dict(self.get_metadata()); }, "")
+        .def("get_texture", &ReadLease::get_texture, "")
+        // Read-only view of the pinned slot; None when the frame lives on the GPU.
+        .def_property_readonly("array", [](std::shared_ptr<ReadLease> self) -> py::object {
+            auto texture = self->get_texture();
+            uint8_t* data = reinterpret_cast<uint8_t*>(texture->get_host_ptr());
+            if (!data) return py::none();
+            py::array view = pixels_to_array(data, texture->get_width(), texture->get_height(), texture->get_row_pitch(), texture->get_format(), py::cast(self));
+            py::detail::array_proxy(view.ptr())->flags &= ~py::detail::npy_api::NPY_ARRAY_WRITEABLE_;
+            return std::move(view);
+        }, "")
+        .def("__enter__", [](std::shared_ptr<ReadLease> self) { return self; }, "")
+        .def("__exit__", [](ReadLease& self, py::args) { self.release(); }, "");
 
     py::class_<Consumer, std::shared_ptr<Consumer>>(m, "Consumer", "")
-        .def("wait_for_frame", &Consumer::wait_for_frame, "", py::call_guard<py::gil_scoped_release>())
+        .def("wait_for_frame", py::overload_cast<>(&Consumer::wait_for_frame), "", py::call_guard<py::gil_scoped_release>())
+        .def("wait_for_frame", py::overload_cast<uint32_t>(&Consumer::wait_for_frame), py::arg("timeout_ms"), "", py::call_guard<py::gil_scoped_release>())
         .def("is_alive", &Consumer::is_alive, "", py::call_guard<py::gil_scoped_release>())
+        .def("acquire_read", &Consumer::acquire_read, "", py::call_guard<py::gil_scoped_release>())
+        .def("get_frame_metadata", [](Consumer& self) { return metadata_to_dict(self.get_frame_metadata()); }, "")
+        .def("latency_stats", [](Consumer& self) { return latency_to_dict(self.get_latency_stats()); }, "")
         .def("get_texture", &Consumer::get_texture, "")
         .def("get_shared_texture", &Consumer::get_shared_texture, "")
         .def_property_readonly("pid", &Consumer::get_pid, "");
 
     py::class_<Producer, std::shared_ptr<Producer>>(m, "Producer", "")
-        .def("signal_frame", &Producer::signal_frame, "", py::call_guard<py::gil_scoped_release>());
-        
+        .def("signal_frame", &Producer::signal_frame, "", py::call_guard<py::gil_scoped_release>())
+        .def("get_texture", &Producer::get_texture, "")
+        .def("acquire_write_buffer", [](std::shared_ptr<Producer> self) {
+            WriteBuffer buffer;
+            {
+                py::gil_scoped_release release;
+                buffer = self->acquire_write_buffer();
+            }
+            return pixels_to_array(buffer.data, buffer.width, buffer.height, buffer.row_pitch, buffer.format, py::cast(self));
+        }, "")
+        .def("commit", &Producer::commit, "", py::call_guard<py::gil_scoped_release>())
+        .def("abort_write", &Producer::abort_write, "", py::call_guard<py::gil_scoped_release>())
+        // Converts host pixels straight into the next frame and publishes it.
+        .def("write_frame", [](std::shared_ptr<Producer> self, const py::array& source, CPU::HostLayout layout) {
+            HostPixels pixels = host_pixels(source, layout);
+            auto texture = self->get_texture();
+            if (pixels.width != texture->get_width() || pixels.height != texture->get_height()) {
+                throw std::invalid_argument("Host pixels do not match the producer's frame size.");
+            }
+            py::gil_scoped_release release;
+            ProducerWrite write(*self);
+            CPU::convert_from_host(pixels.data, pixels.rowPitch, layout, write.surface());
+            write.commit();
+        }, py::arg("source"), py::arg("layout") = CPU::HostLayout::BGR8, "")
+        // Area-resamples a frame of any size into the next frame, optionally mirrored, and publishes it.
+        .def("ingest_frame", [](std::shared_ptr<Producer> self, const py::array& source, CPU::HostLayout layout, bool mirror) {
+            HostPixels pixels = host_pixels(source, layout);
+            py::gil_scoped_release release;
+            ProducerWrite write(*self);
+            CPU::resample_area(pixels.data, pixels.width, pixels.height, pixels.rowPitch, layout, write.surface(), mirror);
+            write.commit();
+        }, py::arg("source"), py::arg("layout") = CPU::HostLayout::BGR8, py::arg("mirror") = false, "")
+        .def("set_frame_metadata", [](Producer& self, py::dict metadata) { self.set_frame_metadata(dict_to_metadata(metadata)); }, py::arg("metadata"), "")
+        .def("stats", [](Producer& self) {
+            ProducerStats stats;
+            {
+                py::gil_scoped_release release;
+                stats = self.get_stats();
+            }
+            py::list consumers;
+            for (const auto& consumer : stats.consumers) {
+                py::dict entry;
+                entry["pid"] = consumer.pid;
+                entry["last_frame"] = consumer.last_frame;
+                entry["latency"] = latency_to_dict(consumer.latency);
+                consumers.append(entry);
+            }
+            py::dict result;
+            result["frames"] = stats.frames;
+            result["signal_cost"] = latency_to_dict(stats.signal_cost);
+            result["consumers"] = consumers;
+            return result;
+        }, "");
+
+    auto create_texture_cpu = [](DeviceCPU& self, uint32_t w, uint32_t h, DXGI_FORMAT f, py::object data, py::object layout) {
+        if (data.is_none()) {
+            return self.create_texture(w, h, f, nullptr, 0);
+        }
+        if (!layout.is_none()) {
+            std::vector<uint8_t> converted = convert_upload(data, layout.cast<CPU::HostLayout>(), w, h, f);
+            return self.create_texture(w, h, f, converted.data(), converted.size());
+        }
+        py::buffer_info info = py::buffer(data).request();
+        return self.create_texture(w, h, f, info.ptr, info.size * info.itemsize);
+    };
+
+    auto apply_shader_lambda_cpu = [](DeviceCPU& self, std::shared_ptr<Texture> output, const py::object& shader, const std::string& entry_point, const py::list& inputs, const py::bytes& constants) {
+        std::vector<uint8_t> shader_bytes = shader_to_bytes(shader);
+        std::vector<std::shared_ptr<Texture>> cpp_inputs;
+        for (const auto& item : inputs) {
+            cpp_inputs.push_back(item.cast<std::shared_ptr<Texture>>());
+        }
+        std::string_view const_sv(constants);
+        py::gil_scoped_release release;
+        self.apply_shader(output, shader_bytes, entry_point, cpp_inputs, {const_sv.begin(), const_sv.end()});
+    };
+
+    py::class_<DeviceCPU, std::shared_ptr<DeviceCPU>>(m, "DeviceCPU", "")
+        .def_static("create", &DeviceCPU::create, "")
+        .def("create_texture", create_texture_cpu, py::arg("width"), py::arg("height"), py::arg("format"), py::arg("data") = py::none(), py::arg("layout") = py::none(), "")
+        .def("acquire_texture", &DeviceCPU::acquire_texture, py::arg("width"), py::arg("height"), py::arg("format"), "", py::call_guard<py::gil_scoped_release>())
+        .def("set_pool_budget", &DeviceCPU::set_pool_budget, py::arg("bytes"), "", py::call_guard<py::gil_scoped_release>())
+        .def("pool_stats", [](DeviceCPU& self) { return pool_stats_to_dict(self.get_pool_stats()); }, "")
+        .def("set_shader_cache_capacity", &DeviceCPU::set_shader_cache_capacity, py::arg("entries"), "")
+        .def("shader_cache_stats", [](DeviceCPU& self) { return shader_cache_stats_to_dict(self.get_shader_cache_stats()); }, "")
+        .def("create_producer", &DeviceCPU::create_producer, py::arg("stream_name"), py::arg("texture"), "")
+        .def("connect_to_producer", &DeviceCPU::connect_to_producer, py::arg("pid"), py::arg("stream_name") = "", "")
+        .def("prepare_shader", [](DeviceCPU& self, const py::object& shader, const std::string& entry_point, DXGI_FORMAT output_format) {
+            return prepare_shader_from_python(self, shader, entry_point, output_format);
+        }, py::arg("shader") = py::none(), py::arg("entry_point") = "PSMain", py::arg("output_format") = DXGI_FORMAT_B8G8R8A8_UNORM, "")
+        .def("run", [](DeviceCPU& self, std::shared_ptr<PreparedShader> shader, std::shared_ptr<Texture> output, const py::object& inputs, const py::object& constants) {
+            std::vector<PreparedRun> runs;
+            runs.push_back(make_prepared_run(std::move(shader), std::move(output), inputs, constants));
+            execute_runs(self, runs);
+        }, py::arg("shader"), py::arg("output"), py::arg("inputs") = py::none(), py::arg("constants") = py::none(), "")
+        .def("run_batch", [](DeviceCPU& self, const py::iterable& runs) { run_batch_from_python(self, runs); }, py::arg("runs"), "")
+        .def("run_async", [](DeviceCPU& self, std::shared_ptr<PreparedShader> shader, std::shared_ptr<Texture> output, const py::object& inputs, const py::object& constants, const py::object& dependencies) {
+            return run_async_from_python(self, std::move(shader), std::move(output), inputs, constants, dependencies);
+        }, py::arg("shader"), py::arg("output"), py::arg("inputs") = py::none(), py::arg("constants") = py::none(), py::arg("dependencies") = py::none(), "")
+        .def("copy_texture_async", [](DeviceCPU& self, std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination, const py::object& dependencies) {
+            std::vector<std::shared_ptr<Fence>> fences = fences_from_python(dependencies);
+            py::gil_scoped_release release;
+            return self.copy_texture_async(source, destination, fences);
+        }, py::arg("source"), py::arg("destination"), py::arg("dependencies") = py::none(), "")
+        .def("blit_texture_to_region_async", [](DeviceCPU& self, std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination,
+                                                uint32_t dest_x, uint32_t dest_y, uint32_t dest_width, uint32_t dest_height, const py::object& dependencies) {
+            std::vector<std::shared_ptr<Fence>> fences = fences_from_python(dependencies);
+            py::gil_scoped_release release;
+            return self.blit_texture_to_region_async(source, destination, dest_x, dest_y, dest_width, dest_height, fences);
+        }, py::arg("source"), py::arg("destination"), py::arg("dest_x"), py::arg("dest_y"), py::arg("dest_width"), py::arg("dest_height"),
+             py::arg("dependencies") = py::none(), "")
+        .def("create_command_list", &DeviceCPU::create_command_list, "")
+        .def("apply_shader", apply_shader_lambda_cpu, py::arg("output"), py::arg("shader") = py::none(), py::arg("entry_point") = "PSMain", py::arg("inputs") = py::list(), py::arg("constants") = py::bytes(""), "")
+        .def("copy_texture", &DeviceCPU::copy_texture, py::arg("source"), py::arg("destination"), "", py::call_guard<py::gil_scoped_release>())
+        .def("blit_texture_to_region", &DeviceCPU::blit_texture_to_region, py::arg("source"), py::arg("destination"),
+             py::arg("dest_x"), py::arg("dest_y"), py::arg("dest_width"), py::arg("dest_height"),
+             "", py::call_guard<py::gil_scoped_release>());
+
+#ifdef _WIN32
     py::class_<Window, std::shared_ptr<Window>>(m, "Window", "")
         .def("process_events", &Window::process_events, "", py::call_guard<py::gil_scoped_release>())
         .def("present", &Window::present, py::arg("vsync") = true, "", py::call_guard<py::gil_scoped_release>())
@@ -62,69 +726,90 @@ PYBIND11_MODULE(directport, m) {
         .def("get_width", &Window::get_width, "")
         .def("get_height", &Window::get_height, "");
 
-    auto create_texture_d3d11 = [](DeviceD3D11& self, uint32_t w, uint32_t h, DXGI_FORMAT f, py::object data) {
+    auto create_texture_d3d11 = [](DeviceD3D11& self, uint32_t w, uint32_t h, DXGI_FORMAT f, py::object data, py::object layout) {
         if (data.is_none()) {
             return self.create_texture(w, h, f, nullptr, 0);
         }
+        if (!layout.is_none()) {
+            std::vector<uint8_t> converted = convert_upload(data, layout.cast<CPU::HostLayout>(), w, h, f);
+            return self.create_texture(w, h, f, converted.data(), converted.size());
+        }
         py::buffer_info info = py::buffer(data).request();
         return self.create_texture(w, h, f, info.ptr, info.size);
     };
 
-    auto create_texture_d3d12 = [](DeviceD3D12& self, uint32_t w, uint32_t h, DXGI_FORMAT f, py::object data) {
+    auto create_texture_d3d12 = [](DeviceD3D12& self, uint32_t w, uint32_t h, DXGI_FORMAT f, py::object data, py::object layout) {
         if (data.is_none()) {
             return self.create_texture(w, h, f, nullptr, 0);
         }
+        if (!layout.is_none()) {
+            std::vector<uint8_t> converted = convert_upload(data, layout.cast<CPU::HostLayout>(), w, h, f);
+            return self.create_texture(w, h, f, converted.data(), converted.size());
+        }
         py::buffer_info info = py::buffer(data).request();
         return self.create_texture(w, h, f, info.ptr, info.size);
     };
 
     auto apply_shader_lambda_d3d11 = [](DeviceD3D11& self, std::shared_ptr<Texture> output, const py::object& shader, const std::string& entry_point, const py::list& inputs, const py::bytes& constants) {
-        std::vector<uint8_t> shader_bytes;
-        if (py::isinstance<py::str>(shader)) {
-            std::string hlsl = shader.cast<std::string>();
-            shader_bytes.assign(hlsl.begin(), hlsl.end());
-        } else if (py::isinstance<py::bytes>(shader)) {
-            std::string cso = shader.cast<std::string>();
-            shader_bytes.assign(cso.begin(), cso.end());
-        } else if (!shader.is_none()) {
-                throw py::type_error("Shader must be bytes (CSO/HLSL) or str (HLSL source).");
-        }
+        std::vector<uint8_t> shader_bytes = shader_to_bytes(shader);
         std::vector<std::shared_ptr<Texture>> cpp_inputs;
-        for(const auto& item : inputs) { 
-            cpp_inputs.push_back(item.cast<std::shared_ptr<Texture>>()); 
+        for (const auto& item : inputs) {
+            cpp_inputs.push_back(item.cast<std::shared_ptr<Texture>>());
         }
         std::string_view const_sv(constants);
+        py::gil_scoped_release release;
         self.apply_shader(output, shader_bytes, entry_point, cpp_inputs, {const_sv.begin(), const_sv.end()});
     };
 
     auto apply_shader_lambda_d3d12 = [](DeviceD3D12& self, std::shared_ptr<Texture> output, const py::object& shader, const std::string& entry_point, const py::list& inputs, const py::bytes& constants) {
-        std::vector<uint8_t> shader_bytes;
-        if (py::isinstance<py::str>(shader)) {
-            std::string hlsl = shader.cast<std::string>();
-            shader_bytes.assign(hlsl.begin(), hlsl.end());
-        } else if (py::isinstance<py::bytes>(shader)) {
-            std::string cso = shader.cast<std::string>();
-            shader_bytes.assign(cso.begin(), cso.end());
-        } else if (!shader.is_none()) {
-                throw py::type_error("Shader must be bytes (CSO/HLSL) or str (HLSL source).");
-        }
+        std::vector<uint8_t> shader_bytes = shader_to_bytes(shader);
         std::vector<std::shared_ptr<Texture>> cpp_inputs;
-        for(const auto& item : inputs) { 
-            cpp_inputs.push_back(item.cast<std::shared_ptr<Texture>>()); 
+        for (const auto& item : inputs) {
+            cpp_inputs.push_back(item.cast<std::shared_ptr<Texture>>());
         }
         std::string_view const_sv(constants);
+        py::gil_scoped_release release;
         self.apply_shader(output, shader_bytes, entry_point, cpp_inputs, {const_sv.begin(), const_sv.end()});
     };
 
     py::class_<DeviceD3D11, std::shared_ptr<DeviceD3D11>>(m, "DeviceD3D11", "")
         .def_static("create", &DeviceD3D11::create, "")
-        .def("create_texture", create_texture_d3d11, py::arg("width"), py::arg("height"), py::arg("format"), py::arg("data") = py::none(), "")
+        .def("create_texture", create_texture_d3d11, py::arg("width"), py::arg("height"), py::arg("format"), py::arg("data") = py::none(), py::arg("layout") = py::none(), "")
+        .def("acquire_texture", &DeviceD3D11::acquire_texture, py::arg("width"), py::arg("height"), py::arg("format"), "", py::call_guard<py::gil_scoped_release>())
+        .def("set_pool_budget", &DeviceD3D11::set_pool_budget, py::arg("bytes"), "", py::call_guard<py::gil_scoped_release>())
+        .def("pool_stats", [](DeviceD3D11& self) { return pool_stats_to_dict(self.get_pool_stats()); }, "")
+        .def("set_shader_cache_capacity", &DeviceD3D11::set_shader_cache_capacity, py::arg("entries"), "")
+        .def("shader_cache_stats", [](DeviceD3D11& self) { return shader_cache_stats_to_dict(self.get_shader_cache_stats()); }, "")
         .def("create_producer", &DeviceD3D11::create_producer, py::arg("stream_name"), py::arg("texture"), "")
-        .def("connect_to_producer", &DeviceD3D11::connect_to_producer, py::arg("pid"), "")
+        .def("connect_to_producer", &DeviceD3D11::connect_to_producer, py::arg("pid"), py::arg("stream_name") = "", "")
         .def("create_window", &DeviceD3D11::create_window, py::arg("width"), py::arg("height"), py::arg("title"), "")
         .def("resize_window", &DeviceD3D11::resize_window, py::arg("window"), "")
-        .def("apply_shader", apply_shader_lambda_d3d11, py::arg("output"), py::arg("shader"), py::arg("entry_point") = "PSMain", py::arg("inputs") = py::list(), py::arg("constants") = py::bytes(""), 
-        "", py::call_guard<py::gil_scoped_release>())
+        .def("prepare_shader", [](DeviceD3D11& self, const py::object& shader, const std::string& entry_point, DXGI_FORMAT output_format) {
+            return prepare_shader_from_python(self, shader, entry_point, output_format);
+        }, py::arg("shader") = py::none(), py::arg("entry_point") = "PSMain", py::arg("output_format") = DXGI_FORMAT_B8G8R8A8_UNORM, "")
+        .def("run", [](DeviceD3D11& self, std::shared_ptr<PreparedShader> shader, std::shared_ptr<Texture> output, const py::object& inputs, const py::object& constants) {
+            std::vector<PreparedRun> runs;
+            runs.push_back(make_prepared_run(std::move(shader), std::move(output), inputs, constants));
+            execute_runs(self, runs);
+        }, py::arg("shader"), py::arg("output"), py::arg("inputs") = py::none(), py::arg("constants") = py::none(), "")
+        .def("run_batch", [](DeviceD3D11& self, const py::iterable& runs) { run_batch_from_python(self, runs); }, py::arg("runs"), "")
+        .def("run_async", [](DeviceD3D11& self, std::shared_ptr<PreparedShader> shader, std::shared_ptr<Texture> output, const py::object& inputs, const py::object& constants, const py::object& dependencies) {
+            return run_async_from_python(self, std::move(shader), std::move(output), inputs, constants, dependencies);
+        }, py::arg("shader"), py::arg("output"), py::arg("inputs") = py::none(), py::arg("constants") = py::none(), py::arg("dependencies") = py::none(), "")
+        .def("copy_texture_async", [](DeviceD3D11& self, std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination, const py::object& dependencies) {
+            std::vector<std::shared_ptr<Fence>> fences = fences_from_python(dependencies);
+            py::gil_scoped_release release;
+            return self.copy_texture_async(source, destination, fences);
+        }, py::arg("source"), py::arg("destination"), py::arg("dependencies") = py::none(), "")
+        .def("blit_texture_to_region_async", [](DeviceD3D11& self, std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination,
+                                                uint32_t dest_x, uint32_t dest_y, uint32_t dest_width, uint32_t dest_height, const py::object& dependencies) {
+            std::vector<std::shared_ptr<Fence>> fences = fences_from_python(dependencies);
+            py::gil_scoped_release release;
+            return self.blit_texture_to_region_async(source, destination, dest_x, dest_y, dest_width, dest_height, fences);
+        }, py::arg("source"), py::arg("destination"), py::arg("dest_x"), py::arg("dest_y"), py::arg("dest_width"), py::arg("dest_height"),
+             py::arg("dependencies") = py::none(), "")
+        .def("create_command_list", &DeviceD3D11::create_command_list, "")
+        .def("apply_shader", apply_shader_lambda_d3d11, py::arg("output"), py::arg("shader"), py::arg("entry_point") = "PSMain", py::arg("inputs") = py::list(), py::arg("constants") = py::bytes(""), "")
         .def("copy_texture", &DeviceD3D11::copy_texture, py::arg("source"), py::arg("destination"), "", py::call_guard<py::gil_scoped_release>())
         .def("blit", &DeviceD3D11::blit, py::arg("source"), py::arg("destination"), "", py::call_guard<py::gil_scoped_release>())
         .def("clear", &DeviceD3D11::clear, py::arg("window"), py::arg("r"), py::arg("g"), py::arg("b"), py::arg("a"), "", py::call_guard<py::gil_scoped_release>())
@@ -134,17 +819,47 @@ PYBIND11_MODULE(directport, m) {
     
     py::class_<DeviceD3D12, std::shared_ptr<DeviceD3D12>>(m, "DeviceD3D12", "")
         .def_static("create", &DeviceD3D12::create, "")
-        .def("create_texture", create_texture_d3d12, py::arg("width"), py::arg("height"), py::arg("format"), py::arg("data") = py::none(), "")
+        .def("create_texture", create_texture_d3d12, py::arg("width"), py::arg("height"), py::arg("format"), py::arg("data") = py::none(), py::arg("layout") = py::none(), "")
+        .def("acquire_texture", &DeviceD3D12::acquire_texture, py::arg("width"), py::arg("height"), py::arg("format"), "", py::call_guard<py::gil_scoped_release>())
+        .def("set_pool_budget", &DeviceD3D12::set_pool_budget, py::arg("bytes"), "", py::call_guard<py::gil_scoped_release>())
+        .def("pool_stats", [](DeviceD3D12& self) { return pool_stats_to_dict(self.get_pool_stats()); }, "")
+        .def("set_shader_cache_capacity", &DeviceD3D12::set_shader_cache_capacity, py::arg("entries"), "")
+        .def("shader_cache_stats", [](DeviceD3D12& self) { return shader_cache_stats_to_dict(self.get_shader_cache_stats()); }, "")
         .def("create_producer", &DeviceD3D12::create_producer, py::arg("stream_name"), py::arg("texture"), "")
-        .def("connect_to_producer", &DeviceD3D12::connect_to_producer, py::arg("pid"), "")
+        .def("connect_to_producer", &DeviceD3D12::connect_to_producer, py::arg("pid"), py::arg("stream_name") = "", "")
         .def("create_window", &DeviceD3D12::create_window, py::arg("width"), py::arg("height"), py::arg("title"), "")
         .def("resize_window", &DeviceD3D12::resize_window, py::arg("window"), "")
-        .def("apply_shader", apply_shader_lambda_d3d12, py::arg("output"), py::arg("shader"), py::arg("entry_point") = "PSMain", py::arg("inputs") = py::list(), py::arg("constants") = py::bytes(""), 
-        "", py::call_guard<py::gil_scoped_release>())
+        .def("prepare_shader", [](DeviceD3D12& self, const py::object& shader, const std::string& entry_point, DXGI_FORMAT output_format) {
+            return prepare_shader_from_python(self, shader, entry_point, output_format);
+        }, py::arg("shader") = py::none(), py::arg("entry_point") = "PSMain", py::arg("output_format") = DXGI_FORMAT_B8G8R8A8_UNORM, "")
+        .def("run", [](DeviceD3D12& self, std::shared_ptr<PreparedShader> shader, std::shared_ptr<Texture> output, const py::object& inputs, const py::object& constants) {
+            std::vector<PreparedRun> runs;
+            runs.push_back(make_prepared_run(std::move(shader), std::move(output), inputs, constants));
+            execute_runs(self, runs);
+        }, py::arg("shader"), py::arg("output"), py::arg("inputs") = py::none(), py::arg("constants") = py::none(), "")
+        .def("run_batch", [](DeviceD3D12& self, const py::iterable& runs) { run_batch_from_python(self, runs); }, py::arg("runs"), "")
+        .def("run_async", [](DeviceD3D12& self, std::shared_ptr<PreparedShader> shader, std::shared_ptr<Texture> output, const py::object& inputs, const py::object& constants, const py::object& dependencies) {
+            return run_async_from_python(self, std::move(shader), std::move(output), inputs, constants, dependencies);
+        }, py::arg("shader"), py::arg("output"), py::arg("inputs") = py::none(), py::arg("constants") = py::none(), py::arg("dependencies") = py::none(), "")
+        .def("copy_texture_async", [](DeviceD3D12& self, std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination, const py::object& dependencies) {
+            std::vector<std::shared_ptr<Fence>> fences = fences_from_python(dependencies);
+            py::gil_scoped_release release;
+            return self.copy_texture_async(source, destination, fences);
+        }, py::arg("source"), py::arg("destination"), py::arg("dependencies") = py::none(), "")
+        .def("blit_texture_to_region_async", [](DeviceD3D12& self, std::shared_ptr<Texture> source, std::shared_ptr<Texture> destination,
+                                                uint32_t dest_x, uint32_t dest_y, uint32_t dest_width, uint32_t dest_height, const py::object& dependencies) {
+            std::vector<std::shared_ptr<Fence>> fences = fences_from_python(dependencies);
+            py::gil_scoped_release release;
+            return self.blit_texture_to_region_async(source, destination, dest_x, dest_y, dest_width, dest_height, fences);
+        }, py::arg("source"), py::arg("destination"), py::arg("dest_x"), py::arg("dest_y"), py::arg("dest_width"), py::arg("dest_height"),
+             py::arg("dependencies") = py::none(), "")
+        .def("create_command_list", &DeviceD3D12::create_command_list, "")
+        .def("apply_shader", apply_shader_lambda_d3d12, py::arg("output"), py::arg("shader"), py::arg("entry_point") = "PSMain", py::arg("inputs") = py::list(), py::arg("constants") = py::bytes(""), "")
         .def("copy_texture", &DeviceD3D12::copy_texture, py::arg("source"), py::arg("destination"), "", py::call_guard<py::gil_scoped_release>())
         .def("blit", &DeviceD3D12::blit, py::arg("source"), py::arg("destination"), "", py::call_guard<py::gil_scoped_release>())
         .def("clear", &DeviceD3D12::clear, py::arg("window"), py::arg("r"), py::arg("g"), py::arg("b"), py::arg("a"), "", py::call_guard<py::gil_scoped_release>())
         .def("blit_texture_to_region", &DeviceD3D12::blit_texture_to_region, py::arg("source"), py::arg("destination"),
              py::arg("dest_x"), py::arg("dest_y"), py::arg("dest_width"), py::arg("dest_height"),
              "", py::call_guard<py::gil_scoped_release>());
+#endif
 }
\ No newline at end of file
@@ -206,9 +206,10 @@ class LivePreviewWindow(tk.Toplevel):
 
     def update_globals(self, *args):
         faceonstudiodefs.ROI_MARGIN = int(self.roi_var.get())
-        faceonstudiodefs.MASK_FEATHER = int(self.feather_var.get())
-        faceonstudiodefs.MASK_CORE_TIGHTNESS = int(self.tightness_var.get())
-        faceonstudiodefs.MASK_EXPANSION = int(self.expansion_var.get())
+        mask_settings = (int(self.feather_var.get()), int(self.tightness_var.get()), int(self.expansion_var.get()))
+        if mask_settings != (faceonstudiodefs.MASK_FEATHER, faceonstudiodefs.MASK_CORE_TIGHTNESS, faceonstudiodefs.MASK_EXPANSION):
+            faceonstudiodefs.MASK_FEATHER, faceonstudiodefs.MASK_CORE_TIGHTNESS, faceonstudiodefs.MASK_EXPANSION = mask_settings
+            faceonstudiodefs.MASK_REVISION += 1
         faceonstudiodefs.affine_x_offset = self.affine_x_var.get()
         faceonstudiodefs.affine_y_offset = self.affine_y_var.get()
         faceonstudiodefs.affine_scale_offset = self.affine_scale_var.get()
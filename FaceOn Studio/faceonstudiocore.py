@@ -61,10 +61,13 @@ class PaintShopCore:
                 if not ret:
                     time.sleep(0.01)
                     continue
+                capture_time_us = directport.monotonic_us()
                 
+                # Faces are processed on the mirrored frame, the orientation the sliders and preview use.
+                # The flip is the frame's only copy: swap_face pastes into a copy of its own.
                 frame = cv2.flip(frame, 1)
-                
-                processed_frame = frame.copy()
+                processed_frame = frame
+                target_faces = []
                 with self.face_lock:
                     if self.current_source_face:
                         target_faces = self.models.find_target_faces(frame)
@@ -77,12 +80,17 @@ class PaintShopCore:
                 except (queue.Empty, queue.Full):
                     pass
 
-                resized_frame = cv2.resize(processed_frame, (w, h), interpolation=cv2.INTER_AREA)
-                bgra_frame = cv2.cvtColor(resized_frame, cv2.COLOR_BGR2BGRA)
-                
-                temp_tex = dp_device.create_texture(w, h, directport.DXGI_FORMAT.B8G8R8A8_UNORM, bgra_frame)
-                dp_device.copy_texture(temp_tex, dp_texture)
-                dp_producer.signal_frame()
+                scale_x, scale_y = w / frame.shape[1], h / frame.shape[0]
+                dp_producer.set_frame_metadata({
+                    "capture_time_us": capture_time_us,
+                    "processing_time_us": directport.monotonic_us() - capture_time_us,
+                    "faces": [{
+                        "bbox": (face.bbox[0] * scale_x, face.bbox[1] * scale_y, face.bbox[2] * scale_x, face.bbox[3] * scale_y),
+                        "score": float(face.det_score),
+                        "kps": [(x * scale_x, y * scale_y) for x, y in face.kps],
+                    } for face in target_faces[:directport.MAX_FRAME_FACES]],
+                })
+                dp_producer.ingest_frame(processed_frame, directport.PixelLayout.BGR8)
 
         except Exception as e:
             print(f"ERROR in PaintShopCore thread: {e}")
@@ -20,4 +20,7 @@ MASK_EXPANSION=-50
 affine_x_offset=0.0
 affine_y_offset=0.0
 affine_scale_offset=1.0
-mouth_y_offset=-20.0
\ No newline at end of file
+mouth_y_offset=-20.0
+
+# Bumped by the live preview whenever a MASK_* slider changes, so blend masks cached from them are rebuilt.
+MASK_REVISION=0
\ No newline at end of file
@@ -30,56 +30,48 @@ def norm_crop2(engine,img,landmark,image_size=112):
     warped=engine.warp_affine(img,M,(image_size,image_size))
     return warped,M
 
-def distance2bbox(points,distance):
-    x1,y1=points[:,0]-distance[:,0],points[:,1]-distance[:,1]
-    x2,y2=points[:,0]+distance[:,2],points[:,1]+distance[:,3]
-    return np.stack([x1,y1,x2,y2],axis=-1)
-
-def distance2kps(points,distance):
-    preds=[points[:,i%2]+distance[:,i] for i in range(distance.shape[1])]
-    return np.stack(preds,axis=-1)
+class FaceMaskCache:
+    # Blend masks shaped once in face space per slider revision, face size and face scale in eighths of an
+    # octave, with the slider sizes (frame pixels) divided by that scale. Frames then only warp them.
+    SCALE_STEPS=8
+    def __init__(self):
+        self.revision,self.masks=defs.MASK_REVISION,{}
+    def get(self,face_shape:tuple,M_inv:np.ndarray)->tuple:
+        if self.revision!=defs.MASK_REVISION:self.revision,self.masks=defs.MASK_REVISION,{}
+        scale=np.sqrt(abs(np.linalg.det(M_inv[:,:2])))
+        step=int(np.round(np.log2(max(scale,1e-3))*self.SCALE_STEPS))
+        key=(face_shape[0],face_shape[1],step)
+        if key not in self.masks:self.masks[key]=self.build(face_shape[0],face_shape[1],2.0**(step/self.SCALE_STEPS))
+        return self.masks[key]
+    def build(self,face_h:int,face_w:int,scale:float)->tuple:
+        expansion=int(round(abs(defs.MASK_EXPANSION)/scale))
+        feather=max(3,int(round(defs.MASK_FEATHER/scale))|1)
+        core=int(round(defs.MASK_CORE_TIGHTNESS/scale))
+        dilate=defs.MASK_EXPANSION>0
+        # The canvas leaves room for the dilation and the feather's reach past the face rectangle.
+        margin=feather//2+1+(expansion//2 if dilate else 0)
+        shaped=np.zeros((face_h+2*margin,face_w+2*margin),dtype=np.uint8)
+        shaped[margin:margin+face_h,margin:margin+face_w]=255
+        if expansion>1:shaped=directport.morph_mask(shaped,expansion,dilate=dilate)
+        alpha=directport.feather_mask(shaped,feather)
+        if core>0:alpha=np.maximum(alpha,directport.morph_mask(shaped,core))
+        return alpha,margin
 
 class TegrityEngine:
     def __init__(self):
-        pass
+        self.mask_cache=FaceMaskCache()
     def warp_affine(self,src_image_np:np.ndarray,M:np.ndarray,dsize:tuple)->np.ndarray:
-        return cv2.warpAffine(src_image_np,M,dsize,borderValue=0.0)
+        return directport.warp_affine(src_image_np,M,dsize)
     def process_and_paste_face(self,frame_np:np.ndarray,face_np:np.ndarray,M_inv:np.ndarray,roi:tuple)->np.ndarray:
         roi_x,roi_y,roi_w,roi_h=map(int,roi)
-        target_roi_img=frame_np[roi_y:roi_y+roi_h,roi_x:roi_x+roi_w]
-        M_inv_roi=M_inv.copy()
-        M_inv_roi[0,2]-=roi_x
-        M_inv_roi[1,2]-=roi_y
-        warped_face_roi=cv2.warpAffine(face_np,M_inv_roi,(roi_w,roi_h))
-        mask_roi=np.full(face_np.shape[:2],255,dtype=np.uint8)
-        warped_mask_roi=cv2.warpAffine(mask_roi,M_inv_roi,(roi_w,roi_h))
-        if defs.MASK_EXPANSION>0:
-            expand_kernel=np.ones((defs.MASK_EXPANSION,defs.MASK_EXPANSION),np.uint8)
-            processed_mask=cv2.dilate(warped_mask_roi,expand_kernel,iterations=1)
-        elif defs.MASK_EXPANSION<0:
-            contract_kernel=np.ones((-defs.MASK_EXPANSION,-defs.MASK_EXPANSION),np.uint8)
-            processed_mask=cv2.erode(warped_mask_roi,contract_kernel,iterations=1)
-        else:
-            processed_mask=warped_mask_roi
-        feather_ksize=defs.MASK_FEATHER
-        if feather_ksize<3:feather_ksize=3
-        if feather_ksize%2==0:feather_ksize+=1
-        feathered_mask=cv2.GaussianBlur(processed_mask,(feather_ksize,feather_ksize),0)
-        if defs.MASK_CORE_TIGHTNESS>0:
-            erosion_kernel=np.ones((defs.MASK_CORE_TIGHTNESS,defs.MASK_CORE_TIGHTNESS),np.uint8)
-            eroded_core_mask=cv2.erode(processed_mask,erosion_kernel,iterations=1)
-            final_mask_roi=np.maximum(feathered_mask,eroded_core_mask)
-        else:
-            final_mask_roi=feathered_mask
-        mask_float=(final_mask_roi.astype(np.float32)/255.0)[:,:,np.newaxis]
-        blended_roi=(warped_face_roi*mask_float+target_roi_img*(1-mask_float)).astype(np.uint8)
-        frame_np[roi_y:roi_y+roi_h,roi_x:roi_x+roi_w]=blended_roi
+        alpha,margin=self.mask_cache.get(face_np.shape,M_inv)
+        directport.composite_face_alpha(frame_np,face_np,alpha,margin,M_inv,(roi_x,roi_y,roi_w,roi_h))
         return frame_np
 
 class RetinaFace:
     def __init__(self,model_file=None,providers=None):
         self.session=onnxruntime.InferenceSession(model_file,providers=providers)
-        self.center_cache,self.nms_thresh,self.det_thresh={},0.4,0.5
+        self.decoder,self.nms_thresh,self.det_thresh=directport.FaceDecoder(),0.4,0.5
         input_cfg=self.session.get_inputs()[0]
         input_shape=list(input_cfg.shape)
         if not all(isinstance(dim,int) for dim in input_shape[2:]):input_shape[2],input_shape[3]=640,640
@@ -87,7 +79,7 @@ class RetinaFace:
         self.input_name=input_cfg.name
         outputs=self.session.get_outputs()
         self.output_names=[o.name for o in outputs]
-        self.use_kps,self.fmc,self._feat_stride_fpn,self._num_anchors=len(outputs)==9,3,[8,16,32],2
+        self._feat_stride_fpn=[8,16,32]
     def detect(self,img):
         im_ratio=float(img.shape[0])/img.shape[1]
         model_ratio=float(self.input_size[1])/self.input_size[0]
@@ -96,43 +88,10 @@ class RetinaFace:
         resized_img=cv2.resize(img,(new_width,new_height))
         det_img=np.zeros((self.input_size[1],self.input_size[0],3),dtype=np.uint8)
         det_img[:new_height,:new_width,:]=resized_img
-        scores_list,bboxes_list,kpss_list=self.forward(det_img)
-        if not scores_list or not bboxes_list:return np.array([]),np.array([])
-        scores,order=np.vstack(scores_list).ravel().argsort()[::-1],np.vstack(scores_list).ravel().argsort()[::-1]
-        pre_det=np.hstack((np.vstack(bboxes_list)/det_scale,np.vstack(scores_list))).astype(np.float32,copy=False)[order,:]
-        keep=self.nms(pre_det)
-        det=pre_det[keep,:]
-        kpss=np.vstack(kpss_list)[order,:][keep,:]/det_scale if self.use_kps else None
-        if kpss is not None:kpss=kpss.reshape((-1,5,2))
-        return det,kpss
+        return self.decoder.decode(self.forward(det_img),self.input_size,self._feat_stride_fpn,self.det_thresh,self.nms_thresh,det_scale)
     def forward(self,img):
-        scores_list,bboxes_list,kpss_list=[],[],[]
         blob=cv2.dnn.blobFromImage(img,1.0/128.0,self.input_size,(127.5,127.5,127.5),swapRB=True)
-        net_outs=self.session.run(self.output_names,{self.input_name:blob})
-        for idx,stride in enumerate(self._feat_stride_fpn):
-            height,width=blob.shape[2]//stride,blob.shape[3]//stride
-            anchor_centers=self.center_cache.get((height,width,stride))
-            if anchor_centers is None:
-                anchor_centers=np.stack(np.mgrid[:height,:width][::-1],axis=-1).astype(np.float32)
-                anchor_centers=np.stack([(anchor_centers*stride).reshape((-1,2))]*self._num_anchors,axis=1).reshape((-1,2))
-                self.center_cache[(height,width,stride)]=anchor_centers
-            pos_inds=np.where(net_outs[idx]>=self.det_thresh)[0]
-            if not pos_inds.any():continue
-            bboxes_list.append(distance2bbox(anchor_centers[pos_inds],(net_outs[idx+self.fmc]*stride)[pos_inds]))
-            scores_list.append(net_outs[idx][pos_inds])
-            if self.use_kps:kpss_list.append(distance2kps(anchor_centers[pos_inds],(net_outs[idx+self.fmc*2]*stride)[pos_inds]))
-        return scores_list,bboxes_list,kpss_list
-    def nms(self,dets):
-        x1,y1,x2,y2,scores=dets[:,0],dets[:,1],dets[:,2],dets[:,3],dets[:,4]
-        areas,order,keep=(x2-x1+1)*(y2-y1+1),scores.argsort()[::-1],[]
-        while order.size>0:
-            i=order[0];keep.append(i)
-            xx1,yy1=np.maximum(x1[i],x1[order[1:]]),np.maximum(y1[i],y1[order[1:]])
-            xx2,yy2=np.minimum(x2[i],x2[order[1:]]),np.minimum(y2[i],y2[order[1:]])
-            w,h=np.maximum(0.0,xx2-xx1+1),np.maximum(0.0,yy2-yy1+1)
-            ovr=(w*h)/(areas[i]+areas[order[1:]]-(w*h))
-            order=order[np.where(ovr<=self.nms_thresh)[0]+1]
-        return keep
+        return self.session.run(self.output_names,{self.input_name:blob})
 
 class ArcFaceONNX:
     def __init__(self,model_file,providers,engine):